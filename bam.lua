@@ -82,12 +82,16 @@ function set_compiler( settings, config )
     elseif compiler == "gcc" then
         SetDriversGCC( settings )
         settings.cc.flags:Add( "-Wconversion", "-Wextra", "-Wall", "-Werror", "-Wstrict-aliasing=2" )
+        settings.cc.flags:Add( "-pthread" ) -- std::thread for utf8_lookup_perform_parallel
+        settings.link.flags:Add( "-pthread" )
         if config == "release" then
             settings.cc.flags:Add( "-O2" )
         end
     elseif compiler == "clang" then
         SetDriversClang( settings )
         settings.cc.flags:Add( "-Wconversion", "-Wextra", "-Wall", "-Werror", "-Wstrict-aliasing=2" )
+        settings.cc.flags:Add( "-pthread" ) -- std::thread for utf8_lookup_perform_parallel
+        settings.link.flags:Add( "-pthread" )
         if config == "release" then
             settings.cc.flags:Add( "-O2")
         end
@@ -108,6 +112,9 @@ settings.link.Output = output_func
 settings.cc.includes:Add("include")
 
 settings.link.libpath:Add( 'local/' .. config .. '/' .. platform )
+if platform == "linux_x86_64" then
+    settings.link.libs:Add( "rt" ) -- shm_open/shm_unlink for shared tables
+end
 
 local tests = Link( settings, 'utf8_lookup_tests', Compile( settings, 'test/utf8_lookup_tests.cpp' ) )
 
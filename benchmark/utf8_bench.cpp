@@ -26,6 +26,11 @@
    Fredrik Kihlander
 */
 
+#if defined(__linux__)
+#  define UTF8_LOOKUP_ENABLE_SHARED_TABLES
+#endif
+
+#define UTF8_LOOKUP_ENABLE_THREADS
 #define UTF8_LOOKUP_IMPLEMENTATION
 #include "../utf8_lookup.h"
 
@@ -38,6 +43,15 @@
 #include <vector>
 #include <unordered_map>
 #include <algorithm>
+#include <limits>
+#include <thread>
+#include <utility>
+#include <iterator>
+
+#if defined(__linux__)
+#  include <sys/wait.h>
+#  include <unistd.h>
+#endif
 
 size_t g_num_alloc = 0;
 size_t g_num_free  = 0;
@@ -74,9 +88,10 @@ class utf8_bench_std_alloc
 		return (pointer)(::operator new(num*sizeof(T)));
 	}
 
-	template< class U, class ARG1, class ARG2, class ARG3 >
-	void construct( U* p, ARG1 a, ARG2 b, ARG3 c )       { new((void*)p)T(a, b, c); }
-	void destroy   ( pointer p ) { p->~T(); }
+	template< class U, class... ARGS >
+	void construct( U* p, ARGS&&... args ) { new((void*)p)U(std::forward<ARGS>(args)...); }
+	template< class U >
+	void destroy( U* p ) { p->~U(); }
 	void deallocate( pointer p, size_type num)
 	{
 		++g_num_free;
@@ -413,220 +428,1900 @@ static void* build_utf8_lookup_map( std::vector<unsigned int>& cps, test_case* t
 	return table;
 }
 
-const uint8_t* utf8_lookup_perform_scalar( void*               lookup,
+const uint8_t* utf8_lookup_perform_scalar( const void*         lookup,
  	  	  	  							   const uint8_t*      str,
 										   utf8_lookup_result* res,
 										   size_t*             res_size );
 
-const uint8_t* utf8_lookup_perform_popcnt( void*               lookup,
+const uint8_t* utf8_lookup_perform_popcnt( const void*         lookup,
  	  	  	  							   const uint8_t*      str,
 										   utf8_lookup_result* res,
 										   size_t*             res_size );
 
-static void run_test_case(const char* test_text_file)
+const uint8_t* utf8_lookup_perform_to_utf16_popcnt( const void*         lookup,
+                                                    const uint8_t*      str,
+                                                    utf8_lookup_result* res,
+                                                    size_t*             res_size,
+                                                    uint16_t*           utf16,
+                                                    size_t*             utf16_size );
+
+void utf8_lookup_perform_utf32_popcnt( const void*         lookup,
+                                       const unsigned int* codepoints,
+                                       size_t              num_codepoints,
+                                       unsigned int*       offsets );
+
+#if defined( __x86_64__ ) || defined( _M_X64 )
+void utf8_lookup_perform_utf32_avx2( const void*         lookup,
+                                     const unsigned int* codepoints,
+                                     size_t              num_codepoints,
+                                     unsigned int*       offsets );
+#endif
+
+/**
+ * time utf8_lookup_collect_missing against utf8_lookup_perform with a table containing every other codepoint
+ * in the text, i.e. half of the codepoints are missing.
+ */
+static void collect_missing_bench( const uint8_t* text, std::vector<unsigned int>& cps )
 {
-	size_t file_size;
-	uint8_t* text_data = load_file( test_text_file, &file_size );
-	if( text_data == 0x0 )
+	std::vector<unsigned int> half;
+	for( size_t i = 0; i < cps.size(); i += 2 )
+		half.push_back( cps[i] );
+
+	size_t size;
+	utf8_lookup_calc_table_size( &size, &half[0], (unsigned int)half.size() );
+	void* table = malloc( size );
+	utf8_lookup_gen_table( table, size, &half[0], (unsigned int)half.size() );
+
+	std::vector<uint64_t> missing_bits( UTF8_LOOKUP_MISSING_BITS_WORDS, 0 );
+	std::vector<unsigned int> missing( cps.size() );
+	std::vector<unsigned int> counts( cps.size() );
+
+	uint64_t perform_time;
 	{
-		printf( "couldn't load file %s\n", test_text_file );
-		return;
+		utf8_lookup_result res[256];
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < 10; ++i )
+		{
+			const uint8_t* str_iter = text;
+			while( *str_iter )
+			{
+				size_t res_size = ARRAY_LENGTH(res);
+				str_iter = utf8_lookup_perform( table, str_iter, res, &res_size );
+			}
+		}
+		perform_time = cpu_tick() - start;
 	}
 
-	uint8_t* text = text_data;
+	size_t num_missing = 0;
+	uint64_t collect_time;
+	{
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < 10; ++i )
+		{
+			num_missing = missing.size();
+			utf8_lookup_collect_missing( table, text, &missing_bits[0], &missing[0], 0x0, &num_missing, 0x0 );
+		}
+		collect_time = cpu_tick() - start;
+	}
 
-	// skip BOM
-	if( text_data[0] == 0xEF && text_data[1] == 0xBB && text_data[2] == 0xBF )
+	uint64_t count_time;
 	{
-		text = &text_data[3];
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < 10; ++i )
+		{
+			num_missing = missing.size();
+			utf8_lookup_collect_missing( table, text, &missing_bits[0], &missing[0], &counts[0], &num_missing, 0x0 );
+		}
+		count_time = cpu_tick() - start;
 	}
 
-	test_case test_cases[] = {
-		{ "utf8_lookup_scalar", 0 ,0, 0, 0 },
-		{ "utf8_lookup_popcnt", 0 ,0, 0, 0 },
-		{ "std::map", 0 ,0, 0, 0 },
-		{ "std::unordered_map", 0 ,0, 0, 0 },
-		{ "bitarray_scalar", 0 ,0, 0, 0 },
-		{ "bitarray_popcnt", 0 ,0, 0, 0 }
-	};
+	printf( "collect missing (%zu unique missing): perform %.3f ms, collect %.3f ms, collect+counts %.3f ms\n",
+			num_missing,
+			cpu_ticks_to_ms( perform_time ) / 10.0f,
+			cpu_ticks_to_ms( collect_time ) / 10.0f,
+			cpu_ticks_to_ms( count_time ) / 10.0f );
 
-	std::vector<unsigned int> cps;
-	find_all_codepoints( text, cps );
+	free( table );
+}
 
-	printf("\ntest text: %s (code points %zu)\n", test_text_file, cps.size());
+/**
+ * print table statistics, to see where the bytes/codepoint comes from.
+ */
+static void print_table_stats( void* table )
+{
+	utf8_lookup_stats stats;
+	utf8_lookup_table_stats( table, &stats );
+
+	printf( "table: %zu bytes, %zu items (%zu unused), %zu codepoints, %.2f bytes/codepoint\n",
+			stats.table_size, stats.items, stats.unused_items, stats.num_codepoints,
+			stats.num_codepoints ? (float)stats.table_size / (float)stats.num_codepoints : 0.0f );
+	printf( "       avail_bits %zu bytes, offsets %zu bytes, avg fill %.1f%%, max offset %u\n",
+			stats.avail_bits_bytes, stats.offsets_bytes, stats.avg_fill * 100.0f, stats.max_offset );
+	for( int level = 0; level < 4; ++level )
+		printf( "       level %d: %zu nodes, %zu bits\n", level, stats.nodes_per_level[level], stats.bits_per_level[level] );
+}
 
-	// build lookup map
-	void* table = build_utf8_lookup_map( cps, &test_cases[0] );
-	memcpy( &test_cases[1], &test_cases[0], sizeof(test_case) );
-	test_cases[1].name = "utf8_lookup_popcnt";
+/**
+ * time union/intersection/difference of two tables against extracting their codepoints, merging the
+ * lists and building a new table.
+ */
+static void set_op_bench( std::vector<unsigned int>& cps )
+{
+	// ... two overlapping "fonts", every second and every third codepoint ...
+	std::vector<unsigned int> a, b;
+	for( size_t i = 0; i < cps.size(); ++i )
+	{
+		if( i % 2 == 0 ) a.push_back( cps[i] );
+		if( i % 3 == 0 ) b.push_back( cps[i] );
+	}
+	if( a.empty() || b.empty() )
+		return;
 
-	tracked_map compare_map;
-	tracked_unordered_map compare_unordered_map;
-	build_compare_map( cps, compare_map, &test_cases[2] );
-	build_compare_map( cps, compare_unordered_map, &test_cases[3] );
-	bitarray_lookup bitarray;
-	build_bitarray_lookup_map( cps, bitarray, &test_cases[4] );
-	memcpy( &test_cases[5], &test_cases[4], sizeof(test_case) );
-	test_cases[5].name = "bitarray_popcnt";
+	size_t size_a, size_b;
+	utf8_lookup_calc_table_size( &size_a, &a[0], (unsigned int)a.size() );
+	utf8_lookup_calc_table_size( &size_b, &b[0], (unsigned int)b.size() );
+	void* table_a = malloc( size_a );
+	void* table_b = malloc( size_b );
+	utf8_lookup_gen_table( table_a, size_a, &a[0], (unsigned int)a.size() );
+	utf8_lookup_gen_table( table_b, size_b, &b[0], (unsigned int)b.size() );
 
-	size_t txt_cp_count = count_chars(text);
+	const utf8_lookup_set_op ops[] = { UTF8_LOOKUP_SET_UNION, UTF8_LOOKUP_SET_INTERSECTION, UTF8_LOOKUP_SET_DIFFERENCE };
+	const char* op_names[] = { "union", "intersection", "difference" };
 
+	for( size_t op = 0; op < ARRAY_LENGTH( ops ); ++op )
 	{
-		utf8_lookup_result res[256];
-		size_t res_size = ARRAY_LENGTH(res);
-
-		uint64_t start = cpu_tick();
+		uint64_t set_op_time;
+		{
+			uint64_t start = cpu_tick();
+			for( int i = 0; i < 10; ++i )
+			{
+				size_t size;
+				utf8_lookup_calc_set_op_table_size( &size, table_a, table_b, ops[op] );
+				void* table = malloc( size );
+				utf8_lookup_gen_set_op_table( table, size, table_a, table_b, ops[op] );
+				free( table );
+			}
+			set_op_time = cpu_tick() - start;
+		}
 
-		for( int i = 0; i < 100; ++i )
+		// ... compare with extracting codepoints from both tables, merging the lists and rebuilding ...
+		uint64_t rebuild_time;
 		{
-			const uint8_t* str_iter = text;
-			while( *str_iter )
-				str_iter = utf8_lookup_perform_scalar( table, str_iter, res, &res_size );
+			uint64_t start = cpu_tick();
+			for( int i = 0; i < 10; ++i )
+			{
+				std::vector<unsigned int> list_a, list_b, result;
+				unsigned int cp, offset;
+				utf8_lookup_iterator it;
+				utf8_lookup_iterator_init( &it, table_a );
+				while( utf8_lookup_iterator_next( &it, &cp, &offset ) )
+					list_a.push_back( cp );
+				utf8_lookup_iterator_init( &it, table_b );
+				while( utf8_lookup_iterator_next( &it, &cp, &offset ) )
+					list_b.push_back( cp );
+
+				switch( ops[op] )
+				{
+					case UTF8_LOOKUP_SET_UNION:        std::set_union( list_a.begin(), list_a.end(), list_b.begin(), list_b.end(), std::back_inserter( result ) ); break;
+					case UTF8_LOOKUP_SET_INTERSECTION: std::set_intersection( list_a.begin(), list_a.end(), list_b.begin(), list_b.end(), std::back_inserter( result ) ); break;
+					case UTF8_LOOKUP_SET_DIFFERENCE:   std::set_difference( list_a.begin(), list_a.end(), list_b.begin(), list_b.end(), std::back_inserter( result ) ); break;
+				}
+
+				size_t size;
+				utf8_lookup_calc_table_size( &size, result.empty() ? 0x0 : &result[0], (unsigned int)result.size() );
+				void* table = malloc( size );
+				utf8_lookup_gen_table( table, size, result.empty() ? 0x0 : &result[0], (unsigned int)result.size() );
+				free( table );
+			}
+			rebuild_time = cpu_tick() - start;
 		}
-		test_cases[0].runtime = cpu_tick() - start;
+
+		printf( "set-op %s: set-op %.3f ms, extract+merge+rebuild %.3f ms\n",
+				op_names[op],
+				cpu_ticks_to_ms( set_op_time ) / 10.0f,
+				cpu_ticks_to_ms( rebuild_time ) / 10.0f );
 	}
 
+	free( table_a );
+	free( table_b );
+}
+
+/**
+ * time utf8_lookup_count_chars + utf8_lookup_perform_all against the chunked loop.
+ */
+static void perform_all_bench( void* table, const uint8_t* text )
+{
+	const int ITERATIONS = 20;
+	std::vector<utf8_lookup_result> all( utf8_lookup_count_chars( text ) );
+
+	uint64_t chunked_time;
 	{
 		utf8_lookup_result res[256];
-		size_t res_size = ARRAY_LENGTH(res);
-
 		uint64_t start = cpu_tick();
-
-		for( int i = 0; i < 100; ++i )
+		for( int i = 0; i < ITERATIONS; ++i )
 		{
 			const uint8_t* str_iter = text;
 			while( *str_iter )
-				str_iter = utf8_lookup_perform_popcnt( table, str_iter, res, &res_size );
+			{
+				size_t res_size = ARRAY_LENGTH(res);
+				str_iter = utf8_lookup_perform( table, str_iter, res, &res_size );
+			}
 		}
-		test_cases[1].runtime = cpu_tick() - start;
+		chunked_time = cpu_tick() - start;
 	}
 
+	size_t chars[2] = { 0, 0 };
+	uint64_t count_scalar_time;
 	{
-		utf8_lookup_result res[256];
-		size_t res_size = ARRAY_LENGTH(res);
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < ITERATIONS; ++i )
+			chars[0] += count_chars( text );
+		count_scalar_time = cpu_tick() - start;
+	}
 
+	uint64_t count_time;
+	{
 		uint64_t start = cpu_tick();
+		for( int i = 0; i < ITERATIONS; ++i )
+			chars[1] += utf8_lookup_count_chars( text );
+		count_time = cpu_tick() - start;
+	}
 
-		for( int i = 0; i < 100; ++i )
+	// ... the buffer is allocated once outside, as a caller reusing it between strings would ...
+	uint64_t all_time;
+	{
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < ITERATIONS; ++i )
 		{
-			const uint8_t* str_iter = text;
-			while( *str_iter )
-				str_iter = utf8_lookup_perform_std_cmp( compare_map, str_iter, res, &res_size );
+			size_t num_chars = utf8_lookup_count_chars( text );
+			if( num_chars > all.size() )
+				all.resize( num_chars );
+			utf8_lookup_perform_all( table, text, &all[0] );
 		}
-		test_cases[2].runtime = cpu_tick() - start;
+		all_time = cpu_tick() - start;
 	}
 
+	if( chars[0] != chars[1] )
+		printf( "utf8_lookup_count_chars mismatch! %zu %zu\n", chars[0], chars[1] );
+
+	printf( "chunked perform(256) %.3f ms, count_chars %.3f ms (scalar %.3f ms), count_chars+perform_all %.3f ms\n",
+			cpu_ticks_to_ms( chunked_time ) / (float)ITERATIONS,
+			cpu_ticks_to_ms( count_time ) / (float)ITERATIONS,
+			cpu_ticks_to_ms( count_scalar_time ) / (float)ITERATIONS,
+			cpu_ticks_to_ms( all_time ) / (float)ITERATIONS );
+}
+
+/**
+ * time random utf8_lookup_successor and utf8_lookup_count_range queries against binary searches in the
+ * sorted codepoints.
+ */
+static void successor_bench( void* table, std::vector<unsigned int>& cps )
+{
+	// ... queries spread over the range covered by the text, compared with a binary search in the sorted codepoints ...
+	const int NUM_QUERIES = 100000;
+	std::vector<unsigned int> queries( NUM_QUERIES );
+	unsigned int max_cp = cps.back() + 1;
+	unsigned int seed = 1;
+	for( int i = 0; i < NUM_QUERIES; ++i )
 	{
-		utf8_lookup_result res[256];
-		size_t res_size = ARRAY_LENGTH(res);
+		seed = seed * 1103515245u + 12345u;
+		queries[i] = ( seed >> 8 ) % max_cp;
+	}
+
+	unsigned int sum[4] = { 0, 0, 0, 0 };
 
+	uint64_t successor_time;
+	{
 		uint64_t start = cpu_tick();
+		for( int i = 0; i < NUM_QUERIES; ++i )
+		{
+			unsigned int cp = 0;
+			utf8_lookup_successor( table, queries[i], &cp, 0x0 );
+			sum[0] += cp;
+		}
+		successor_time = cpu_tick() - start;
+	}
 
-		for( int i = 0; i < 100; ++i )
+	uint64_t lower_bound_time;
+	{
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < NUM_QUERIES; ++i )
 		{
-			const uint8_t* str_iter = text;
-			while( *str_iter )
-				str_iter = utf8_lookup_perform_std_cmp( compare_unordered_map, str_iter, res, &res_size );
+			std::vector<unsigned int>::iterator it = std::lower_bound( cps.begin(), cps.end(), queries[i] );
+			sum[1] += it == cps.end() ? 0 : *it;
 		}
-		test_cases[3].runtime = cpu_tick() - start;
+		lower_bound_time = cpu_tick() - start;
 	}
 
+	uint64_t count_range_time;
 	{
-		utf8_lookup_result res[256];
-		size_t res_size = ARRAY_LENGTH(res);
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < NUM_QUERIES; i += 2 )
+			sum[2] += utf8_lookup_count_range( table, std::min( queries[i], queries[i + 1] ), std::max( queries[i], queries[i + 1] ) );
+		count_range_time = cpu_tick() - start;
+	}
 
+	uint64_t range_bound_time;
+	{
 		uint64_t start = cpu_tick();
+		for( int i = 0; i < NUM_QUERIES; i += 2 )
+		{
+			std::vector<unsigned int>::iterator first = std::lower_bound( cps.begin(), cps.end(), std::min( queries[i], queries[i + 1] ) );
+			std::vector<unsigned int>::iterator last  = std::upper_bound( cps.begin(), cps.end(), std::max( queries[i], queries[i + 1] ) );
+			sum[3] += (unsigned int)( last - first );
+		}
+		range_bound_time = cpu_tick() - start;
+	}
 
-		for( int i = 0; i < 100; ++i )
+	if( sum[0] != sum[1] || sum[2] != sum[3] )
+		printf( "successor/count_range mismatch!\n" );
+
+	printf( "successor: %.2f ns/query (lower_bound %.2f ns/query), count_range: %.2f ns/query (lower+upper_bound %.2f ns/query)\n",
+			cpu_ticks_to_ms( successor_time )   * 1000000.0f / (float)NUM_QUERIES,
+			cpu_ticks_to_ms( lower_bound_time ) * 1000000.0f / (float)NUM_QUERIES,
+			cpu_ticks_to_ms( count_range_time ) * 1000000.0f / (float)( NUM_QUERIES / 2 ),
+			cpu_ticks_to_ms( range_bound_time ) * 1000000.0f / (float)( NUM_QUERIES / 2 ) );
+}
+
+/**
+ * time lookups on the text decoded to utf32 and utf16 against utf8_lookup_perform on the utf8-text.
+ */
+static void utf16_utf32_bench( void* table, const uint8_t* text )
+{
+	const int ITERATIONS = 20;
+
+	std::vector<unsigned int> utf32;
+	std::vector<uint16_t> utf16;
+	for( const uint8_t* pos = text; *pos; )
+	{
+		unsigned int cp = utf8_to_unicode_codepoint( &pos );
+		utf32.push_back( cp );
+		if( cp >= 0x10000 )
 		{
-			const uint8_t* str_iter = text;
-			while( *str_iter )
-				str_iter = utf8_lookup_perform_bitarray_cmp_scalar( bitarray, str_iter, res, &res_size );
+			utf16.push_back( (uint16_t)( 0xD800 + ( ( cp - 0x10000 ) >> 10 ) ) );
+			utf16.push_back( (uint16_t)( 0xDC00 + ( ( cp - 0x10000 ) & 0x3FF ) ) );
 		}
-		test_cases[4].runtime = cpu_tick() - start;
+		else
+			utf16.push_back( (uint16_t)cp );
 	}
+	utf16.push_back( 0 );
+
+	std::vector<unsigned int> offsets[3];
+	for( int i = 0; i < 3; ++i )
+		offsets[i].resize( utf32.size() );
 
+	uint64_t utf8_time;
 	{
 		utf8_lookup_result res[256];
-		size_t res_size = ARRAY_LENGTH(res);
-
 		uint64_t start = cpu_tick();
-
-		for( int i = 0; i < 100; ++i )
+		for( int i = 0; i < ITERATIONS; ++i )
 		{
 			const uint8_t* str_iter = text;
 			while( *str_iter )
-				str_iter = utf8_lookup_perform_bitarray_cmp_popcnt( bitarray, str_iter, res, &res_size );
+			{
+				size_t res_size = ARRAY_LENGTH(res);
+				str_iter = utf8_lookup_perform( table, str_iter, res, &res_size );
+			}
 		}
-		test_cases[5].runtime = cpu_tick() - start;
+		utf8_time = cpu_tick() - start;
 	}
 
-	printf("%-20s%-20s%-20s%-20s%-20s%-20s%-20s\n", "name", "allocs", "frees", "memused (kb)", "bytes/codepoint", "ms/10000 cp", "GB/sec");
-	for( size_t i = 0; i < ARRAY_LENGTH(test_cases); ++i )
+	uint64_t utf16_time;
 	{
-		printf("%-20s%-20zu%-20zu%-20f%-20f%-20f%-20f\n", test_cases[i].name,
-										  	   		 	  test_cases[i].allocs,
-													 	  test_cases[i].frees,
-										  	   		 	  (float)test_cases[i].memused / 1024.0f,
-													 	  (float)(test_cases[i].memused) / (float)cps.size(),
-											   		 	  (cpu_ticks_to_ms( test_cases[i].runtime ) / (float)txt_cp_count) * 1000.0f,
-											   		 	  ( (float)file_size / ( 1024 * 1024 ) ) / cpu_ticks_to_sec( test_cases[i].runtime ));
+		utf8_lookup_utf16_result res[256];
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < ITERATIONS; ++i )
+		{
+			const uint16_t* str_iter = &utf16[0];
+			while( *str_iter )
+			{
+				size_t res_size = ARRAY_LENGTH(res);
+				str_iter = utf8_lookup_perform_utf16( table, str_iter, res, &res_size );
+			}
+		}
+		utf16_time = cpu_tick() - start;
 	}
 
-	// check output!
+	uint64_t utf32_time;
 	{
-		utf8_lookup_result res1[256];
-		utf8_lookup_result res2[256];
-		utf8_lookup_result res3[256];
-		size_t res_size1 = 256;
-		size_t res_size2 = 256;
-		size_t res_size3 = 256;
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < ITERATIONS; ++i )
+			utf8_lookup_perform_utf32_popcnt( table, &utf32[0], utf32.size(), &offsets[0][0] );
+		utf32_time = cpu_tick() - start;
+	}
 
-		memset( res1, 0x0, sizeof(res1) );
-		memset( res2, 0x0, sizeof(res2) );
-		memset( res3, 0x0, sizeof(res3) );
+	uint64_t utf32_avx2_time = 0;
+#if defined( __x86_64__ ) || defined( _M_X64 )
+	{
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < ITERATIONS; ++i )
+			utf8_lookup_perform_utf32( table, &utf32[0], utf32.size(), &offsets[1][0] );
+		utf32_avx2_time = cpu_tick() - start;
+	}
+	if( offsets[0] != offsets[1] )
+		printf( "utf32 simd mismatch!\n" );
+#endif
 
-		const uint8_t* str_iter1 = text;
-		const uint8_t* str_iter2 = text;
-		const uint8_t* str_iter3 = text;
+	printf( "utf8 %.3f ms, utf16 %.3f ms, utf32 %.3f ms, utf32 dispatched (avx2 if available) %.3f ms\n",
+			cpu_ticks_to_ms( utf8_time ) / (float)ITERATIONS,
+			cpu_ticks_to_ms( utf16_time ) / (float)ITERATIONS,
+			cpu_ticks_to_ms( utf32_time ) / (float)ITERATIONS,
+			cpu_ticks_to_ms( utf32_avx2_time ) / (float)ITERATIONS );
+}
 
-		unsigned int chars = 0;
-		unsigned int num_missmatch = 0;
+/**
+ * time utf8_lookup_perform_runs against utf8_lookup_perform + finding run-boundaries in the result, with a
+ * table missing every 8th char in the text to get a mix of found and missing runs.
+ */
+static void perform_runs_bench( const uint8_t* text, std::vector<unsigned int>& cps )
+{
+	const int ITERATIONS = 20;
 
-		int loop = 0;
-		bool print = true;
-		while( *str_iter1 && *str_iter2 )
-		{
-			str_iter1 = utf8_lookup_perform_std_cmp( compare_unordered_map, str_iter1, res1, &res_size1 );
-			str_iter2 = utf8_lookup_perform( table, str_iter2, res2, &res_size2 );
-			str_iter3 = utf8_lookup_perform_bitarray_cmp_popcnt( bitarray, str_iter3, res3, &res_size3 );
+	std::vector<unsigned int> primary;
+	for( size_t i = 0; i < cps.size(); ++i )
+		if( i % 8 != 7 )
+			primary.push_back( cps[i] );
 
-			if( str_iter1 != str_iter2 ) { printf("mismatching str_iter!\n"); break; }
-			if( str_iter1 != str_iter3 ) { printf("mismatching str_iter!\n"); break; }
-			if( res_size1 != res_size2 ) { printf("mismatching res_size!\n"); break; }
-			if( res_size1 != res_size3 ) { printf("mismatching res_size!\n"); break; }
+	size_t table_size;
+	utf8_lookup_calc_table_size( &table_size, &primary[0], (unsigned int)primary.size() );
+	void* table = malloc( table_size );
+	utf8_lookup_gen_table( table, table_size, &primary[0], (unsigned int)primary.size() );
 
-			for( size_t i = 0; i < res_size1; ++i )
+	size_t num_runs[2] = { 0, 0 };
+	uint64_t perform_time;
+	{
+		utf8_lookup_result res[256];
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < ITERATIONS; ++i )
+		{
+			int last_found = -1;
+			const uint8_t* str_iter = text;
+			while( *str_iter )
 			{
-				++chars;
-
-				if( res1[i].pos != res2[i].pos )
+				size_t res_size = ARRAY_LENGTH(res);
+				str_iter = utf8_lookup_perform( table, str_iter, res, &res_size );
+				for( size_t r = 0; r < res_size; ++r )
 				{
-					if( print )
-						printf("%d[%lu] = pos mismatch! %p %p\n", loop, i, res1[i].pos, res2[i].pos);
+					int found = res[r].offset != 0;
+					if( found != last_found )
+						++num_runs[0];
+					last_found = found;
 				}
+			}
+		}
+		perform_time = cpu_tick() - start;
+	}
 
-				if( res1[i].pos != res3[i].pos )
-				{
-					if( print )
-						printf("%d[%lu] = pos mismatch! %p %p\n", loop, i, res1[i].pos, res3[i].pos);
-				}
+	uint64_t runs_time;
+	{
+		utf8_lookup_run runs[64];
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < ITERATIONS; ++i )
+		{
+			const uint8_t* str_iter = text;
+			while( *str_iter )
+			{
+				size_t runs_size = ARRAY_LENGTH(runs);
+				str_iter = utf8_lookup_perform_runs( table, str_iter, runs, &runs_size );
+				num_runs[1] += runs_size;
+			}
+		}
+		runs_time = cpu_tick() - start;
+	}
 
-				if( res1[i].offset != res2[i].offset )
-				{
-					if( print )
-					{
-						printf("%d[%lu] = %u %u\n", loop, i, res1[i].offset, res2[i].offset );
+	if( num_runs[0] != num_runs[1] )
+		printf( "utf8_lookup_perform_runs mismatch! %zu %zu\n", num_runs[0], num_runs[1] );
+
+	printf( "runs: perform + boundaries %.3f ms, perform_runs %.3f ms (%zu runs)\n",
+			cpu_ticks_to_ms( perform_time ) / (float)ITERATIONS,
+			cpu_ticks_to_ms( runs_time ) / (float)ITERATIONS,
+			num_runs[1] / ITERATIONS );
+
+	free( table );
+}
+
+/**
+ * time utf8_lookup_map against a std::unordered_map as per-codepoint property table.
+ */
+static void lookup_map_bench( const uint8_t* text, std::vector<unsigned int>& cps )
+{
+	const int ITERATIONS = 20;
+
+	// ... some made up 16 bit property per codepoint ...
+	std::vector<uint16_t> values( cps.size() );
+	std::unordered_map<unsigned int, uint16_t> hash;
+	for( size_t i = 0; i < cps.size(); ++i )
+	{
+		values[i] = (uint16_t)( cps[i] * 2654435761u >> 16 );
+		hash[cps[i]] = values[i];
+	}
+
+	size_t map_size;
+	if( utf8_lookup_map<uint16_t>::calc_size( &map_size, &cps[0], (unsigned int)cps.size() ) != UTF8_LOOKUP_ERROR_OK )
+	{
+		printf( "lookup map: failed to calculate map size\n" );
+		return;
+	}
+	void* map = malloc( map_size );
+	if( utf8_lookup_map<uint16_t>::gen( map, map_size, &cps[0], &values[0], (unsigned int)cps.size(), 0 ) != UTF8_LOOKUP_ERROR_OK )
+	{
+		printf( "lookup map: failed to generate map\n" );
+		free( map );
+		return;
+	}
+
+	uint64_t sums[2] = { 0, 0 };
+	uint64_t hash_time;
+	{
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < ITERATIONS; ++i )
+		{
+			const uint8_t* pos = text;
+			while( *pos )
+			{
+				std::unordered_map<unsigned int, uint16_t>::const_iterator it = hash.find( utf8_to_unicode_codepoint( &pos ) );
+				sums[0] += it == hash.end() ? 0 : it->second;
+			}
+		}
+		hash_time = cpu_tick() - start;
+	}
+
+	uint64_t map_time;
+	{
+		uint16_t res[256];
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < ITERATIONS; ++i )
+		{
+			const uint8_t* str_iter = text;
+			while( *str_iter )
+			{
+				size_t res_size = ARRAY_LENGTH(res);
+				str_iter = utf8_lookup_map<uint16_t>::perform( map, str_iter, res, &res_size );
+				for( size_t r = 0; r < res_size; ++r )
+					sums[1] += res[r];
+			}
+		}
+		map_time = cpu_tick() - start;
+	}
+
+	if( sums[0] != sums[1] )
+		printf( "utf8_lookup_map mismatch!\n" );
+
+	printf( "map: std::unordered_map %.3f ms (%zu buckets), utf8_lookup_map %.3f ms (%zu bytes)\n",
+			cpu_ticks_to_ms( hash_time ) / (float)ITERATIONS,
+			hash.bucket_count(),
+			cpu_ticks_to_ms( map_time ) / (float)ITERATIONS,
+			map_size );
+
+	free( map );
+}
+
+/**
+ * tokenizer-like character-class, whitespace, identifier, digit, punctuation and cjk.
+ */
+static uint8_t bench_char_class( unsigned int cp )
+{
+	switch( cp )
+	{
+		case ' ': case '\t': case '\n': case '\r':
+			return 1;
+		case '_':
+			return 2;
+		default:
+			break;
+	}
+	if( ( cp >= 'a' && cp <= 'z' ) || ( cp >= 'A' && cp <= 'Z' ) || ( cp >= 0xC0 && cp < 0x250 ) || ( cp >= 0x370 && cp < 0x500 ) )
+		return 2;
+	if( cp >= '0' && cp <= '9' )
+		return 3;
+	if( ( cp > ' ' && cp < 127 ) || ( cp >= 0x3000 && cp < 0x3040 ) )
+		return 4;
+	if( cp >= 0x4E00 && cp < 0xA000 )
+		return 5;
+	return 0;
+}
+
+/**
+ * time utf8_lookup_perform_class_runs against decoding and classifying each char with bench_char_class.
+ */
+static void class_runs_bench( const uint8_t* text )
+{
+	const int ITERATIONS = 20;
+
+	std::vector<unsigned int> cps;
+	std::vector<uint8_t>      classes;
+	for( unsigned int cp = 1; cp < 0xA000; ++cp )
+	{
+		uint8_t c = bench_char_class( cp );
+		if( c != 0 )
+		{
+			cps.push_back( cp );
+			classes.push_back( c );
+		}
+	}
+
+	size_t table_size;
+	if( utf8_lookup_calc_class_table_size( &table_size, &cps[0], (unsigned int)cps.size() ) != UTF8_LOOKUP_ERROR_OK )
+	{
+		printf( "class runs: failed to calculate class-table size\n" );
+		return;
+	}
+	void* table = malloc( table_size );
+	if( utf8_lookup_gen_class_table( table, table_size, &cps[0], &classes[0], (unsigned int)cps.size(), 0 ) != UTF8_LOOKUP_ERROR_OK )
+	{
+		printf( "class runs: failed to generate class-table\n" );
+		free( table );
+		return;
+	}
+
+	size_t num_runs[2] = { 0, 0 };
+	uint64_t switch_time;
+	{
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < ITERATIONS; ++i )
+		{
+			int last_class = -1;
+			const uint8_t* pos = text;
+			while( *pos )
+			{
+				int c = bench_char_class( utf8_to_unicode_codepoint( &pos ) );
+				if( c != last_class )
+					++num_runs[0];
+				last_class = c;
+			}
+		}
+		switch_time = cpu_tick() - start;
+	}
+
+	uint64_t runs_time;
+	{
+		utf8_lookup_class_run runs[64];
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < ITERATIONS; ++i )
+		{
+			const uint8_t* str_iter = text;
+			while( *str_iter )
+			{
+				size_t runs_size = ARRAY_LENGTH(runs);
+				str_iter = utf8_lookup_perform_class_runs( table, str_iter, runs, &runs_size );
+				num_runs[1] += runs_size;
+			}
+		}
+		runs_time = cpu_tick() - start;
+	}
+
+	if( num_runs[0] != num_runs[1] )
+		printf( "utf8_lookup_perform_class_runs mismatch! %zu %zu\n", num_runs[0], num_runs[1] );
+
+	printf( "class runs: decode + switch %.3f ms, perform_class_runs %.3f ms (%zu runs, %zu bytes)\n",
+			cpu_ticks_to_ms( switch_time ) / (float)ITERATIONS,
+			cpu_ticks_to_ms( runs_time ) / (float)ITERATIONS,
+			num_runs[1] / ITERATIONS,
+			table_size );
+
+	free( table );
+}
+
+/**
+ * time utf8_lookup_perform_kerning against utf8_lookup_perform + kerning from a std::unordered_map keyed
+ * on the offset-pair.
+ */
+static void kerning_bench( void* table, const uint8_t* text, std::vector<unsigned int>& cps )
+{
+	const int ITERATIONS = 20;
+
+	// ... kerning for about 80% of the pairs between the 300 first chars in the text ...
+	size_t num_kerned = std::min( cps.size(), (size_t)300 );
+	std::vector<utf8_lookup_kerning_pair> pairs;
+	std::unordered_map<uint32_t, int> hash;
+	for( size_t f = 0; f < num_kerned; ++f )
+		for( size_t s = 0; s < num_kerned; ++s )
+		{
+			if( ( cps[f] * 31 + cps[s] * 17 ) % 5 == 0 )
+				continue;
+			utf8_lookup_kerning_pair pair = { cps[f], cps[s], (int16_t)( ( cps[f] * 7 + cps[s] * 13 ) % 199 ) };
+			pairs.push_back( pair );
+			hash[ (uint32_t)( ( f + 1 ) << 16 | ( s + 1 ) ) ] = pair.value;
+		}
+
+	size_t kerning_size;
+	utf8_lookup_calc_kerning_table_size( &kerning_size, table, &pairs[0], pairs.size() );
+	void* kerning = malloc( kerning_size );
+	utf8_lookup_gen_kerning_table( kerning, kerning_size, table, &pairs[0], pairs.size() );
+
+	int64_t sums[2] = { 0, 0 };
+	uint64_t hash_time;
+	{
+		utf8_lookup_result res[256];
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < ITERATIONS; ++i )
+		{
+			unsigned int prev = 0;
+			const uint8_t* str_iter = text;
+			while( *str_iter )
+			{
+				size_t res_size = ARRAY_LENGTH(res);
+				str_iter = utf8_lookup_perform( table, str_iter, res, &res_size );
+				for( size_t r = 0; r < res_size; ++r )
+				{
+					std::unordered_map<uint32_t, int>::const_iterator it = hash.find( prev << 16 | res[r].offset );
+					sums[0] += it == hash.end() ? 0 : it->second;
+					prev = res[r].offset;
+				}
+			}
+		}
+		hash_time = cpu_tick() - start;
+	}
+
+	uint64_t kerning_time;
+	{
+		utf8_lookup_kerning_result res[256];
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < ITERATIONS; ++i )
+		{
+			unsigned int prev = 0;
+			const uint8_t* str_iter = text;
+			while( *str_iter )
+			{
+				size_t res_size = ARRAY_LENGTH(res);
+				str_iter = utf8_lookup_perform_kerning( table, kerning, str_iter, &prev, res, &res_size );
+				for( size_t r = 0; r < res_size; ++r )
+					sums[1] += res[r].kerning;
+			}
+		}
+		kerning_time = cpu_tick() - start;
+	}
+
+	if( sums[0] != sums[1] )
+		printf( "utf8_lookup_perform_kerning mismatch! %lld %lld\n", (long long)sums[0], (long long)sums[1] );
+
+	printf( "kerning: perform + std::unordered_map %.3f ms, perform_kerning %.3f ms (%zu pairs, %zu bytes)\n",
+			cpu_ticks_to_ms( hash_time ) / (float)ITERATIONS,
+			cpu_ticks_to_ms( kerning_time ) / (float)ITERATIONS,
+			pairs.size(),
+			kerning_size );
+
+	free( kerning );
+}
+
+/**
+ * time utf8_lookup_measure, with and without prefix-widths, against utf8_lookup_perform + summing advances
+ * from a glyph-array.
+ */
+static void measure_bench( void* table, const uint8_t* text, std::vector<unsigned int>& cps )
+{
+	const int ITERATIONS = 20;
+
+	std::vector<int32_t> advances( cps.size() + 1 );
+	advances[0] = 500;
+	for( size_t i = 0; i < cps.size(); ++i )
+		advances[i + 1] = (int32_t)( cps[i] * 37 % 1000 );
+
+	size_t advance_size;
+	if( utf8_lookup_calc_advance_table_size( &advance_size, &cps[0], (unsigned int)cps.size() ) != UTF8_LOOKUP_ERROR_OK )
+	{
+		printf( "measure: failed to calculate advance-table size\n" );
+		return;
+	}
+	void* advance_table = malloc( advance_size );
+	if( utf8_lookup_gen_advance_table( advance_table, advance_size, &cps[0], &advances[1], (unsigned int)cps.size(), advances[0] ) != UTF8_LOOKUP_ERROR_OK )
+	{
+		printf( "measure: failed to generate advance-table\n" );
+		free( advance_table );
+		return;
+	}
+
+	int64_t widths[3] = { 0, 0, 0 };
+	uint64_t perform_time;
+	{
+		utf8_lookup_result res[256];
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < ITERATIONS; ++i )
+		{
+			const uint8_t* str_iter = text;
+			while( *str_iter )
+			{
+				size_t res_size = ARRAY_LENGTH(res);
+				str_iter = utf8_lookup_perform( table, str_iter, res, &res_size );
+				for( size_t r = 0; r < res_size; ++r )
+					widths[0] += advances[ res[r].offset ];
+			}
+		}
+		perform_time = cpu_tick() - start;
+	}
+
+	uint64_t measure_time;
+	{
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < ITERATIONS; ++i )
+			widths[1] += utf8_lookup_measure( advance_table, text, 0x0 );
+		measure_time = cpu_tick() - start;
+	}
+
+	uint64_t prefix_time;
+	{
+		std::vector<int64_t> prefix( utf8_lookup_count_chars( text ) + 1 );
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < ITERATIONS; ++i )
+			widths[2] += utf8_lookup_measure( advance_table, text, &prefix[0] );
+		prefix_time = cpu_tick() - start;
+	}
+
+	if( widths[0] != widths[1] || widths[0] != widths[2] )
+		printf( "utf8_lookup_measure mismatch! %lld %lld %lld\n", (long long)widths[0], (long long)widths[1], (long long)widths[2] );
+
+	printf( "measure: perform + sum %.3f ms, measure %.3f ms, measure with prefix %.3f ms\n",
+			cpu_ticks_to_ms( perform_time ) / (float)ITERATIONS,
+			cpu_ticks_to_ms( measure_time ) / (float)ITERATIONS,
+			cpu_ticks_to_ms( prefix_time ) / (float)ITERATIONS );
+
+	free( advance_table );
+}
+
+static uint8_t bench_break_class( unsigned int cp )
+{
+	if( cp == '\n' )
+		return UTF8_LOOKUP_BREAK_MANDATORY;
+	if( cp == ' ' || cp == '\t' || cp == '\r' )
+		return UTF8_LOOKUP_BREAK_SPACE;
+	if( cp == '-' || ( cp >= 0x4E00 && cp < 0xA000 ) )
+		return UTF8_LOOKUP_BREAK_AFTER;
+	return UTF8_LOOKUP_BREAK_NONE;
+}
+
+/**
+ * greedy line-breaking over already looked up chars, as done when lookup and layout are separate passes.
+ */
+static size_t break_lines_two_pass( const utf8_lookup_result* res, size_t num_chars, const int32_t* advances, const uint8_t* classes, int64_t max_width, int64_t* total_width )
+{
+	size_t  num_lines = 0;
+	size_t  line_start = 0;
+	size_t  content_end = 0;
+	int64_t width = 0;
+	int64_t content_width = 0;
+	size_t  break_pos = (size_t)-1;
+	int64_t break_content_width = 0;
+	int64_t break_width = 0;
+	for( size_t i = 0; i < num_chars; ++i )
+	{
+		int32_t advance = advances[ res[i].offset ];
+		uint8_t cls     = classes[ res[i].offset ];
+		if( cls == UTF8_LOOKUP_BREAK_MANDATORY )
+		{
+			*total_width += content_width; ++num_lines;
+			line_start = content_end = i + 1;
+			width = content_width = 0;
+			break_pos = (size_t)-1;
+			continue;
+		}
+		if( cls == UTF8_LOOKUP_BREAK_SPACE )
+		{
+			width += advance;
+			break_pos = i + 1; break_content_width = content_width; break_width = width;
+			continue;
+		}
+		if( width + advance > max_width && content_end != line_start && break_pos != (size_t)-1 )
+		{
+			*total_width += break_content_width; ++num_lines;
+			if( content_end <= break_pos ) { content_end = break_pos; content_width = 0; }
+			else content_width -= break_width;
+			width -= break_width;
+			line_start = break_pos;
+			break_pos = (size_t)-1;
+		}
+		if( width + advance > max_width && content_end != line_start )
+		{
+			*total_width += width; ++num_lines;
+			line_start = content_end = i;
+			width = content_width = 0;
+		}
+		width += advance;
+		content_end = i + 1;
+		content_width = width;
+		if( cls == UTF8_LOOKUP_BREAK_AFTER )
+		{
+			break_pos = i + 1; break_content_width = width; break_width = width;
+		}
+	}
+	if( line_start != num_chars )
+	{
+		*total_width += content_width; ++num_lines;
+	}
+	return num_lines;
+}
+
+/**
+ * time relayout of all lines in text as separate labels at a few widths, perform_all + greedy line-breaking
+ * vs utf8_lookup_break_lines.
+ */
+static void break_lines_bench( void* table, const uint8_t* text, std::vector<unsigned int>& cps )
+{
+	const int ITERATIONS = 20;
+
+	std::vector<int32_t> advances( cps.size() + 1 );
+	std::vector<uint8_t> classes( cps.size() + 1 );
+	advances[0] = 500;
+	classes[0]  = UTF8_LOOKUP_BREAK_NONE;
+	for( size_t i = 0; i < cps.size(); ++i )
+	{
+		advances[i + 1] = (int32_t)( cps[i] * 37 % 1000 );
+		classes[i + 1]  = bench_break_class( cps[i] );
+	}
+
+	size_t advance_size, class_size;
+	if( utf8_lookup_calc_advance_table_size( &advance_size, &cps[0], (unsigned int)cps.size() ) != UTF8_LOOKUP_ERROR_OK ||
+		utf8_lookup_calc_class_table_size( &class_size, &cps[0], (unsigned int)cps.size() ) != UTF8_LOOKUP_ERROR_OK )
+	{
+		printf( "break lines: failed to calculate advance- or class-table size\n" );
+		return;
+	}
+	void* advance_table = malloc( advance_size );
+	void* class_table   = malloc( class_size );
+	if( utf8_lookup_gen_advance_table( advance_table, advance_size, &cps[0], &advances[1], (unsigned int)cps.size(), advances[0] ) != UTF8_LOOKUP_ERROR_OK ||
+		utf8_lookup_gen_class_table( class_table, class_size, &cps[0], &classes[1], (unsigned int)cps.size(), classes[0] ) != UTF8_LOOKUP_ERROR_OK )
+	{
+		printf( "break lines: failed to generate advance- or class-table\n" );
+		free( advance_table );
+		free( class_table );
+		return;
+	}
+
+	// ... each line in text is a label ...
+	std::vector<uint8_t> labels;
+	std::vector<size_t>  label_starts;
+	size_t max_label_chars = 0;
+	const uint8_t* line = text;
+	while( *line )
+	{
+		const uint8_t* end = line;
+		while( *end && *end != '\n' )
+			++end;
+		if( end != line )
+		{
+			label_starts.push_back( labels.size() );
+			labels.insert( labels.end(), line, end );
+			labels.push_back( 0 );
+			size_t chars = utf8_lookup_count_chars( &labels[label_starts.back()] );
+			if( chars > max_label_chars )
+				max_label_chars = chars;
+		}
+		line = *end ? end + 1 : end;
+	}
+	if( label_starts.empty() )
+	{
+		free( advance_table );
+		free( class_table );
+		return;
+	}
+
+	static const int64_t max_widths[] = { 4000, 16000, 64000 };
+
+	size_t  num_lines[2] = { 0, 0 };
+	int64_t total_width[2] = { 0, 0 };
+	uint64_t two_pass_time;
+	{
+		std::vector<utf8_lookup_result> res( max_label_chars + 1 );
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < ITERATIONS; ++i )
+			for( size_t w = 0; w < ARRAY_LENGTH( max_widths ); ++w )
+				for( size_t l = 0; l < label_starts.size(); ++l )
+				{
+					size_t num_chars = utf8_lookup_perform_all( table, &labels[label_starts[l]], &res[0] );
+					num_lines[0] += break_lines_two_pass( &res[0], num_chars, &advances[0], &classes[0], max_widths[w], &total_width[0] );
+				}
+		two_pass_time = cpu_tick() - start;
+	}
+
+	uint64_t fused_time;
+	{
+		utf8_lookup_line lines[64];
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < ITERATIONS; ++i )
+			for( size_t w = 0; w < ARRAY_LENGTH( max_widths ); ++w )
+				for( size_t l = 0; l < label_starts.size(); ++l )
+				{
+					const uint8_t* str_iter = &labels[label_starts[l]];
+					while( *str_iter )
+					{
+						size_t lines_size = ARRAY_LENGTH( lines );
+						str_iter = utf8_lookup_break_lines( advance_table, class_table, str_iter, max_widths[w], lines, &lines_size );
+						num_lines[1] += lines_size;
+						for( size_t r = 0; r < lines_size; ++r )
+							total_width[1] += lines[r].width;
+					}
+				}
+		fused_time = cpu_tick() - start;
+	}
+
+	if( num_lines[0] != num_lines[1] || total_width[0] != total_width[1] )
+		printf( "utf8_lookup_break_lines mismatch! %llu %llu %lld %lld\n", (unsigned long long)num_lines[0], (unsigned long long)num_lines[1], (long long)total_width[0], (long long)total_width[1] );
+
+	printf( "break lines: %u labels at %u widths, perform_all + break %.3f ms, break_lines %.3f ms\n",
+			(unsigned int)label_starts.size(),
+			(unsigned int)ARRAY_LENGTH( max_widths ),
+			cpu_ticks_to_ms( two_pass_time ) / (float)ITERATIONS,
+			cpu_ticks_to_ms( fused_time ) / (float)ITERATIONS );
+
+	free( advance_table );
+	free( class_table );
+}
+
+/**
+ * time utf8_lookup_perform_to_utf16 against utf8_lookup_perform followed by transcoding the same chunk to utf16.
+ */
+static void to_utf16_bench( void* table, const uint8_t* text )
+{
+	const int ITERATIONS = 20;
+
+	uint64_t sums[3] = { 0, 0, 0 };
+	uint64_t two_pass_time;
+	{
+		utf8_lookup_result res[256];
+		uint16_t utf16[512];
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < ITERATIONS; ++i )
+		{
+			const uint8_t* str_iter = text;
+			while( *str_iter )
+			{
+				size_t res_size = ARRAY_LENGTH(res);
+				const uint8_t* chunk = str_iter;
+				str_iter = utf8_lookup_perform( table, str_iter, res, &res_size );
+
+				size_t units = 0;
+				while( chunk != str_iter )
+				{
+					unsigned int cp = utf8_to_unicode_codepoint( &chunk );
+					if( cp >= 0x10000 )
+					{
+						utf16[units++] = (uint16_t)( 0xD800 + ( ( cp - 0x10000 ) >> 10 ) );
+						utf16[units++] = (uint16_t)( 0xDC00 + ( ( cp - 0x10000 ) & 0x3FF ) );
+					}
+					else
+						utf16[units++] = (uint16_t)cp;
+				}
+				for( size_t r = 0; r < res_size; ++r )
+					sums[0] += res[r].offset;
+				for( size_t u = 0; u < units; ++u )
+					sums[0] += utf16[u];
+			}
+		}
+		two_pass_time = cpu_tick() - start;
+	}
+
+	uint64_t fused_time[2];
+	for( int variant = 0; variant < 2; ++variant )
+	{
+		utf8_lookup_result res[256];
+		uint16_t utf16[512];
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < ITERATIONS; ++i )
+		{
+			const uint8_t* str_iter = text;
+			while( *str_iter )
+			{
+				size_t res_size   = ARRAY_LENGTH(res);
+				size_t utf16_size = ARRAY_LENGTH(utf16);
+				if( variant == 0 )
+					str_iter = utf8_lookup_perform_to_utf16_popcnt( table, str_iter, res, &res_size, utf16, &utf16_size );
+				else
+					str_iter = utf8_lookup_perform_to_utf16( table, str_iter, res, &res_size, utf16, &utf16_size );
+				for( size_t r = 0; r < res_size; ++r )
+					sums[variant + 1] += res[r].offset;
+				for( size_t u = 0; u < utf16_size; ++u )
+					sums[variant + 1] += utf16[u];
+			}
+		}
+		fused_time[variant] = cpu_tick() - start;
+	}
+
+	if( sums[0] != sums[1] || sums[0] != sums[2] )
+		printf( "utf8_lookup_perform_to_utf16 mismatch!\n" );
+
+	printf( "to utf16: perform + transcode %.3f ms, perform_to_utf16 %.3f ms, dispatched (avx2 if available) %.3f ms\n",
+			cpu_ticks_to_ms( two_pass_time ) / (float)ITERATIONS,
+			cpu_ticks_to_ms( fused_time[0] ) / (float)ITERATIONS,
+			cpu_ticks_to_ms( fused_time[1] ) / (float)ITERATIONS );
+}
+
+/**
+ * time utf8_lookup_perform through a utf8_lookup_hot_table, acquire and release around each perform, against
+ * utf8_lookup_perform on the table directly.
+ */
+static void hot_table_bench( const uint8_t* text, std::vector<unsigned int>& cps )
+{
+	const int ITERATIONS = 20;
+
+	size_t table_size;
+	if( utf8_lookup_calc_table_size( &table_size, &cps[0], (unsigned int)cps.size() ) != UTF8_LOOKUP_ERROR_OK )
+	{
+		printf( "hot table: failed to calculate table size\n" );
+		return;
+	}
+	void* table = UTF8_LOOKUP_MALLOC( table_size );
+	if( utf8_lookup_gen_table( table, table_size, &cps[0], (unsigned int)cps.size() ) != UTF8_LOOKUP_ERROR_OK )
+	{
+		printf( "hot table: failed to generate table\n" );
+		UTF8_LOOKUP_FREE( table );
+		return;
+	}
+
+	utf8_lookup_hot_table* hot;
+	if( utf8_lookup_hot_table_create( &hot, table, 1 ) != UTF8_LOOKUP_ERROR_OK )
+	{
+		printf( "hot table: failed to create handle\n" );
+		UTF8_LOOKUP_FREE( table );
+		return;
+	}
+
+	uint64_t sums[2] = { 0, 0 };
+	uint64_t direct_time;
+	{
+		utf8_lookup_result res[64];
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < ITERATIONS; ++i )
+		{
+			const uint8_t* str_iter = text;
+			while( *str_iter )
+			{
+				size_t res_size = ARRAY_LENGTH(res);
+				str_iter = utf8_lookup_perform( table, str_iter, res, &res_size );
+				for( size_t r = 0; r < res_size; ++r )
+					sums[0] += res[r].offset;
+			}
+		}
+		direct_time = cpu_tick() - start;
+	}
+
+	uint64_t hot_time;
+	{
+		utf8_lookup_result res[64];
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < ITERATIONS; ++i )
+		{
+			const uint8_t* str_iter = text;
+			while( *str_iter )
+			{
+				size_t res_size = ARRAY_LENGTH(res);
+				const void* hot_table = utf8_lookup_hot_table_acquire( hot, 0 );
+				str_iter = utf8_lookup_perform( hot_table, str_iter, res, &res_size );
+				utf8_lookup_hot_table_release( hot, 0 );
+				for( size_t r = 0; r < res_size; ++r )
+					sums[1] += res[r].offset;
+			}
+		}
+		hot_time = cpu_tick() - start;
+	}
+
+	if( sums[0] != sums[1] )
+		printf( "utf8_lookup_hot_table mismatch!\n" );
+
+	printf( "hot table: perform %.3f ms, acquire + perform + release per 64 chars %.3f ms\n",
+			cpu_ticks_to_ms( direct_time ) / (float)ITERATIONS,
+			cpu_ticks_to_ms( hot_time ) / (float)ITERATIONS );
+
+	utf8_lookup_hot_table_destroy( hot );
+}
+
+static void append_utf8( std::vector<uint8_t>& out, unsigned int cp )
+{
+	if( cp < 0x80 )
+		out.push_back( (uint8_t)cp );
+	else if( cp < 0x800 )
+	{
+		out.push_back( (uint8_t)( 0xC0 | ( cp >> 6 ) ) );
+		out.push_back( (uint8_t)( 0x80 | ( cp & 0x3F ) ) );
+	}
+	else if( cp < 0x10000 )
+	{
+		out.push_back( (uint8_t)( 0xE0 | ( cp >> 12 ) ) );
+		out.push_back( (uint8_t)( 0x80 | ( ( cp >> 6 ) & 0x3F ) ) );
+		out.push_back( (uint8_t)( 0x80 | ( cp & 0x3F ) ) );
+	}
+	else
+	{
+		out.push_back( (uint8_t)( 0xF0 | ( cp >> 18 ) ) );
+		out.push_back( (uint8_t)( 0x80 | ( ( cp >> 12 ) & 0x3F ) ) );
+		out.push_back( (uint8_t)( 0x80 | ( ( cp >> 6 ) & 0x3F ) ) );
+		out.push_back( (uint8_t)( 0x80 | ( cp & 0x3F ) ) );
+	}
+}
+
+/**
+ * time utf8_lookup_perform_sequences against utf8_lookup_perform_ex + a greedy longest-match in a
+ * std::map of codepoint-sequences on a synthetic emoji-heavy text. Sequences are all flags, keycaps,
+ * skin-tones for a few people and zwj-families of 2 - 4 members.
+ */
+static void sequence_bench()
+{
+	const int ITERATIONS = 20;
+	const unsigned int ZWJ = 0x200D;
+	const unsigned int people[] = { 0x1F466, 0x1F467, 0x1F468, 0x1F469 };
+
+	std::vector< std::vector<unsigned int> > seqs;
+	for( unsigned int a = 0x1F1E6; a <= 0x1F1FF; ++a )
+		for( unsigned int b = 0x1F1E6; b <= 0x1F1FF; ++b )
+			seqs.push_back( std::vector<unsigned int>{ a, b } );
+	const char keycaps[] = "0123456789#*";
+	for( size_t k = 0; k < sizeof( keycaps ) - 1; ++k )
+		seqs.push_back( std::vector<unsigned int>{ (unsigned int)keycaps[k], 0xFE0F, 0x20E3 } );
+	for( size_t p = 0; p < ARRAY_LENGTH( people ); ++p )
+		for( unsigned int tone = 0x1F3FB; tone <= 0x1F3FF; ++tone )
+			seqs.push_back( std::vector<unsigned int>{ people[p], tone } );
+	for( int members = 2; members <= 4; ++members )
+		for( int combo = 0; combo < ( 1 << ( members * 2 ) ); ++combo )
+		{
+			std::vector<unsigned int> seq;
+			for( int m = 0; m < members; ++m )
+			{
+				if( m > 0 )
+					seq.push_back( ZWJ );
+				seq.push_back( people[ ( combo >> ( m * 2 ) ) & 3 ] );
+			}
+			seqs.push_back( seq );
+		}
+
+	// ... the text is words of ascii mixed with sequences and single emoji ...
+	std::vector<uint8_t> text;
+	unsigned int seed = 1;
+	while( text.size() < 1024 * 1024 )
+	{
+		seed = seed * 1103515245u + 12345u;
+		unsigned int r = seed >> 8;
+		if( r % 3 == 0 )
+		{
+			const char* word = "hello world ";
+			text.insert( text.end(), word, word + strlen( word ) );
+		}
+		else if( r % 3 == 1 )
+			append_utf8( text, people[ ( r >> 4 ) % ARRAY_LENGTH( people ) ] );
+		else
+		{
+			const std::vector<unsigned int>& seq = seqs[ ( r >> 4 ) % seqs.size() ];
+			for( size_t c = 0; c < seq.size(); ++c )
+				append_utf8( text, seq[c] );
+		}
+	}
+	text.push_back( 0 );
+
+	std::set<unsigned int> cp_set;
+	for( const char* c = "helo wrd"; *c; ++c )
+		cp_set.insert( (unsigned int)*c );
+	for( size_t i = 0; i < seqs.size(); ++i )
+		cp_set.insert( seqs[i].begin(), seqs[i].end() );
+	std::vector<unsigned int> cps( cp_set.begin(), cp_set.end() );
+
+	size_t table_size;
+	utf8_lookup_calc_table_size( &table_size, &cps[0], (unsigned int)cps.size() );
+	void* table = malloc( table_size );
+	utf8_lookup_gen_table( table, table_size, &cps[0], (unsigned int)cps.size() );
+
+	std::vector<utf8_lookup_sequence> lookup_seqs( seqs.size() );
+	std::map<std::vector<unsigned int>, unsigned int> seq_map;
+	std::set<unsigned int> seq_starts;
+	size_t max_seq_length = 0;
+	for( size_t i = 0; i < seqs.size(); ++i )
+	{
+		lookup_seqs[i].codepoints     = &seqs[i][0];
+		lookup_seqs[i].num_codepoints = (unsigned int)seqs[i].size();
+		seq_map[seqs[i]] = (unsigned int)( cps.size() + 1 + i );
+		seq_starts.insert( seqs[i][0] );
+		max_seq_length = std::max( max_seq_length, seqs[i].size() );
+	}
+
+	size_t seq_table_size;
+	utf8_lookup_calc_sequence_table_size( &seq_table_size, table, &lookup_seqs[0], (unsigned int)lookup_seqs.size() );
+	void* seq_table = malloc( seq_table_size );
+	utf8_lookup_gen_sequence_table( seq_table, seq_table_size, table, &lookup_seqs[0], (unsigned int)lookup_seqs.size() );
+
+	uint64_t sums[2] = { 0, 0 };
+	uint64_t two_stage_time;
+	{
+		std::vector<utf8_lookup_result_ex> res( utf8_lookup_count_chars( &text[0] ) );
+		std::vector<unsigned int> key;
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < ITERATIONS; ++i )
+		{
+			size_t num_res = res.size();
+			utf8_lookup_perform_ex( table, &text[0], &res[0], &num_res );
+
+			for( size_t r = 0; r < num_res; )
+			{
+				unsigned int offset = res[r].offset;
+				size_t length = 1;
+				if( seq_starts.count( res[r].codepoint ) )
+				{
+					for( size_t l = std::min( max_seq_length, num_res - r ); l >= 2; --l )
+					{
+						key.clear();
+						for( size_t c = 0; c < l; ++c )
+							key.push_back( res[r + c].codepoint );
+						std::map<std::vector<unsigned int>, unsigned int>::const_iterator it = seq_map.find( key );
+						if( it != seq_map.end() )
+						{
+							offset = it->second;
+							length = l;
+							break;
+						}
+					}
+				}
+				sums[0] += offset;
+				r += length;
+			}
+		}
+		two_stage_time = cpu_tick() - start;
+	}
+
+	uint64_t fused_time;
+	{
+		utf8_lookup_sequence_result res[256];
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < ITERATIONS; ++i )
+		{
+			const uint8_t* str_iter = &text[0];
+			while( *str_iter )
+			{
+				size_t res_size = ARRAY_LENGTH(res);
+				str_iter = utf8_lookup_perform_sequences( table, seq_table, str_iter, res, &res_size );
+				for( size_t r = 0; r < res_size; ++r )
+					sums[1] += res[r].offset;
+			}
+		}
+		fused_time = cpu_tick() - start;
+	}
+
+	if( sums[0] != sums[1] )
+		printf( "utf8_lookup_perform_sequences mismatch! %llu %llu\n", (unsigned long long)sums[0], (unsigned long long)sums[1] );
+
+	printf( "sequences, %zu KB synthetic emoji-text, %zu sequences: perform_ex + std::map longest-match %.3f ms, perform_sequences %.3f ms (%zu bytes)\n",
+			text.size() / 1024,
+			seqs.size(),
+			cpu_ticks_to_ms( two_stage_time ) / (float)ITERATIONS,
+			cpu_ticks_to_ms( fused_time ) / (float)ITERATIONS,
+			seq_table_size );
+
+	free( seq_table );
+	free( table );
+}
+
+/**
+ * time utf8_lookup_perform_parallel on 1 - N threads on all files on the command-line concatenated and
+ * repeated up to 64 MB, against utf8_lookup_perform_all on a single thread.
+ */
+static void parallel_bench( int num_files, char** files )
+{
+	const int ITERATIONS = 5;
+	const size_t TARGET_SIZE = 64 * 1024 * 1024;
+
+	std::vector<uint8_t> text;
+	for( int i = 0; i < num_files; ++i )
+	{
+		size_t file_size;
+		uint8_t* file = load_file( files[i], &file_size );
+		if( file == 0x0 )
+			continue;
+		text.insert( text.end(), file, file + file_size );
+		free( file );
+	}
+	if( text.empty() )
+		return;
+	for( size_t size = text.size(); text.size() < TARGET_SIZE; )
+		text.insert( text.end(), text.begin(), text.begin() + (ptrdiff_t)size );
+	text.push_back( 0 );
+
+	std::set<unsigned int> cp_set;
+	for( const uint8_t* pos = &text[0]; *pos; )
+		cp_set.insert( utf8_to_unicode_codepoint( &pos ) );
+	std::vector<unsigned int> cps( cp_set.begin(), cp_set.end() );
+
+	size_t table_size;
+	utf8_lookup_calc_table_size( &table_size, &cps[0], (unsigned int)cps.size() );
+	void* table = malloc( table_size );
+	utf8_lookup_gen_table( table, table_size, &cps[0], (unsigned int)cps.size() );
+
+	size_t num_chars = utf8_lookup_count_chars( &text[0] );
+	std::vector<utf8_lookup_result> expect( num_chars );
+	std::vector<utf8_lookup_result> res( num_chars );
+
+	uint64_t single_time;
+	{
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < ITERATIONS; ++i )
+			utf8_lookup_perform_all( table, &text[0], &expect[0] );
+		single_time = cpu_tick() - start;
+	}
+
+	printf( "parallel, %zu MB, %u hardware threads: perform_all %.3f ms\n",
+			text.size() / ( 1024 * 1024 ),
+			std::thread::hardware_concurrency(),
+			cpu_ticks_to_ms( single_time ) / (float)ITERATIONS );
+
+	unsigned int max_threads = std::max( std::thread::hardware_concurrency() * 2, 8u );
+	for( unsigned int num_threads = 1; num_threads <= max_threads; num_threads *= 2 )
+	{
+		size_t count = 0;
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < ITERATIONS; ++i )
+			count = utf8_lookup_perform_parallel( table, &text[0], text.size() - 1, &res[0], num_threads );
+		uint64_t parallel_time = cpu_tick() - start;
+
+		bool match = count == num_chars;
+		for( size_t c = 0; match && c < num_chars; ++c )
+			match = expect[c].pos == res[c].pos && expect[c].offset == res[c].offset;
+		if( !match )
+			printf( "utf8_lookup_perform_parallel mismatch at %u threads!\n", num_threads );
+
+		printf( "  %2u threads %.3f ms (%.2fx)\n",
+				num_threads,
+				cpu_ticks_to_ms( parallel_time ) / (float)ITERATIONS,
+				(double)single_time / (double)parallel_time );
+	}
+
+	free( table );
+}
+
+#if defined(__linux__)
+/**
+ * return private resident bytes for the current process.
+ */
+static size_t private_resident_bytes()
+{
+	FILE* f = fopen( "/proc/self/statm", "r" );
+	if( f == 0x0 )
+		return 0;
+	unsigned long size = 0, resident = 0, shared = 0;
+	if( fscanf( f, "%lu %lu %lu", &size, &resident, &shared ) != 3 )
+		resident = shared = 0;
+	fclose( f );
+	return (size_t)( resident - shared ) * (size_t)sysconf( _SC_PAGESIZE );
+}
+
+static size_t worker_private_growth( std::vector<unsigned int>& cps, bool use_shared )
+{
+	int fds[2];
+	if( pipe( fds ) != 0 )
+		return 0;
+
+	pid_t pid = fork();
+	if( pid == 0 )
+	{
+		size_t before = private_resident_bytes();
+		utf8_lookup_shared_table shared;
+		void* private_table = 0x0;
+		const void* table;
+		if( use_shared )
+		{
+			utf8_lookup_shared_table_acquire( &shared, &cps[0], (unsigned int)cps.size() );
+			table = shared.table;
+		}
+		else
+		{
+			size_t size;
+			utf8_lookup_calc_table_size( &size, &cps[0], (unsigned int)cps.size() );
+			private_table = malloc( size );
+			utf8_lookup_gen_table( private_table, size, &cps[0], (unsigned int)cps.size() );
+			table = private_table;
+		}
+
+		// ... touch all of the table by looking up all codepoints ...
+		uint64_t sum = 0;
+		for( size_t i = 0; i < cps.size(); ++i )
+		{
+			uint8_t str[8] = { 0 };
+			unsigned int cp = cps[i];
+			if( cp == 0 ) continue;
+			if( cp < 0x80 )       { str[0] = (uint8_t)cp; }
+			else if( cp < 0x800 ) { str[0] = (uint8_t)(0xC0 | (cp >> 6)); str[1] = (uint8_t)(0x80 | (cp & 63)); }
+			else if( cp < 0x10000 ) { str[0] = (uint8_t)(0xE0 | (cp >> 12)); str[1] = (uint8_t)(0x80 | ((cp >> 6) & 63)); str[2] = (uint8_t)(0x80 | (cp & 63)); }
+			else { str[0] = (uint8_t)(0xF0 | (cp >> 18)); str[1] = (uint8_t)(0x80 | ((cp >> 12) & 63)); str[2] = (uint8_t)(0x80 | ((cp >> 6) & 63)); str[3] = (uint8_t)(0x80 | (cp & 63)); }
+			utf8_lookup_result res[1];
+			size_t res_size = 1;
+			utf8_lookup_perform( table, str, res, &res_size );
+			sum += res[0].offset;
+		}
+
+		size_t growth = private_resident_bytes() - before;
+		growth += (size_t)( sum & 0 ); // keep the lookups alive.
+		if( write( fds[1], &growth, sizeof( growth ) ) != (ssize_t)sizeof( growth ) )
+			_exit( 1 );
+		_exit( 0 );
+	}
+
+	size_t growth = 0;
+	if( read( fds[0], &growth, sizeof( growth ) ) != (ssize_t)sizeof( growth ) )
+		growth = 0;
+	waitpid( pid, 0x0, 0 );
+	close( fds[0] );
+	close( fds[1] );
+	return growth;
+}
+
+static void shared_table_rss_report( std::vector<unsigned int>& cps )
+{
+	static const int NUM_WORKERS = 32;
+
+	// ... make sure that the first shared worker creates the table ...
+	utf8_lookup_shared_table shared;
+	if( utf8_lookup_shared_table_acquire( &shared, &cps[0], (unsigned int)cps.size() ) != UTF8_LOOKUP_ERROR_OK )
+		return;
+	size_t table_size = shared.table_size;
+	utf8_lookup_shared_table_unlink( &shared );
+	utf8_lookup_shared_table_release( &shared );
+
+	size_t private_total = 0;
+	size_t shared_total = 0;
+	for( int i = 0; i < NUM_WORKERS; ++i )
+	{
+		private_total += worker_private_growth( cps, false );
+		shared_total  += worker_private_growth( cps, true );
+	}
+
+	if( utf8_lookup_shared_table_acquire( &shared, &cps[0], (unsigned int)cps.size() ) == UTF8_LOOKUP_ERROR_OK )
+	{
+		utf8_lookup_shared_table_unlink( &shared );
+		utf8_lookup_shared_table_release( &shared );
+	}
+
+	printf( "shared table (%d workers, table %.1f kb): private rss growth %.1f kb private tables, %.1f kb shared tables, saved %.1f kb\n",
+			NUM_WORKERS,
+			(float)table_size / 1024.0f,
+			(float)private_total / 1024.0f,
+			(float)shared_total / 1024.0f,
+			(float)( private_total > shared_total ? private_total - shared_total : 0 ) / 1024.0f );
+}
+#endif
+
+static void run_test_case(const char* test_text_file)
+{
+	size_t file_size;
+	uint8_t* text_data = load_file( test_text_file, &file_size );
+	if( text_data == 0x0 )
+	{
+		printf( "couldn't load file %s\n", test_text_file );
+		return;
+	}
+
+	uint8_t* text = text_data;
+
+	// skip BOM
+	if( text_data[0] == 0xEF && text_data[1] == 0xBB && text_data[2] == 0xBF )
+	{
+		text = &text_data[3];
+	}
+
+	test_case test_cases[] = {
+		{ "utf8_lookup_scalar", 0 ,0, 0, 0 },
+		{ "utf8_lookup_popcnt", 0 ,0, 0, 0 },
+		{ "std::map", 0 ,0, 0, 0 },
+		{ "std::unordered_map", 0 ,0, 0, 0 },
+		{ "bitarray_scalar", 0 ,0, 0, 0 },
+		{ "bitarray_popcnt", 0 ,0, 0, 0 },
+		{ "perform+scan", 0 ,0, 0, 0 },
+		{ "count_missing", 0 ,0, 0, 0 },
+		{ "all_present", 0 ,0, 0, 0 },
+		{ "membership+scan", 0 ,0, 0, 0 },
+		{ "membership_missing", 0 ,0, 0, 0 },
+		{ "perform+decode", 0 ,0, 0, 0 },
+		{ "perform_ex", 0 ,0, 0, 0 }
+	};
+
+	std::vector<unsigned int> cps;
+	find_all_codepoints( text, cps );
+
+	printf("\ntest text: %s (code points %zu)\n", test_text_file, cps.size());
+
+	// build lookup map
+	void* table = build_utf8_lookup_map( cps, &test_cases[0] );
+	memcpy( &test_cases[1], &test_cases[0], sizeof(test_case) );
+	test_cases[1].name = "utf8_lookup_popcnt";
+
+	tracked_map compare_map;
+	tracked_unordered_map compare_unordered_map;
+	build_compare_map( cps, compare_map, &test_cases[2] );
+	build_compare_map( cps, compare_unordered_map, &test_cases[3] );
+	bitarray_lookup bitarray;
+	build_bitarray_lookup_map( cps, bitarray, &test_cases[4] );
+	memcpy( &test_cases[5], &test_cases[4], sizeof(test_case) );
+	test_cases[5].name = "bitarray_popcnt";
+	for( int i = 6; i < (int)ARRAY_LENGTH( test_cases ); ++i )
+	{
+		const char* name = test_cases[i].name;
+		memcpy( &test_cases[i], &test_cases[0], sizeof(test_case) );
+		test_cases[i].name = name;
+	}
+
+	size_t membership_size = 0;
+	void* membership = 0x0;
+	if( utf8_lookup_calc_membership_table_size( &membership_size, &cps[0], (unsigned int)cps.size() ) == UTF8_LOOKUP_ERROR_OK )
+		membership = malloc( membership_size );
+	if( membership == 0x0 ||
+		utf8_lookup_gen_membership_table( membership, membership_size, &cps[0], (unsigned int)cps.size() ) != UTF8_LOOKUP_ERROR_OK )
+	{
+		printf( "failed to build membership table for %s\n", test_text_file );
+		free( membership );
+		free( text_data );
+		free( table );
+		free( bitarray.lookup );
+		return;
+	}
+	test_cases[9].memused  = membership_size;
+	test_cases[10].memused = membership_size;
+
+	print_table_stats( table );
+
+	size_t txt_cp_count = count_chars(text);
+
+	{
+		utf8_lookup_result res[256];
+		size_t res_size = ARRAY_LENGTH(res);
+
+		uint64_t start = cpu_tick();
+
+		for( int i = 0; i < 100; ++i )
+		{
+			const uint8_t* str_iter = text;
+			while( *str_iter )
+				str_iter = utf8_lookup_perform_scalar( table, str_iter, res, &res_size );
+		}
+		test_cases[0].runtime = cpu_tick() - start;
+	}
+
+	{
+		utf8_lookup_result res[256];
+		size_t res_size = ARRAY_LENGTH(res);
+
+		uint64_t start = cpu_tick();
+
+		for( int i = 0; i < 100; ++i )
+		{
+			const uint8_t* str_iter = text;
+			while( *str_iter )
+				str_iter = utf8_lookup_perform_popcnt( table, str_iter, res, &res_size );
+		}
+		test_cases[1].runtime = cpu_tick() - start;
+	}
+
+	{
+		utf8_lookup_result res[256];
+		size_t res_size = ARRAY_LENGTH(res);
+
+		uint64_t start = cpu_tick();
+
+		for( int i = 0; i < 100; ++i )
+		{
+			const uint8_t* str_iter = text;
+			while( *str_iter )
+				str_iter = utf8_lookup_perform_std_cmp( compare_map, str_iter, res, &res_size );
+		}
+		test_cases[2].runtime = cpu_tick() - start;
+	}
+
+	{
+		utf8_lookup_result res[256];
+		size_t res_size = ARRAY_LENGTH(res);
+
+		uint64_t start = cpu_tick();
+
+		for( int i = 0; i < 100; ++i )
+		{
+			const uint8_t* str_iter = text;
+			while( *str_iter )
+				str_iter = utf8_lookup_perform_std_cmp( compare_unordered_map, str_iter, res, &res_size );
+		}
+		test_cases[3].runtime = cpu_tick() - start;
+	}
+
+	{
+		utf8_lookup_result res[256];
+		size_t res_size = ARRAY_LENGTH(res);
+
+		uint64_t start = cpu_tick();
+
+		for( int i = 0; i < 100; ++i )
+		{
+			const uint8_t* str_iter = text;
+			while( *str_iter )
+				str_iter = utf8_lookup_perform_bitarray_cmp_scalar( bitarray, str_iter, res, &res_size );
+		}
+		test_cases[4].runtime = cpu_tick() - start;
+	}
+
+	{
+		utf8_lookup_result res[256];
+		size_t res_size = ARRAY_LENGTH(res);
+
+		uint64_t start = cpu_tick();
+
+		for( int i = 0; i < 100; ++i )
+		{
+			const uint8_t* str_iter = text;
+			while( *str_iter )
+				str_iter = utf8_lookup_perform_bitarray_cmp_popcnt( bitarray, str_iter, res, &res_size );
+		}
+		test_cases[5].runtime = cpu_tick() - start;
+	}
+
+	size_t missing[3] = { 0, 0, 0 };
+	{
+		utf8_lookup_result res[256];
+
+		uint64_t start = cpu_tick();
+
+		for( int i = 0; i < 100; ++i )
+		{
+			const uint8_t* str_iter = text;
+			while( *str_iter )
+			{
+				size_t res_size = ARRAY_LENGTH(res);
+				str_iter = utf8_lookup_perform( table, str_iter, res, &res_size );
+				for( size_t j = 0; j < res_size; ++j )
+					missing[0] += res[j].offset == 0;
+			}
+		}
+		test_cases[6].runtime = cpu_tick() - start;
+	}
+
+	{
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < 100; ++i )
+			missing[1] += utf8_lookup_count_missing( table, text );
+		test_cases[7].runtime = cpu_tick() - start;
+	}
+
+	{
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < 100; ++i )
+			missing[2] += (size_t)!utf8_lookup_all_present( table, text );
+		test_cases[8].runtime = cpu_tick() - start;
+	}
+
+	size_t membership_missing[2] = { 0, 0 };
+	{
+		uint64_t found_bits[4];
+
+		uint64_t start = cpu_tick();
+
+		for( int i = 0; i < 100; ++i )
+		{
+			const uint8_t* str_iter = text;
+			while( *str_iter )
+			{
+				size_t res_size = 256;
+				str_iter = utf8_lookup_perform_membership( membership, str_iter, found_bits, &res_size );
+				for( size_t j = 0; j < ( res_size + 63 ) / 64; ++j )
+				{
+					uint64_t valid = ( j + 1 ) * 64 <= res_size ? ~(uint64_t)0 : ( (uint64_t)1 << ( res_size & 63 ) ) - 1;
+					for( uint64_t miss = ~found_bits[j] & valid; miss != 0; miss &= miss - 1 )
+						++membership_missing[0];
+				}
+			}
+		}
+		test_cases[9].runtime = cpu_tick() - start;
+	}
+
+	{
+		uint64_t start = cpu_tick();
+		for( int i = 0; i < 100; ++i )
+			membership_missing[1] += utf8_lookup_membership_count_missing( membership, text );
+		test_cases[10].runtime = cpu_tick() - start;
+	}
+
+	// ... decoding the chars again after lookup, as a shaper would without perform_ex ...
+	unsigned int cp_sum[2] = { 0, 0 };
+	{
+		utf8_lookup_result res[256];
+
+		uint64_t start = cpu_tick();
+
+		for( int i = 0; i < 100; ++i )
+		{
+			const uint8_t* str_iter = text;
+			while( *str_iter )
+			{
+				size_t res_size = ARRAY_LENGTH(res);
+				str_iter = utf8_lookup_perform( table, str_iter, res, &res_size );
+				for( size_t j = 0; j < res_size; ++j )
+				{
+					const uint8_t* pos = res[j].pos;
+					cp_sum[0] += utf8_to_unicode_codepoint( &pos ) + (unsigned int)( pos - res[j].pos );
+				}
+			}
+		}
+		test_cases[11].runtime = cpu_tick() - start;
+	}
+
+	{
+		utf8_lookup_result_ex res[256];
+
+		uint64_t start = cpu_tick();
+
+		for( int i = 0; i < 100; ++i )
+		{
+			const uint8_t* str_iter = text;
+			while( *str_iter )
+			{
+				size_t res_size = ARRAY_LENGTH(res);
+				str_iter = utf8_lookup_perform_ex( table, str_iter, res, &res_size );
+				for( size_t j = 0; j < res_size; ++j )
+					cp_sum[1] += res[j].codepoint + res[j].length;
+			}
+		}
+		test_cases[12].runtime = cpu_tick() - start;
+	}
+
+	if( cp_sum[0] != cp_sum[1] )
+		printf( "perform_ex decode mismatch!\n" );
+	free( membership );
+
+	if( missing[0] != 0 || missing[1] != 0 || missing[2] != 0 || membership_missing[0] != 0 || membership_missing[1] != 0 )
+		printf( "coverage mismatch, table built from text should cover all of it! %zu %zu %zu %zu %zu\n", missing[0], missing[1], missing[2], membership_missing[0], membership_missing[1] );
+
+	printf("%-20s%-20s%-20s%-20s%-20s%-20s%-20s\n", "name", "allocs", "frees", "memused (kb)", "bytes/codepoint", "ms/10000 cp", "GB/sec");
+	for( size_t i = 0; i < ARRAY_LENGTH(test_cases); ++i )
+	{
+		printf("%-20s%-20zu%-20zu%-20f%-20f%-20f%-20f\n", test_cases[i].name,
+										  	   		 	  test_cases[i].allocs,
+													 	  test_cases[i].frees,
+										  	   		 	  (float)test_cases[i].memused / 1024.0f,
+													 	  (float)(test_cases[i].memused) / (float)cps.size(),
+											   		 	  (cpu_ticks_to_ms( test_cases[i].runtime ) / (float)txt_cp_count) * 1000.0f,
+											   		 	  ( (float)file_size / ( 1024 * 1024 ) ) / cpu_ticks_to_sec( test_cases[i].runtime ));
+	}
+
+	// check output!
+	{
+		utf8_lookup_result res1[256];
+		utf8_lookup_result res2[256];
+		utf8_lookup_result res3[256];
+		size_t res_size1 = 256;
+		size_t res_size2 = 256;
+		size_t res_size3 = 256;
+
+		memset( res1, 0x0, sizeof(res1) );
+		memset( res2, 0x0, sizeof(res2) );
+		memset( res3, 0x0, sizeof(res3) );
+
+		const uint8_t* str_iter1 = text;
+		const uint8_t* str_iter2 = text;
+		const uint8_t* str_iter3 = text;
+
+		unsigned int chars = 0;
+		unsigned int num_missmatch = 0;
+
+		int loop = 0;
+		bool print = true;
+		while( *str_iter1 && *str_iter2 )
+		{
+			str_iter1 = utf8_lookup_perform_std_cmp( compare_unordered_map, str_iter1, res1, &res_size1 );
+			str_iter2 = utf8_lookup_perform( table, str_iter2, res2, &res_size2 );
+			str_iter3 = utf8_lookup_perform_bitarray_cmp_popcnt( bitarray, str_iter3, res3, &res_size3 );
+
+			if( str_iter1 != str_iter2 ) { printf("mismatching str_iter!\n"); break; }
+			if( str_iter1 != str_iter3 ) { printf("mismatching str_iter!\n"); break; }
+			if( res_size1 != res_size2 ) { printf("mismatching res_size!\n"); break; }
+			if( res_size1 != res_size3 ) { printf("mismatching res_size!\n"); break; }
+
+			for( size_t i = 0; i < res_size1; ++i )
+			{
+				++chars;
+
+				if( res1[i].pos != res2[i].pos )
+				{
+					if( print )
+						printf("%d[%lu] = pos mismatch! %p %p\n", loop, i, res1[i].pos, res2[i].pos);
+				}
+
+				if( res1[i].pos != res3[i].pos )
+				{
+					if( print )
+						printf("%d[%lu] = pos mismatch! %p %p\n", loop, i, res1[i].pos, res3[i].pos);
+				}
+
+				if( res1[i].offset != res2[i].offset )
+				{
+					if( print )
+					{
+						printf("%d[%lu] = %u %u\n", loop, i, res1[i].offset, res2[i].offset );
 						uint8_t test[4] = { res1[i].pos[0], res1[i].pos[1], res1[i].pos[2], '\0' };
 						printf("char %s\n", test);
 						print = false;
@@ -656,6 +2351,24 @@ static void run_test_case(const char* test_text_file)
 		}
 	}
 
+	collect_missing_bench( text, cps );
+	set_op_bench( cps );
+	successor_bench( table, cps );
+	perform_all_bench( table, text );
+	utf16_utf32_bench( table, text );
+	perform_runs_bench( text, cps );
+	lookup_map_bench( text, cps );
+	class_runs_bench( text );
+	kerning_bench( table, text, cps );
+	measure_bench( table, text, cps );
+	break_lines_bench( table, text, cps );
+	to_utf16_bench( table, text );
+	hot_table_bench( text, cps );
+
+#if defined(__linux__)
+	shared_table_rss_report( cps );
+#endif
+
 	free( text_data );
 	free( table );
 	free( bitarray.lookup );
@@ -672,5 +2385,8 @@ int main( int argc, char** argv )
 	for( int i = 1; i < argc; ++i )
 		run_test_case(argv[i]);
 
+	sequence_bench();
+	parallel_bench( argc - 1, argv + 1 );
+
 	return 0;
 }
@@ -28,9 +28,26 @@
 
 #include "greatest.h"
 
+#if !defined(_WIN32)
+#  define UTF8_LOOKUP_ENABLE_SHARED_TABLES
+#  define UTF8_LOOKUP_SHARED_TABLE_TIMEOUT_MS 200 // do not wait seconds for segments that are never published
+#endif
+
+#define UTF8_LOOKUP_ENABLE_THREADS
+#define UTF8_LOOKUP_PARALLEL_MIN_SLICE 256 // small slices to get many splits in the test-texts
+
 #define UTF8_LOOKUP_IMPLEMENTATION
 #include "../utf8_lookup.h"
 
+#include <atomic>
+#include <thread>
+
+#if !defined(_WIN32)
+#  include <sys/mman.h>
+#  include <sys/wait.h>
+#  include <unistd.h>
+#endif
+
 #define ARRAY_LENGTH( arr ) ( sizeof( arr )/sizeof( arr[0] ) )
 
 void print_as_bf( uint64_t value )
@@ -594,6 +611,2408 @@ TEST octet_1_2_3_and_4()
 	return 0;
 }
 
+TEST read_only_table()
+{
+#if defined(_WIN32)
+	SKIPm( "read-only mapping only tested on posix" );
+#else
+	unsigned int test_cps[] = { 'a', 228, 0x1024, 0x10801 };
+
+	size_t size;
+	utf8_lookup_calc_table_size( &size, test_cps, ARRAY_LENGTH(test_cps) );
+
+	void* mem = mmap( 0x0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+	ASSERT( mem != MAP_FAILED );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_gen_table( mem, size, test_cps, ARRAY_LENGTH(test_cps) ) );
+
+	// ... any write from the lookup will now fault ...
+	ASSERT_EQ( 0, mprotect( mem, size, PROT_READ ) );
+	const void* table = mem;
+
+	const uint8_t* str = (const uint8_t*)"a"
+										 "\xc3\xa4"          // ä
+										 "\xe1\x80\xa4"      // 0x1024
+										 "\xf0\x90\xa0\x81"  // 0x10801
+										 "b";
+	utf8_lookup_result res[128];
+	size_t res_size = ARRAY_LENGTH( res );
+
+	str = utf8_lookup_perform( table, str, res, &res_size );
+
+	ASSERT_EQ( 5u, res_size );
+	ASSERT_EQ( 1u, res[0].offset );
+	ASSERT_EQ( 2u, res[1].offset );
+	ASSERT_EQ( 3u, res[2].offset );
+	ASSERT_EQ( 4u, res[3].offset );
+	ASSERT_EQ( 0u, res[4].offset );
+
+	munmap( mem, size );
+#endif
+	return 0;
+}
+
+TEST fallback_chain()
+{
+	unsigned int primary_cps[]  = { 'a', 'b', 'c' };
+	unsigned int fallback1_cps[] = { 'b', 'd', 228 };               // b shadowed by primary
+	unsigned int fallback2_cps[] = { 'e', 228, 0x1024, 0x10801 };  // ä shadowed by fallback1
+
+	uint8_t primary[256];
+	uint8_t fallback1[256];
+	uint8_t fallback2[512];
+	pack_table( primary,   sizeof(primary),   primary_cps,   ARRAY_LENGTH(primary_cps) );
+	pack_table( fallback1, sizeof(fallback1), fallback1_cps, ARRAY_LENGTH(fallback1_cps) );
+	pack_table( fallback2, sizeof(fallback2), fallback2_cps, ARRAY_LENGTH(fallback2_cps) );
+
+	const void* tables[] = { primary, fallback1, fallback2 };
+
+	const uint8_t* str = (const uint8_t*)"cbde"
+										 "\xc3\xa4"          // ä
+										 "\xe1\x80\xa4"      // 0x1024
+										 "\xf0\x90\xa0\x81"  // 0x10801
+										 "q";                 // ... do not exist in any table ...
+
+	utf8_lookup_fallback_result res[128];
+	size_t res_size = ARRAY_LENGTH( res );
+
+	const uint8_t* end = utf8_lookup_perform_fallback( tables, ARRAY_LENGTH(tables), str, res, &res_size );
+
+	ASSERT_EQ( 8u, res_size );
+	ASSERT_EQ( '\0', *end );
+
+	unsigned int expect_table[]  = { 0, 0, 1, 2, 1, 2, 2, 0 };
+	unsigned int expect_offset[] = { 3, 2, 2, 1, 3, 3, 4, 0 };
+	size_t       expect_pos[]    = { 0, 1, 2, 3, 4, 6, 9, 13 };
+
+	for( size_t i = 0; i < res_size; ++i )
+	{
+		ASSERT_EQ( expect_table[i],  res[i].table );
+		ASSERT_EQ( expect_offset[i], res[i].offset );
+		ASSERT_EQ( str + expect_pos[i], res[i].pos );
+	}
+
+	// ... limited result-buffer should resume where it stopped ...
+	res_size = 3;
+	const uint8_t* rest = utf8_lookup_perform_fallback( tables, ARRAY_LENGTH(tables), str, res, &res_size );
+	ASSERT_EQ( 3u, res_size );
+	ASSERT_EQ( str + 3, rest );
+
+	return 0;
+}
+
+TEST merged_table()
+{
+	unsigned int primary_cps[]   = { 'a', 'b', 'c' };
+	unsigned int fallback1_cps[] = { 'b', 'd', 228 };
+	unsigned int fallback2_cps[] = { 'e', 228, 0x1024, 0x10801 };
+
+	const unsigned int* sets[]     = { primary_cps, fallback1_cps, fallback2_cps };
+	unsigned int        set_size[] = { ARRAY_LENGTH(primary_cps), ARRAY_LENGTH(fallback1_cps), ARRAY_LENGTH(fallback2_cps) };
+
+	size_t size;
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_calc_merged_table_size( &size, sets, set_size, ARRAY_LENGTH(sets) ) );
+
+	uint8_t table[512];
+	ASSERT( size < sizeof(table) );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_BUFFER_TO_SMALL, utf8_lookup_gen_merged_table( table, size - 1, sets, set_size, ARRAY_LENGTH(sets) ) );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_gen_merged_table( table, size, sets, set_size, ARRAY_LENGTH(sets) ) );
+
+	uint8_t primary[256];
+	uint8_t fallback1[256];
+	uint8_t fallback2[512];
+	pack_table( primary,   sizeof(primary),   primary_cps,   ARRAY_LENGTH(primary_cps) );
+	pack_table( fallback1, sizeof(fallback1), fallback1_cps, ARRAY_LENGTH(fallback1_cps) );
+	pack_table( fallback2, sizeof(fallback2), fallback2_cps, ARRAY_LENGTH(fallback2_cps) );
+	const void* tables[] = { primary, fallback1, fallback2 };
+
+	const uint8_t* str = (const uint8_t*)"cbdeaq"
+										 "\xc3\xa4"          // ä
+										 "\xe1\x80\xa4"      // 0x1024
+										 "\xe1\x80\xa5"      // ... do not exist in any table ...
+										 "\xf0\x90\xa0\x81"; // 0x10801
+
+	utf8_lookup_fallback_result merged_res[128];
+	utf8_lookup_fallback_result chain_res[128];
+	size_t merged_size = ARRAY_LENGTH( merged_res );
+	size_t chain_size  = ARRAY_LENGTH( chain_res );
+
+	const uint8_t* merged_end = utf8_lookup_perform_merged( table, str, merged_res, &merged_size );
+	const uint8_t* chain_end  = utf8_lookup_perform_fallback( tables, ARRAY_LENGTH(tables), str, chain_res, &chain_size );
+
+	ASSERT_EQ( 10u, merged_size );
+	ASSERT_EQ( chain_size, merged_size );
+	ASSERT_EQ( chain_end, merged_end );
+
+	for( size_t i = 0; i < merged_size; ++i )
+	{
+		ASSERT_EQ( chain_res[i].pos,    merged_res[i].pos );
+		ASSERT_EQ( chain_res[i].table,  merged_res[i].table );
+		ASSERT_EQ( chain_res[i].offset, merged_res[i].offset );
+	}
+
+	ASSERT_EQ( 2u, merged_res[1].offset ); // b from primary, not fallback1
+	ASSERT_EQ( 0u, merged_res[1].table );
+	ASSERT_EQ( 0u, merged_res[5].offset ); // q
+	ASSERT_EQ( 0u, merged_res[5].table );
+	ASSERT_EQ( 3u, merged_res[6].offset ); // ä from fallback1, not fallback2
+	ASSERT_EQ( 1u, merged_res[6].table );
+
+	return 0;
+}
+
+TEST merged_table_limits()
+{
+	// ... 2 sets that each fit in a table, but not the union of them ...
+	unsigned int* cps_a = (unsigned int*)malloc( 0x9000 * sizeof( unsigned int ) );
+	unsigned int* cps_b = (unsigned int*)malloc( 0x9000 * sizeof( unsigned int ) );
+	for( unsigned int i = 0; i < 0x9000; ++i )
+	{
+		cps_a[i] = 0x10000 + i * 2;
+		cps_b[i] = 0x10001 + i * 2;
+	}
+	const unsigned int* sets[]     = { cps_a, cps_b };
+	unsigned int        set_size[] = { 0x9000, 0x9000 };
+
+	size_t size = 0;
+	uint8_t table[256];
+	utf8_lookup_error calc_err = utf8_lookup_calc_merged_table_size( &size, sets, set_size, 2 );
+	utf8_lookup_error gen_err  = utf8_lookup_gen_merged_table( table, sizeof( table ), sets, set_size, 2 );
+	utf8_lookup_error ok_err   = utf8_lookup_calc_merged_table_size( &size, sets, set_size, 1 );
+	free( cps_a );
+	free( cps_b );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_TOO_MANY_CODEPOINTS, calc_err );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_TOO_MANY_CODEPOINTS, gen_err );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, ok_err );
+
+	// ... the set-index is 16 bit ...
+	unsigned int        one_cp[]  = { 'a' };
+	static const unsigned int* many_sets[0x10000];
+	static unsigned int        many_size[0x10000];
+	for( unsigned int i = 0; i < 0x10000; ++i )
+	{
+		many_sets[i] = one_cp;
+		many_size[i] = 1;
+	}
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_TOO_MANY_CODEPOINTS, utf8_lookup_calc_merged_table_size( &size, many_sets, many_size, 0x10000 ) );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_calc_merged_table_size( &size, many_sets, many_size, 0xFFFF ) );
+
+	// ... no sets at all is an empty table ...
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_calc_merged_table_size( &size, sets, set_size, 0 ) );
+	ASSERT( size <= sizeof( table ) );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_gen_merged_table( table, size, sets, set_size, 0 ) );
+	utf8_lookup_fallback_result res[2];
+	size_t res_size = ARRAY_LENGTH( res );
+	utf8_lookup_perform_merged( table, (const uint8_t*)"a", res, &res_size );
+	ASSERT_EQ( 1u, res_size );
+	ASSERT_EQ( 0u, res[0].offset );
+	return 0;
+}
+
+static size_t count_missing_reference( const void* table, const uint8_t* str )
+{
+	size_t missing = 0;
+	while( *str )
+	{
+		utf8_lookup_result res[16];
+		size_t res_size = ARRAY_LENGTH( res );
+		str = utf8_lookup_perform( table, str, res, &res_size );
+		for( size_t i = 0; i < res_size; ++i )
+			missing += res[i].offset == 0;
+	}
+	return missing;
+}
+
+TEST count_missing()
+{
+	unsigned int test_cps[] = { ' ', ',', '.', 'a', 'b', 'c', 'd', 'e', 'f', 'x', 'y', 'z', 228, 0x1024, 0x10801 };
+
+	uint8_t table[512];
+	pack_table( table, sizeof(table), test_cps, ARRAY_LENGTH(test_cps) );
+
+	ASSERT_EQ( 0u, utf8_lookup_count_missing( table, (const uint8_t*)"" ) );
+	ASSERT_EQ( 1,  utf8_lookup_all_present( table, (const uint8_t*)"" ) );
+
+	// ... long ascii-runs to hit the simd-path at all alignments, with misses inside and outside of blocks ...
+	static const char* parts[] = { "abc def, xyz. ", "\xc3\xa4", "abcdefabcdefabcdefabcdefabcdefabcdefabcdef", "Q",
+								   "\xe1\x80\xa4", "zzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzz!zzzzzzzzzzzzzzzz", "\xf0\x90\xa0\x81",
+								   "\xe1\x80\xa5", "fedcba fedcba fedcba fedcba fedcba fedcba fedcba fedcba~" };
+
+	char text[512];
+	char buffer[512 + 16];
+	text[0] = '\0';
+	for( size_t i = 0; i < ARRAY_LENGTH( parts ); ++i )
+		strcat( text, parts[i] );
+
+	for( size_t align = 0; align < 16; ++align )
+	{
+		uint8_t* str = (uint8_t*)buffer + align;
+		strcpy( (char*)str, text );
+		ASSERT_EQ( count_missing_reference( table, str ), utf8_lookup_count_missing( table, str ) );
+		ASSERT_EQ( 4u, utf8_lookup_count_missing( table, str ) );
+		ASSERT_EQ( 0,  utf8_lookup_all_present( table, str ) );
+
+		// ... only the last char missing ...
+		memset( str, 'a', 200 );
+		str[200] = 'Q';
+		str[201] = '\0';
+		ASSERT_EQ( 1u, utf8_lookup_count_missing( table, str ) );
+		ASSERT_EQ( 0,  utf8_lookup_all_present( table, str ) );
+
+		str[200] = 'b';
+		ASSERT_EQ( 0u, utf8_lookup_count_missing( table, str ) );
+		ASSERT_EQ( 1,  utf8_lookup_all_present( table, str ) );
+	}
+
+	return 0;
+}
+
+TEST collect_missing()
+{
+	unsigned int test_cps[] = { 'a', 'b', 'c', 228, 0x1024 };
+
+	uint8_t table[512];
+	pack_table( table, sizeof(table), test_cps, ARRAY_LENGTH(test_cps) );
+
+	uint64_t* missing_bits = (uint64_t*)calloc( UTF8_LOOKUP_MISSING_BITS_WORDS, sizeof( uint64_t ) );
+
+	const uint8_t* str = (const uint8_t*)"zabq"
+										 "\xe1\x80\xa5"       // 0x1025
+										 "\xc3\xa4"           // ä, exists
+										 "zz"
+										 "\xf0\x90\xa0\x81"   // 0x10801
+										 "\xe1\x80\xa5"       // 0x1025
+										 "q\xc3\xa5z";         // å
+
+	unsigned int codepoints[16];
+	unsigned int counts[16];
+	size_t num_codepoints = ARRAY_LENGTH( codepoints );
+
+	size_t num_missing = 0;
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_collect_missing( table, str, missing_bits, codepoints, counts, &num_codepoints, &num_missing ) );
+	ASSERT_EQ( 10u, num_missing );
+	ASSERT_EQ( 5u, num_codepoints );
+
+	unsigned int expect_cps[]    = { 'q', 'z', 229, 0x1025, 0x10801 };
+	unsigned int expect_counts[] = {  2,   4,   1,  2,      1 };
+	for( size_t i = 0; i < num_codepoints; ++i )
+	{
+		ASSERT_EQ( expect_cps[i],    codepoints[i] );
+		ASSERT_EQ( expect_counts[i], counts[i] );
+	}
+
+	for( size_t i = 0; i < UTF8_LOOKUP_MISSING_BITS_WORDS; ++i )
+		ASSERT_EQ( 0u, missing_bits[i] );
+
+	// ... without counts and too small buffer, the smallest codepoints are returned ...
+	num_codepoints = 2;
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_BUFFER_TO_SMALL, utf8_lookup_collect_missing( table, str, missing_bits, codepoints, 0x0, &num_codepoints, &num_missing ) );
+	ASSERT_EQ( 10u, num_missing );
+	ASSERT_EQ( 2u, num_codepoints );
+	ASSERT_EQ( (unsigned int)'q', codepoints[0] );
+	ASSERT_EQ( (unsigned int)'z', codepoints[1] );
+
+	for( size_t i = 0; i < UTF8_LOOKUP_MISSING_BITS_WORDS; ++i )
+		ASSERT_EQ( 0u, missing_bits[i] );
+
+	// ... exactly fitting buffer is not truncated, with counts ...
+	num_codepoints = 5;
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_collect_missing( table, str, missing_bits, codepoints, counts, &num_codepoints, &num_missing ) );
+	ASSERT_EQ( 5u, num_codepoints );
+	num_codepoints = 3;
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_BUFFER_TO_SMALL, utf8_lookup_collect_missing( table, str, missing_bits, codepoints, counts, &num_codepoints, &num_missing ) );
+	ASSERT_EQ( 3u, num_codepoints );
+	for( size_t i = 0; i < num_codepoints; ++i )
+	{
+		ASSERT_EQ( expect_cps[i],    codepoints[i] );
+		ASSERT_EQ( expect_counts[i], counts[i] );
+	}
+
+	for( size_t i = 0; i < UTF8_LOOKUP_MISSING_BITS_WORDS; ++i )
+		ASSERT_EQ( 0u, missing_bits[i] );
+
+	// ... more unique missing codepoints than can be counted, codepoints is still returned ...
+	uint8_t* many = (uint8_t*)malloc( 0x10000 * 4 + 1 );
+	uint8_t* out  = many;
+	for( unsigned int cp = 0x20000; cp < 0x30000; ++cp )
+	{
+		*out++ = (uint8_t)( 0xF0 | ( cp >> 18 ) );
+		*out++ = (uint8_t)( 0x80 | ( ( cp >> 12 ) & 63 ) );
+		*out++ = (uint8_t)( 0x80 | ( ( cp >> 6 ) & 63 ) );
+		*out++ = (uint8_t)( 0x80 | ( cp & 63 ) );
+	}
+	*out = 0;
+
+	unsigned int* many_cps    = (unsigned int*)malloc( 0x10000 * sizeof( unsigned int ) );
+	unsigned int* many_counts = (unsigned int*)malloc( 0x10000 * sizeof( unsigned int ) );
+	num_codepoints = 0x10000;
+	utf8_lookup_error err = utf8_lookup_collect_missing( table, many, missing_bits, many_cps, many_counts, &num_codepoints, &num_missing );
+	int counts_zeroed = 1;
+	for( size_t i = 0; i < num_codepoints; ++i )
+		counts_zeroed &= many_counts[i] == 0;
+	unsigned int first_cp = many_cps[0];
+	unsigned int last_cp  = many_cps[0xFFFF];
+	free( many_counts );
+	free( many_cps );
+	free( many );
+
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_TOO_MANY_CODEPOINTS, err );
+	ASSERT_EQ( 0x10000u, num_codepoints );
+	ASSERT_EQ( 0x10000u, num_missing );
+	ASSERT_EQ( 0x20000u, first_cp );
+	ASSERT_EQ( 0x2FFFFu, last_cp );
+	ASSERT( counts_zeroed );
+
+	for( size_t i = 0; i < UTF8_LOOKUP_MISSING_BITS_WORDS; ++i )
+		ASSERT_EQ( 0u, missing_bits[i] );
+
+	free( missing_bits );
+	return 0;
+}
+
+TEST reverse_lookup()
+{
+	unsigned int test_cps[] = { 'A', 'B', 'b', 'd', 130, 165, 228, 229, 246, 0x7CF, 0x7FF,
+								0x800, 0x1024, 0x1025, 0xFFFF, 0x10000, 0x10801, 0x10802, 0x10FFFF };
+
+	uint8_t table[512];
+	pack_table( table, sizeof(table), test_cps, ARRAY_LENGTH(test_cps) );
+
+	for( unsigned int i = 0; i < ARRAY_LENGTH(test_cps); ++i )
+	{
+		unsigned int cp = 0;
+		ASSERT_EQ( 1, utf8_lookup_codepoint_from_offset( table, i + 1, &cp ) );
+		ASSERT_EQ( test_cps[i], cp );
+	}
+
+	unsigned int cp;
+	ASSERT_EQ( 0, utf8_lookup_codepoint_from_offset( table, 0, &cp ) );
+	ASSERT_EQ( 0, utf8_lookup_codepoint_from_offset( table, ARRAY_LENGTH(test_cps) + 1, &cp ) );
+
+	utf8_lookup_iterator it;
+	utf8_lookup_iterator_init( &it, table );
+	unsigned int num_visited = 0;
+	unsigned int offset;
+	while( utf8_lookup_iterator_next( &it, &cp, &offset ) )
+	{
+		ASSERT( num_visited < ARRAY_LENGTH(test_cps) );
+		ASSERT_EQ( test_cps[num_visited], cp );
+		ASSERT_EQ( num_visited + 1, offset );
+		++num_visited;
+	}
+	ASSERT_EQ( ARRAY_LENGTH(test_cps), num_visited );
+
+	return 0;
+}
+
+TEST reverse_lookup_large()
+{
+	// ... spread out over the whole range to get many elements on all levels ...
+	unsigned int num_cps = 0;
+	unsigned int* test_cps = (unsigned int*)malloc( 0x110000 / 37 * sizeof(unsigned int) + sizeof(unsigned int) );
+	for( unsigned int cp = 1; cp < 0x110000; cp += 37 )
+		test_cps[num_cps++] = cp;
+
+	size_t size;
+	utf8_lookup_calc_table_size( &size, test_cps, num_cps );
+	void* table = malloc( size );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_gen_table( table, size, test_cps, num_cps ) );
+
+	utf8_lookup_iterator it;
+	utf8_lookup_iterator_init( &it, table );
+	unsigned int i = 0;
+	unsigned int cp, offset;
+	while( utf8_lookup_iterator_next( &it, &cp, &offset ) )
+	{
+		ASSERT( i < num_cps );
+		ASSERT_EQ( test_cps[i], cp );
+		ASSERT_EQ( i + 1, offset );
+
+		unsigned int reverse_cp = 0;
+		ASSERT_EQ( 1, utf8_lookup_codepoint_from_offset( table, offset, &reverse_cp ) );
+		ASSERT_EQ( cp, reverse_cp );
+		++i;
+	}
+	ASSERT_EQ( num_cps, i );
+
+	free( table );
+	free( test_cps );
+	return 0;
+}
+
+static int set_op_check( const void* table_a, const void* table_b, utf8_lookup_set_op op, const unsigned int* expect, unsigned int num_expect )
+{
+	size_t size;
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_calc_set_op_table_size( &size, table_a, table_b, op ) );
+	void* table = malloc( size );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_BUFFER_TO_SMALL, utf8_lookup_gen_set_op_table( table, size - 1, table_a, table_b, op ) );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_gen_set_op_table( table, size, table_a, table_b, op ) );
+
+	// ... should be as compact as building from the codepoints ...
+	size_t gen_size;
+	utf8_lookup_calc_table_size( &gen_size, expect, num_expect );
+	ASSERT_EQ( gen_size, size );
+
+	utf8_lookup_iterator it;
+	utf8_lookup_iterator_init( &it, table );
+	unsigned int i = 0;
+	unsigned int cp, offset;
+	while( utf8_lookup_iterator_next( &it, &cp, &offset ) )
+	{
+		ASSERT( i < num_expect );
+		ASSERT_EQ( expect[i], cp );
+		ASSERT_EQ( i + 1, offset );
+		++i;
+	}
+	ASSERT_EQ( num_expect, i );
+
+	free( table );
+	return 0;
+}
+
+TEST set_op_simple()
+{
+	unsigned int a_cps[] = { 'a', 'b', 0xE4, 0x1024, 0x10000 };
+	unsigned int b_cps[] = { 'b', 'c', 0x1024, 0x1025 };
+	unsigned int union_cps[] = { 'a', 'b', 'c', 0xE4, 0x1024, 0x1025, 0x10000 };
+	unsigned int inter_cps[] = { 'b', 0x1024 };
+	unsigned int diff_cps[]  = { 'a', 0xE4, 0x10000 };
+
+	uint8_t table_a[2048];
+	uint8_t table_b[2048];
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_gen_table( table_a, sizeof( table_a ), a_cps, ARRAY_LENGTH( a_cps ) ) );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_gen_table( table_b, sizeof( table_b ), b_cps, ARRAY_LENGTH( b_cps ) ) );
+
+	ASSERT_EQ( 0, set_op_check( table_a, table_b, UTF8_LOOKUP_SET_UNION,        union_cps, ARRAY_LENGTH( union_cps ) ) );
+	ASSERT_EQ( 0, set_op_check( table_a, table_b, UTF8_LOOKUP_SET_INTERSECTION, inter_cps, ARRAY_LENGTH( inter_cps ) ) );
+	ASSERT_EQ( 0, set_op_check( table_a, table_b, UTF8_LOOKUP_SET_DIFFERENCE,   diff_cps,  ARRAY_LENGTH( diff_cps ) ) );
+
+	// ... empty result, all elements outside the roots should be removed ...
+	ASSERT_EQ( 0, set_op_check( table_a, table_a, UTF8_LOOKUP_SET_DIFFERENCE, 0x0, 0 ) );
+
+	// ... and a lookup in the result gives new offsets ...
+	size_t size;
+	utf8_lookup_calc_set_op_table_size( &size, table_a, table_b, UTF8_LOOKUP_SET_UNION );
+	void* table = malloc( size );
+	utf8_lookup_gen_set_op_table( table, size, table_a, table_b, UTF8_LOOKUP_SET_UNION );
+
+	const uint8_t* str = (const uint8_t*)"cq" "\xe1\x80\xa5";
+	utf8_lookup_result res[4];
+	size_t res_size = ARRAY_LENGTH( res );
+	utf8_lookup_perform( table, str, res, &res_size );
+	ASSERT_EQ( 3u, res_size );
+	ASSERT_EQ( 3u, res[0].offset );
+	ASSERT_EQ( 0u, res[1].offset );
+	ASSERT_EQ( 6u, res[2].offset );
+
+	free( table );
+	return 0;
+}
+
+TEST set_op_large()
+{
+	unsigned int* a_cps = (unsigned int*)malloc( 0x110000 / 37 * sizeof(unsigned int) + sizeof(unsigned int) );
+	unsigned int* b_cps = (unsigned int*)malloc( 0x110000 / 53 * sizeof(unsigned int) + sizeof(unsigned int) );
+	unsigned int* union_cps = (unsigned int*)malloc( 0x110000 / 20 * sizeof(unsigned int) );
+	unsigned int* inter_cps = (unsigned int*)malloc( 0x110000 / 20 * sizeof(unsigned int) );
+	unsigned int* diff_cps  = (unsigned int*)malloc( 0x110000 / 20 * sizeof(unsigned int) );
+	unsigned int num_a = 0, num_b = 0, num_union = 0, num_inter = 0, num_diff = 0;
+	for( unsigned int cp = 1; cp < 0x110000; ++cp )
+	{
+		int in_a = cp % 37 == 1;
+		int in_b = cp % 53 == 1;
+		if( in_a )          a_cps[num_a++] = cp;
+		if( in_b )          b_cps[num_b++] = cp;
+		if( in_a || in_b )  union_cps[num_union++] = cp;
+		if( in_a && in_b )  inter_cps[num_inter++] = cp;
+		if( in_a && !in_b ) diff_cps[num_diff++] = cp;
+	}
+
+	size_t size_a, size_b;
+	utf8_lookup_calc_table_size( &size_a, a_cps, num_a );
+	utf8_lookup_calc_table_size( &size_b, b_cps, num_b );
+	void* table_a = malloc( size_a );
+	void* table_b = malloc( size_b );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_gen_table( table_a, size_a, a_cps, num_a ) );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_gen_table( table_b, size_b, b_cps, num_b ) );
+
+	ASSERT_EQ( 0, set_op_check( table_a, table_b, UTF8_LOOKUP_SET_UNION,        union_cps, num_union ) );
+	ASSERT_EQ( 0, set_op_check( table_a, table_b, UTF8_LOOKUP_SET_INTERSECTION, inter_cps, num_inter ) );
+	ASSERT_EQ( 0, set_op_check( table_a, table_b, UTF8_LOOKUP_SET_DIFFERENCE,   diff_cps,  num_diff ) );
+
+	free( table_a );
+	free( table_b );
+	free( a_cps );
+	free( b_cps );
+	free( union_cps );
+	free( inter_cps );
+	free( diff_cps );
+	return 0;
+}
+
+static uint8_t* encode_utf8( uint8_t* out, unsigned int cp )
+{
+	if( cp < 0x80 )
+		*out++ = (uint8_t)cp;
+	else if( cp < 0x800 )
+	{
+		*out++ = (uint8_t)( 0xC0 | ( cp >> 6 ) );
+		*out++ = (uint8_t)( 0x80 | ( cp & 63 ) );
+	}
+	else if( cp < 0x10000 )
+	{
+		*out++ = (uint8_t)( 0xE0 | ( cp >> 12 ) );
+		*out++ = (uint8_t)( 0x80 | ( ( cp >> 6 ) & 63 ) );
+		*out++ = (uint8_t)( 0x80 | ( cp & 63 ) );
+	}
+	else
+	{
+		*out++ = (uint8_t)( 0xF0 | ( cp >> 18 ) );
+		*out++ = (uint8_t)( 0x80 | ( ( cp >> 12 ) & 63 ) );
+		*out++ = (uint8_t)( 0x80 | ( ( cp >> 6 ) & 63 ) );
+		*out++ = (uint8_t)( 0x80 | ( cp & 63 ) );
+	}
+	return out;
+}
+
+TEST membership_table()
+{
+	unsigned int num_cps = 0;
+	unsigned int* test_cps = (unsigned int*)malloc( 0x110000 / 37 * sizeof(unsigned int) + sizeof(unsigned int) );
+	for( unsigned int cp = 1; cp < 0x110000; cp += 37 )
+		test_cps[num_cps++] = cp;
+
+	size_t size;
+	utf8_lookup_calc_table_size( &size, test_cps, num_cps );
+	void* table = malloc( size );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_gen_table( table, size, test_cps, num_cps ) );
+
+	size_t membership_size;
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_calc_membership_table_size( &membership_size, test_cps, num_cps ) );
+	ASSERT( membership_size < size );
+	uint8_t* membership = (uint8_t*)malloc( membership_size + 1 );
+	membership[membership_size] = 0xFE;
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_BUFFER_TO_SMALL, utf8_lookup_gen_membership_table( membership, membership_size - 1, test_cps, num_cps ) );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_gen_membership_table( membership, membership_size, test_cps, num_cps ) );
+	ASSERT_EQ( 0xFE, membership[membership_size] );
+
+	// ... every 5th codepoint, hits and misses on all levels ...
+	uint8_t* text = (uint8_t*)malloc( 0x110000 / 5 * 4 + 1 );
+	uint8_t* out  = text;
+	for( unsigned int cp = 1; cp < 0x110000; cp += 5 )
+		out = encode_utf8( out, cp );
+	*out = '\0';
+
+	ASSERT_EQ( utf8_lookup_count_missing( table, text ), utf8_lookup_membership_count_missing( membership, text ) );
+	ASSERT_EQ( 0, utf8_lookup_membership_all_present( membership, text ) );
+	ASSERT_EQ( 1, utf8_lookup_membership_all_present( membership, (const uint8_t*)"\x01&" ) );
+
+	utf8_lookup_result res[100];
+	uint64_t found_bits[2];
+	const uint8_t* str = text;
+	const uint8_t* membership_str = text;
+	size_t total = 0;
+	while( *str )
+	{
+		size_t res_size = ARRAY_LENGTH( res );
+		size_t found_size = ARRAY_LENGTH( res );
+		str = utf8_lookup_perform( table, str, res, &res_size );
+		membership_str = utf8_lookup_perform_membership( membership, membership_str, found_bits, &found_size );
+		ASSERT_EQ( str, membership_str );
+		ASSERT_EQ( res_size, found_size );
+
+		for( size_t i = 0; i < res_size; ++i )
+			ASSERT_EQ( res[i].offset != 0, ( ( found_bits[i / 64] >> ( i & 63 ) ) & 1 ) != 0 );
+		total += res_size;
+	}
+	ASSERT_EQ( ( 0x110000 + 3 ) / 5, total );
+
+	free( text );
+	free( membership );
+	free( table );
+	free( test_cps );
+	return 0;
+}
+
+TEST successor_and_rank()
+{
+	unsigned int test_cps[] = { 'a', 'b', 'z', 0x7F, 0xE4, 0x7FF, 0x1024, 0x1025, 0xFFFF, 0x10000, 0x10801 };
+
+	uint8_t table[1024];
+	pack_table( table, sizeof(table), test_cps, ARRAY_LENGTH(test_cps) );
+
+	unsigned int cp, offset;
+	ASSERT_EQ( 1, utf8_lookup_successor( table, 0, &cp, &offset ) );
+	ASSERT_EQ( (unsigned int)'a', cp );
+	ASSERT_EQ( 1u, offset );
+	ASSERT_EQ( 1, utf8_lookup_successor( table, 'b', &cp, &offset ) );
+	ASSERT_EQ( (unsigned int)'b', cp );
+	ASSERT_EQ( 2u, offset );
+	ASSERT_EQ( 1, utf8_lookup_successor( table, 'c', &cp, &offset ) );
+	ASSERT_EQ( (unsigned int)'z', cp );
+	ASSERT_EQ( 1, utf8_lookup_successor( table, 0x80, &cp, &offset ) );   // over into the next root
+	ASSERT_EQ( 0xE4u, cp );
+	ASSERT_EQ( 5u, offset );
+	ASSERT_EQ( 1, utf8_lookup_successor( table, 0x800, &cp, 0x0 ) );
+	ASSERT_EQ( 0x1024u, cp );
+	ASSERT_EQ( 1, utf8_lookup_successor( table, 0x1026, &cp, &offset ) ); // up two levels and over to the next group
+	ASSERT_EQ( 0xFFFFu, cp );
+	ASSERT_EQ( 9u, offset );
+	ASSERT_EQ( 1, utf8_lookup_successor( table, 0x10001, &cp, &offset ) );
+	ASSERT_EQ( 0x10801u, cp );
+	ASSERT_EQ( 11u, offset );
+	ASSERT_EQ( 0, utf8_lookup_successor( table, 0x10802, &cp, &offset ) );
+	ASSERT_EQ( 0, utf8_lookup_successor( table, 0x110000, &cp, &offset ) );
+
+	ASSERT_EQ( 0u,  utf8_lookup_rank( table, 'a' ) );
+	ASSERT_EQ( 2u,  utf8_lookup_rank( table, 'c' + 1 ) );
+	ASSERT_EQ( 11u, utf8_lookup_rank( table, 0x10FFFF ) );
+	ASSERT_EQ( 11u, utf8_lookup_count_range( table, 0, 0x10FFFF ) );
+	ASSERT_EQ( 2u,  utf8_lookup_count_range( table, 0x1024, 0x1025 ) );
+	ASSERT_EQ( 0u,  utf8_lookup_count_range( table, 0x1026, 0xFFFE ) );
+	ASSERT_EQ( 0u,  utf8_lookup_count_range( table, 'z', 'a' ) );
+
+	// ... empty table ...
+	uint8_t empty[256];
+	pack_table( empty, sizeof(empty), test_cps, 0 );
+	ASSERT_EQ( 0, utf8_lookup_successor( empty, 0, &cp, &offset ) );
+	ASSERT_EQ( 0u, utf8_lookup_count_range( empty, 0, 0x10FFFF ) );
+	return 0;
+}
+
+TEST successor_and_rank_large()
+{
+	unsigned int num_cps = 0;
+	unsigned int* test_cps = (unsigned int*)malloc( 0x110000 / 37 * sizeof(unsigned int) + sizeof(unsigned int) );
+	for( unsigned int cp = 1; cp < 0x110000; cp += 37 )
+		test_cps[num_cps++] = cp;
+
+	size_t size;
+	utf8_lookup_calc_table_size( &size, test_cps, num_cps );
+	void* table = malloc( size );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_gen_table( table, size, test_cps, num_cps ) );
+
+	// ... compare with a linear scan over the sorted codepoints ...
+	unsigned int next = 0;
+	for( unsigned int cp = 0; cp < 0x110000; cp += 5 )
+	{
+		while( next < num_cps && test_cps[next] < cp )
+			++next;
+
+		unsigned int found_cp, offset;
+		int found = utf8_lookup_successor( table, cp, &found_cp, &offset );
+		ASSERT_EQ( next < num_cps ? 1 : 0, found );
+		if( found )
+		{
+			ASSERT_EQ( test_cps[next], found_cp );
+			ASSERT_EQ( next + 1, offset );
+		}
+		ASSERT_EQ( next, utf8_lookup_rank( table, cp ) );
+	}
+
+	ASSERT_EQ( num_cps, utf8_lookup_count_range( table, 0, 0x10FFFF ) );
+	ASSERT_EQ( 56u, utf8_lookup_count_range( table, 0x1000, 0x17FF ) ); // 0x100C - 0x17FF in steps of 37
+
+	free( table );
+	free( test_cps );
+	return 0;
+}
+
+TEST table_stats()
+{
+	unsigned int test_cps[] = { 'a', 'b', 'z', 0xE4, 0x1024, 0x1025, 0x10801 };
+
+	uint8_t table[1024];
+	pack_table( table, sizeof(table), test_cps, ARRAY_LENGTH(test_cps) );
+
+	size_t size;
+	utf8_lookup_calc_table_size( &size, test_cps, ARRAY_LENGTH(test_cps) );
+
+	utf8_lookup_stats stats;
+	utf8_lookup_table_stats( table, &stats );
+	ASSERT_EQ( size, stats.table_size );
+	ASSERT_EQ( stats.items * 8, stats.avail_bits_bytes );
+	ASSERT_EQ( stats.items * 2, stats.offsets_bytes );
+	ASSERT_EQ( 7u, stats.num_codepoints );
+	ASSERT_EQ( 11u, stats.max_offset );   // group-offset to the last element, larger than the 7 chars.
+
+	// roots: ascii 64-127, 2-byte, 3-byte and 4-byte.
+	ASSERT_EQ( 4u, stats.nodes_per_level[0] );
+	ASSERT_EQ( 6u, stats.bits_per_level[0] );   // a b z + 1 group each in the other roots.
+	ASSERT_EQ( 3u, stats.nodes_per_level[1] );  // E4, 0x1024 group, 0x10801 group
+	ASSERT_EQ( 3u, stats.bits_per_level[1] );
+	ASSERT_EQ( 2u, stats.nodes_per_level[2] );
+	ASSERT_EQ( 3u, stats.bits_per_level[2] );
+	ASSERT_EQ( 1u, stats.nodes_per_level[3] );
+	ASSERT_EQ( 1u, stats.bits_per_level[3] );
+	ASSERT_EQ( stats.items - 10, stats.unused_items );
+	ASSERT_EQ( 13.0f / ( 10.0f * 64.0f ), stats.avg_fill );
+	return 0;
+}
+
+static uint8_t* load_text( const char* name, size_t* size )
+{
+	char path[256];
+	snprintf( path, sizeof( path ), "test/texts/%s", name );
+	FILE* f = fopen( path, "rb" );
+	if( f == 0x0 )
+		return 0x0;
+	fseek( f, 0, SEEK_END );
+	*size = (size_t)ftell( f );
+	fseek( f, 0, SEEK_SET );
+	uint8_t* data = (uint8_t*)malloc( *size + 1 );
+	*size = fread( data, 1, *size, f );
+	data[*size] = 0;
+	fclose( f );
+	return data;
+}
+
+/**
+ * Feed text to a stream in chunks of all sizes 1 - 64 and check against lookup in the complete string.
+ */
+static int stream_chunks_check( const void* table, const uint8_t* text, size_t text_size )
+{
+	// ... reference, lookup in the complete string ...
+	size_t num_chars = 0;
+	for( size_t i = 0; i < text_size; ++i )
+		num_chars += ( text[i] & 0xC0 ) != 0x80;
+	utf8_lookup_result* expect = (utf8_lookup_result*)malloc( ( num_chars + 1 ) * sizeof( utf8_lookup_result ) );
+	size_t expect_size = num_chars;
+	utf8_lookup_perform( table, text, expect, &expect_size );
+	int ok = num_chars == expect_size;
+
+	for( size_t chunk_size = 1; ok && chunk_size <= 64; ++chunk_size )
+	{
+		utf8_lookup_stream stream;
+		utf8_lookup_stream_init( &stream, table );
+
+		size_t char_index = 0;
+		for( const uint8_t* chunk = text; ok && chunk < text + text_size; chunk += chunk_size )
+		{
+			const uint8_t* chunk_end = chunk + chunk_size < text + text_size ? chunk + chunk_size : text + text_size;
+			const uint8_t* pos = chunk;
+			do
+			{
+				// ... small result-buffer to also resume in the middle of a chunk ...
+				utf8_lookup_result res[5];
+				size_t res_size = ARRAY_LENGTH( res );
+				pos = utf8_lookup_stream_feed( &stream, pos, chunk_end, res, &res_size );
+
+				for( size_t i = 0; ok && i < res_size; ++i, ++char_index )
+				{
+					// ... chars split over chunks is returned pointing into stream.completed ...
+					ok = char_index < num_chars &&
+						 expect[char_index].offset == res[i].offset &&
+						 expect[char_index].pos[0] == res[i].pos[0] &&
+						 ( res[i].pos == stream.completed || expect[char_index].pos == res[i].pos );
+				}
+			}
+			while( ok && pos != chunk_end );
+		}
+
+		utf8_lookup_result res[1];
+		size_t res_size = ARRAY_LENGTH( res );
+		utf8_lookup_stream_finish( &stream, res, &res_size );
+		ok = ok && res_size == 0 && char_index == num_chars;
+	}
+
+	free( expect );
+	return ok ? 0 : 1;
+}
+
+TEST stream_chunks()
+{
+	static const char* texts[] = { "ancient_greek.txt", "chinese1.txt", "chinese2.txt", "chinese3.txt", "danish.txt",
+								   "esperanto.txt", "germain.txt", "japanese.txt", "japanese2.txt", "russian.txt",
+								   "stb_image.h" };
+
+	// ... all ascii and every 37th codepoint above that to get both hits and misses ...
+	unsigned int num_cps = 0;
+	unsigned int* test_cps = (unsigned int*)malloc( ( 128 + 0x110000 / 37 + 1 ) * sizeof(unsigned int) );
+	for( unsigned int cp = 1; cp < 128; ++cp )
+		test_cps[num_cps++] = cp;
+	for( unsigned int cp = 128; cp < 0x110000; cp += 37 )
+		test_cps[num_cps++] = cp;
+
+	size_t size;
+	utf8_lookup_calc_table_size( &size, test_cps, num_cps );
+	void* table = malloc( size );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_gen_table( table, size, test_cps, num_cps ) );
+
+	for( size_t t = 0; t < ARRAY_LENGTH( texts ); ++t )
+	{
+		size_t text_size;
+		uint8_t* text = load_text( texts[t], &text_size );
+		if( text == 0x0 )
+			SKIPm( "could not load test/texts, run from the repository root" );
+
+		int failed = stream_chunks_check( table, text, text_size );
+		free( text );
+		ASSERT_EQ( 0, failed );
+	}
+
+	// ... input ending in the middle of a char ...
+	const uint8_t* broken = (const uint8_t*)"a\xe1\x80";
+	utf8_lookup_stream stream;
+	utf8_lookup_stream_init( &stream, table );
+	utf8_lookup_result res[4];
+	size_t res_size = ARRAY_LENGTH( res );
+	ASSERT_EQ( broken + 3, utf8_lookup_stream_feed( &stream, broken, broken + 3, res, &res_size ) );
+	ASSERT_EQ( 1u, res_size );
+	res_size = ARRAY_LENGTH( res );
+	utf8_lookup_stream_finish( &stream, res, &res_size );
+	ASSERT_EQ( 1u, res_size );
+	ASSERT_EQ( 0u, res[0].offset );
+	ASSERT_EQ( 0xE1, res[0].pos[0] );
+
+	free( table );
+	free( test_cps );
+	return 0;
+}
+
+TEST count_chars_and_perform_all()
+{
+	unsigned int test_cps[] = { 'a', 'b', 0xE4, 0x1024, 0x10801 };
+
+	uint8_t table[512];
+	pack_table( table, sizeof(table), test_cps, ARRAY_LENGTH(test_cps) );
+
+	// ... long enough to overflow the per-byte counters in the simd-path, mixed char-lengths ...
+	static const char* parts[] = { "ab", "\xc3\xa4", "\xe1\x80\xa4", "\xf0\x90\xa0\x81", "q" };
+	const size_t text_cap = 16 * 1024;
+	uint8_t* buffer = (uint8_t*)malloc( text_cap + 16 );
+	utf8_lookup_result* res    = (utf8_lookup_result*)malloc( text_cap * sizeof( utf8_lookup_result ) );
+	utf8_lookup_result* expect = (utf8_lookup_result*)malloc( text_cap * sizeof( utf8_lookup_result ) );
+
+	for( size_t align = 0; align < 16; ++align )
+	{
+		for( size_t len = 0; len < text_cap - 16; len = len * 2 + 5 )
+		{
+			uint8_t* text = buffer + align;
+			size_t text_len = 0;
+			size_t num_chars = 0;
+			for( size_t i = 0; text_len < len; ++i )
+			{
+				const char* part = parts[ i % ARRAY_LENGTH( parts ) ];
+				memcpy( text + text_len, part, strlen( part ) );
+				text_len += strlen( part );
+				num_chars += i % ARRAY_LENGTH( parts ) == 0 ? 2 : 1;
+			}
+			text[text_len] = 0;
+
+			ASSERT_EQ( num_chars, utf8_lookup_count_chars( text ) );
+
+			size_t expect_size = text_cap;
+			utf8_lookup_perform( table, text, expect, &expect_size );
+			ASSERT_EQ( num_chars, expect_size );
+			ASSERT_EQ( num_chars, utf8_lookup_perform_all( table, text, res ) );
+			for( size_t i = 0; i < num_chars; ++i )
+			{
+				ASSERT_EQ( expect[i].pos,    res[i].pos );
+				ASSERT_EQ( expect[i].offset, res[i].offset );
+			}
+		}
+	}
+
+	free( expect );
+	free( res );
+	free( buffer );
+	return 0;
+}
+
+TEST utf16_input()
+{
+	unsigned int test_cps[] = { 'a', 'b', 0xE4, 0x1024, 0xFFFD, 0x10801, 0x10FFFF };
+
+	uint8_t table[1024];
+	pack_table( table, sizeof(table), test_cps, ARRAY_LENGTH(test_cps) );
+
+	const uint16_t str[] = { 'a', 'q', 0xE4, 0x1024, 0xD802, 0xDC01, 0xDBFF, 0xDFFF, 'b',
+							 0xDC01, 'a',    // unpaired low surrogate
+							 0xD802, 'b',    // unpaired high surrogate
+							 0xFFFD, 0xD802, // unpaired high surrogate at end of string
+							 0 };
+
+	utf8_lookup_utf16_result res[16];
+	size_t res_size = ARRAY_LENGTH( res );
+	const uint16_t* end = utf8_lookup_perform_utf16( table, str, res, &res_size );
+	ASSERT_EQ( str + ARRAY_LENGTH( str ) - 1, end );
+	ASSERT_EQ( 13u, res_size );
+
+	const unsigned int expect_offsets[] = { 1, 0, 3, 4, 6, 7, 2, 0, 1, 0, 2, 5, 0 };
+	const size_t       expect_pos[]     = { 0, 1, 2, 3, 4, 6, 8, 9, 10, 11, 12, 13, 14 };
+	for( size_t i = 0; i < res_size; ++i )
+	{
+		ASSERT_EQ( expect_offsets[i], res[i].offset );
+		ASSERT_EQ( str + expect_pos[i], res[i].pos );
+	}
+
+	// ... resume when res is full, should not split a surrogate pair ...
+	res_size = 5;
+	end = utf8_lookup_perform_utf16( table, str, res, &res_size );
+	ASSERT_EQ( 5u, res_size );
+	ASSERT_EQ( str + 6, end );
+	return 0;
+}
+
+TEST utf16_input_surrogate_in_table()
+{
+	// ... a table generated with surrogates in it, still never found as unpaired surrogates ...
+	unsigned int test_cps[] = { 'a', 0xD802, 0xDC01, 0xDFFF, 0x10801, 0x1D800 };
+
+	uint8_t table[1024];
+	pack_table( table, sizeof(table), test_cps, ARRAY_LENGTH(test_cps) );
+
+	const uint16_t str[] = { 'a', 0xD802, 'a', 0xDC01, 0xD802, 0xDC01, 0xDFFF, 0xD836, 0xDC00, 0 };
+
+	utf8_lookup_utf16_result res[16];
+	size_t res_size = ARRAY_LENGTH( res );
+	utf8_lookup_perform_utf16( table, str, res, &res_size );
+	ASSERT_EQ( 7u, res_size );
+
+	const unsigned int expect_offsets[] = { 1, 0, 1, 0, 5, 0, 6 };
+	for( size_t i = 0; i < res_size; ++i )
+		ASSERT_EQ( expect_offsets[i], res[i].offset );
+	return 0;
+}
+
+TEST utf32_input()
+{
+	unsigned int num_cps = 0;
+	unsigned int* test_cps = (unsigned int*)malloc( 0x110000 / 37 * sizeof(unsigned int) + sizeof(unsigned int) );
+	for( unsigned int cp = 1; cp < 0x110000; cp += 37 )
+		test_cps[num_cps++] = cp;
+
+	size_t size;
+	utf8_lookup_calc_table_size( &size, test_cps, num_cps );
+	void* table = malloc( size );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_gen_table( table, size, test_cps, num_cps ) );
+
+	// ... every 3rd codepoint and some past the end of unicode, odd count to also hit the tail of simd-paths ...
+	size_t num_input = 0;
+	unsigned int* input = (unsigned int*)malloc( ( 0x110100 / 3 + 1 ) * sizeof(unsigned int) );
+	for( unsigned int cp = 0; cp < 0x110100; cp += 3 )
+		input[num_input++] = cp;
+	input[num_input++] = 0xFFFFFFFF;
+
+	unsigned int* offsets = (unsigned int*)malloc( num_input * sizeof(unsigned int) );
+	utf8_lookup_perform_utf32( table, input, num_input, offsets );
+
+	uint8_t str[8];
+	for( size_t i = 0; i < num_input; ++i )
+	{
+		unsigned int expect = 0;
+		if( input[i] < 0x110000 && input[i] != 0 )
+		{
+			*encode_utf8( str, input[i] ) = 0;
+			utf8_lookup_result res[1];
+			size_t res_size = 1;
+			utf8_lookup_perform( table, str, res, &res_size );
+			expect = res[0].offset;
+		}
+		ASSERT_EQ( expect, offsets[i] );
+	}
+
+	free( offsets );
+	free( input );
+	free( table );
+	free( test_cps );
+	return 0;
+}
+
+TEST perform_ex()
+{
+	unsigned int num_cps = 0;
+	unsigned int* test_cps = (unsigned int*)malloc( 0x110000 / 37 * sizeof(unsigned int) + sizeof(unsigned int) );
+	for( unsigned int cp = 1; cp < 0x110000; cp += 37 )
+		test_cps[num_cps++] = cp;
+
+	size_t size;
+	utf8_lookup_calc_table_size( &size, test_cps, num_cps );
+	void* table = malloc( size );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_gen_table( table, size, test_cps, num_cps ) );
+
+	// ... every 5th codepoint, all lengths ...
+	uint8_t* text = (uint8_t*)malloc( 0x110000 / 5 * 4 + 1 );
+	uint8_t* out  = text;
+	for( unsigned int cp = 1; cp < 0x110000; cp += 5 )
+		out = encode_utf8( out, cp );
+	*out = '\0';
+
+	utf8_lookup_result    res[100];
+	utf8_lookup_result_ex res_ex[100];
+	const uint8_t* str    = text;
+	const uint8_t* str_ex = text;
+	unsigned int expect_cp = 1;
+	while( *str )
+	{
+		size_t res_size    = ARRAY_LENGTH( res );
+		size_t res_ex_size = ARRAY_LENGTH( res_ex );
+		str    = utf8_lookup_perform( table, str, res, &res_size );
+		str_ex = utf8_lookup_perform_ex( table, str_ex, res_ex, &res_ex_size );
+		ASSERT_EQ( str, str_ex );
+		ASSERT_EQ( res_size, res_ex_size );
+
+		for( size_t i = 0; i < res_size; ++i, expect_cp += 5 )
+		{
+			ASSERT_EQ( res[i].pos,    res_ex[i].pos );
+			ASSERT_EQ( res[i].offset, res_ex[i].offset );
+			ASSERT_EQ( expect_cp,     res_ex[i].codepoint );
+			uint8_t tmp[4];
+			ASSERT_EQ( (unsigned int)( encode_utf8( tmp, expect_cp ) - tmp ), res_ex[i].length );
+		}
+	}
+
+	free( text );
+	free( table );
+	free( test_cps );
+	return 0;
+}
+
+static int perform_to_utf16_check( const void* table, const uint8_t* text, size_t res_chunk, size_t utf16_chunk )
+{
+	size_t num_chars = utf8_lookup_count_chars( text );
+	utf8_lookup_result_ex* expect = (utf8_lookup_result_ex*)malloc( ( num_chars + 1 ) * sizeof( utf8_lookup_result_ex ) );
+	uint16_t* expect_utf16 = (uint16_t*)malloc( ( num_chars * 2 + 1 ) * sizeof( uint16_t ) );
+	size_t num_expect = num_chars + 1;
+	utf8_lookup_perform_ex( table, text, expect, &num_expect );
+
+	size_t num_units = 0;
+	for( size_t i = 0; i < num_expect; ++i )
+	{
+		unsigned int cp = expect[i].codepoint;
+		if( cp >= 0x10000 )
+		{
+			expect_utf16[num_units++] = (uint16_t)( 0xD800 | ( ( cp - 0x10000 ) >> 10 ) );
+			expect_utf16[num_units++] = (uint16_t)( 0xDC00 | ( ( cp - 0x10000 ) & 0x3FF ) );
+		}
+		else
+			expect_utf16[num_units++] = (uint16_t)cp;
+	}
+
+	utf8_lookup_result* res = (utf8_lookup_result*)malloc( ( num_chars + res_chunk ) * sizeof( utf8_lookup_result ) );
+	uint16_t* utf16 = (uint16_t*)malloc( ( num_units + utf16_chunk ) * sizeof( uint16_t ) );
+	size_t total_res   = 0;
+	size_t total_units = 0;
+	int ok = 1;
+	const uint8_t* str = text;
+	while( ok && *str )
+	{
+		size_t res_size   = res_chunk;
+		size_t utf16_size = utf16_chunk;
+		str = utf8_lookup_perform_to_utf16( table, str, res + total_res, &res_size, utf16 + total_units, &utf16_size );
+		ok = res_size > 0 && res_size <= res_chunk && utf16_size <= utf16_chunk &&
+			 total_res + res_size <= num_expect && total_units + utf16_size <= num_units;
+		total_res   += res_size;
+		total_units += utf16_size;
+	}
+
+	ok = ok && total_res == num_expect && total_units == num_units &&
+		 memcmp( expect_utf16, utf16, num_units * sizeof( uint16_t ) ) == 0;
+	for( size_t i = 0; ok && i < num_expect; ++i )
+		ok = res[i].pos == expect[i].pos && res[i].offset == expect[i].offset;
+
+	free( expect );
+	free( expect_utf16 );
+	free( res );
+	free( utf16 );
+	return ok ? 0 : 1;
+}
+
+TEST perform_to_utf16()
+{
+	unsigned int num_cps = 0;
+	unsigned int* test_cps = (unsigned int*)malloc( ( 0x80 + 0x110000 / 37 ) * sizeof(unsigned int) );
+	for( unsigned int cp = 1; cp < 0x80; ++cp )
+		test_cps[num_cps++] = cp;
+	for( unsigned int cp = 0x80; cp < 0x110000; cp += 37 )
+		test_cps[num_cps++] = cp;
+
+	size_t size;
+	utf8_lookup_calc_table_size( &size, test_cps, num_cps );
+	void* table = malloc( size );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_gen_table( table, size, test_cps, num_cps ) );
+
+	// ... every 5th codepoint, all lengths, surrogate pairs that do not fit in utf16 ...
+	uint8_t* text = (uint8_t*)malloc( 0x110000 / 5 * 4 + 1 );
+	uint8_t* out  = text;
+	for( unsigned int cp = 1; cp < 0x110000; cp += 5 )
+		out = encode_utf8( out, cp );
+	*out = '\0';
+	ASSERT_EQ( 0, perform_to_utf16_check( table, text, 100, 100 ) );
+	ASSERT_EQ( 0, perform_to_utf16_check( table, text, 64, 3 ) );
+	free( text );
+
+	static const char* texts[] = { "danish.txt", "russian.txt", "chinese1.txt", "stb_image.h" };
+	for( size_t t = 0; t < ARRAY_LENGTH( texts ); ++t )
+	{
+		size_t text_size;
+		uint8_t* loaded = load_text( texts[t], &text_size );
+		ASSERT( loaded != 0x0 );
+
+		// ... the first 64 KB at a few alignments to hit all positions in the 32 byte blocks ...
+		size_t len = text_size < 64 * 1024 ? text_size : 64 * 1024;
+		while( len > 0 && ( loaded[len] & 0xC0 ) == 0x80 )
+			--len;
+		uint8_t* buffer = (uint8_t*)malloc( len + 64 );
+		for( size_t align = 0; align < 32; align += 7 )
+		{
+			uint8_t* aligned = buffer + align;
+			memcpy( aligned, loaded, len );
+			aligned[len] = 0;
+			ASSERT_EQ( 0, perform_to_utf16_check( table, aligned, 256, 256 ) );
+			ASSERT_EQ( 0, perform_to_utf16_check( table, aligned, 33, 40 ) );
+			ASSERT_EQ( 0, perform_to_utf16_check( table, aligned, 100, 31 ) );
+		}
+
+		free( buffer );
+		free( loaded );
+	}
+
+	free( table );
+	free( test_cps );
+	return 0;
+}
+
+static int perform_runs_check( const void* table, const uint8_t* text, size_t max_runs )
+{
+	size_t num_chars = utf8_lookup_count_chars( text );
+	utf8_lookup_result* expect = (utf8_lookup_result*)malloc( ( num_chars + 1 ) * sizeof( utf8_lookup_result ) );
+	utf8_lookup_perform_all( table, text, expect );
+	expect[num_chars].pos = text + strlen( (const char*)text );
+
+	utf8_lookup_run runs[64];
+	int ok = 1;
+	int last_found = -1;
+	size_t curr = 0;
+	const uint8_t* str = text;
+	while( ok && *str )
+	{
+		size_t num_runs = max_runs;
+		str = utf8_lookup_perform_runs( table, str, runs, &num_runs );
+		ok = num_runs > 0;
+
+		for( size_t i = 0; ok && i < num_runs; ++i )
+		{
+			const utf8_lookup_run& run = runs[i];
+			ok = run.found != last_found &&
+				 run.char_count > 0 &&
+				 curr + run.char_count <= num_chars &&
+				 run.pos == expect[curr].pos &&
+				 run.pos + run.byte_length == expect[curr + run.char_count].pos;
+
+			for( size_t c = curr; ok && c < curr + run.char_count; ++c )
+				ok = ( expect[c].offset != 0 ) == ( run.found != 0 );
+
+			curr += run.char_count;
+			last_found = run.found;
+		}
+
+		// ... a run is never split between calls ...
+		ok = ok && str == expect[curr].pos;
+	}
+
+	free( expect );
+	return ok && curr == num_chars ? 0 : 1;
+}
+
+TEST perform_runs()
+{
+	// ... everything below 0x800 except every 7th char, gives short runs in ascii and longer in other text ...
+	unsigned int num_cps = 0;
+	unsigned int test_cps[0x800];
+	for( unsigned int cp = 1; cp < 0x800; ++cp )
+		if( cp % 7 != 0 )
+			test_cps[num_cps++] = cp;
+
+	size_t size;
+	utf8_lookup_calc_table_size( &size, test_cps, num_cps );
+	void* table = malloc( size );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_gen_table( table, size, test_cps, num_cps ) );
+
+	uint8_t empty_table[512];
+	pack_table( empty_table, sizeof(empty_table), test_cps, 0 );
+
+	static const char* texts[] = { "danish.txt", "russian.txt", "chinese1.txt", "stb_image.h" };
+	for( size_t t = 0; t < ARRAY_LENGTH( texts ); ++t )
+	{
+		size_t text_size;
+		uint8_t* text = load_text( texts[t], &text_size );
+		ASSERT( text != 0x0 );
+
+		ASSERT_EQ( 0, perform_runs_check( table, text, 1 ) );
+		ASSERT_EQ( 0, perform_runs_check( table, text, 3 ) );
+		ASSERT_EQ( 0, perform_runs_check( table, text, 64 ) );
+
+		// ... all missing, one run ...
+		utf8_lookup_run run;
+		size_t num_runs = 1;
+		ASSERT_EQ( text + strlen( (const char*)text ), utf8_lookup_perform_runs( empty_table, text, &run, &num_runs ) );
+		ASSERT_EQ( 1u, num_runs );
+		ASSERT_EQ( 0, run.found );
+		ASSERT_EQ( strlen( (const char*)text ), run.byte_length );
+		ASSERT_EQ( utf8_lookup_count_chars( text ), run.char_count );
+
+		free( text );
+	}
+
+	size_t num_runs = 4;
+	utf8_lookup_run runs[4];
+	const uint8_t* empty = (const uint8_t*)"";
+	ASSERT_EQ( empty, utf8_lookup_perform_runs( table, empty, runs, &num_runs ) );
+	ASSERT_EQ( 0u, num_runs );
+
+	free( table );
+	return 0;
+}
+
+struct test_map_value
+{
+	unsigned int folded;
+	uint8_t      script;
+};
+
+TEST lookup_map()
+{
+	// ... every 37th codepoint, all lengths, mapped to a value derived from the codepoint ...
+	unsigned int num_cps = 0;
+	unsigned int* test_cps = (unsigned int*)malloc( ( 0x110000 / 37 + 1 ) * sizeof(unsigned int) );
+	test_map_value* values = (test_map_value*)malloc( ( 0x110000 / 37 + 1 ) * sizeof(test_map_value) );
+	for( unsigned int cp = 1; cp < 0x110000; cp += 37 )
+	{
+		test_map_value v = { cp ^ 0x20, (uint8_t)( cp >> 12 ) };
+		values[num_cps] = v;
+		test_cps[num_cps++] = cp;
+	}
+
+	size_t size;
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_map<test_map_value>::calc_size( &size, test_cps, num_cps ) );
+	void* map = malloc( size );
+	test_map_value missing = { 0xFFFFFFFF, 0xFF };
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_BUFFER_TO_SMALL, utf8_lookup_map<test_map_value>::gen( map, size - 1, test_cps, values, num_cps, missing ) );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_map<test_map_value>::gen( map, size, test_cps, values, num_cps, missing ) );
+
+	for( unsigned int cp = 0; cp < 0x110000; cp += 7 )
+	{
+		test_map_value v = utf8_lookup_map<test_map_value>::get( map, cp );
+		if( cp % 37 == 1 )
+		{
+			ASSERT_EQ( cp ^ 0x20, v.folded );
+			ASSERT_EQ( (uint8_t)( cp >> 12 ), v.script );
+		}
+		else
+			ASSERT_EQ( 0xFFFFFFFF, v.folded );
+	}
+
+	// ... every 5th codepoint, as utf8 and utf32 ...
+	unsigned int num_text_cps = 0;
+	unsigned int* text_cps = (unsigned int*)malloc( ( 0x110000 / 5 + 1 ) * sizeof(unsigned int) );
+	uint8_t* text = (uint8_t*)malloc( 0x110000 / 5 * 4 + 1 );
+	uint8_t* out  = text;
+	for( unsigned int cp = 1; cp < 0x110000; cp += 5 )
+	{
+		text_cps[num_text_cps++] = cp;
+		out = encode_utf8( out, cp );
+	}
+	*out = '\0';
+
+	test_map_value* res = (test_map_value*)malloc( num_text_cps * sizeof(test_map_value) );
+	utf8_lookup_map<test_map_value>::perform_utf32( map, text_cps, num_text_cps, res );
+	for( unsigned int i = 0; i < num_text_cps; ++i )
+		ASSERT_EQ( text_cps[i] % 37 == 1 ? text_cps[i] ^ 0x20 : 0xFFFFFFFF, res[i].folded );
+
+	test_map_value chunk[100];
+	const uint8_t* str = text;
+	unsigned int curr = 0;
+	while( *str )
+	{
+		size_t chunk_size = ARRAY_LENGTH( chunk );
+		str = utf8_lookup_map<test_map_value>::perform( map, str, chunk, &chunk_size );
+		ASSERT( chunk_size > 0 );
+		for( size_t i = 0; i < chunk_size; ++i, ++curr )
+			ASSERT_EQ( res[curr].folded, chunk[i].folded );
+	}
+	ASSERT_EQ( num_text_cps, curr );
+
+	// ... the map is a lookup-table for the same codepoints ...
+	unsigned int num_found = 0;
+	for( unsigned int i = 0; i < num_text_cps; ++i )
+		num_found += text_cps[i] % 37 == 1 ? 1 : 0;
+	ASSERT_EQ( num_text_cps - num_found, utf8_lookup_count_missing( map, text ) );
+
+	free( res );
+	free( text );
+	free( text_cps );
+	free( map );
+	free( values );
+	free( test_cps );
+	return 0;
+}
+
+static uint8_t test_char_class( unsigned int cp )
+{
+	if( cp == ' ' || cp == '\t' || cp == '\n' || cp == '\r' )
+		return 1;
+	if( ( cp >= 'a' && cp <= 'z' ) || ( cp >= 'A' && cp <= 'Z' ) || cp == '_' || ( cp >= 0xC0 && cp < 0x250 ) || ( cp >= 0x400 && cp < 0x500 ) )
+		return 2;
+	if( cp >= '0' && cp <= '9' )
+		return 3;
+	if( ( cp > ' ' && cp < 127 ) || ( cp >= 0x3000 && cp < 0x3040 ) )
+		return 4;
+	if( cp >= 0x4E00 && cp < 0xA000 )
+		return 5;
+	return 0;
+}
+
+static int class_runs_check( const void* table, const uint8_t* text, size_t max_runs )
+{
+	size_t num_chars = utf8_lookup_count_chars( text );
+	utf8_lookup_result_ex* expect = (utf8_lookup_result_ex*)malloc( ( num_chars + 1 ) * sizeof( utf8_lookup_result_ex ) );
+	size_t expect_size = num_chars;
+	utf8_lookup_perform_ex( table, text, expect, &expect_size );
+	expect[num_chars].pos = text + strlen( (const char*)text );
+
+	utf8_lookup_class_run runs[64];
+	int ok = expect_size == num_chars;
+	int last_class = -1;
+	size_t curr = 0;
+	const uint8_t* str = text;
+	while( ok && *str )
+	{
+		size_t num_runs = max_runs;
+		str = utf8_lookup_perform_class_runs( table, str, runs, &num_runs );
+		ok = num_runs > 0;
+
+		for( size_t i = 0; ok && i < num_runs; ++i )
+		{
+			const utf8_lookup_class_run& run = runs[i];
+			ok = run.class_id != last_class &&
+				 run.char_count > 0 &&
+				 curr + run.char_count <= num_chars &&
+				 run.pos == expect[curr].pos &&
+				 run.pos + run.byte_length == expect[curr + run.char_count].pos;
+
+			for( size_t c = curr; ok && c < curr + run.char_count; ++c )
+				ok = test_char_class( expect[c].codepoint ) == run.class_id;
+
+			curr += run.char_count;
+			last_class = run.class_id;
+		}
+
+		ok = ok && str == expect[curr].pos;
+	}
+
+	free( expect );
+	return ok && curr == num_chars ? 0 : 1;
+}
+
+TEST class_runs()
+{
+	unsigned int num_cps = 0;
+	unsigned int* test_cps = (unsigned int*)malloc( 0xA000 * sizeof(unsigned int) );
+	uint8_t*      classes  = (uint8_t*)malloc( 0xA000 );
+	for( unsigned int cp = 1; cp < 0xA000; ++cp )
+	{
+		uint8_t c = test_char_class( cp );
+		if( c != 0 )
+		{
+			test_cps[num_cps] = cp;
+			classes[num_cps++] = c;
+		}
+	}
+
+	size_t size;
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_calc_class_table_size( &size, test_cps, num_cps ) );
+	void* table = malloc( size );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_BUFFER_TO_SMALL, utf8_lookup_gen_class_table( table, size - 1, test_cps, classes, num_cps, 0 ) );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_gen_class_table( table, size, test_cps, classes, num_cps, 0 ) );
+
+	static const char* texts[] = { "danish.txt", "russian.txt", "chinese1.txt", "japanese.txt", "stb_image.h" };
+	for( size_t t = 0; t < ARRAY_LENGTH( texts ); ++t )
+	{
+		size_t text_size;
+		uint8_t* text = load_text( texts[t], &text_size );
+		ASSERT( text != 0x0 );
+
+		ASSERT_EQ( 0, class_runs_check( table, text, 1 ) );
+		ASSERT_EQ( 0, class_runs_check( table, text, 3 ) );
+		ASSERT_EQ( 0, class_runs_check( table, text, 64 ) );
+
+		free( text );
+	}
+
+	// ... the class-table is also a lookup-table ...
+	const uint8_t* str = (const uint8_t*)"a" "\xe1\x80\xa4" "\xf0\x90\xa0\x81";
+	ASSERT_EQ( 2u, utf8_lookup_count_missing( table, str ) );
+
+	// ... and do not need to be more than 8 byte aligned ...
+	uint64_t* unaligned = (uint64_t*)malloc( size + 16 );
+	void* table8 = ( (uintptr_t)unaligned & 15 ) != 0 ? (void*)unaligned : (void*)( unaligned + 1 );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_gen_class_table( table8, size, test_cps, classes, num_cps, 0 ) );
+	size_t text_size;
+	uint8_t* text = load_text( "stb_image.h", &text_size );
+	ASSERT( text != 0x0 );
+	ASSERT_EQ( 0, class_runs_check( table8, text, 64 ) );
+	free( text );
+	free( unaligned );
+
+	free( table );
+	free( classes );
+	free( test_cps );
+	return 0;
+}
+
+static int test_kerning_value( unsigned int first, unsigned int second )
+{
+	if( ( first * 31 + second * 17 ) % 5 == 0 )
+		return 0;
+	return (int)( ( first * 7 + second * 13 ) % 199 ) - 99;
+}
+
+TEST kerning_pairs()
+{
+	// ... ascii-letters, latin-1 and latin extended-a, a dense block of cjk and one 4-byte char ...
+	unsigned int num_cps = 0;
+	unsigned int test_cps[512];
+	for( unsigned int cp = 'A'; cp <= 'z'; ++cp )
+		test_cps[num_cps++] = cp;
+	for( unsigned int cp = 0xC0; cp < 0x180; ++cp )
+		test_cps[num_cps++] = cp;
+	for( unsigned int cp = 0x4E00; cp < 0x4E50; ++cp )
+		test_cps[num_cps++] = cp;
+	test_cps[num_cps++] = 0x10400;
+
+	size_t size;
+	utf8_lookup_calc_table_size( &size, test_cps, num_cps );
+	void* table = malloc( size );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_gen_table( table, size, test_cps, num_cps ) );
+
+	// ... pairs for all chars in table and some that is not, these should be ignored ...
+	unsigned int num_pair_cps = 0;
+	unsigned int pair_cps[ ARRAY_LENGTH( test_cps ) + 2 ];
+	for( unsigned int i = 0; i < num_cps; ++i )
+	{
+		if( test_cps[i] == 0x4E00 )
+			pair_cps[num_pair_cps++] = 0x3000;
+		pair_cps[num_pair_cps++] = test_cps[i];
+	}
+	pair_cps[num_pair_cps++] = 0x10401;
+
+	utf8_lookup_kerning_pair* pairs = (utf8_lookup_kerning_pair*)malloc( num_pair_cps * num_pair_cps * sizeof( utf8_lookup_kerning_pair ) );
+	size_t num_pairs = 0;
+	for( unsigned int f = 0; f < num_pair_cps; ++f )
+		for( unsigned int s = 0; s < num_pair_cps; ++s )
+		{
+			int value = test_kerning_value( pair_cps[f], pair_cps[s] );
+			if( value == 0 )
+				continue;
+			utf8_lookup_kerning_pair pair = { pair_cps[f], pair_cps[s], (int16_t)value };
+			pairs[num_pairs++] = pair;
+		}
+
+	size_t kerning_size;
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_calc_kerning_table_size( &kerning_size, table, pairs, num_pairs ) );
+	void* kerning = malloc( kerning_size );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_BUFFER_TO_SMALL, utf8_lookup_gen_kerning_table( kerning, kerning_size - 1, table, pairs, num_pairs ) );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_gen_kerning_table( kerning, kerning_size, table, pairs, num_pairs ) );
+
+	// ... offsets is index + 1 in test_cps ...
+	for( unsigned int f = 0; f < num_cps; ++f )
+		for( unsigned int s = 0; s < num_cps; ++s )
+			ASSERT_EQ( test_kerning_value( test_cps[f], test_cps[s] ), utf8_lookup_kerning( kerning, f + 1, s + 1 ) );
+	ASSERT_EQ( 0, utf8_lookup_kerning( kerning, 0, 1 ) );
+	ASSERT_EQ( 0, utf8_lookup_kerning( kerning, 1, 0 ) );
+	ASSERT_EQ( 0, utf8_lookup_kerning( kerning, 0xFFFF, 1 ) );
+
+	// ... a pseudo-random text over the pair-codepoints, including the ones missing in table ...
+	const unsigned int text_len = 4096;
+	unsigned int* text_cps = (unsigned int*)malloc( text_len * sizeof( unsigned int ) );
+	uint8_t* text = (uint8_t*)malloc( text_len * 4 + 1 );
+	uint8_t* out = text;
+	unsigned int seed = 1;
+	for( unsigned int i = 0; i < text_len; ++i )
+	{
+		seed = seed * 1103515245u + 12345u;
+		text_cps[i] = pair_cps[ ( seed >> 8 ) % num_pair_cps ];
+		out = encode_utf8( out, text_cps[i] );
+	}
+	*out = '\0';
+
+	utf8_lookup_kerning_result res[7];
+	utf8_lookup_result         expect[7];
+	unsigned int prev_offset = 0;
+	unsigned int expect_prev = 0;
+	unsigned int curr = 0;
+	const uint8_t* str = text;
+	const uint8_t* expect_str = text;
+	while( *str )
+	{
+		size_t res_size    = ARRAY_LENGTH( res );
+		size_t expect_size = ARRAY_LENGTH( expect );
+		str        = utf8_lookup_perform_kerning( table, kerning, str, &prev_offset, res, &res_size );
+		expect_str = utf8_lookup_perform( table, expect_str, expect, &expect_size );
+		ASSERT_EQ( expect_str, str );
+		ASSERT_EQ( expect_size, res_size );
+
+		for( size_t i = 0; i < res_size; ++i, ++curr )
+		{
+			ASSERT_EQ( expect[i].pos,    res[i].pos );
+			ASSERT_EQ( expect[i].offset, res[i].offset );
+
+			int expect_kerning = 0;
+			if( expect_prev != 0 && expect[i].offset != 0 )
+				expect_kerning = test_kerning_value( text_cps[curr - 1], text_cps[curr] );
+			expect_prev = expect[i].offset;
+			ASSERT_EQ( expect_kerning, res[i].kerning );
+		}
+	}
+	ASSERT_EQ( text_len, curr );
+	ASSERT_EQ( expect_prev, prev_offset );
+
+	free( text );
+	free( text_cps );
+	free( kerning );
+	free( pairs );
+	free( table );
+	return 0;
+}
+
+TEST kerning_duplicate_pairs()
+{
+	unsigned int test_cps[] = { 'A', 'B', 'C', 0x4E00 };
+	uint8_t table[1024];
+	pack_table( table, sizeof(table), test_cps, ARRAY_LENGTH(test_cps) );
+
+	// ... only the first of duplicated pairs is used and values for later pairs is not shifted ...
+	const utf8_lookup_kerning_pair unique[] = { { 'A', 'B', -5 }, { 'A', 'C', 3 }, { 'B', 'A', 2 }, { 'C', 0x4E00, 1 } };
+	const utf8_lookup_kerning_pair pairs[]  = { { 'A', 'B', -5 }, { 'A', 'B', -7 }, { 'A', 'C', 3 },
+												{ 'B', 'A', 2 }, { 'B', 'A', 9 }, { 'B', 'A', 4 },
+												{ 'C', 0x4E00, 1 }, { 'C', 0x4E00, 8 } };
+
+	size_t unique_size;
+	size_t kerning_size;
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_calc_kerning_table_size( &unique_size, table, unique, ARRAY_LENGTH(unique) ) );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_calc_kerning_table_size( &kerning_size, table, pairs, ARRAY_LENGTH(pairs) ) );
+	ASSERT_EQ( unique_size, kerning_size );
+
+	void* kerning = malloc( kerning_size );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_gen_kerning_table( kerning, kerning_size, table, pairs, ARRAY_LENGTH(pairs) ) );
+	int ab = utf8_lookup_kerning( kerning, 1, 2 );
+	int ac = utf8_lookup_kerning( kerning, 1, 3 );
+	int ba = utf8_lookup_kerning( kerning, 2, 1 );
+	int cx = utf8_lookup_kerning( kerning, 3, 4 );
+	free( kerning );
+
+	ASSERT_EQ( -5, ab );
+	ASSERT_EQ(  3, ac );
+	ASSERT_EQ(  2, ba );
+	ASSERT_EQ(  1, cx );
+	return 0;
+}
+
+TEST sequences()
+{
+	unsigned int num_cps = 0;
+	unsigned int test_cps[128];
+	test_cps[num_cps++] = '#';
+	for( unsigned int cp = 'a'; cp <= 'f'; ++cp )
+		test_cps[num_cps++] = cp;
+	test_cps[num_cps++] = 0x200D;  // zwj
+	test_cps[num_cps++] = 0x20E3;  // combining enclosing keycap
+	test_cps[num_cps++] = 0x2764;  // heart
+	test_cps[num_cps++] = 0xFE0F;  // variation selector-16
+	for( unsigned int cp = 0x1F1E6; cp <= 0x1F1FF; ++cp ) // regional indicators
+		test_cps[num_cps++] = cp;
+	for( unsigned int cp = 0x1F3FB; cp <= 0x1F3FF; ++cp ) // skin tones
+		test_cps[num_cps++] = cp;
+	for( unsigned int cp = 0x1F466; cp <= 0x1F469; ++cp ) // boy, girl, man, woman
+		test_cps[num_cps++] = cp;
+
+	size_t size;
+	utf8_lookup_calc_table_size( &size, test_cps, num_cps );
+	void* table = malloc( size );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_gen_table( table, size, test_cps, num_cps ) );
+
+	static const unsigned int family_mwg[]  = { 0x1F468, 0x200D, 0x1F469, 0x200D, 0x1F467 };
+	static const unsigned int family_mwgb[] = { 0x1F468, 0x200D, 0x1F469, 0x200D, 0x1F467, 0x200D, 0x1F466 };
+	static const unsigned int couple_mw[]   = { 0x1F468, 0x200D, 0x1F469 };
+	static const unsigned int flag_us[]     = { 0x1F1FA, 0x1F1F8 };
+	static const unsigned int flag_se[]     = { 0x1F1F8, 0x1F1EA };
+	static const unsigned int keycap[]      = { '#', 0xFE0F, 0x20E3 };
+	static const unsigned int man_light[]   = { 0x1F468, 0x1F3FB };
+	static const unsigned int scientist[]   = { 0x1F468, 0x200D, 0x1F52C }; // 0x1F52C not in table, ignored.
+	static const unsigned int heart[]       = { 0x2764 };                   // single char, ignored.
+	static const unsigned int red_heart[]   = { 0x2764, 0xFE0F };
+	utf8_lookup_sequence seqs[] = {
+		{ family_mwg,  ARRAY_LENGTH( family_mwg ) },
+		{ family_mwgb, ARRAY_LENGTH( family_mwgb ) },
+		{ couple_mw,   ARRAY_LENGTH( couple_mw ) },
+		{ flag_us,     ARRAY_LENGTH( flag_us ) },
+		{ flag_se,     ARRAY_LENGTH( flag_se ) },
+		{ keycap,      ARRAY_LENGTH( keycap ) },
+		{ man_light,   ARRAY_LENGTH( man_light ) },
+		{ scientist,   ARRAY_LENGTH( scientist ) },
+		{ heart,       ARRAY_LENGTH( heart ) },
+		{ flag_us,     ARRAY_LENGTH( flag_us ) },  // duplicate, first one wins.
+		{ red_heart,   ARRAY_LENGTH( red_heart ) },
+	};
+	const unsigned int valid_seqs = ( 1 << 0 ) | ( 1 << 1 ) | ( 1 << 2 ) | ( 1 << 3 ) | ( 1 << 4 ) | ( 1 << 5 ) | ( 1 << 6 ) | ( 1 << 10 );
+
+	size_t seq_size;
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_calc_sequence_table_size( &seq_size, table, seqs, ARRAY_LENGTH( seqs ) ) );
+	void* seq_table = malloc( seq_size );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_BUFFER_TO_SMALL, utf8_lookup_gen_sequence_table( seq_table, seq_size - 1, table, seqs, ARRAY_LENGTH( seqs ) ) );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_gen_sequence_table( seq_table, seq_size, table, seqs, ARRAY_LENGTH( seqs ) ) );
+
+	// ... pseudo-random text of sequences, broken sequences and single chars ...
+	static const unsigned int broken_family[] = { 0x1F468, 0x200D, 0x1F469, 0x200D };
+	static const unsigned int broken_keycap[] = { '#', 0xFE0F, 'a' };
+	static const unsigned int single_ri[]     = { 0x1F1FA };
+	static const unsigned int missing[]       = { 0x1F52C };
+	utf8_lookup_sequence parts[] = {
+		seqs[0], seqs[1], seqs[2], seqs[3], seqs[4], seqs[5], seqs[6], seqs[7], seqs[8], seqs[10],
+		{ broken_family, ARRAY_LENGTH( broken_family ) },
+		{ broken_keycap, ARRAY_LENGTH( broken_keycap ) },
+		{ single_ri,     ARRAY_LENGTH( single_ri ) },
+		{ missing,       ARRAY_LENGTH( missing ) },
+	};
+
+	const unsigned int max_text_cps = 8192;
+	unsigned int* text_cps = (unsigned int*)malloc( max_text_cps * sizeof( unsigned int ) );
+	unsigned int* text_offsets = (unsigned int*)malloc( max_text_cps * sizeof( unsigned int ) );
+	uint8_t* text_pos[8192 + 1];
+	uint8_t* text = (uint8_t*)malloc( max_text_cps * 4 + 1 );
+	uint8_t* out = text;
+	unsigned int num_text_cps = 0;
+	unsigned int seed = 1;
+	while( num_text_cps + 8 < max_text_cps )
+	{
+		seed = seed * 1103515245u + 12345u;
+		const utf8_lookup_sequence& part = parts[ ( seed >> 8 ) % ARRAY_LENGTH( parts ) ];
+		for( unsigned int c = 0; c < part.num_codepoints; ++c )
+		{
+			text_pos[num_text_cps]   = out;
+			text_cps[num_text_cps++] = part.codepoints[c];
+			out = encode_utf8( out, part.codepoints[c] );
+		}
+	}
+	text_pos[num_text_cps] = out;
+	*out = '\0';
+	utf8_lookup_perform_utf32( table, text_cps, num_text_cps, text_offsets );
+
+	utf8_lookup_sequence_result res[5];
+	unsigned int curr = 0;
+	const uint8_t* str = text;
+	while( *str )
+	{
+		size_t res_size = ARRAY_LENGTH( res );
+		str = utf8_lookup_perform_sequences( table, seq_table, str, res, &res_size );
+		ASSERT( res_size > 0 );
+
+		for( size_t i = 0; i < res_size; ++i )
+		{
+			// ... brute-force longest match, first sequence wins if equal ...
+			unsigned int expect_offset = text_offsets[curr];
+			unsigned int expect_length = 1;
+			for( unsigned int q = 0; q < ARRAY_LENGTH( seqs ); ++q )
+			{
+				if( ( valid_seqs & ( 1u << q ) ) == 0 || seqs[q].num_codepoints <= expect_length || curr + seqs[q].num_codepoints > num_text_cps )
+					continue;
+				if( memcmp( text_cps + curr, seqs[q].codepoints, seqs[q].num_codepoints * sizeof( unsigned int ) ) != 0 )
+					continue;
+				expect_offset = num_cps + 1 + q;
+				expect_length = seqs[q].num_codepoints;
+			}
+
+			ASSERT_EQ( text_pos[curr], res[i].pos );
+			ASSERT_EQ( expect_offset, res[i].offset );
+			ASSERT_EQ( (unsigned int)( text_pos[curr + expect_length] - text_pos[curr] ), res[i].length );
+			curr += expect_length;
+		}
+	}
+	ASSERT_EQ( num_text_cps, curr );
+
+	free( text );
+	free( text_offsets );
+	free( text_cps );
+	free( seq_table );
+	free( table );
+	return 0;
+}
+
+TEST measure_width()
+{
+	// ... all ascii except every 7th char, latin-1 and some cjk, advance derived from the codepoint ...
+	unsigned int num_cps = 0;
+	unsigned int test_cps[1024];
+	int32_t      advances[1024];
+	for( unsigned int cp = 1; cp < 0x100; ++cp )
+		if( cp % 7 != 0 )
+			test_cps[num_cps++] = cp;
+	for( unsigned int cp = 0x4E00; cp < 0x4F00; ++cp )
+		test_cps[num_cps++] = cp;
+	for( unsigned int i = 0; i < num_cps; ++i )
+		advances[i] = (int32_t)( test_cps[i] * 37 % 1000 ) - 100;
+
+	size_t size;
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_calc_advance_table_size( &size, test_cps, num_cps ) );
+	void* table = malloc( size );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_BUFFER_TO_SMALL, utf8_lookup_gen_advance_table( table, size - 1, test_cps, advances, num_cps, 555 ) );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_gen_advance_table( table, size, test_cps, advances, num_cps, 555 ) );
+
+	ASSERT_EQ( 0, utf8_lookup_measure( table, (const uint8_t*)"", 0x0 ) );
+
+	static const char* texts[] = { "danish.txt", "chinese1.txt", "stb_image.h" };
+	for( size_t t = 0; t < ARRAY_LENGTH( texts ); ++t )
+	{
+		size_t text_size;
+		uint8_t* loaded = load_text( texts[t], &text_size );
+		ASSERT( loaded != 0x0 );
+
+		// ... the first 64 KB at all alignments against lookup + sum ...
+		size_t len = text_size < 64 * 1024 ? text_size : 64 * 1024;
+		while( len > 0 && ( loaded[len] & 0xC0 ) == 0x80 )
+			--len;
+		uint8_t* buffer = (uint8_t*)malloc( len + 32 );
+		size_t num_chars = 0;
+		int64_t* prefix = 0x0;
+		int64_t* expect = 0x0;
+		utf8_lookup_result* res = 0x0;
+
+		for( size_t align = 0; align < 16; align += 5 )
+		{
+			uint8_t* text = buffer + align;
+			memcpy( text, loaded, len );
+			text[len] = 0;
+
+			if( res == 0x0 )
+			{
+				num_chars = utf8_lookup_count_chars( text );
+				res    = (utf8_lookup_result*)malloc( num_chars * sizeof( utf8_lookup_result ) );
+				prefix = (int64_t*)malloc( num_chars * sizeof( int64_t ) );
+				expect = (int64_t*)malloc( num_chars * sizeof( int64_t ) );
+			}
+
+			ASSERT_EQ( num_chars, utf8_lookup_perform_all( table, text, res ) );
+			int64_t width = 0;
+			for( size_t i = 0; i < num_chars; ++i )
+			{
+				width += res[i].offset == 0 ? 555 : advances[ res[i].offset - 1 ];
+				expect[i] = width;
+			}
+
+			ASSERT_EQ( width, utf8_lookup_measure( table, text, 0x0 ) );
+			ASSERT_EQ( width, utf8_lookup_measure( table, text, prefix ) );
+			ASSERT_EQ( 0, memcmp( expect, prefix, num_chars * sizeof( int64_t ) ) );
+		}
+
+		free( res );
+		free( prefix );
+		free( expect );
+		free( buffer );
+		free( loaded );
+	}
+
+	free( table );
+
+	// ... advances large enough that two of them overflow 32 bit, over full aligned ascii-blocks ...
+	unsigned int big_cps[26];
+	int32_t      big_advances[26];
+	for( unsigned int i = 0; i < 26; ++i )
+	{
+		big_cps[i]      = 'a' + i;
+		big_advances[i] = 0x60000000;
+	}
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_calc_advance_table_size( &size, big_cps, 26 ) );
+	table = malloc( size );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_gen_advance_table( table, size, big_cps, big_advances, 26, 0 ) );
+
+	// ... malloc:ed to get a 16 byte aligned string ...
+	uint8_t* big_text = (uint8_t*)malloc( 64 );
+	memcpy( big_text, "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuv", 49 );
+	int64_t big_prefix[48];
+	int64_t big_width        = utf8_lookup_measure( table, big_text, 0x0 );
+	int64_t big_prefix_width = utf8_lookup_measure( table, big_text, big_prefix );
+	free( big_text );
+	free( table );
+	ASSERT_EQ( 77309411328LL, big_width );
+	ASSERT_EQ( 77309411328LL, big_prefix_width );
+	ASSERT_EQ( 77309411328LL, big_prefix[47] );
+	return 0;
+}
+
+static int test_break_class( unsigned int cp )
+{
+	if( cp == '\n' )
+		return UTF8_LOOKUP_BREAK_MANDATORY;
+	if( cp == ' ' || cp == '\t' || cp == '\r' )
+		return UTF8_LOOKUP_BREAK_SPACE;
+	if( cp == '-' || ( cp >= 0x4E00 && cp < 0xA000 ) )
+		return UTF8_LOOKUP_BREAK_AFTER;
+	return UTF8_LOOKUP_BREAK_NONE;
+}
+
+// ... reference line-breaker, rescans each line from its start over chars already looked up ...
+static size_t break_lines_reference( const uint8_t* text, const utf8_lookup_result* res, size_t num_chars,
+                                     const int32_t* advances, const int* classes, int64_t max_width,
+                                     utf8_lookup_line* lines )
+{
+	size_t num_lines = 0;
+	size_t start = 0;
+	while( start < num_chars )
+	{
+		int64_t width = 0;
+		size_t  content_end = start;
+		int64_t content_width = 0;
+		size_t  last_break = (size_t)-1;
+		size_t  next_start = num_chars;
+		size_t  line_end = num_chars;
+		for( size_t k = start; k < num_chars; ++k )
+		{
+			int cls = classes[ res[k].offset ];
+			int32_t advance = advances[ res[k].offset ];
+			if( cls == UTF8_LOOKUP_BREAK_MANDATORY )
+			{
+				line_end = k; next_start = k + 1;
+				break;
+			}
+			if( cls == UTF8_LOOKUP_BREAK_SPACE )
+			{
+				width += advance;
+				last_break = k + 1;
+				continue;
+			}
+			if( width + advance > max_width && content_end != start )
+			{
+				line_end = next_start = last_break != (size_t)-1 ? last_break : k;
+				break;
+			}
+			width += advance;
+			content_end = k + 1;
+			content_width = width;
+			if( cls == UTF8_LOOKUP_BREAK_AFTER )
+				last_break = k + 1;
+		}
+
+		// ... trailing spaces is not part of the line ...
+		size_t end = line_end;
+		while( end > start && classes[ res[end - 1].offset ] == UTF8_LOOKUP_BREAK_SPACE )
+			--end;
+		content_width = 0;
+		for( size_t k = start; k < end; ++k )
+			content_width += advances[ res[k].offset ];
+
+		const uint8_t* end_pos = end == num_chars ? text + strlen( (const char*)text ) : res[end].pos;
+		lines[num_lines].pos         = res[start].pos;
+		lines[num_lines].byte_length = (size_t)( end_pos - res[start].pos );
+		lines[num_lines].width       = content_width;
+		++num_lines;
+		start = next_start;
+	}
+	return num_lines;
+}
+
+TEST break_lines()
+{
+	unsigned int num_cps = 0;
+	unsigned int* test_cps = (unsigned int*)malloc( 0x6000 * sizeof( unsigned int ) );
+	int32_t*      advances = (int32_t*)malloc( 0x6000 * sizeof( int32_t ) );
+	uint8_t*      classes  = (uint8_t*)malloc( 0x6000 );
+	for( unsigned int cp = 1; cp < 0x100; ++cp )
+		test_cps[num_cps++] = cp;
+	for( unsigned int cp = 0x4E00; cp < 0xA000; ++cp )
+		test_cps[num_cps++] = cp;
+
+	// ... index by offset, 0 is missing ...
+	int32_t expect_advances[0x6000];
+	int     expect_classes[0x6000];
+	expect_advances[0] = 13;
+	expect_classes[0]  = UTF8_LOOKUP_BREAK_NONE;
+	for( unsigned int i = 0; i < num_cps; ++i )
+	{
+		advances[i] = (int32_t)( 1 + test_cps[i] * 37 % 20 );
+		if( test_cps[i] == 'a' || test_cps[i] == '-' )
+			advances[i] = 1;
+		if( test_cps[i] == ' ' )
+			advances[i] = 5;
+		classes[i]  = (uint8_t)test_break_class( test_cps[i] );
+		expect_advances[i + 1] = advances[i];
+		expect_classes[i + 1]  = classes[i];
+	}
+
+	size_t advance_size, class_size;
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_calc_advance_table_size( &advance_size, test_cps, num_cps ) );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_calc_class_table_size( &class_size, test_cps, num_cps ) );
+	void* advance_table = malloc( advance_size );
+	void* class_table   = malloc( class_size );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_gen_advance_table( advance_table, advance_size, test_cps, advances, num_cps, 13 ) );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_gen_class_table( class_table, class_size, test_cps, classes, num_cps, UTF8_LOOKUP_BREAK_NONE ) );
+
+	utf8_lookup_line lines[8];
+	size_t num_lines = ARRAY_LENGTH( lines );
+	const uint8_t* empty = (const uint8_t*)"";
+	ASSERT_EQ( empty, utf8_lookup_break_lines( advance_table, class_table, empty, 100, lines, &num_lines ) );
+	ASSERT_EQ( 0, num_lines );
+
+	// ... hanging spaces, break-after, mandatory breaks and broken words, 'a' and '-' is 1 wide and ' ' 5 ...
+	const uint8_t* simple = (const uint8_t*)"aa aa-aaa  aaaa\n\naaaaaaaaa";
+	num_lines = ARRAY_LENGTH( lines );
+	ASSERT_EQ( simple + strlen( (const char*)simple ), utf8_lookup_break_lines( advance_table, class_table, simple, 4, lines, &num_lines ) );
+	ASSERT_EQ( 8, num_lines );
+	ASSERT_EQ( simple +  0, lines[0].pos ); ASSERT_EQ( 2, lines[0].byte_length ); ASSERT_EQ( 2, lines[0].width );
+	ASSERT_EQ( simple +  3, lines[1].pos ); ASSERT_EQ( 3, lines[1].byte_length ); ASSERT_EQ( 3, lines[1].width );
+	ASSERT_EQ( simple +  6, lines[2].pos ); ASSERT_EQ( 3, lines[2].byte_length ); ASSERT_EQ( 3, lines[2].width );
+	ASSERT_EQ( simple + 11, lines[3].pos ); ASSERT_EQ( 4, lines[3].byte_length ); ASSERT_EQ( 4, lines[3].width );
+	ASSERT_EQ( simple + 16, lines[4].pos ); ASSERT_EQ( 0, lines[4].byte_length ); ASSERT_EQ( 0, lines[4].width );
+	ASSERT_EQ( simple + 17, lines[5].pos ); ASSERT_EQ( 4, lines[5].byte_length ); ASSERT_EQ( 4, lines[5].width );
+	ASSERT_EQ( simple + 21, lines[6].pos ); ASSERT_EQ( 4, lines[6].byte_length ); ASSERT_EQ( 4, lines[6].width );
+	ASSERT_EQ( simple + 25, lines[7].pos ); ASSERT_EQ( 1, lines[7].byte_length ); ASSERT_EQ( 1, lines[7].width );
+
+	// ... a full lines-buffer returns the start of the next line ...
+	num_lines = 3;
+	ASSERT_EQ( simple + 11, utf8_lookup_break_lines( advance_table, class_table, simple, 4, lines, &num_lines ) );
+	ASSERT_EQ( 3, num_lines );
+
+	static const char* texts[] = { "danish.txt", "chinese1.txt", "stb_image.h" };
+	static const int64_t widths[] = { 0, 40, 300, 5000 };
+	for( size_t t = 0; t < ARRAY_LENGTH( texts ); ++t )
+	{
+		size_t text_size;
+		uint8_t* text = load_text( texts[t], &text_size );
+		ASSERT( text != 0x0 );
+
+		size_t len = text_size < 64 * 1024 ? text_size : 64 * 1024;
+		while( len > 0 && ( text[len] & 0xC0 ) == 0x80 )
+			--len;
+		text[len] = 0;
+
+		size_t num_chars = utf8_lookup_count_chars( text );
+		utf8_lookup_result* res = (utf8_lookup_result*)malloc( num_chars * sizeof( utf8_lookup_result ) );
+		utf8_lookup_line* expect = (utf8_lookup_line*)malloc( ( num_chars + 1 ) * sizeof( utf8_lookup_line ) );
+		utf8_lookup_line* result = (utf8_lookup_line*)malloc( ( num_chars + 1 ) * sizeof( utf8_lookup_line ) );
+		ASSERT_EQ( num_chars, utf8_lookup_perform_all( advance_table, text, res ) );
+
+		for( size_t w = 0; w < ARRAY_LENGTH( widths ); ++w )
+		{
+			size_t num_expect = break_lines_reference( text, res, num_chars, expect_advances, expect_classes, widths[w], expect );
+
+			// ... in one go and in chunks of 7 lines ...
+			num_lines = num_chars + 1;
+			ASSERT_EQ( text + len, utf8_lookup_break_lines( advance_table, class_table, text, widths[w], result, &num_lines ) );
+			ASSERT_EQ( num_expect, num_lines );
+			ASSERT_EQ( 0, memcmp( expect, result, num_expect * sizeof( utf8_lookup_line ) ) );
+
+			size_t total = 0;
+			const uint8_t* str = text;
+			while( *str )
+			{
+				num_lines = 7;
+				str = utf8_lookup_break_lines( advance_table, class_table, str, widths[w], result + total, &num_lines );
+				total += num_lines;
+			}
+			ASSERT_EQ( num_expect, total );
+			ASSERT_EQ( 0, memcmp( expect, result, num_expect * sizeof( utf8_lookup_line ) ) );
+		}
+
+		free( res );
+		free( expect );
+		free( result );
+		free( text );
+	}
+
+	free( advance_table );
+	free( class_table );
+	free( test_cps );
+	free( advances );
+	free( classes );
+	return 0;
+}
+
+TEST perform_parallel()
+{
+	unsigned int num_cps = 0;
+	unsigned int* test_cps = (unsigned int*)malloc( ( 0x80 + 0x110000 / 37 ) * sizeof(unsigned int) );
+	for( unsigned int cp = 1; cp < 0x80; ++cp )
+		test_cps[num_cps++] = cp;
+	for( unsigned int cp = 0x80; cp < 0x110000; cp += 37 )
+		test_cps[num_cps++] = cp;
+
+	size_t size;
+	utf8_lookup_calc_table_size( &size, test_cps, num_cps );
+	void* table = malloc( size );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_gen_table( table, size, test_cps, num_cps ) );
+
+	utf8_lookup_result small[4];
+	ASSERT_EQ( 0, utf8_lookup_perform_parallel( table, (const uint8_t*)"", 0, small, 8 ) );
+	ASSERT_EQ( 3, utf8_lookup_perform_parallel( table, (const uint8_t*)"abc", 3, small, 8 ) );
+
+	// ... every 3rd codepoint, all lengths, gives splits in the middle of chars of all lengths ...
+	uint8_t* synthetic = (uint8_t*)malloc( 0x110000 / 3 * 4 + 16 );
+	uint8_t* out = synthetic;
+	for( unsigned int cp = 1; cp < 0x110000; cp += 3 )
+		out = encode_utf8( out, cp );
+	*out = '\0';
+
+	static const char* texts[] = { "russian.txt", "chinese1.txt", "stb_image.h" };
+	for( size_t t = 0; t <= ARRAY_LENGTH( texts ); ++t )
+	{
+		size_t text_size;
+		uint8_t* text = t < ARRAY_LENGTH( texts ) ? load_text( texts[t], &text_size ) : synthetic;
+		ASSERT( text != 0x0 );
+		if( text == synthetic )
+			text_size = (size_t)( out - synthetic );
+
+		size_t num_chars = utf8_lookup_count_chars( text );
+		utf8_lookup_result* expect = (utf8_lookup_result*)malloc( num_chars * sizeof( utf8_lookup_result ) );
+		utf8_lookup_result* res    = (utf8_lookup_result*)malloc( num_chars * sizeof( utf8_lookup_result ) );
+		ASSERT_EQ( num_chars, utf8_lookup_perform_all( table, text, expect ) );
+
+		static const unsigned int num_threads[] = { 1, 2, 3, 7, 64, 1000 };
+		for( size_t n = 0; n < ARRAY_LENGTH( num_threads ); ++n )
+		{
+			memset( res, 0x0, num_chars * sizeof( utf8_lookup_result ) );
+			ASSERT_EQ( num_chars, utf8_lookup_perform_parallel( table, text, text_size, res, num_threads[n] ) );
+			for( size_t i = 0; i < num_chars; ++i )
+			{
+				ASSERT_EQ( expect[i].pos,    res[i].pos );
+				ASSERT_EQ( expect[i].offset, res[i].offset );
+			}
+		}
+
+		free( expect );
+		free( res );
+		if( text != synthetic )
+			free( text );
+	}
+
+	free( synthetic );
+	free( table );
+	free( test_cps );
+	return 0;
+}
+
+// ... 'a' - 'z' and one of the 64 codepoints from 0x100 picked by generation ...
+static void* hot_table_build( unsigned int generation )
+{
+	unsigned int cps[27];
+	for( unsigned int i = 0; i < 26; ++i )
+		cps[i] = 'a' + i;
+	cps[26] = 0x100 + generation % 64;
+
+	size_t size;
+	utf8_lookup_calc_table_size( &size, cps, ARRAY_LENGTH( cps ) );
+	void* table = malloc( size );
+	utf8_lookup_gen_table( table, size, cps, ARRAY_LENGTH( cps ) );
+	return table;
+}
+
+// ... 1 if table looks like one built by hot_table_build ...
+static int hot_table_check( const void* table )
+{
+	utf8_lookup_result res[2];
+	size_t res_size = ARRAY_LENGTH( res );
+	utf8_lookup_perform( table, (const uint8_t*)"az", res, &res_size );
+	if( res_size != 2 || res[0].offset != 1 || res[1].offset != 26 )
+		return 0;
+
+	int found = 0;
+	for( unsigned int cp = 0x100; cp < 0x140; ++cp )
+	{
+		uint8_t str[5];
+		*encode_utf8( str, cp ) = 0;
+		res_size = 1;
+		utf8_lookup_perform( table, str, res, &res_size );
+		found += res[0].offset == 27;
+	}
+	return found == 1;
+}
+
+TEST hot_table()
+{
+	void* first = hot_table_build( 0 );
+	utf8_lookup_hot_table* hot;
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_hot_table_create( &hot, first, 2 ) );
+	ASSERT_EQ( first, utf8_lookup_hot_table_acquire( hot, 0 ) );
+
+	// ... first is held by reader 0, second by no-one ...
+	void* second = hot_table_build( 1 );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_hot_table_publish( hot, second ) );
+	ASSERT_EQ( 1, utf8_lookup_hot_table_pending( hot ) );
+	ASSERT_EQ( second, utf8_lookup_hot_table_acquire( hot, 1 ) );
+	utf8_lookup_hot_table_release( hot, 1 );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_hot_table_publish( hot, hot_table_build( 2 ) ) );
+	ASSERT_EQ( 1, utf8_lookup_hot_table_pending( hot ) );
+	ASSERT( hot_table_check( first ) );
+
+	utf8_lookup_hot_table_release( hot, 0 );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_hot_table_publish( hot, hot_table_build( 3 ) ) );
+	ASSERT_EQ( 0, utf8_lookup_hot_table_pending( hot ) );
+
+	utf8_lookup_hot_table_destroy( hot );
+	return 0;
+}
+
+struct hot_table_stress_state
+{
+	utf8_lookup_hot_table*    hot;
+	std::atomic<bool>         stop;
+	std::atomic<unsigned int> bad_reads;
+	std::atomic<unsigned int> reads;
+};
+
+static void hot_table_stress_reader( hot_table_stress_state* state, unsigned int reader )
+{
+	while( !state->stop.load() )
+	{
+		const void* table = utf8_lookup_hot_table_acquire( state->hot, reader );
+		if( !hot_table_check( table ) )
+			++state->bad_reads;
+		utf8_lookup_hot_table_release( state->hot, reader );
+		++state->reads;
+	}
+}
+
+TEST hot_table_stress()
+{
+	const unsigned int NUM_READERS = 4;
+	const unsigned int NUM_REBUILDS = 2000;
+
+	hot_table_stress_state state;
+	state.stop.store( false );
+	state.bad_reads.store( 0 );
+	state.reads.store( 0 );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_hot_table_create( &state.hot, hot_table_build( 0 ), NUM_READERS ) );
+
+	std::thread readers[NUM_READERS];
+	for( unsigned int r = 0; r < NUM_READERS; ++r )
+		readers[r] = std::thread( hot_table_stress_reader, &state, r );
+
+	// ... rebuild and publish continuously while the readers run, then wait for all readers to have read ...
+	unsigned int failed_publish = 0;
+	for( unsigned int i = 1; i <= NUM_REBUILDS; ++i )
+	{
+		failed_publish += utf8_lookup_hot_table_publish( state.hot, hot_table_build( i ) ) != UTF8_LOOKUP_ERROR_OK;
+		if( i % 100 == 0 )
+			std::this_thread::yield();
+	}
+	while( state.reads.load() < NUM_READERS * 100 )
+		std::this_thread::yield();
+
+	state.stop.store( true );
+	for( unsigned int r = 0; r < NUM_READERS; ++r )
+		readers[r].join();
+
+	ASSERT_EQ( 0, failed_publish );
+	ASSERT_EQ( 0, state.bad_reads.load() );
+
+	// ... no readers left, next publish frees everything replaced ...
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_hot_table_publish( state.hot, hot_table_build( 0 ) ) );
+	ASSERT_EQ( 0, utf8_lookup_hot_table_pending( state.hot ) );
+
+	utf8_lookup_hot_table_destroy( state.hot );
+	return 0;
+}
+
+#if !defined(_WIN32)
+static int shared_table_child( const unsigned int* cps, unsigned int num_cps )
+{
+	utf8_lookup_shared_table shared;
+	if( utf8_lookup_shared_table_acquire( &shared, cps, num_cps ) != UTF8_LOOKUP_ERROR_OK )
+		return 2;
+
+	const uint8_t* str = (const uint8_t*)"ab" "\xc3\xa4" "\xe1\x80\xa4" "q";
+	utf8_lookup_result res[16];
+	size_t res_size = ARRAY_LENGTH( res );
+	utf8_lookup_perform( shared.table, str, res, &res_size );
+
+	int ok = res_size == 5 &&
+			 res[0].offset == 1 &&
+			 res[1].offset == 2 &&
+			 res[2].offset == 3 &&
+			 res[3].offset == 4 &&
+			 res[4].offset == 0;
+
+	int created = shared.created;
+	utf8_lookup_shared_table_release( &shared );
+	return ok ? created : 3;
+}
+#endif
+
+TEST shared_table_multi_process()
+{
+#if defined(_WIN32)
+	SKIPm( "shared tables only supported on posix" );
+#else
+	unsigned int test_cps[] = { 'a', 'b', 228, 0x1024, 0x10801 };
+
+	// ... clear out any segment left behind by an earlier, crashed, run, the name is set even if acquire fails ...
+	utf8_lookup_shared_table shared;
+	utf8_lookup_shared_table_acquire( &shared, test_cps, ARRAY_LENGTH(test_cps) );
+	utf8_lookup_shared_table_unlink( &shared );
+	utf8_lookup_shared_table_release( &shared );
+
+	pid_t children[8];
+	for( size_t i = 0; i < ARRAY_LENGTH( children ); ++i )
+	{
+		children[i] = fork();
+		ASSERT( children[i] >= 0 );
+		if( children[i] == 0 )
+			_exit( shared_table_child( test_cps, ARRAY_LENGTH(test_cps) ) );
+	}
+
+	int num_created = 0;
+	for( size_t i = 0; i < ARRAY_LENGTH( children ); ++i )
+	{
+		int status;
+		ASSERT_EQ( children[i], waitpid( children[i], &status, 0 ) );
+		ASSERT( WIFEXITED( status ) );
+		ASSERT( WEXITSTATUS( status ) <= 1 );
+		num_created += WEXITSTATUS( status );
+	}
+
+	// ... exactly one process should have built the table, all others mapped it ...
+	ASSERT_EQ( 1, num_created );
+
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_shared_table_acquire( &shared, test_cps, ARRAY_LENGTH(test_cps) ) );
+	ASSERT_EQ( 0, shared.created );
+
+	size_t size;
+	utf8_lookup_calc_table_size( &size, test_cps, ARRAY_LENGTH(test_cps) );
+	ASSERT_EQ( size, shared.table_size );
+
+	utf8_lookup_shared_table_unlink( &shared );
+	utf8_lookup_shared_table_release( &shared );
+#endif
+	return 0;
+}
+
+#if !defined(_WIN32)
+/**
+ * Create a segment as another process would have, table and codepoints from cps with header-fields as passed.
+ */
+static int shared_table_plant( const utf8_lookup_shared_table* shared, const unsigned int* cps, unsigned int num_cps,
+							   uint64_t hash, uint64_t creator, uint64_t ready, mode_t mode )
+{
+	int fd = shm_open( shared->name, O_RDWR | O_CREAT | O_EXCL, 0600 );
+	if( fd < 0 )
+		return 1;
+	int ok = fchmod( fd, mode ) == 0 && ftruncate( fd, (off_t)shared->mapping_size ) == 0;
+	uint8_t* mem = ok ? (uint8_t*)mmap( 0x0, shared->mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 ) : (uint8_t*)MAP_FAILED;
+	close( fd );
+	if( mem == MAP_FAILED )
+		return 1;
+
+	utf8_lookup_shared_header* header = (utf8_lookup_shared_header*)mem;
+	ok = utf8_lookup_gen_table( header + 1, shared->table_size, cps, num_cps ) == UTF8_LOOKUP_ERROR_OK;
+	memcpy( (uint8_t*)( header + 1 ) + shared->table_size, cps, num_cps * sizeof( unsigned int ) );
+	header->magic          = UTF8_LOOKUP_SHARED_MAGIC;
+	header->hash           = hash;
+	header->num_codepoints = num_cps;
+	header->table_size     = shared->table_size;
+	header->creator        = creator;
+	header->ready          = ready;
+	munmap( mem, shared->mapping_size );
+	return ok ? 0 : 1;
+}
+
+static int shared_table_exists( const utf8_lookup_shared_table* shared )
+{
+	int fd = shm_open( shared->name, O_RDONLY, 0 );
+	if( fd >= 0 )
+		close( fd );
+	return fd >= 0;
+}
+#endif
+
+TEST shared_table_recover_stale()
+{
+#if defined(_WIN32)
+	SKIPm( "shared tables only supported on posix" );
+#else
+	unsigned int test_cps[] = { 'a', 'b', 228, 0x1024, 0x10802 };
+	uint64_t hash = utf8_lookup_hash_codepoints( test_cps, ARRAY_LENGTH(test_cps) );
+
+	// ... clear out any segment left behind by an earlier run, the name is set even if acquire fails ...
+	utf8_lookup_shared_table shared;
+	utf8_lookup_shared_table_acquire( &shared, test_cps, ARRAY_LENGTH(test_cps) );
+	utf8_lookup_shared_table_unlink( &shared );
+	utf8_lookup_shared_table_release( &shared );
+
+	// ... creator died before setting ready, the segment is replaced ...
+	ASSERT_EQ( 0, shared_table_plant( &shared, test_cps, ARRAY_LENGTH(test_cps), hash, 0, 0, 0600 ) );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_shared_table_acquire( &shared, test_cps, ARRAY_LENGTH(test_cps) ) );
+	ASSERT_EQ( 1, shared.created );
+	utf8_lookup_result res[1];
+	size_t res_size = 1;
+	utf8_lookup_perform( shared.table, (const uint8_t*)"\xf0\x90\xa0\x82", res, &res_size );
+	ASSERT_EQ( 5, res[0].offset );
+	utf8_lookup_shared_table_unlink( &shared );
+	utf8_lookup_shared_table_release( &shared );
+
+	// ... creator still alive but slow, the segment is left for it to finish ...
+	ASSERT_EQ( 0, shared_table_plant( &shared, test_cps, ARRAY_LENGTH(test_cps), hash, (uint64_t)getpid(), 0, 0600 ) );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_SHARED_MEMORY_FAILED, utf8_lookup_shared_table_acquire( &shared, test_cps, ARRAY_LENGTH(test_cps) ) );
+	ASSERT( shared_table_exists( &shared ) );
+	utf8_lookup_shared_table_unlink( &shared );
+#endif
+	return 0;
+}
+
+TEST shared_table_untrusted()
+{
+#if defined(_WIN32)
+	SKIPm( "shared tables only supported on posix" );
+#else
+	unsigned int test_cps[]  = { 'a', 'b', 228, 0x1024, 0x10802 };
+	unsigned int other_cps[] = { 'a', 'b', 228, 0x1024, 0x10803 };
+	uint64_t hash = utf8_lookup_hash_codepoints( test_cps, ARRAY_LENGTH(test_cps) );
+
+	// ... clear out any segment left behind by an earlier run, the name is set even if acquire fails ...
+	utf8_lookup_shared_table shared;
+	utf8_lookup_shared_table_acquire( &shared, test_cps, ARRAY_LENGTH(test_cps) );
+	utf8_lookup_shared_table_unlink( &shared );
+	utf8_lookup_shared_table_release( &shared );
+
+	// ... another set with the same hash is reported and not removed ...
+	ASSERT_EQ( 0, shared_table_plant( &shared, other_cps, ARRAY_LENGTH(other_cps), hash, 0, 1, 0600 ) );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_SHARED_MEMORY_COLLISION, utf8_lookup_shared_table_acquire( &shared, test_cps, ARRAY_LENGTH(test_cps) ) );
+	ASSERT( shared_table_exists( &shared ) );
+	utf8_lookup_shared_table_unlink( &shared );
+
+	// ... writable by others, could have been planted by another user ...
+	ASSERT_EQ( 0, shared_table_plant( &shared, test_cps, ARRAY_LENGTH(test_cps), hash, 0, 1, 0622 ) );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_SHARED_MEMORY_FAILED, utf8_lookup_shared_table_acquire( &shared, test_cps, ARRAY_LENGTH(test_cps) ) );
+	ASSERT( shared_table_exists( &shared ) );
+	utf8_lookup_shared_table_unlink( &shared );
+
+	// ... correct header and codepoints but offsets out of range in the table ...
+	static const size_t corrupt_offsets[] = { 2, 3, 9 };
+	for( size_t c = 0; c < ARRAY_LENGTH( corrupt_offsets ); ++c )
+	{
+		ASSERT_EQ( 0, shared_table_plant( &shared, test_cps, ARRAY_LENGTH(test_cps), hash, 0, 0, 0600 ) );
+		int fd = shm_open( shared.name, O_RDWR, 0 );
+		ASSERT( fd >= 0 );
+		uint8_t* mem = (uint8_t*)mmap( 0x0, shared.mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+		close( fd );
+		ASSERT( mem != MAP_FAILED );
+		utf8_lookup_shared_header* header = (utf8_lookup_shared_header*)mem;
+		( (uint16_t*)utf8_lookup_offsets( header + 1 ) )[ corrupt_offsets[c] ] = 0xFFF0;
+		header->ready = 1;
+		munmap( mem, shared.mapping_size );
+
+		ASSERT_EQ( UTF8_LOOKUP_ERROR_SHARED_MEMORY_FAILED, utf8_lookup_shared_table_acquire( &shared, test_cps, ARRAY_LENGTH(test_cps) ) );
+		utf8_lookup_shared_table_unlink( &shared );
+	}
+
+	// ... and a valid segment is still mapped ...
+	ASSERT_EQ( 0, shared_table_plant( &shared, test_cps, ARRAY_LENGTH(test_cps), hash, 0, 1, 0600 ) );
+	ASSERT_EQ( UTF8_LOOKUP_ERROR_OK, utf8_lookup_shared_table_acquire( &shared, test_cps, ARRAY_LENGTH(test_cps) ) );
+	ASSERT_EQ( 0, shared.created );
+	utf8_lookup_shared_table_unlink( &shared );
+	utf8_lookup_shared_table_release( &shared );
+#endif
+	return 0;
+}
+
 GREATEST_SUITE( utf8_lookup )
 {
 	RUN_TEST( octet_1_simple );
@@ -609,6 +3028,41 @@ GREATEST_SUITE( utf8_lookup )
 	RUN_TEST( octet_2_and_3 );
 	RUN_TEST( octet_1_2_and_3 );
 	RUN_TEST( octet_1_2_3_and_4 );
+	RUN_TEST( read_only_table );
+	RUN_TEST( fallback_chain );
+	RUN_TEST( merged_table );
+	RUN_TEST( merged_table_limits );
+	RUN_TEST( count_missing );
+	RUN_TEST( collect_missing );
+	RUN_TEST( reverse_lookup );
+	RUN_TEST( reverse_lookup_large );
+	RUN_TEST( set_op_simple );
+	RUN_TEST( set_op_large );
+	RUN_TEST( membership_table );
+	RUN_TEST( successor_and_rank );
+	RUN_TEST( successor_and_rank_large );
+	RUN_TEST( table_stats );
+	RUN_TEST( stream_chunks );
+	RUN_TEST( count_chars_and_perform_all );
+	RUN_TEST( utf16_input );
+	RUN_TEST( utf16_input_surrogate_in_table );
+	RUN_TEST( utf32_input );
+	RUN_TEST( perform_ex );
+	RUN_TEST( perform_runs );
+	RUN_TEST( lookup_map );
+	RUN_TEST( class_runs );
+	RUN_TEST( kerning_pairs );
+	RUN_TEST( kerning_duplicate_pairs );
+	RUN_TEST( sequences );
+	RUN_TEST( measure_width );
+	RUN_TEST( break_lines );
+	RUN_TEST( perform_to_utf16 );
+	RUN_TEST( perform_parallel );
+	RUN_TEST( hot_table );
+	RUN_TEST( hot_table_stress );
+	RUN_TEST( shared_table_multi_process );
+	RUN_TEST( shared_table_recover_stale );
+	RUN_TEST( shared_table_untrusted );
 }
 
 GREATEST_MAIN_DEFS();
@@ -45,13 +45,140 @@ struct utf8_lookup_result
 	unsigned int   offset;  //< offset in glyph-table where to find character.
 };
 
+/**
+ * Struct containing result for one translated utf8-codepoint when doing lookup in a chain of tables.
+ */
+struct utf8_lookup_fallback_result
+{
+	const uint8_t* pos;     //< position in input-data that generated result
+	unsigned int   table;   //< index of first table that contained character, 0 if no table contained it.
+	unsigned int   offset;  //< offset in glyph-table for table where to find character, 0 if not found.
+};
+
+/**
+ * Struct containing result for one translated utf8-codepoint with the decoded char, see utf8_lookup_perform_ex.
+ */
+struct utf8_lookup_result_ex
+{
+	const uint8_t* pos;        //< position in input-data that generated result
+	unsigned int   offset;     //< offset in glyph-table where to find character.
+	unsigned int   codepoint;  //< decoded codepoint of character.
+	unsigned int   length;     //< length of character in bytes.
+};
+
+/**
+ * Struct describing one run of consecutive chars that are all found or all missing, see utf8_lookup_perform_runs.
+ */
+struct utf8_lookup_run
+{
+	const uint8_t* pos;          //< position in input-data where run starts.
+	size_t         byte_length;  //< length of run in bytes.
+	size_t         char_count;   //< number of chars in run.
+	int            found;        //< 1 if all chars in run are available in table, 0 if none of them are.
+};
+
+/**
+ * Struct describing one run of consecutive chars of the same class, see utf8_lookup_perform_class_runs.
+ */
+struct utf8_lookup_class_run
+{
+	const uint8_t* pos;          //< position in input-data where run starts.
+	size_t         byte_length;  //< length of run in bytes.
+	size_t         char_count;   //< number of chars in run.
+	uint8_t        class_id;     //< class of all chars in run.
+};
+
+/**
+ * Kerning between two codepoints, input to utf8_lookup_gen_kerning_table.
+ */
+struct utf8_lookup_kerning_pair
+{
+	unsigned int first;   //< codepoint of first char in pair.
+	unsigned int second;  //< codepoint of second char in pair.
+	int16_t      value;   //< kerning to apply between first and second.
+};
+
+/**
+ * Struct containing result for one translated utf8-codepoint with kerning, see utf8_lookup_perform_kerning.
+ */
+struct utf8_lookup_kerning_result
+{
+	const uint8_t* pos;      //< position in input-data that generated result
+	unsigned int   offset;   //< offset in glyph-table where to find character.
+	int            kerning;  //< kerning between the char before this char and this char, 0 if no pair was found.
+};
+
+/**
+ * Sequence of codepoints that map to one glyph, i.e. an emoji zwj-sequence, flag or keycap, input to
+ * utf8_lookup_gen_sequence_table.
+ */
+struct utf8_lookup_sequence
+{
+	const unsigned int* codepoints;      //< codepoints in sequence.
+	unsigned int        num_codepoints;  //< number of codepoints in sequence.
+};
+
+/**
+ * Struct containing result for one translated char or sequence, see utf8_lookup_perform_sequences.
+ */
+struct utf8_lookup_sequence_result
+{
+	const uint8_t* pos;     //< position in input-data that generated result
+	unsigned int   offset;  //< offset in glyph-table where to find character or sequence.
+	unsigned int   length;  //< length of character or sequence in bytes.
+};
+
+/**
+ * Break-classes to store in a class-table used with utf8_lookup_break_lines.
+ */
+enum utf8_lookup_break_class
+{
+	UTF8_LOOKUP_BREAK_NONE,      //< no break-opportunity after char.
+	UTF8_LOOKUP_BREAK_SPACE,     //< break-opportunity after char, char is not counted at the end of a line.
+	UTF8_LOOKUP_BREAK_AFTER,     //< break-opportunity after char, i.e. hyphens and ideographs.
+	UTF8_LOOKUP_BREAK_MANDATORY  //< line always ends after char, i.e. newline.
+};
+
+/**
+ * Struct describing one line, see utf8_lookup_break_lines.
+ */
+struct utf8_lookup_line
+{
+	const uint8_t* pos;          //< position in input-data where line starts.
+	size_t         byte_length;  //< length of line in bytes, trailing spaces and the mandatory break is not included.
+	int64_t        width;        //< width of line.
+};
+
+/**
+ * Struct containing result for one translated char when doing lookup in an utf16-string.
+ */
+struct utf8_lookup_utf16_result
+{
+	const uint16_t* pos;     //< position in input-data that generated result, first unit of a surrogate pair.
+	unsigned int    offset;  //< offset in glyph-table where to find character.
+};
+
+/**
+ * Operations supported by utf8_lookup_gen_set_op_table.
+ */
+enum utf8_lookup_set_op
+{
+	UTF8_LOOKUP_SET_UNION,        //< codepoints in table a or b.
+	UTF8_LOOKUP_SET_INTERSECTION, //< codepoints in both table a and b.
+	UTF8_LOOKUP_SET_DIFFERENCE    //< codepoints in table a but not in b.
+};
+
 /**
  * Error-codes returned from utf8_lookup.
  */
 enum utf8_lookup_error
 {
 	UTF8_LOOKUP_ERROR_OK,
-	UTF8_LOOKUP_ERROR_BUFFER_TO_SMALL
+	UTF8_LOOKUP_ERROR_BUFFER_TO_SMALL,
+	UTF8_LOOKUP_ERROR_SHARED_MEMORY_FAILED,
+	UTF8_LOOKUP_ERROR_OUT_OF_MEMORY,
+	UTF8_LOOKUP_ERROR_TOO_MANY_CODEPOINTS,
+	UTF8_LOOKUP_ERROR_SHARED_MEMORY_COLLISION
 };
 
 /**
@@ -63,9 +190,9 @@ enum utf8_lookup_error
  *
  * @return UTF8_LOOKUP_ERROR_OK on success.
  */
-utf8_lookup_error utf8_lookup_calc_table_size( size_t*       table_size,
-                                               unsigned int* codepoints,
-                                               unsigned int  num_codepoint );
+utf8_lookup_error utf8_lookup_calc_table_size( size_t*             table_size,
+                                               const unsigned int* codepoints,
+                                               unsigned int        num_codepoint );
 
 /**
  * Builds lookup-data to use with utf8_lookup_perform to lookup glyph offsets.
@@ -77,10 +204,10 @@ utf8_lookup_error utf8_lookup_calc_table_size( size_t*       table_size,
  *
  * @return UTF8_LOOKUP_ERROR_OK on success.
  */
-utf8_lookup_error utf8_lookup_gen_table( void*         table,
-                                         size_t        table_size,
-                                         unsigned int* codepoints,
-                                         unsigned int  num_codepoint );
+utf8_lookup_error utf8_lookup_gen_table( void*               table,
+                                         size_t              table_size,
+                                         const unsigned int* codepoints,
+                                         unsigned int        num_codepoint );
 
 /**
  * Perform lookup of offsets for chars in str.
@@ -93,486 +220,5917 @@ utf8_lookup_error utf8_lookup_gen_table( void*         table,
  * @return pointer into str to start of what is left of string after parse.
  *
  * @note str is assumed to be correct utf8, no error-checking is performed.
+ * @note table is never written to by the lookup, it is safe to place it in read-only memory, i.e. a
+ *       PROT_READ-mapping of a file or shared memory, and to share it between threads and processes.
  */
-const uint8_t* utf8_lookup_perform( void*               table,
+const uint8_t* utf8_lookup_perform( const void*         table,
                                     const uint8_t*      str,
                                     utf8_lookup_result* res,
                                     size_t*             res_size );
 
-#ifdef __cplusplus
-}
-#endif
+/**
+ * Same as utf8_lookup_perform but also return the decoded codepoint and byte-length of each char, decoded
+ * from the same bytes as is used to walk the table.
+ *
+ * @param table memory area containing data packed with utf8_lookup_gen_table.
+ * @param str string to make lookup in.
+ * @param res pointer to buffer where to return result.
+ * @param res_size size of res.
+ *
+ * @return pointer into str to start of what is left of string after parse.
+ *
+ * @note str is assumed to be correct utf8, no error-checking is performed.
+ */
+const uint8_t* utf8_lookup_perform_ex( const void*            table,
+                                       const uint8_t*         str,
+                                       utf8_lookup_result_ex* res,
+                                       size_t*                res_size );
 
-#if defined(UTF8_LOOKUP_IMPLEMENTATION)
+/**
+ * Same as utf8_lookup_perform but also transcode str to utf16, decoded from the same bytes as is used to walk
+ * the table. Parse stops when either res or utf16 is full.
+ *
+ * @param table memory area containing data packed with utf8_lookup_gen_table.
+ * @param str string to make lookup in.
+ * @param res pointer to buffer where to return result.
+ * @param res_size size of res.
+ * @param utf16 pointer to buffer where to write utf16 code units, in native byte-order and not 0-terminated.
+ * @param utf16_size size of utf16 in code units, returns number of code units written.
+ *
+ * @return pointer into str to start of what is left of string after parse.
+ *
+ * @note str is assumed to be correct utf8, no error-checking is performed.
+ * @note codepoints above 0xFFFF is written as a surrogate pair and still only produce one result.
+ */
+const uint8_t* utf8_lookup_perform_to_utf16( const void*         table,
+                                             const uint8_t*      str,
+                                             utf8_lookup_result* res,
+                                             size_t*             res_size,
+                                             uint16_t*           utf16,
+                                             size_t*             utf16_size );
 
-#include <ctype.h>
-#include <string.h>
+/**
+ * Count the chars in str, i.e. the number of results utf8_lookup_perform will produce for str. Used to
+ * allocate a result-buffer that fits the whole string before calling utf8_lookup_perform_all.
+ *
+ * @param str 0-terminated string to count chars in.
+ *
+ * @return number of chars in str.
+ *
+ * @note str is assumed to be correct utf8, no error-checking is performed.
+ */
+size_t utf8_lookup_count_chars( const uint8_t* str );
 
-#if defined( __GNUC__ )
-#  include <cpuid.h>
-#elif defined( _MSC_VER )
-#  include <intrin.h>
-#endif
+/**
+ * Perform lookup of all chars in str in one call.
+ *
+ * @param table memory area containing data packed with utf8_lookup_gen_table.
+ * @param str string to make lookup in.
+ * @param res pointer to buffer where to return result, need room for utf8_lookup_count_chars( str ) items.
+ *
+ * @return number of items written to res.
+ *
+ * @note str is assumed to be correct utf8, no error-checking is performed.
+ */
+size_t utf8_lookup_perform_all( const void*         table,
+                                const uint8_t*      str,
+                                utf8_lookup_result* res );
 
-/*
-	range		      binary code point             utf8 bytes
-	 0 - 7F           0xxxxxxx                      0xxxxxxx
+/**
+ * Perform lookup of offsets for chars in an utf16-string, without converting it to utf8 first.
+ *
+ * @param table memory area containing data packed with utf8_lookup_gen_table.
+ * @param str 0-terminated utf16-string, in native byte-order, to make lookup in.
+ * @param res pointer to buffer where to return result.
+ * @param res_size size of res.
+ *
+ * @return pointer into str to start of what is left of string after parse.
+ *
+ * @note a surrogate pair is returned as one result. An unpaired surrogate is returned as its own char,
+ *       that is never found in the table, even if the table was generated with that surrogate.
+ */
+const uint16_t* utf8_lookup_perform_utf16( const void*               table,
+                                           const uint16_t*           str,
+                                           utf8_lookup_utf16_result* res,
+                                           size_t*                   res_size );
 
-	80 - 7FF          00000yyy yyxxxxxx             110yyyyy
-													10xxxxxx
+/**
+ * Perform lookup of offsets for an array of codepoints, i.e. utf32, without converting it to utf8 first.
+ *
+ * @param table memory area containing data packed with utf8_lookup_gen_table.
+ * @param codepoints codepoints to make lookup for.
+ * @param num_codepoints number of codepoints in codepoints.
+ * @param offsets offset for codepoints[i] is returned in offsets[i], need room for num_codepoints items.
+ *
+ * @note codepoints > 0x10FFFF is returned as not found.
+ */
+void utf8_lookup_perform_utf32( const void*         table,
+                                const unsigned int* codepoints,
+                                size_t              num_codepoints,
+                                unsigned int*       offsets );
 
-	800 - FFFF        zzzzyyyy yyxxxxxx             1110zzzz
-													10yyyyyy
-													10xxxxxx
+/**
+ * Perform lookup of offsets for chars in str in a chain of tables, i.e. a primary font followed by
+ * fallback-fonts. Each char is decoded once and the first table containing the char is returned, the
+ * next table in the chain is only walked on a miss.
+ *
+ * @param tables tables packed with utf8_lookup_gen_table, in priority order.
+ * @param num_tables number of tables in tables.
+ * @param str string to make lookup in.
+ * @param res pointer to buffer where to return result.
+ * @param res_size size of res.
+ *
+ * @return pointer into str to start of what is left of string after parse.
+ *
+ * @note str is assumed to be correct utf8, no error-checking is performed.
+ * @note a char not found in any table is returned as table 0, offset 0, i.e. the "not found"-glyph
+ *       of the primary table.
+ */
+const uint8_t* utf8_lookup_perform_fallback( const void* const*           tables,
+                                             unsigned int                 num_tables,
+                                             const uint8_t*               str,
+                                             utf8_lookup_fallback_result* res,
+                                             size_t*                      res_size );
 
-	10000 - 10FFFF    000wwwzz zzzzyyyy yyxxxxxx    11110www
-													10zzzzzz
-													10yyyyyy
-													10xxxxxx
+/**
+ * Calculates the size needed to build a merged lookup-table for several codepoint-sets, i.e. the glyphs
+ * of a primary font and its fallback-fonts.
+ *
+ * @param table_size pointer to a size_t where to return the size.
+ * @param codepoints codepoint-sets to merge in priority order, each set sorted from small to big.
+ * @param num_codepoints number of codepoints in each set.
+ * @param num_sets number of sets in codepoints, max 65535.
+ *
+ * @return UTF8_LOOKUP_ERROR_OK on success, UTF8_LOOKUP_ERROR_TOO_MANY_CODEPOINTS if the union of all sets
+ *         has more than 65535 codepoints or there is more than 65535 sets.
+ */
+utf8_lookup_error utf8_lookup_calc_merged_table_size( size_t*                   table_size,
+                                                      const unsigned int* const* codepoints,
+                                                      const unsigned int*        num_codepoints,
+                                                      unsigned int               num_sets );
 
+/**
+ * Builds a merged lookup-table to use with utf8_lookup_perform_merged. All sets share one trie where each
+ * codepoint resolves to the first set containing it and the offset of the codepoint in that set.
+ *
+ * @param table memory area where to build lookup-data
+ * @param table_size size of data pointed to by table
+ * @param codepoints codepoint-sets to merge in priority order, each set sorted from small to big.
+ * @param num_codepoints number of codepoints in each set.
+ * @param num_sets number of sets in codepoints, max 65535.
+ *
+ * @return UTF8_LOOKUP_ERROR_OK on success, UTF8_LOOKUP_ERROR_TOO_MANY_CODEPOINTS if the union of all sets
+ *         has more than 65535 codepoints or there is more than 65535 sets.
+ */
+utf8_lookup_error utf8_lookup_gen_merged_table( void*                      table,
+                                                size_t                     table_size,
+                                                const unsigned int* const* codepoints,
+                                                const unsigned int*        num_codepoints,
+                                                unsigned int               num_sets );
 
+/**
+ * Perform lookup of chars in str in a table built with utf8_lookup_gen_merged_table. Results are the
+ * same as utf8_lookup_perform_fallback with one table per set but costs only one trie-walk per char.
+ *
+ * @param table memory area containing data packed with utf8_lookup_gen_merged_table.
+ * @param str string to make lookup in.
+ * @param res pointer to buffer where to return result.
+ * @param res_size size of res.
+ *
+ * @return pointer into str to start of what is left of string after parse.
+ *
+ * @note str is assumed to be correct utf8, no error-checking is performed.
+ */
+const uint8_t* utf8_lookup_perform_merged( const void*                  table,
+                                           const uint8_t*               str,
+                                           utf8_lookup_fallback_result* res,
+                                           size_t*                      res_size );
 
-	* if glyph do not exist in font, result shoud be zero ( place default glyph at zero )
-	* all octets need a base do do lookup in that need to be addressable for all bytes.
-		- for first octet 3 lookup elements is needed ( enough to cover all chars in octet )
-		- for the other octets one 32 bit lookup is needed since none of them has more than 5 bits
-		  in first byte that is valid for this byte.
+/**
+ * Count chars in str that are not available in table without producing any per-char result, i.e. to check
+ * if a font can render a string.
+ *
+ * @param table memory area containing data packed with utf8_lookup_gen_table.
+ * @param str string to check.
+ *
+ * @return number of chars in str not found in table.
+ *
+ * @note str is assumed to be correct utf8, no error-checking is performed.
+ */
+size_t utf8_lookup_count_missing( const void*    table,
+                                  const uint8_t* str );
 
-	* on octet one we need to find if the char is in character-group 0, 1 or 2 and on the other octets we need
-	  the code to say that they belong in sub-group 0 ( since there are only one on top-level. )
+/**
+ * Check if all chars in str are available in table, returns at first missing char.
+ *
+ * @param table memory area containing data packed with utf8_lookup_gen_table.
+ * @param str string to check.
+ *
+ * @return 1 if all chars in str was found in table, 0 otherwise.
+ *
+ * @note str is assumed to be correct utf8, no error-checking is performed.
+ */
+int utf8_lookup_all_present( const void*    table,
+                             const uint8_t* str );
 
-		- this is done by selecting a bitmask from octet of char. On octet one, we mask off top 3 and shift 5.
-		  mask with 0 on other octets.
+/**
+ * Split str into runs of consecutive chars that are all available or all missing in table, i.e. to group
+ * text by if it can be rendered with the primary font or need fallback.
+ *
+ * @param table memory area containing data packed with utf8_lookup_gen_table.
+ * @param str string to split.
+ * @param runs pointer to buffer where to return runs.
+ * @param num_runs size of runs, returns number of runs written.
+ *
+ * @return pointer into str to start of what is left of string after parse. Only complete runs are returned
+ *         so calling again with the returned pointer continues with the next run.
+ *
+ * @note str is assumed to be correct utf8, no error-checking is performed.
+ */
+const uint8_t* utf8_lookup_perform_runs( const void*      table,
+                                         const uint8_t*   str,
+                                         utf8_lookup_run* runs,
+                                         size_t*          num_runs );
 
-	* on bytes over first byte, we shift by 5 and get either 1 or 0 to index into the next lookup-element.
+/**
+ * Calculates the size needed to build a class-table for codepoints, see utf8_lookup_gen_class_table.
+ *
+ * @param table_size pointer to a size_t where to return the size.
+ * @param codepoints the codepoints to pack, requires codepoints to be sorted from small to big.
+ * @param num_codepoints number of codepoints in codepoints.
+ *
+ * @return UTF8_LOOKUP_ERROR_OK on success.
+ */
+utf8_lookup_error utf8_lookup_calc_class_table_size( size_t*             table_size,
+                                                     const unsigned int* codepoints,
+                                                     unsigned int        num_codepoints );
 
-	* lookup-elem 0 is always 0 and 0 to be able to revert all lookups to it if any other lookup is found as no-available.
-		- could use pop_count to select if available to get 0 or 1 on availability.
-*/
+/**
+ * Builds a class-table mapping each codepoint to a small class-id, i.e. identifier, whitespace or punctuation
+ * for a tokenizer. The table starts with a lookup-table for codepoints so it can also be used with all
+ * functions taking a table built with utf8_lookup_gen_table.
+ *
+ * @param table memory area where to build table.
+ * @param table_size size of data pointed to by table.
+ * @param codepoints the codepoints to pack, requires codepoints to be sorted from small to big.
+ * @param classes class-id for each codepoint in codepoints.
+ * @param num_codepoints number of codepoints in codepoints and classes.
+ * @param default_class class-id for codepoints not in codepoints.
+ *
+ * @return UTF8_LOOKUP_ERROR_OK on success.
+ */
+utf8_lookup_error utf8_lookup_gen_class_table( void*               table,
+                                               size_t              table_size,
+                                               const unsigned int* codepoints,
+                                               const uint8_t*      classes,
+                                               unsigned int        num_codepoints,
+                                               uint8_t             default_class );
 
-#if defined( __GNUC__ )
-#  define UTF8_LOOKUP_ALWAYSINLINE inline __attribute__((always_inline))
-#elif defined( _MSC_VER )
-#  define UTF8_LOOKUP_ALWAYSINLINE __forceinline
-#else
-#  define UTF8_LOOKUP_ALWAYSINLINE inline
-#endif
+/**
+ * Split str into runs of consecutive chars with the same class.
+ *
+ * @param table memory area containing data packed with utf8_lookup_gen_class_table.
+ * @param str string to split.
+ * @param runs pointer to buffer where to return runs.
+ * @param num_runs size of runs, returns number of runs written.
+ *
+ * @return pointer into str to start of what is left of string after parse. Only complete runs are returned
+ *         so calling again with the returned pointer continues with the next run.
+ *
+ * @note str is assumed to be correct utf8, no error-checking is performed.
+ */
+const uint8_t* utf8_lookup_perform_class_runs( const void*            table,
+                                               const uint8_t*         str,
+                                               utf8_lookup_class_run* runs,
+                                               size_t*                num_runs );
 
-static void utf8_lookup_cpuid( uint32_t op, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx )
-{
-#if defined( __GNUC__ )
-	__get_cpuid(op,eax,ebx,ecx,edx);
-#elif defined( _MSC_VER )
-	int regs[4];
-	__cpuid( regs, op );
-	*eax = (uint32_t)regs[0];
-	*ebx = (uint32_t)regs[1];
-	*ecx = (uint32_t)regs[2];
-	*edx = (uint32_t)regs[3];
-#else
-	*eax = 0;
-#endif
-}
+/**
+ * Calculates the size needed to build a kerning-table, see utf8_lookup_gen_kerning_table.
+ *
+ * @param kerning_size pointer to a size_t where to return the size.
+ * @param table lookup-table packed with utf8_lookup_gen_table that the kerning-table will be used with.
+ * @param pairs pairs to pack, requires pairs to be sorted by first and then second codepoint.
+ * @param num_pairs number of pairs in pairs.
+ *
+ * @return UTF8_LOOKUP_ERROR_OK on success.
+ *
+ * @note each (first, second) pair should be unique, only the first of duplicated pairs is used.
+ */
+utf8_lookup_error utf8_lookup_calc_kerning_table_size( size_t*                         kerning_size,
+                                                       const void*                     table,
+                                                       const utf8_lookup_kerning_pair* pairs,
+                                                       size_t                          num_pairs );
 
-static bool utf8_lookup_has_popcnt()
-{
-	uint32_t eax; uint32_t ebx; uint32_t ecx; uint32_t edx;
-	utf8_lookup_cpuid(0, &eax, &ebx, &ecx, &edx);
-	if( eax >= 1 )
-	{
-		utf8_lookup_cpuid( 1, &eax, &ebx, &ecx, &edx );
-		return ecx & ( 1 << 23 );
+/**
+ * Builds a kerning-table for pairs of chars in table. Pairs are keyed on the offsets of the chars in table,
+ * the offset of the first char selects a bitmap over the offsets of the second chars so that no extra
+ * trie-walk is needed when the offsets are already known. Pairs where one of the codepoints is not in
+ * table is ignored.
+ *
+ * @param kerning memory area where to build kerning-table.
+ * @param kerning_size size of data pointed to by kerning.
+ * @param table lookup-table packed with utf8_lookup_gen_table that the kerning-table will be used with.
+ * @param pairs pairs to pack, requires pairs to be sorted by first and then second codepoint.
+ * @param num_pairs number of pairs in pairs.
+ *
+ * @return UTF8_LOOKUP_ERROR_OK on success.
+ *
+ * @note each (first, second) pair should be unique, only the first of duplicated pairs is used.
+ */
+utf8_lookup_error utf8_lookup_gen_kerning_table( void*                           kerning,
+                                                 size_t                          kerning_size,
+                                                 const void*                     table,
+                                                 const utf8_lookup_kerning_pair* pairs,
+                                                 size_t                          num_pairs );
+
+/**
+ * Return kerning between the chars with offset first_offset and second_offset, 0 if there is no such pair.
+ *
+ * @param kerning memory area containing data packed with utf8_lookup_gen_kerning_table.
+ * @param first_offset offset of first char, as returned by utf8_lookup_perform.
+ * @param second_offset offset of second char, as returned by utf8_lookup_perform.
+ */
+int utf8_lookup_kerning( const void*  kerning,
+                         unsigned int first_offset,
+                         unsigned int second_offset );
+
+/**
+ * Perform lookup of offsets for chars in str together with the kerning between each char and the char
+ * before it.
+ *
+ * @param table memory area containing data packed with utf8_lookup_gen_table.
+ * @param kerning memory area containing data packed with utf8_lookup_gen_kerning_table for table.
+ * @param str string to make lookup in.
+ * @param prev_offset offset of the char before str, 0 at start of string. Returns offset of the last char
+ *                    written to res so that the returned pointer can be passed in the next call.
+ * @param res pointer to buffer where to return result.
+ * @param res_size size of res.
+ *
+ * @return pointer into str to start of what is left of string after parse.
+ *
+ * @note str is assumed to be correct utf8, no error-checking is performed.
+ */
+const uint8_t* utf8_lookup_perform_kerning( const void*                 table,
+                                            const void*                 kerning,
+                                            const uint8_t*              str,
+                                            unsigned int*               prev_offset,
+                                            utf8_lookup_kerning_result* res,
+                                            size_t*                     res_size );
+
+/**
+ * Calculates the size needed to build a sequence-table, see utf8_lookup_gen_sequence_table.
+ *
+ * @param sequences_size pointer to a size_t where to return the size.
+ * @param table lookup-table packed with utf8_lookup_gen_table that the sequence-table will be used with.
+ * @param sequences sequences to pack.
+ * @param num_sequences number of sequences in sequences.
+ *
+ * @return UTF8_LOOKUP_ERROR_OK on success, UTF8_LOOKUP_ERROR_OUT_OF_MEMORY if temporary memory could not be
+ *         allocated.
+ */
+utf8_lookup_error utf8_lookup_calc_sequence_table_size( size_t*                     sequences_size,
+                                                        const void*                 table,
+                                                        const utf8_lookup_sequence* sequences,
+                                                        unsigned int                num_sequences );
+
+/**
+ * Builds a sequence-table with continuation-nodes for sequences of codepoints to use with
+ * utf8_lookup_perform_sequences. The nodes are keyed on the offsets of the chars in table so all codepoints
+ * in a sequence need to be in table, sequences where that is not the case and sequences of less than 2
+ * codepoints are ignored.
+ *
+ * Sequence i gets offset num_codepoints_in_table + 1 + i, i.e. glyphs for sequences is expected to be stored
+ * directly after the glyphs for the single chars.
+ *
+ * @param sequences_table memory area where to build sequence-table.
+ * @param sequences_size size of data pointed to by sequences_table.
+ * @param table lookup-table packed with utf8_lookup_gen_table that the sequence-table will be used with.
+ * @param sequences sequences to pack.
+ * @param num_sequences number of sequences in sequences.
+ *
+ * @return UTF8_LOOKUP_ERROR_OK on success, UTF8_LOOKUP_ERROR_OUT_OF_MEMORY if temporary memory could not be
+ *         allocated.
+ */
+utf8_lookup_error utf8_lookup_gen_sequence_table( void*                       sequences_table,
+                                                  size_t                      sequences_size,
+                                                  const void*                 table,
+                                                  const utf8_lookup_sequence* sequences,
+                                                  unsigned int                num_sequences );
+
+/**
+ * Perform lookup of offsets for chars in str where the longest matching sequence in sequences_table is
+ * returned as one result spanning all its chars.
+ *
+ * @param table memory area containing data packed with utf8_lookup_gen_table.
+ * @param sequences_table memory area containing data packed with utf8_lookup_gen_sequence_table for table.
+ * @param str string to make lookup in.
+ * @param res pointer to buffer where to return result.
+ * @param res_size size of res.
+ *
+ * @return pointer into str to start of what is left of string after parse.
+ *
+ * @note str is assumed to be correct utf8, no error-checking is performed.
+ */
+const uint8_t* utf8_lookup_perform_sequences( const void*                  table,
+                                              const void*                  sequences_table,
+                                              const uint8_t*               str,
+                                              utf8_lookup_sequence_result* res,
+                                              size_t*                      res_size );
+
+/**
+ * Calculates the size needed to build an advance-table, see utf8_lookup_gen_advance_table.
+ *
+ * @param table_size pointer to a size_t where to return the size.
+ * @param codepoints the codepoints to pack, requires codepoints to be sorted from small to big.
+ * @param num_codepoints number of codepoints in codepoints.
+ *
+ * @return UTF8_LOOKUP_ERROR_OK on success.
+ */
+utf8_lookup_error utf8_lookup_calc_advance_table_size( size_t*             table_size,
+                                                       const unsigned int* codepoints,
+                                                       unsigned int        num_codepoints );
+
+/**
+ * Builds an advance-table storing the advance-width of each codepoint inline after a lookup-table, used to
+ * measure strings with utf8_lookup_measure. The table starts with a lookup-table for codepoints so it can
+ * also be used with all functions taking a table built with utf8_lookup_gen_table.
+ *
+ * @param table memory area where to build table, need to be 16 byte aligned.
+ * @param table_size size of data pointed to by table.
+ * @param codepoints the codepoints to pack, requires codepoints to be sorted from small to big.
+ * @param advances advance-width for each codepoint in codepoints, in any integer unit, i.e. font-units or 26.6
+ *                 fixed point.
+ * @param num_codepoints number of codepoints in codepoints and advances.
+ * @param missing_advance advance-width for codepoints not in codepoints.
+ *
+ * @return UTF8_LOOKUP_ERROR_OK on success.
+ */
+utf8_lookup_error utf8_lookup_gen_advance_table( void*               table,
+                                                 size_t              table_size,
+                                                 const unsigned int* codepoints,
+                                                 const int32_t*      advances,
+                                                 unsigned int        num_codepoints,
+                                                 int32_t             missing_advance );
+
+/**
+ * Measure the width of str, i.e. the sum of the advance-widths of all chars, without producing any
+ * per-char lookup-result.
+ *
+ * @param table memory area containing data packed with utf8_lookup_gen_advance_table.
+ * @param str string to measure.
+ * @param prefix_widths optional buffer where to return the width of str up to and including each char, need
+ *                      room for utf8_lookup_count_chars( str ) items. Pass 0x0 if not needed.
+ *
+ * @return width of str.
+ *
+ * @note str is assumed to be correct utf8, no error-checking is performed.
+ */
+int64_t utf8_lookup_measure( const void*    table,
+                             const uint8_t* str,
+                             int64_t*       prefix_widths );
+
+/**
+ * Break str into lines no wider than max_width with greedy line-breaking, the string is only decoded once
+ * and each char is walked once in advance_table.
+ *
+ * Lines are broken at the last break-opportunity that fits, spaces at the end of a line hang outside of
+ * max_width. A word that do not fit on a line by itself is broken at the last char that fits, at least one
+ * char is always put on a line.
+ *
+ * @param advance_table memory area containing data packed with utf8_lookup_gen_advance_table.
+ * @param class_table memory area containing data packed with utf8_lookup_gen_class_table with
+ *                    utf8_lookup_break_class for the same codepoints as advance_table.
+ * @param str string to break.
+ * @param max_width max width of a line.
+ * @param lines pointer to buffer where to return lines.
+ * @param num_lines size of lines, returns number of lines written.
+ *
+ * @return pointer into str to start of what is left of string after parse, always the start of a line.
+ *
+ * @note str is assumed to be correct utf8, no error-checking is performed.
+ */
+const uint8_t* utf8_lookup_break_lines( const void*       advance_table,
+                                        const void*       class_table,
+                                        const uint8_t*    str,
+                                        int64_t           max_width,
+                                        utf8_lookup_line* lines,
+                                        size_t*           num_lines );
+
+/**
+ * Number of uint64_t needed for the missing_bits passed to utf8_lookup_collect_missing, one bit per
+ * unicode codepoint.
+ */
+#define UTF8_LOOKUP_MISSING_BITS_WORDS ( 0x110000 / 64 )
+
+/**
+ * Find the unique codepoints in str that are not available in table, i.e. to find what glyphs that need
+ * to be requested for a font to be able to render str.
+ *
+ * @param table memory area containing data packed with utf8_lookup_gen_table.
+ * @param str string to check.
+ * @param missing_bits scratch-memory of UTF8_LOOKUP_MISSING_BITS_WORDS uint64_t used to remove duplicates,
+ *                     needs to be zeroed before first call and is left zeroed on return.
+ * @param codepoints buffer where to return the missing codepoints, sorted from small to big.
+ * @param counts optional buffer where to return how many times each codepoint in codepoints occurred in str,
+ *               pass 0x0 if not needed.
+ * @param num_codepoints size of codepoints and counts, returns number of codepoints written.
+ * @param num_missing optional pointer where to return number of missing chars in str, including duplicates,
+ *                    pass 0x0 if not needed.
+ *
+ * @return UTF8_LOOKUP_ERROR_OK on success. UTF8_LOOKUP_ERROR_BUFFER_TO_SMALL if there was more unique missing
+ *         codepoints than fit in codepoints, the smallest ones and their counts are still returned.
+ *         If counts could not be collected UTF8_LOOKUP_ERROR_OUT_OF_MEMORY is returned if the scratch-table
+ *         used for counting could not be allocated and UTF8_LOOKUP_ERROR_TOO_MANY_CODEPOINTS if more than 0xFFFF
+ *         codepoints was returned, codepoints, num_codepoints and num_missing is still valid but counts is all 0.
+ *
+ * @note str is assumed to be correct utf8, no error-checking is performed.
+ */
+utf8_lookup_error utf8_lookup_collect_missing( const void*    table,
+                                               const uint8_t* str,
+                                               uint64_t*      missing_bits,
+                                               unsigned int*  codepoints,
+                                               unsigned int*  counts,
+                                               size_t*        num_codepoints,
+                                               size_t*        num_missing );
+
+/**
+ * Find the codepoint that generated offset, i.e. the reverse of utf8_lookup_perform.
+ *
+ * @param table memory area containing data packed with utf8_lookup_gen_table.
+ * @param offset offset to find codepoint for.
+ * @param codepoint pointer where to return the codepoint.
+ *
+ * @return 1 if offset was found in the table, 0 otherwise.
+ */
+int utf8_lookup_codepoint_from_offset( const void*   table,
+                                       unsigned int  offset,
+                                       unsigned int* codepoint );
+
+/**
+ * Iterator over all codepoints in a table, in order from small to big, see utf8_lookup_iterator_init.
+ */
+struct utf8_lookup_iterator
+{
+	const void*  table;
+	int          root;      //< next root-element to visit.
+	int          levels;    //< number of levels below current root, 0 if a new root should be selected.
+	int          depth;     //< current level.
+	uint64_t     node[4];   //< element visited at each level.
+	uint64_t     bits[4];   //< bits left to visit at each level.
+	unsigned int prefix[4]; //< codepoint-bits decided by the levels above each level.
+};
+
+/**
+ * Initialize iterator to iterate over all codepoints in table.
+ *
+ * @example
+ * utf8_lookup_iterator it;
+ * utf8_lookup_iterator_init( &it, table );
+ * unsigned int cp, offset;
+ * while( utf8_lookup_iterator_next( &it, &cp, &offset ) )
+ *     ... do something with cp/offset ...
+ */
+void utf8_lookup_iterator_init( utf8_lookup_iterator* it,
+                                const void*           table );
+
+/**
+ * Get the next codepoint and its offset from iterator.
+ *
+ * @return 1 if a codepoint was returned, 0 if all codepoints has been visited.
+ */
+int utf8_lookup_iterator_next( utf8_lookup_iterator* it,
+                               unsigned int*         codepoint,
+                               unsigned int*         offset );
+
+/**
+ * State for looking up a string delivered in chunks, see utf8_lookup_stream_feed.
+ */
+struct utf8_lookup_stream
+{
+	const void*  table;
+	uint8_t      pending[4];    //< bytes of a char split between two chunks.
+	uint8_t      completed[4];  //< the split char once all bytes has arrived, results for that char will point here.
+	unsigned int num_pending;   //< bytes stored in pending.
+	unsigned int char_length;   //< total bytes of the char in pending.
+};
+
+/**
+ * Initialize stream to do lookups in table.
+ *
+ * @param stream stream to initialize.
+ * @param table memory area containing data packed with utf8_lookup_gen_table.
+ */
+void utf8_lookup_stream_init( utf8_lookup_stream* stream,
+                              const void*         table );
+
+/**
+ * Perform lookup on a chunk of a string. Chunks do not need to end at a char-boundary, the bytes of a char
+ * that is split between two chunks is kept in stream and the char is returned when the next chunk is fed.
+ *
+ * @param stream stream initialized with utf8_lookup_stream_init.
+ * @param chunk start of chunk, do not need to be 0-terminated.
+ * @param chunk_end end of chunk.
+ * @param res pointer to array where to return result.
+ * @param res_size pointer to size of res, will be set to number of items written to res on return.
+ *
+ * @return pointer to where lookup stopped in chunk, if it is not chunk_end res was filled and feed should
+ *         be called again with the rest of the chunk.
+ *
+ * @note pos in the result for a char that was split between two chunks points into stream and is only valid
+ *       until the next call to feed or finish, all other results point into chunk.
+ * @note chunks are assumed to be correct utf8, no error-checking is performed.
+ */
+const uint8_t* utf8_lookup_stream_feed( utf8_lookup_stream* stream,
+                                        const uint8_t*      chunk,
+                                        const uint8_t*      chunk_end,
+                                        utf8_lookup_result* res,
+                                        size_t*             res_size );
+
+/**
+ * End of input for stream. If the input ended in the middle of a char, that char is returned with offset 0
+ * and pos pointing into stream.
+ *
+ * @param stream stream initialized with utf8_lookup_stream_init.
+ * @param res pointer to array where to return result, need room for at least one item.
+ * @param res_size pointer to size of res, will be set to number of items written to res on return.
+ */
+void utf8_lookup_stream_finish( utf8_lookup_stream* stream,
+                                utf8_lookup_result* res,
+                                size_t*             res_size );
+
+/**
+ * Find the first codepoint in table that is >= codepoint.
+ *
+ * @param table memory area containing data packed with utf8_lookup_gen_table.
+ * @param codepoint codepoint to start search at.
+ * @param next_codepoint found codepoint is returned here.
+ * @param offset offset of found codepoint is returned here, can be 0x0.
+ *
+ * @return 1 if a codepoint was found, 0 if there is no codepoint >= codepoint in table.
+ */
+int utf8_lookup_successor( const void*   table,
+                           unsigned int  codepoint,
+                           unsigned int* next_codepoint,
+                           unsigned int* offset );
+
+/**
+ * Return the number of codepoints in table that is < codepoint.
+ *
+ * @param table memory area containing data packed with utf8_lookup_gen_table.
+ * @param codepoint codepoint to count up to.
+ */
+unsigned int utf8_lookup_rank( const void*  table,
+                               unsigned int codepoint );
+
+/**
+ * Return the number of codepoints in table in the range [first, last], both inclusive.
+ *
+ * @param table memory area containing data packed with utf8_lookup_gen_table.
+ * @param first first codepoint in range.
+ * @param last last codepoint in range.
+ */
+unsigned int utf8_lookup_count_range( const void*  table,
+                                      unsigned int first,
+                                      unsigned int last );
+
+/**
+ * Statistics about a table packed with utf8_lookup_gen_table, see utf8_lookup_table_stats().
+ */
+struct utf8_lookup_stats
+{
+	size_t       table_size;          //< total size of table in bytes.
+	size_t       items;               //< number of elements in avail_bits/offsets, including unused elements.
+	size_t       unused_items;        //< elements not reachable from a root or empty, element 0, empty roots and padding.
+	size_t       nodes_per_level[4];  //< non-empty elements per level in the lookup, level 0 is the roots.
+	size_t       bits_per_level[4];   //< bits set in avail_bits per level in the lookup.
+	size_t       num_codepoints;      //< number of codepoints in table, same as the bits set on the last level of each root.
+	float        avg_fill;            //< average ratio of set bits in non-empty elements, 1.0 if all 64 bits are set.
+	size_t       avail_bits_bytes;    //< bytes used by avail_bits.
+	size_t       offsets_bytes;       //< bytes used by offsets.
+	unsigned int max_offset;          //< largest value stored in or returned from offsets, need to fit in uint16_t.
+};
+
+/**
+ * Collect statistics about a table.
+ *
+ * @param table memory area containing data packed with utf8_lookup_gen_table.
+ * @param stats struct to fill with statistics.
+ */
+void utf8_lookup_table_stats( const void*        table,
+                              utf8_lookup_stats* stats );
+
+/**
+ * Calculates the size needed to build the result of a set-operation on two tables.
+ *
+ * @param table_size pointer to a size_t where to return the size.
+ * @param table_a table packed with utf8_lookup_gen_table.
+ * @param table_b table packed with utf8_lookup_gen_table.
+ * @param op operation to perform.
+ *
+ * @return UTF8_LOOKUP_ERROR_OK on success.
+ */
+utf8_lookup_error utf8_lookup_calc_set_op_table_size( size_t*            table_size,
+                                                      const void*        table_a,
+                                                      const void*        table_b,
+                                                      utf8_lookup_set_op op );
+
+/**
+ * Builds a table containing the union, intersection or difference of the codepoints in two tables by
+ * merging them element by element, without decoding the codepoints. The result is the same as calling
+ * utf8_lookup_gen_table with the resulting codepoint-list, i.e. offsets are the index of the codepoint
+ * in the sorted result + 1.
+ *
+ * @param table memory area where to build lookup-data.
+ * @param table_size size of data pointed to by table.
+ * @param table_a table packed with utf8_lookup_gen_table.
+ * @param table_b table packed with utf8_lookup_gen_table.
+ * @param op operation to perform.
+ *
+ * @return UTF8_LOOKUP_ERROR_OK on success.
+ */
+utf8_lookup_error utf8_lookup_gen_set_op_table( void*              table,
+                                                size_t             table_size,
+                                                const void*        table_a,
+                                                const void*        table_b,
+                                                utf8_lookup_set_op op );
+
+/**
+ * Calculates the size needed for a membership-table, a table that can only answer if a codepoint exist or
+ * not. It stores the same availability-bits as a table from utf8_lookup_gen_table but no offsets for the
+ * last level of the lookup, making it smaller.
+ *
+ * @param table_size pointer to a size_t where to return the size.
+ * @param codepoints sorted array of codepoints to pack.
+ * @param num_codepoints number of codepoints in codepoints.
+ *
+ * @return UTF8_LOOKUP_ERROR_OK on success.
+ */
+utf8_lookup_error utf8_lookup_calc_membership_table_size( size_t*             table_size,
+                                                          const unsigned int* codepoints,
+                                                          unsigned int        num_codepoints );
+
+/**
+ * Generate a membership-table, see utf8_lookup_calc_membership_table_size.
+ *
+ * @param table memory area where to build lookup-data.
+ * @param table_size size of data pointed to by table.
+ * @param codepoints sorted array of codepoints to pack.
+ * @param num_codepoints number of codepoints in codepoints.
+ *
+ * @return UTF8_LOOKUP_ERROR_OK on success.
+ */
+utf8_lookup_error utf8_lookup_gen_membership_table( void*               table,
+                                                    size_t              table_size,
+                                                    const unsigned int* codepoints,
+                                                    unsigned int        num_codepoints );
+
+/**
+ * Check chars in str against a membership-table.
+ *
+ * @param table memory area containing data packed with utf8_lookup_gen_membership_table.
+ * @param str string to check.
+ * @param found_bits bit n is set if char n in str exist in table, need to fit res_size bits.
+ * @param res_size pointer to number of chars to check, will be set to number of chars checked on return.
+ *
+ * @return pointer to where the check stopped in str, pass this to continue checking.
+ *
+ * @note str is assumed to be correct utf8, no error-checking is performed.
+ */
+const uint8_t* utf8_lookup_perform_membership( const void*    table,
+                                               const uint8_t* str,
+                                               uint64_t*      found_bits,
+                                               size_t*        res_size );
+
+/**
+ * Same as utf8_lookup_count_missing but on a membership-table.
+ */
+size_t utf8_lookup_membership_count_missing( const void*    table,
+                                             const uint8_t* str );
+
+/**
+ * Same as utf8_lookup_all_present but on a membership-table.
+ */
+int utf8_lookup_membership_all_present( const void*    table,
+                                        const uint8_t* str );
+
+#if defined(UTF8_LOOKUP_ENABLE_THREADS)
+
+/**
+ * Perform lookup of all chars in str on multiple threads. str is split in num_threads slices at char-boundaries,
+ * the chars in each slice is counted and looked up on its own thread directly into its part of res so that the
+ * result is in the same order as from utf8_lookup_perform_all.
+ *
+ * @param table memory area containing data packed with utf8_lookup_gen_table.
+ * @param str string to make lookup in.
+ * @param str_len length of str in bytes, all str_len bytes is looked up, 0-terminated or not.
+ * @param res pointer to buffer where to return result, need room for all chars in str.
+ * @param num_threads number of threads to use including the calling thread, fewer threads is used if slices
+ *                    would be smaller than UTF8_LOOKUP_PARALLEL_MIN_SLICE bytes.
+ *
+ * @return number of items written to res.
+ *
+ * @note str is assumed to be correct utf8, no error-checking is performed.
+ * @note only available when UTF8_LOOKUP_ENABLE_THREADS is defined, the implementation uses std::thread.
+ */
+size_t utf8_lookup_perform_parallel( const void*         table,
+                                     const uint8_t*      str,
+                                     size_t              str_len,
+                                     utf8_lookup_result* res,
+                                     unsigned int        num_threads );
+
+/**
+ * Handle to a lookup-table that can be replaced while other threads use it, see utf8_lookup_hot_table_create.
+ */
+struct utf8_lookup_hot_table;
+
+/**
+ * Create a handle to table that readers can acquire without ever blocking while a new table is published.
+ * A replaced table is freed when no reader has it acquired anymore, readers protect the table they use with
+ * a hazard-pointer in their own reader-slot.
+ *
+ * @param hot returns the new handle.
+ * @param table first table to publish, the handle takes ownership and frees it with UTF8_LOOKUP_FREE.
+ * @param max_readers number of reader-slots, each thread reading from the handle need its own slot.
+ *
+ * @return UTF8_LOOKUP_ERROR_OK on success, UTF8_LOOKUP_ERROR_OUT_OF_MEMORY if the handle could not be allocated.
+ *
+ * @note only available when UTF8_LOOKUP_ENABLE_THREADS is defined.
+ */
+utf8_lookup_error utf8_lookup_hot_table_create( utf8_lookup_hot_table** hot,
+                                                void*                   table,
+                                                unsigned int            max_readers );
+
+/**
+ * Free handle and all tables still owned by it, no reader may have a table acquired.
+ */
+void utf8_lookup_hot_table_destroy( utf8_lookup_hot_table* hot );
+
+/**
+ * Replace the table in hot with table, readers acquiring after this will get the new table. Replaced tables
+ * that no reader has acquired are freed, the rest is freed by a later publish or destroy.
+ *
+ * @param hot handle to publish to.
+ * @param table table to publish, the handle takes ownership and frees it with UTF8_LOOKUP_FREE.
+ *
+ * @return UTF8_LOOKUP_ERROR_OK on success, UTF8_LOOKUP_ERROR_OUT_OF_MEMORY if the replaced table could not be
+ *         queued for freeing, hot is left unchanged and the caller keeps ownership of table.
+ *
+ * @note publish can be called from multiple threads, publishers are serialized with a mutex but readers never
+ *       wait for a publish.
+ */
+utf8_lookup_error utf8_lookup_hot_table_publish( utf8_lookup_hot_table* hot,
+                                                 void*                  table );
+
+/**
+ * Acquire the current table in hot for use by reader, the table will not be freed until it is released.
+ *
+ * @param hot handle to acquire table from.
+ * @param reader reader-slot of the calling thread, < max_readers. A slot may only hold one table at a time.
+ *
+ * @return table to pass to utf8_lookup_perform and friends.
+ */
+const void* utf8_lookup_hot_table_acquire( utf8_lookup_hot_table* hot,
+                                           unsigned int           reader );
+
+/**
+ * Release the table acquired by reader.
+ */
+void utf8_lookup_hot_table_release( utf8_lookup_hot_table* hot,
+                                    unsigned int           reader );
+
+/**
+ * Return the number of replaced tables that has not been freed yet since they might still be in use.
+ */
+size_t utf8_lookup_hot_table_pending( utf8_lookup_hot_table* hot );
+
+#endif // defined(UTF8_LOOKUP_ENABLE_THREADS)
+
+#if defined(UTF8_LOOKUP_ENABLE_SHARED_TABLES)
+
+/**
+ * Lookup-table published in posix shared memory, see utf8_lookup_shared_table_acquire.
+ */
+struct utf8_lookup_shared_table
+{
+	const void* table;        //< lookup-table to pass to utf8_lookup_perform, mapped read-only.
+	size_t      table_size;   //< size of table.
+	int         created;      //< 1 if this process built and published the table, 0 if it was mapped from another process.
+	void*       mapping;      //< internal, start of mapped segment.
+	size_t      mapping_size; //< internal, size of mapped segment.
+	char        name[32];     //< name of shared memory segment.
+};
+
+/**
+ * Map a lookup-table for codepoints from shared memory, building and publishing it if no other process
+ * has done so already. Tables are keyed by a hash of the codepoint-set so all processes, run by the same
+ * user, asking for the same set will share the same physical pages.
+ *
+ * @param shared handle to initialize.
+ * @param codepoints the codepoints to pack, requires codepoints to be sorted from small to big.
+ * @param num_codepoints number of codepoints in codepoints.
+ *
+ * @return UTF8_LOOKUP_ERROR_OK on success, UTF8_LOOKUP_ERROR_SHARED_MEMORY_FAILED if the segment could
+ *         not be created/mapped or is not trusted, UTF8_LOOKUP_ERROR_SHARED_MEMORY_COLLISION if the segment
+ *         is published for another codepoint-set with the same hash, any error from
+ *         utf8_lookup_calc_table_size/utf8_lookup_gen_table if the table could not be built.
+ *
+ * @note segments are created readable and writable by the owner only. A segment found is only mapped if it
+ *       is owned by the effective user of this process, is not writable by group/other and contains a valid
+ *       table, so that no other user can plant a table with offsets out of range.
+ *
+ * @note a segment where the creating process died before it finished publishing is unlinked and the table
+ *       is built and published again by this process, this is only done once per call. A segment with a
+ *       creator still alive that is not ready within UTF8_LOOKUP_SHARED_TABLE_TIMEOUT_MS is left alone.
+ *
+ * @note only available on posix-systems and when UTF8_LOOKUP_ENABLE_SHARED_TABLES is defined.
+ */
+utf8_lookup_error utf8_lookup_shared_table_acquire( utf8_lookup_shared_table* shared,
+                                                    const unsigned int*       codepoints,
+                                                    unsigned int              num_codepoints );
+
+/**
+ * Unmap a table mapped with utf8_lookup_shared_table_acquire. The segment itself is kept alive
+ * for other processes to map until utf8_lookup_shared_table_unlink is called.
+ */
+void utf8_lookup_shared_table_release( utf8_lookup_shared_table* shared );
+
+/**
+ * Remove the name of the shared segment, memory is returned to the system when the last process
+ * has released the table. Processes acquiring the same codepoint-set after this will build a new table.
+ */
+void utf8_lookup_shared_table_unlink( utf8_lookup_shared_table* shared );
+
+#endif // defined(UTF8_LOOKUP_ENABLE_SHARED_TABLES)
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __cplusplus
+/**
+ * Map from codepoint to a value of type T built on the same trie as the lookup-tables, i.e. for per-codepoint
+ * properties as case-folding, script or width-class.
+ *
+ * A map is one memory area containing a lookup-table followed by the values stored in the same order as
+ * the offsets returned by utf8_lookup_perform, so the map can be passed to all the utf8_lookup_*-functions
+ * taking a table built with utf8_lookup_gen_table and can be placed in read-only or shared memory.
+ *
+ * @note T is copied with memcpy and need to be trivially copyable.
+ * @note memory passed to gen need to be aligned for T.
+ */
+template <typename T>
+struct utf8_lookup_map
+{
+	/**
+	 * Calculates the size needed to build a map for codepoints.
+	 *
+	 * @param map_size pointer to a size_t where to return the size.
+	 * @param codepoints the codepoints to pack, requires codepoints to be sorted from small to big.
+	 * @param num_codepoints number of codepoints in codepoints.
+	 *
+	 * @return UTF8_LOOKUP_ERROR_OK on success.
+	 */
+	static utf8_lookup_error calc_size( size_t*             map_size,
+	                                    const unsigned int* codepoints,
+	                                    unsigned int        num_codepoints )
+	{
+		size_t table_size;
+		utf8_lookup_error err = utf8_lookup_calc_table_size( &table_size, codepoints, num_codepoints );
+		if( err != UTF8_LOOKUP_ERROR_OK )
+			return err;
+		*map_size = values_offset( table_size ) + ( (size_t)num_codepoints + 1 ) * sizeof( T );
+		return UTF8_LOOKUP_ERROR_OK;
+	}
+
+	/**
+	 * Builds a map from codepoints[i] to values[i].
+	 *
+	 * @param map memory area where to build map.
+	 * @param map_size size of data pointed to by map.
+	 * @param codepoints the codepoints to pack, requires codepoints to be sorted from small to big.
+	 * @param values value for each codepoint in codepoints.
+	 * @param num_codepoints number of codepoints in codepoints and values.
+	 * @param missing_value value returned for codepoints not in the map.
+	 *
+	 * @return UTF8_LOOKUP_ERROR_OK on success.
+	 */
+	static utf8_lookup_error gen( void*               map,
+	                              size_t              map_size,
+	                              const unsigned int* codepoints,
+	                              const T*            values,
+	                              unsigned int        num_codepoints,
+	                              const T&            missing_value )
+	{
+		size_t table_size;
+		utf8_lookup_calc_table_size( &table_size, codepoints, num_codepoints );
+		if( values_offset( table_size ) + ( (size_t)num_codepoints + 1 ) * sizeof( T ) > map_size )
+			return UTF8_LOOKUP_ERROR_BUFFER_TO_SMALL;
+
+		utf8_lookup_error err = utf8_lookup_gen_table( map, table_size, codepoints, num_codepoints );
+		if( err != UTF8_LOOKUP_ERROR_OK )
+			return err;
+
+		// ... offset 0 is returned for missing chars so the missing value is stored first ...
+		uint8_t* map_values = (uint8_t*)map + values_offset( table_size );
+		memset( (uint8_t*)map + table_size, 0x0, values_offset( table_size ) - table_size );
+		memcpy( map_values, &missing_value, sizeof( T ) );
+		memcpy( map_values + sizeof( T ), values, (size_t)num_codepoints * sizeof( T ) );
+		return UTF8_LOOKUP_ERROR_OK;
+	}
+
+	/**
+	 * Return the values stored in map, indexed by the offsets returned by utf8_lookup_perform on map.
+	 * values( map )[0] is the missing value.
+	 */
+	static const T* values( const void* map )
+	{
+		// ... table-size is stored as item-count first in the table, see utf8_lookup_gen_table ...
+		size_t items = (size_t)*(const uint64_t*)map;
+		size_t table_size = sizeof( uint64_t ) + items * ( sizeof( uint64_t ) + sizeof( uint16_t ) );
+		return (const T*)( (const uint8_t*)map + values_offset( table_size ) );
+	}
+
+	/**
+	 * Lookup value for one codepoint.
+	 */
+	static T get( const void* map, unsigned int codepoint )
+	{
+		unsigned int offset;
+		utf8_lookup_perform_utf32( map, &codepoint, 1, &offset );
+		return values( map )[offset];
+	}
+
+	/**
+	 * Perform lookup of values for chars in str, works as utf8_lookup_perform but returns the value for each
+	 * char instead of the offset. Use utf8_lookup_perform + values() if the position of each char is needed.
+	 *
+	 * @param map memory area containing data packed with gen.
+	 * @param str string to make lookup in.
+	 * @param res pointer to buffer where to return result.
+	 * @param res_size size of res.
+	 *
+	 * @return pointer into str to start of what is left of string after parse.
+	 *
+	 * @note str is assumed to be correct utf8, no error-checking is performed.
+	 */
+	static const uint8_t* perform( const void*    map,
+	                               const uint8_t* str,
+	                               T*             res,
+	                               size_t*        res_size )
+	{
+		const T* map_values = values( map );
+		size_t max_res = *res_size;
+		size_t num_res = 0;
+
+		utf8_lookup_result chunk[64];
+		while( *str && num_res < max_res )
+		{
+			size_t chunk_size = max_res - num_res < 64 ? max_res - num_res : 64;
+			str = utf8_lookup_perform( map, str, chunk, &chunk_size );
+			for( size_t i = 0; i < chunk_size; ++i )
+				res[num_res++] = map_values[ chunk[i].offset ];
+		}
+
+		*res_size = num_res;
+		return str;
+	}
+
+	/**
+	 * Perform lookup of values for codepoints, works as utf8_lookup_perform_utf32.
+	 */
+	static void perform_utf32( const void*         map,
+	                           const unsigned int* codepoints,
+	                           size_t              num_codepoints,
+	                           T*                  res )
+	{
+		const T* map_values = values( map );
+
+		unsigned int chunk[64];
+		for( size_t start = 0; start < num_codepoints; start += 64 )
+		{
+			size_t chunk_size = num_codepoints - start < 64 ? num_codepoints - start : 64;
+			utf8_lookup_perform_utf32( map, codepoints + start, chunk_size, chunk );
+			for( size_t i = 0; i < chunk_size; ++i )
+				res[start + i] = map_values[ chunk[i] ];
+		}
+	}
+
+private:
+	// values are stored 16 byte aligned after the table, enough for any T without depending on alignof.
+	static size_t values_offset( size_t table_size )
+	{
+		return ( table_size + 15 ) & ~(size_t)15;
+	}
+};
+#endif // __cplusplus
+
+#if defined(UTF8_LOOKUP_IMPLEMENTATION)
+
+#include <ctype.h>
+#include <string.h>
+#include <stdlib.h> // qsort, and malloc/free for the default UTF8_LOOKUP_MALLOC.
+
+#if !defined(UTF8_LOOKUP_MALLOC)
+#  define UTF8_LOOKUP_MALLOC( size ) malloc( size )
+#  define UTF8_LOOKUP_FREE( ptr )    free( ptr )
+#endif
+
+#if defined( __GNUC__ )
+#  include <cpuid.h>
+#elif defined( _MSC_VER )
+#  include <intrin.h>
+#endif
+
+/*
+	range		      binary code point             utf8 bytes
+	 0 - 7F           0xxxxxxx                      0xxxxxxx
+
+	80 - 7FF          00000yyy yyxxxxxx             110yyyyy
+													10xxxxxx
+
+	800 - FFFF        zzzzyyyy yyxxxxxx             1110zzzz
+													10yyyyyy
+													10xxxxxx
+
+	10000 - 10FFFF    000wwwzz zzzzyyyy yyxxxxxx    11110www
+													10zzzzzz
+													10yyyyyy
+													10xxxxxx
+
+
+
+	* if glyph do not exist in font, result shoud be zero ( place default glyph at zero )
+	* all octets need a base do do lookup in that need to be addressable for all bytes.
+		- for first octet 3 lookup elements is needed ( enough to cover all chars in octet )
+		- for the other octets one 32 bit lookup is needed since none of them has more than 5 bits
+		  in first byte that is valid for this byte.
+
+	* on octet one we need to find if the char is in character-group 0, 1 or 2 and on the other octets we need
+	  the code to say that they belong in sub-group 0 ( since there are only one on top-level. )
+
+		- this is done by selecting a bitmask from octet of char. On octet one, we mask off top 3 and shift 5.
+		  mask with 0 on other octets.
+
+	* on bytes over first byte, we shift by 5 and get either 1 or 0 to index into the next lookup-element.
+
+	* lookup-elem 0 is always 0 and 0 to be able to revert all lookups to it if any other lookup is found as no-available.
+		- could use pop_count to select if available to get 0 or 1 on availability.
+*/
+
+#if defined( __GNUC__ )
+#  define UTF8_LOOKUP_ALWAYSINLINE inline __attribute__((always_inline))
+#elif defined( _MSC_VER )
+#  define UTF8_LOOKUP_ALWAYSINLINE __forceinline
+#else
+#  define UTF8_LOOKUP_ALWAYSINLINE inline
+#endif
+
+#if defined(__GNUC__)
+#  if defined(__clang__)
+#    if defined(__has_attribute)
+#      if __has_attribute(target)
+#        define UTF8_LOOKUP_HAS_ATTRIBUTE_TARGET
+#      endif
+#    endif
+#  else
+#      define UTF8_LOOKUP_HAS_ATTRIBUTE_TARGET
+#  endif
+#endif
+
+#if defined(UTF8_LOOKUP_HAS_ATTRIBUTE_TARGET)
+#  define UTF8_LOOKUP_TARGET( target_str ) __attribute__((target(target_str)))
+#else
+#  define UTF8_LOOKUP_TARGET( target_str )
+#endif
+
+// dispatching functions pick an implementation on first call and cache it in a function-local static,
+// threads racing on the first call might both resolve it but will only ever see 0 or a valid function.
+#if defined( __GNUC__ )
+#  define UTF8_LOOKUP_DISPATCH_LOAD( func )        __atomic_load_n( &( func ), __ATOMIC_RELAXED )
+#  define UTF8_LOOKUP_DISPATCH_STORE( func, impl ) __atomic_store_n( &( func ), &( impl ), __ATOMIC_RELAXED )
+#else
+// ... the cache is volatile, aligned pointer loads and stores are never torn on the msvc-targets ...
+#  define UTF8_LOOKUP_DISPATCH_LOAD( func )        ( func )
+#  define UTF8_LOOKUP_DISPATCH_STORE( func, impl ) ( ( func ) = &( impl ) )
+#endif
+
+// sse-paths are only built for x86_64 where sse2 is always available, higher instruction-sets are
+// selected at runtime via cpuid.
+#if defined( __x86_64__ ) || defined( _M_X64 )
+#  define UTF8_LOOKUP_X64
+#  include <immintrin.h>
+#endif
+
+static void utf8_lookup_cpuid( uint32_t op, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx )
+{
+#if defined( __GNUC__ )
+	__get_cpuid(op,eax,ebx,ecx,edx);
+#elif defined( _MSC_VER )
+	int regs[4];
+	__cpuid( regs, op );
+	*eax = (uint32_t)regs[0];
+	*ebx = (uint32_t)regs[1];
+	*ecx = (uint32_t)regs[2];
+	*edx = (uint32_t)regs[3];
+#else
+	*eax = 0;
+#endif
+}
+
+static bool utf8_lookup_has_popcnt()
+{
+	uint32_t eax = 0; uint32_t ebx = 0; uint32_t ecx = 0; uint32_t edx = 0;
+	utf8_lookup_cpuid(0, &eax, &ebx, &ecx, &edx);
+	if( eax >= 1 )
+	{
+		utf8_lookup_cpuid( 1, &eax, &ebx, &ecx, &edx );
+		return ecx & ( 1 << 23 );
+	}
+	return false;
+}
+
+static bool utf8_lookup_has_ssse3()
+{
+	uint32_t eax = 0; uint32_t ebx = 0; uint32_t ecx = 0; uint32_t edx = 0;
+	utf8_lookup_cpuid(0, &eax, &ebx, &ecx, &edx);
+	if( eax >= 1 )
+	{
+		utf8_lookup_cpuid( 1, &eax, &ebx, &ecx, &edx );
+		return ecx & ( 1 << 9 );
+	}
+	return false;
+}
+
+static bool utf8_lookup_has_avx2()
+{
+	uint32_t eax = 0; uint32_t ebx = 0; uint32_t ecx = 0; uint32_t edx = 0;
+	utf8_lookup_cpuid(0, &eax, &ebx, &ecx, &edx);
+	if( eax < 7 )
+		return false;
+
+	// ... the os also need to save the ymm-registers, osxsave + xcr0 ...
+	utf8_lookup_cpuid( 1, &eax, &ebx, &ecx, &edx );
+	if( ( ecx & ( 1 << 27 ) ) == 0 )
+		return false;
+
+	uint64_t xcr0 = 0;
+#if defined( __GNUC__ ) && defined( UTF8_LOOKUP_X64 )
+	uint32_t xcr0_lo, xcr0_hi;
+	__asm__ __volatile__( "xgetbv" : "=a"( xcr0_lo ), "=d"( xcr0_hi ) : "c"( 0 ) );
+	xcr0 = ( (uint64_t)xcr0_hi << 32 ) | xcr0_lo;
+#elif defined( _MSC_VER ) && defined( UTF8_LOOKUP_X64 )
+	xcr0 = _xgetbv( 0 );
+#endif
+	if( ( xcr0 & 6 ) != 6 )
+		return false;
+
+#if defined( __GNUC__ )
+	__cpuid_count( 7, 0, eax, ebx, ecx, edx );
+#elif defined( _MSC_VER )
+	int regs[4];
+	__cpuidex( regs, 7, 0 );
+	ebx = (uint32_t)regs[1];
+#else
+	ebx = 0;
+#endif
+	return ( ebx & ( 1 << 5 ) ) != 0;
+}
+
+static UTF8_LOOKUP_ALWAYSINLINE uint64_t utf8_popcnt_impl( uint64_t val, const int has_popcnt )
+{
+#if defined( __GNUC__ )
+	if( has_popcnt )
+		return (uint64_t)__builtin_popcountll( (unsigned long long)val ); // the gcc implementation of popcountll is only faster when the actual instruction exists
+#endif
+
+#if defined(_MSC_VER)
+#if defined(_WIN64)
+	if( has_popcnt )
+		return (uint64_t)__popcnt64((uint64_t)val);
+#else
+	uint32_t* ptr = (uint32_t*)&val;
+	if( has_popcnt )
+		return (uint64_t)__popcnt(ptr[0]) + __popcnt(ptr[1]);
+#endif
+#endif
+
+	val = (val & 0x5555555555555555ULL) + ((val >> 1) & 0x5555555555555555ULL);
+	val = (val & 0x3333333333333333ULL) + ((val >> 2) & 0x3333333333333333ULL);
+	val = (val & 0x0F0F0F0F0F0F0F0FULL) + ((val >> 4) & 0x0F0F0F0F0F0F0F0FULL);
+	return (val * 0x0101010101010101ULL) >> 56;
+}
+
+static int utf8_split_to_bytes( unsigned int cp, unsigned int* bytes )
+{
+	if ( cp <= 127 )
+	{
+		bytes[0] = cp;
+		bytes[1] = 0;
+		bytes[2] = 0;
+		bytes[3] = 0;
+		return 0;
+	}
+	if( cp <= 0x7FF )
+	{
+		bytes[0] = cp >> 6;
+		bytes[1] = cp & 63;
+		bytes[2] = 0;
+		bytes[3] = 0;
+		return 1;
+	}
+
+	if( cp <= 0xFFFF )
+	{
+		bytes[0] = ( cp >> 12 ) & 15;
+		bytes[1] = ( cp >> 6  ) & 63;
+		bytes[2] = cp & 63;
+		bytes[3] = 0;
+		return 2;
+	}
+
+	if( cp <= 0x10FFFF )
+	{
+		bytes[0] = ( cp >> 18 ) & 7;
+		bytes[1] = ( cp >> 12 ) & 63;
+		bytes[2] = ( cp >> 6  ) & 63;
+		bytes[3] = cp & 63;
+		return 3;
+	}
+
+	bytes[0] = 0;
+	bytes[1] = 0;
+	bytes[2] = 0;
+	bytes[3] = 0;
+	return -1;
+}
+
+// table telling where to start a lookup-traversal depending on how many bytes the current utf8-char is.
+// first item in the avail_bits is always 0, this is used as "not found". If sometime in the lookup-loop
+// a char is determined that it do not exist, i.e. a bit in the avail_bits-array is not set, the current
+// lookup index will be set to 0 and reference this empty bitset for the rest of the lookup.
+//
+// This was done under the asumption that you mostly do lookups that "hit" the table, i.e. you will need
+// to do all loop-iterations so instead of branching, just make the code always loop all iterations.
+//
+// if this is a gain is something to actually be tested.
+static const uint64_t START_OFFSET[4] = { 1, 3, 4, 5 };
+
+utf8_lookup_error utf8_lookup_gen_table( void*               table,
+					 	 	 	 	 	 size_t              table_size,
+					 	 	 	 	 	 const unsigned int* codepoints,
+					 	 	 	 	 	 unsigned int        num_codepoints )
+{
+    memset( table, 0x0, table_size );
+
+    size_t calc_table_size;
+    utf8_lookup_calc_table_size( &calc_table_size, codepoints, num_codepoints );
+
+    if( calc_table_size > table_size )
+        return UTF8_LOOKUP_ERROR_BUFFER_TO_SMALL;
+
+    size_t items = ( calc_table_size - sizeof(uint64_t) ) / ( sizeof( uint64_t ) + sizeof(uint16_t) );
+
+    uint64_t* avail_bits = (uint64_t*)((uint8_t*)table + sizeof(uint64_t));
+    uint16_t* offsets    = (uint16_t*)((uint8_t*)avail_bits + sizeof(uint64_t) * items);
+
+    // loop all codepoints
+
+    const unsigned int* start = codepoints;
+    const unsigned int* end   = codepoints + num_codepoints;
+
+    int curr_elem = 0;
+
+    int octet_start[5] = { -1, -1, -1, -1, -1 };
+    int last_octet = -1;
+
+    for( int octet = 0; octet < 5; ++octet )
+    {
+        unsigned int last_prev_gids[4] = { (unsigned int)-1, (unsigned int)-1, (unsigned int)-1, (unsigned int)-1 };
+        const unsigned int* curr = start;
+        while( curr != end )
+        {
+			unsigned int gids[4];
+            int curr_octet = utf8_split_to_bytes( *curr++, gids );
+
+            if( octet == 0 )
+            {
+                // we are in the static section of the table.
+                curr_elem = (int)(START_OFFSET[ curr_octet ] + ( gids[ octet ] >> 6  ) );
+            }
+            else
+            {
+                // we are in the dynamic section of the table.
+                curr_elem = curr_elem < 6 ? 5 : curr_elem;
+
+                if( ( memcmp( last_prev_gids, gids, (size_t)( octet ) * sizeof( unsigned int ) ) != 0 ) || last_octet != curr_octet )
+                {
+                    ++curr_elem;
+                    memcpy( last_prev_gids, gids, sizeof( gids ) );
+                }
+            }
+
+            last_octet = curr_octet;
+
+            if( octet_start[ octet ] == -1 )
+                octet_start[ octet ] = curr_elem;
+
+            if( octet == curr_octet )
+            {
+                // advance start, we will not do anything with this char again.
+                ++start;
+
+                // mark element as chars
+                offsets[ curr_elem ] = 1;
+            }
+            else
+            {
+                // mark element as group
+                offsets[ curr_elem ] = 2;
+            }
+
+			// set the avail bit
+			avail_bits[ curr_elem ] |= (uint64_t)1 << ( gids[ octet ] & 63 );
+        }
+    }
+
+    // write offsets!
+
+    octet_start[4] = curr_elem + 1;
+    int last_start = curr_elem + 1;
+    for( int i = 3; i >= 0; --i )
+    {
+        if( octet_start[i] == -1 )
+            octet_start[i] = last_start;
+        else
+            last_start = octet_start[i];
+    }
+
+    uint32_t char_offset = 1;
+    uint32_t group_offset = 6;
+
+    for( unsigned int octet = 0; octet < 4; ++octet )
+    {
+		group_offset = (uint32_t)octet_start[ octet + 1 ];
+
+        for( int j = octet_start[ octet ]; j < octet_start[ octet + 1 ]; ++j )
+        {
+            if( offsets[ j ] == 1 )
+            {
+                // writing a char
+                offsets[ j ] = (uint16_t)char_offset;
+                char_offset += (uint32_t)utf8_popcnt_impl( avail_bits[ j ], 0 );
+            }
+            else if( offsets[ j ] == 2 )
+            {
+                // writing a group
+                offsets[ j ] = (uint16_t)group_offset;
+                group_offset += (uint32_t)utf8_popcnt_impl( avail_bits[ j ], 0 );
+            }
+        }
+    }
+
+    *((uint64_t*)table) = (uint64_t)items;
+
+	return UTF8_LOOKUP_ERROR_OK;
+}
+
+utf8_lookup_error utf8_lookup_calc_table_size( size_t*             table_size,
+                                               const unsigned int* codepoints,
+                                               unsigned int        num_codepoints )
+{
+    // loop all codepoints
+
+    const unsigned int* start = codepoints;
+    const unsigned int* end   = codepoints + num_codepoints;
+
+    unsigned int curr_elem = 0;
+    int last_octet = -1;
+
+    for( int octet = 0; octet < 5; ++octet )
+    {
+        unsigned int last_prev_gids[4] = { (unsigned int)-1, (unsigned int)-1, (unsigned int)-1, (unsigned int)-1 };
+        const unsigned int* curr = start;
+        while( curr != end )
+        {
+			unsigned int gids[4];
+            int curr_octet = utf8_split_to_bytes( *curr++, gids );
+
+            if( octet == 0 )
+            {
+                // we are in the static section of the table.
+                curr_elem = (unsigned int)(START_OFFSET[ curr_octet ] + ( gids[ octet ] >> 6 ) );
+            }
+            else
+            {
+                // we are in the dynamic section of the table.
+                curr_elem = curr_elem < 6 ? 5 : curr_elem;
+
+                if( ( memcmp( last_prev_gids, gids, (size_t)( octet ) * sizeof( unsigned int ) ) != 0 ) || last_octet != curr_octet )
+                {
+                    ++curr_elem;
+                    memcpy( last_prev_gids, gids, sizeof( gids ) );
+                }
+            }
+
+            last_octet = curr_octet;
+
+            if( octet == curr_octet )
+                // advance start, we will not do anything with this char again.
+                ++start;
+        }
+    }
+
+    // table layout:
+    // uint64_t              - item_count, kept as uint64_t to get valid alignment for the following arrays.
+    // uint64_t[item_count]  - availabillity bits.
+    // uint16_t[item_count]  - group-offsets.
+    // the root-elements 0-5 always need to exist since a lookup of a char of any length will read the root for
+    // that length, even if there are no codepoints of that length in the table.
+    if( curr_elem < 5 )
+        curr_elem = 5;
+    unsigned int item_count = curr_elem + 2; // TODO: remember why I need the +2 here and document. ( unittests fail without it )
+    *table_size = sizeof(uint64_t) +
+                  ( item_count * sizeof(uint64_t) ) +
+                  ( item_count * sizeof(uint16_t) );
+	return UTF8_LOOKUP_ERROR_OK;
+}
+
+static const int UTF8_TRAILING_BYTES_TABLE[256] = {
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+	1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+	2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2, 3,3,3,3,3,3,3,3,4,4,4,4,5,5,5,5
+};
+
+static const uint64_t GROUP_MASK[4]   = { 127, 63, 63, 63 };
+static const uint64_t GID_MASK[4]     = {  63, 31, 15,  7 };
+
+static UTF8_LOOKUP_ALWAYSINLINE const uint64_t* utf8_lookup_avail_bits( const void* table )
+{
+	return (const uint64_t*)((const uint8_t*)table + sizeof(uint64_t));
+}
+
+static UTF8_LOOKUP_ALWAYSINLINE const uint16_t* utf8_lookup_offsets( const void* table )
+{
+	uint64_t items = *((const uint64_t*)table);
+	return (const uint16_t*)((const uint8_t*)utf8_lookup_avail_bits( table ) + sizeof(uint64_t) * items);
+}
+
+/**
+ * Walk the lookup-table for one utf8-char starting at pos with octet trailing bytes and return its offset,
+ * 0 if not found. The codepoint of the char is decoded from the same bytes and returned in codepoint.
+ */
+static UTF8_LOOKUP_ALWAYSINLINE uint64_t utf8_lookup_find_decode( const uint64_t* avail_bits,
+																  const uint16_t* offsets,
+																  const uint8_t*  pos,
+																  int             octet,
+																  unsigned int*   codepoint,
+																  int             has_popcnt )
+{
+	uint64_t curr_offset = START_OFFSET[octet];
+	uint64_t group_mask  = GROUP_MASK[octet];
+	uint64_t gid_mask    = GID_MASK[octet];
+	uint64_t cp          = 0;
+
+	for( int i = 0; i <= octet; ++i )
+	{
+		// make sure that we get a value between 0-63 to decide what bit the current byte.
+		// it is only octet 1 that will have more than 6 significant bits.
+		uint64_t group     = (uint64_t)(*pos & group_mask) >> (uint64_t)6;
+
+		// mask of the bits that is valid in this mask, only the first byte will have a
+		// different amount of set bits. Thereof the table above.
+		uint64_t gid       = (uint64_t)(*pos & gid_mask);
+
+		uint64_t check_bit = (uint64_t)1 << gid;
+
+		// the bits of the codepoint is gid_mask except for ascii where the group-bit is also used.
+		cp = ( cp << 6 ) | (uint64_t)( *pos & ( gid_mask | ( group_mask & 64 ) ) );
+
+		// gid mask will always be 0b111111 i.e. the lowest 6 bit set on all loops except
+		// the first one. This is due to how utf8 is structured, see table at the top of
+		// the file.
+		gid_mask = 63;
+
+		++pos;
+
+		// index in avail_bits and corresponding offsets that we are currently working in.
+		uint64_t index = group + curr_offset;
+
+		// how many bits are set "before" the current element in this group? this is used
+		// to calculate the next item in the lookup.
+		uint64_t items_before = utf8_popcnt_impl( avail_bits[index] & ( check_bit - (uint64_t)1 ), has_popcnt );
+
+		// select the next offset in the avail_bits-array to check or if this is the last iteration this
+		// will be the actual result.
+		// note: if the lookup is a miss, i.e. bit is not set, point curr_offset to 0 that is a bitfield
+		//       that is always 0 and offsets[0] == 0 to just keep on "missing"
+		curr_offset = ( avail_bits[index] & check_bit ) > (uint64_t)0 ? offsets[index] + items_before : 0x0;
+	}
+
+	// curr_offset is now either 0 for not found or offset in glyphs-table
+	*codepoint = (unsigned int)cp;
+	return curr_offset;
+}
+
+/**
+ * Walk the lookup-table for one utf8-char starting at pos with octet trailing bytes and return its offset,
+ * 0 if not found.
+ */
+static UTF8_LOOKUP_ALWAYSINLINE uint64_t utf8_lookup_find( const uint64_t* avail_bits,
+														   const uint16_t* offsets,
+														   const uint8_t*  pos,
+														   int             octet,
+														   int             has_popcnt )
+{
+	// ... the decode is optimized away when inlined and codepoint is not used ...
+	unsigned int codepoint;
+	return utf8_lookup_find_decode( avail_bits, offsets, pos, octet, &codepoint, has_popcnt );
+}
+
+#if defined(UTF8_LOOKUP_X64)
+/**
+ * Lookup and transcode to utf16 over 32 byte aligned blocks of only ascii and 2-byte chars from pos, the code
+ * units for all bytes in a block is decoded at once. A char split between two blocks is handled by the first
+ * one. Stops at the first block that contains longer chars, contains the string terminator or might not fit in
+ * res or utf16.
+ */
+static const uint8_t* utf8_lookup_perform_utf16_blocks( const uint64_t*      avail_bits,
+														const uint16_t*      offsets,
+														const uint8_t*       pos,
+														utf8_lookup_result** res_out,
+														utf8_lookup_result*  res_end,
+														uint16_t**           utf16_out,
+														uint16_t*            utf16_end ) UTF8_LOOKUP_TARGET("popcnt,avx2");
+static const uint8_t* utf8_lookup_perform_utf16_blocks( const uint64_t*      avail_bits,
+														const uint16_t*      offsets,
+														const uint8_t*       pos,
+														utf8_lookup_result** res_out,
+														utf8_lookup_result*  res_end,
+														uint16_t**           utf16_out,
+														uint16_t*            utf16_end )
+{
+	const __m256i zero      = _mm256_setzero_si256();
+	const __m256i max_lead2 = _mm256_set1_epi8( (char)0xDF );
+	const __m256i cont_mask = _mm256_set1_epi8( (char)0xC0 );
+	const __m256i cont      = _mm256_set1_epi8( (char)0x80 );
+
+	utf8_lookup_result* res  = *res_out;
+	uint16_t*           unit = *utf16_out;
+
+	while( res_end - res >= 32 && utf16_end - unit >= 32 )
+	{
+		__m256i block = _mm256_load_si256( (const __m256i*)pos );
+
+		// ... no terminator and nothing above 2-byte leads ...
+		int bad = _mm256_movemask_epi8( _mm256_cmpeq_epi8( block, zero ) ) |
+				  ~_mm256_movemask_epi8( _mm256_cmpeq_epi8( _mm256_min_epu8( block, max_lead2 ), block ) );
+		if( bad != 0 )
+			break;
+
+		__m128i lo = _mm256_castsi256_si128( block );
+		__m128i hi = _mm256_extracti128_si256( block, 1 );
+
+		if( _mm256_movemask_epi8( block ) == 0 )
+		{
+			_mm256_storeu_si256( (__m256i*)unit,        _mm256_cvtepu8_epi16( lo ) );
+			_mm256_storeu_si256( (__m256i*)( unit + 16 ), _mm256_cvtepu8_epi16( hi ) );
+			unit += 32;
+			for( int i = 0; i < 32; ++i )
+			{
+				res->pos    = pos + i;
+				res->offset = (unsigned int)utf8_lookup_find( avail_bits, offsets, pos + i, 0, 1 );
+				++res;
+			}
+			pos += 32;
+			continue;
+		}
+
+		// ... decode every byte as if it was the lead of a char, the continuation-bytes are skipped below ...
+		uint16_t units[32];
+		// ... a lead last in the block always has its continuation-byte in the next block ...
+		__m128i last_next = _mm_cvtsi32_si128( pos[31] >= 0xC0 ? pos[32] : 0 );
+		__m128i next[2] = { _mm_alignr_epi8( hi, lo, 1 ), _mm_alignr_epi8( last_next, hi, 1 ) };
+		__m128i curr[2] = { lo, hi };
+		for( int half = 0; half < 2; ++half )
+		{
+			__m256i b     = _mm256_cvtepu8_epi16( curr[half] );
+			__m256i n     = _mm256_cvtepu8_epi16( next[half] );
+			__m256i lead2 = _mm256_or_si256( _mm256_slli_epi16( _mm256_and_si256( b, _mm256_set1_epi16( 0x1F ) ), 6 ),
+											 _mm256_and_si256( n, _mm256_set1_epi16( 0x3F ) ) );
+			__m256i is_lead = _mm256_cmpgt_epi16( b, _mm256_set1_epi16( 0xBF ) );
+			_mm256_storeu_si256( (__m256i*)( units + half * 16 ), _mm256_blendv_epi8( b, lead2, is_lead ) );
+		}
+
+		uint32_t starts = ~(uint32_t)_mm256_movemask_epi8( _mm256_cmpeq_epi8( _mm256_and_si256( block, cont_mask ), cont ) );
+		while( starts != 0 )
+		{
+			int i = (int)utf8_popcnt_impl( (uint64_t)( starts & -starts ) - 1, 1 );
+			res->pos    = pos + i;
+			res->offset = (unsigned int)utf8_lookup_find( avail_bits, offsets, pos + i, pos[i] >= 0xC0 ? 1 : 0, 1 );
+			++res;
+			*unit++ = units[i];
+			starts &= starts - 1;
+		}
+		pos += 32;
+	}
+
+	// ... skip the continuation-byte of a char handled by the last block ...
+	if( ( *pos & 0xC0 ) == 0x80 )
+		++pos;
+
+	*res_out   = res;
+	*utf16_out = unit;
+	return pos;
+}
+#endif
+
+/**
+ * Shared by utf8_lookup_perform and utf8_lookup_perform_to_utf16, when utf16 is 0x0 nothing is decoded and
+ * the transcode is optimized away.
+ */
+UTF8_LOOKUP_ALWAYSINLINE const uint8_t* utf8_lookup_perform_impl( const void*         lookup,
+													  const uint8_t*      str,
+													  utf8_lookup_result* res,
+													  size_t*             res_size,
+													  uint16_t*           utf16,
+													  size_t*             utf16_size,
+													  int                 has_popcnt,
+													  int                 has_avx2 )
+{
+	utf8_lookup_result* res_out = res;
+	utf8_lookup_result* res_end = res + *res_size;
+
+	uint16_t* utf16_out = utf16;
+	uint16_t* utf16_end = utf16 != 0x0 ? utf16 + *utf16_size : 0x0;
+
+	const uint8_t* pos = str;
+
+	const uint64_t* avail_bits = utf8_lookup_avail_bits( lookup );
+	const uint16_t* offsets    = utf8_lookup_offsets( lookup );
+
+	while( true )
+	{
+#if defined(UTF8_LOOKUP_X64)
+		if( has_avx2 && utf16 != 0x0 && ( (uintptr_t)pos & 31 ) == 0 )
+			pos = utf8_lookup_perform_utf16_blocks( avail_bits, offsets, pos, &res_out, res_end, &utf16_out, utf16_end );
+#else
+		(void)has_avx2;
+#endif
+		if( *pos == 0 || res_out == res_end )
+			break;
+
+		int octet = UTF8_TRAILING_BYTES_TABLE[ *pos ];
+
+		if( utf16 != 0x0 )
+		{
+			// ... a surrogate pair is needed for all 4 byte chars ...
+			if( utf16_end - utf16_out < ( octet == 3 ? 2 : 1 ) )
+				break;
+
+			unsigned int cp;
+			res_out->pos    = pos;
+			res_out->offset = (unsigned int)utf8_lookup_find_decode( avail_bits, offsets, pos, octet, &cp, has_popcnt );
+			if( cp >= 0x10000 )
+			{
+				cp -= 0x10000;
+				*utf16_out++ = (uint16_t)( 0xD800 | ( cp >> 10 ) );
+				*utf16_out++ = (uint16_t)( 0xDC00 | ( cp & 0x3FF ) );
+			}
+			else
+				*utf16_out++ = (uint16_t)cp;
+		}
+		else
+		{
+			res_out->pos    = pos;
+			res_out->offset = (unsigned int)utf8_lookup_find( avail_bits, offsets, pos, octet, has_popcnt );
+		}
+		++res_out;
+
+		pos += octet + 1;
+	}
+
+	*res_size = (size_t)(res_out - res);
+	if( utf16 != 0x0 )
+		*utf16_size = (size_t)(utf16_out - utf16);
+	return pos;
+}
+
+const uint8_t* utf8_lookup_perform_scalar( const void*         lookup,
+                                           const uint8_t*      str,
+                                           utf8_lookup_result* res,
+                                           size_t*             res_size )
+{
+	return utf8_lookup_perform_impl( lookup, str, res, res_size, 0x0, 0x0, 0, 0 );
+}
+
+#if defined(UTF8_LOOKUP_HAS_ATTRIBUTE_TARGET)
+// ... tell gcc to optimize this as if a popcnt instruction exists ...
+const uint8_t* utf8_lookup_perform_popcnt( const void*         lookup,
+                                           const uint8_t*      str,
+                                           utf8_lookup_result* res,
+                                           size_t*             res_size ) __attribute__((target("popcnt")));
+#endif
+
+const uint8_t* utf8_lookup_perform_popcnt( const void*         lookup,
+                                           const uint8_t*      str,
+                                           utf8_lookup_result* res,
+                                           size_t*             res_size )
+{
+	return utf8_lookup_perform_impl( lookup, str, res, res_size, 0x0, 0x0, 1, 0 );
+}
+
+const uint8_t* utf8_lookup_perform( const void*         lookup,
+                                    const uint8_t*      str,
+                                    utf8_lookup_result* res,
+                                    size_t*             res_size )
+{
+	static const uint8_t* (* volatile _func)( const void*, const uint8_t*, utf8_lookup_result*, size_t* ) = 0;
+	if( UTF8_LOOKUP_DISPATCH_LOAD( _func ) == 0 )
+	{
+		if(utf8_lookup_has_popcnt())
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_perform_popcnt );
+		else
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_perform_scalar );
+	}
+
+	return UTF8_LOOKUP_DISPATCH_LOAD( _func )( lookup, str, res, res_size );
+}
+
+const uint8_t* utf8_lookup_perform_to_utf16_scalar( const void*         lookup,
+                                                    const uint8_t*      str,
+                                                    utf8_lookup_result* res,
+                                                    size_t*             res_size,
+                                                    uint16_t*           utf16,
+                                                    size_t*             utf16_size )
+{
+	return utf8_lookup_perform_impl( lookup, str, res, res_size, utf16, utf16_size, 0, 0 );
+}
+
+#if defined(UTF8_LOOKUP_HAS_ATTRIBUTE_TARGET)
+const uint8_t* utf8_lookup_perform_to_utf16_popcnt( const void*         lookup,
+                                                    const uint8_t*      str,
+                                                    utf8_lookup_result* res,
+                                                    size_t*             res_size,
+                                                    uint16_t*           utf16,
+                                                    size_t*             utf16_size ) __attribute__((target("popcnt")));
+const uint8_t* utf8_lookup_perform_to_utf16_avx2( const void*         lookup,
+                                                  const uint8_t*      str,
+                                                  utf8_lookup_result* res,
+                                                  size_t*             res_size,
+                                                  uint16_t*           utf16,
+                                                  size_t*             utf16_size ) __attribute__((target("popcnt,avx2")));
+#endif
+
+const uint8_t* utf8_lookup_perform_to_utf16_popcnt( const void*         lookup,
+                                                    const uint8_t*      str,
+                                                    utf8_lookup_result* res,
+                                                    size_t*             res_size,
+                                                    uint16_t*           utf16,
+                                                    size_t*             utf16_size )
+{
+	return utf8_lookup_perform_impl( lookup, str, res, res_size, utf16, utf16_size, 1, 0 );
+}
+
+const uint8_t* utf8_lookup_perform_to_utf16_avx2( const void*         lookup,
+                                                  const uint8_t*      str,
+                                                  utf8_lookup_result* res,
+                                                  size_t*             res_size,
+                                                  uint16_t*           utf16,
+                                                  size_t*             utf16_size )
+{
+	return utf8_lookup_perform_impl( lookup, str, res, res_size, utf16, utf16_size, 1, 1 );
+}
+
+const uint8_t* utf8_lookup_perform_to_utf16( const void*         lookup,
+                                             const uint8_t*      str,
+                                             utf8_lookup_result* res,
+                                             size_t*             res_size,
+                                             uint16_t*           utf16,
+                                             size_t*             utf16_size )
+{
+	static const uint8_t* (* volatile _func)( const void*, const uint8_t*, utf8_lookup_result*, size_t*, uint16_t*, size_t* ) = 0;
+	if( UTF8_LOOKUP_DISPATCH_LOAD( _func ) == 0 )
+	{
+		if(utf8_lookup_has_popcnt() && utf8_lookup_has_avx2())
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_perform_to_utf16_avx2 );
+		else if(utf8_lookup_has_popcnt())
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_perform_to_utf16_popcnt );
+		else
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_perform_to_utf16_scalar );
+	}
+
+	return UTF8_LOOKUP_DISPATCH_LOAD( _func )( lookup, str, res, res_size, utf16, utf16_size );
+}
+
+UTF8_LOOKUP_ALWAYSINLINE const uint8_t* utf8_lookup_perform_ex_impl( const void*            lookup,
+																	 const uint8_t*         str,
+																	 utf8_lookup_result_ex* res,
+																	 size_t*                res_size,
+																	 int                    has_popcnt )
+{
+	utf8_lookup_result_ex* res_out = res;
+	utf8_lookup_result_ex* res_end = res + *res_size;
+
+	const uint8_t* pos = str;
+
+	const uint64_t* avail_bits = utf8_lookup_avail_bits( lookup );
+	const uint16_t* offsets    = utf8_lookup_offsets( lookup );
+
+	while( *pos && res_out != res_end )
+	{
+		int octet = UTF8_TRAILING_BYTES_TABLE[ *pos ];
+
+		res_out->pos    = pos;
+		res_out->offset = (unsigned int)utf8_lookup_find_decode( avail_bits, offsets, pos, octet, &res_out->codepoint, has_popcnt );
+		res_out->length = (unsigned int)octet + 1;
+		++res_out;
+
+		pos += octet + 1;
+	}
+
+	*res_size = (size_t)(res_out - res);
+	return pos;
+}
+
+const uint8_t* utf8_lookup_perform_ex_scalar( const void*            lookup,
+                                              const uint8_t*         str,
+                                              utf8_lookup_result_ex* res,
+                                              size_t*                res_size )
+{
+	return utf8_lookup_perform_ex_impl( lookup, str, res, res_size, 0 );
+}
+
+#if defined(UTF8_LOOKUP_HAS_ATTRIBUTE_TARGET)
+const uint8_t* utf8_lookup_perform_ex_popcnt( const void*            lookup,
+                                              const uint8_t*         str,
+                                              utf8_lookup_result_ex* res,
+                                              size_t*                res_size ) __attribute__((target("popcnt")));
+#endif
+
+const uint8_t* utf8_lookup_perform_ex_popcnt( const void*            lookup,
+                                              const uint8_t*         str,
+                                              utf8_lookup_result_ex* res,
+                                              size_t*                res_size )
+{
+	return utf8_lookup_perform_ex_impl( lookup, str, res, res_size, 1 );
+}
+
+const uint8_t* utf8_lookup_perform_ex( const void*            lookup,
+                                       const uint8_t*         str,
+                                       utf8_lookup_result_ex* res,
+                                       size_t*                res_size )
+{
+	static const uint8_t* (* volatile _func)( const void*, const uint8_t*, utf8_lookup_result_ex*, size_t* ) = 0;
+	if( UTF8_LOOKUP_DISPATCH_LOAD( _func ) == 0 )
+	{
+		if(utf8_lookup_has_popcnt())
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_perform_ex_popcnt );
+		else
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_perform_ex_scalar );
+	}
+
+	return UTF8_LOOKUP_DISPATCH_LOAD( _func )( lookup, str, res, res_size );
+}
+
+UTF8_LOOKUP_ALWAYSINLINE size_t utf8_lookup_count_chars_impl( const uint8_t* str, int has_popcnt )
+{
+	const uint8_t* pos = str;
+	size_t chars = 0;
+
+#if defined(UTF8_LOOKUP_X64)
+	// ... scalar up to the first 16 byte boundary ...
+	for( ; ( (uintptr_t)pos & 15 ) != 0; ++pos )
+	{
+		if( *pos == 0 )
+			return chars;
+		chars += ( *pos & 0xC0 ) != 0x80;
+	}
+
+	// ... every byte that is not a continuation-byte, 0x80 - 0xBF, starts a char. Compare as signed where
+	// continuation-bytes are -128 - -65 and subtract the -1 from the compare into per-byte counters that are
+	// summed with psadbw before they can overflow. Aligned loads never cross a page so reading past the
+	// terminator is safe.
+	const __m128i zero         = _mm_setzero_si128();
+	const __m128i continuation = _mm_set1_epi8( -65 );
+	while( true )
+	{
+		__m128i counters = zero;
+		int blocks = 0;
+		__m128i block = _mm_load_si128( (const __m128i*)pos );
+		int terminator = _mm_movemask_epi8( _mm_cmpeq_epi8( block, zero ) );
+		while( terminator == 0 && blocks < 255 )
+		{
+			counters = _mm_sub_epi8( counters, _mm_cmpgt_epi8( block, continuation ) );
+			pos += 16;
+			++blocks;
+			block = _mm_load_si128( (const __m128i*)pos );
+			terminator = _mm_movemask_epi8( _mm_cmpeq_epi8( block, zero ) );
+		}
+
+		__m128i sums = _mm_sad_epu8( counters, zero );
+		chars += (size_t)_mm_cvtsi128_si32( sums ) + (size_t)_mm_cvtsi128_si32( _mm_unpackhi_epi64( sums, sums ) );
+
+		if( terminator != 0 )
+		{
+			// ... only count the bytes before the terminator in the last block ...
+			int before = ( terminator & -terminator ) - 1;
+			int starts = _mm_movemask_epi8( _mm_cmpgt_epi8( block, continuation ) ) & before;
+			return chars + (size_t)utf8_popcnt_impl( (uint64_t)starts, has_popcnt );
+		}
+	}
+#else
+	for( ; *pos; ++pos )
+		chars += ( *pos & 0xC0 ) != 0x80;
+	(void)has_popcnt;
+	return chars;
+#endif
+}
+
+size_t utf8_lookup_count_chars_scalar( const uint8_t* str )
+{
+	return utf8_lookup_count_chars_impl( str, 0 );
+}
+
+#if defined(UTF8_LOOKUP_HAS_ATTRIBUTE_TARGET)
+size_t utf8_lookup_count_chars_popcnt( const uint8_t* str ) __attribute__((target("popcnt")));
+#endif
+
+size_t utf8_lookup_count_chars_popcnt( const uint8_t* str )
+{
+	return utf8_lookup_count_chars_impl( str, 1 );
+}
+
+size_t utf8_lookup_count_chars( const uint8_t* str )
+{
+	static size_t (* volatile _func)( const uint8_t* ) = 0;
+	if( UTF8_LOOKUP_DISPATCH_LOAD( _func ) == 0 )
+	{
+		if(utf8_lookup_has_popcnt())
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_count_chars_popcnt );
+		else
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_count_chars_scalar );
+	}
+
+	return UTF8_LOOKUP_DISPATCH_LOAD( _func )( str );
+}
+
+UTF8_LOOKUP_ALWAYSINLINE size_t utf8_lookup_perform_all_impl( const void*         lookup,
+															  const uint8_t*      str,
+															  utf8_lookup_result* res,
+															  int                 has_popcnt )
+{
+	utf8_lookup_result* res_out = res;
+
+	const uint64_t* avail_bits = utf8_lookup_avail_bits( lookup );
+	const uint16_t* offsets    = utf8_lookup_offsets( lookup );
+
+	// ... res is known to fit all chars so only the terminator need to be checked ...
+	for( const uint8_t* pos = str; *pos; ++res_out )
+	{
+		int octet = UTF8_TRAILING_BYTES_TABLE[ *pos ];
+
+		res_out->pos    = pos;
+		res_out->offset = (unsigned int)utf8_lookup_find( avail_bits, offsets, pos, octet, has_popcnt );
+
+		pos += octet + 1;
+	}
+
+	return (size_t)(res_out - res);
+}
+
+size_t utf8_lookup_perform_all_scalar( const void*         lookup,
+                                       const uint8_t*      str,
+                                       utf8_lookup_result* res )
+{
+	return utf8_lookup_perform_all_impl( lookup, str, res, 0 );
+}
+
+#if defined(UTF8_LOOKUP_HAS_ATTRIBUTE_TARGET)
+size_t utf8_lookup_perform_all_popcnt( const void*         lookup,
+                                       const uint8_t*      str,
+                                       utf8_lookup_result* res ) __attribute__((target("popcnt")));
+#endif
+
+size_t utf8_lookup_perform_all_popcnt( const void*         lookup,
+                                       const uint8_t*      str,
+                                       utf8_lookup_result* res )
+{
+	return utf8_lookup_perform_all_impl( lookup, str, res, 1 );
+}
+
+size_t utf8_lookup_perform_all( const void*         lookup,
+                                const uint8_t*      str,
+                                utf8_lookup_result* res )
+{
+	static size_t (* volatile _func)( const void*, const uint8_t*, utf8_lookup_result* ) = 0;
+	if( UTF8_LOOKUP_DISPATCH_LOAD( _func ) == 0 )
+	{
+		if(utf8_lookup_has_popcnt())
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_perform_all_popcnt );
+		else
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_perform_all_scalar );
+	}
+
+	return UTF8_LOOKUP_DISPATCH_LOAD( _func )( lookup, str, res );
+}
+
+/**
+ * Same walk as utf8_lookup_find but the bytes of the utf8-encoding of codepoint is calculated instead of
+ * read from a string.
+ */
+static UTF8_LOOKUP_ALWAYSINLINE uint64_t utf8_lookup_find_codepoint( const uint64_t* avail_bits,
+																	 const uint16_t* offsets,
+																	 unsigned int    codepoint,
+																	 int             has_popcnt )
+{
+	if( codepoint > 0x10FFFF )
+		return 0;
+
+	int octet = ( codepoint >= 0x80 ) + ( codepoint >= 0x800 ) + ( codepoint >= 0x10000 );
+
+	// ... root-selection is the same as utf8_lookup_find, only the ascii-chars is split over 2 roots ...
+	uint64_t curr_offset = START_OFFSET[octet] + ( octet == 0 ? codepoint >> 6 : 0 );
+	uint64_t gid_mask    = GID_MASK[octet];
+
+	for( int i = 0; i <= octet; ++i )
+	{
+		uint64_t gid       = ( codepoint >> ( 6 * ( octet - i ) ) ) & gid_mask;
+		uint64_t check_bit = (uint64_t)1 << gid;
+		gid_mask = 63;
+
+		uint64_t index        = curr_offset;
+		uint64_t items_before = utf8_popcnt_impl( avail_bits[index] & ( check_bit - (uint64_t)1 ), has_popcnt );
+		curr_offset = ( avail_bits[index] & check_bit ) > (uint64_t)0 ? offsets[index] + items_before : 0x0;
+	}
+
+	return curr_offset;
+}
+
+UTF8_LOOKUP_ALWAYSINLINE const uint16_t* utf8_lookup_perform_utf16_impl( const void*               lookup,
+																		 const uint16_t*           str,
+																		 utf8_lookup_utf16_result* res,
+																		 size_t*                   res_size,
+																		 int                       has_popcnt )
+{
+	utf8_lookup_utf16_result* res_out = res;
+	utf8_lookup_utf16_result* res_end = res + *res_size;
+
+	const uint16_t* pos = str;
+
+	const uint64_t* avail_bits = utf8_lookup_avail_bits( lookup );
+	const uint16_t* offsets    = utf8_lookup_offsets( lookup );
+
+	while( *pos && res_out != res_end )
+	{
+		unsigned int codepoint = pos[0];
+		res_out->pos = pos;
+		++pos;
+
+		if( ( codepoint & 0xFC00 ) == 0xD800 && ( pos[0] & 0xFC00 ) == 0xDC00 )
+		{
+			codepoint = 0x10000 + ( ( codepoint - 0xD800 ) << 10 ) + ( pos[0] - 0xDC00u );
+			++pos;
+		}
+
+		// ... an unpaired surrogate is not a char, never found even if the table was generated with it ...
+		if( ( codepoint & 0xFFFFF800 ) == 0xD800 )
+			res_out->offset = 0;
+		else
+			res_out->offset = (unsigned int)utf8_lookup_find_codepoint( avail_bits, offsets, codepoint, has_popcnt );
+		++res_out;
+	}
+
+	*res_size = (size_t)(res_out - res);
+	return pos;
+}
+
+const uint16_t* utf8_lookup_perform_utf16_scalar( const void*               lookup,
+                                                  const uint16_t*           str,
+                                                  utf8_lookup_utf16_result* res,
+                                                  size_t*                   res_size )
+{
+	return utf8_lookup_perform_utf16_impl( lookup, str, res, res_size, 0 );
+}
+
+#if defined(UTF8_LOOKUP_HAS_ATTRIBUTE_TARGET)
+const uint16_t* utf8_lookup_perform_utf16_popcnt( const void*               lookup,
+                                                  const uint16_t*           str,
+                                                  utf8_lookup_utf16_result* res,
+                                                  size_t*                   res_size ) __attribute__((target("popcnt")));
+#endif
+
+const uint16_t* utf8_lookup_perform_utf16_popcnt( const void*               lookup,
+                                                  const uint16_t*           str,
+                                                  utf8_lookup_utf16_result* res,
+                                                  size_t*                   res_size )
+{
+	return utf8_lookup_perform_utf16_impl( lookup, str, res, res_size, 1 );
+}
+
+const uint16_t* utf8_lookup_perform_utf16( const void*               lookup,
+                                           const uint16_t*           str,
+                                           utf8_lookup_utf16_result* res,
+                                           size_t*                   res_size )
+{
+	static const uint16_t* (* volatile _func)( const void*, const uint16_t*, utf8_lookup_utf16_result*, size_t* ) = 0;
+	if( UTF8_LOOKUP_DISPATCH_LOAD( _func ) == 0 )
+	{
+		if(utf8_lookup_has_popcnt())
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_perform_utf16_popcnt );
+		else
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_perform_utf16_scalar );
+	}
+
+	return UTF8_LOOKUP_DISPATCH_LOAD( _func )( lookup, str, res, res_size );
+}
+
+UTF8_LOOKUP_ALWAYSINLINE void utf8_lookup_perform_utf32_impl( const void*         lookup,
+															  const unsigned int* codepoints,
+															  size_t              num_codepoints,
+															  unsigned int*       offsets_out,
+															  int                 has_popcnt )
+{
+	const uint64_t* avail_bits = utf8_lookup_avail_bits( lookup );
+	const uint16_t* offsets    = utf8_lookup_offsets( lookup );
+
+	for( size_t i = 0; i < num_codepoints; ++i )
+		offsets_out[i] = (unsigned int)utf8_lookup_find_codepoint( avail_bits, offsets, codepoints[i], has_popcnt );
+}
+
+void utf8_lookup_perform_utf32_scalar( const void*         lookup,
+                                       const unsigned int* codepoints,
+                                       size_t              num_codepoints,
+                                       unsigned int*       offsets )
+{
+	utf8_lookup_perform_utf32_impl( lookup, codepoints, num_codepoints, offsets, 0 );
+}
+
+#if defined(UTF8_LOOKUP_HAS_ATTRIBUTE_TARGET)
+void utf8_lookup_perform_utf32_popcnt( const void*         lookup,
+                                       const unsigned int* codepoints,
+                                       size_t              num_codepoints,
+                                       unsigned int*       offsets ) __attribute__((target("popcnt")));
+#endif
+
+void utf8_lookup_perform_utf32_popcnt( const void*         lookup,
+                                       const unsigned int* codepoints,
+                                       size_t              num_codepoints,
+                                       unsigned int*       offsets )
+{
+	utf8_lookup_perform_utf32_impl( lookup, codepoints, num_codepoints, offsets, 1 );
+}
+
+#if defined(UTF8_LOOKUP_X64)
+/**
+ * Population count of each 64 bit lane via a nibble lookup, avx2 has no vector popcnt.
+ */
+static UTF8_LOOKUP_ALWAYSINLINE __m256i utf8_lookup_popcnt_epi64( __m256i val ) UTF8_LOOKUP_TARGET("avx2");
+static UTF8_LOOKUP_ALWAYSINLINE __m256i utf8_lookup_popcnt_epi64( __m256i val )
+{
+	const __m256i nibble_count = _mm256_setr_epi8( 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+												   0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 );
+	const __m256i low_mask = _mm256_set1_epi8( 0x0F );
+	__m256i lo = _mm256_shuffle_epi8( nibble_count, _mm256_and_si256( val, low_mask ) );
+	__m256i hi = _mm256_shuffle_epi8( nibble_count, _mm256_and_si256( _mm256_srli_epi16( val, 4 ), low_mask ) );
+	return _mm256_sad_epu8( _mm256_add_epi8( lo, hi ), _mm256_setzero_si256() );
+}
+
+/**
+ * Walk 4 codepoints at a time with gathers, lanes that has walked all its levels keep its result and read
+ * element 0 for the rest of the levels.
+ */
+void utf8_lookup_perform_utf32_avx2( const void*         lookup,
+                                     const unsigned int* codepoints,
+                                     size_t              num_codepoints,
+                                     unsigned int*       offsets_out ) UTF8_LOOKUP_TARGET("popcnt,avx2");
+void utf8_lookup_perform_utf32_avx2( const void*         lookup,
+                                     const unsigned int* codepoints,
+                                     size_t              num_codepoints,
+                                     unsigned int*       offsets_out )
+{
+	const uint64_t* avail_bits = utf8_lookup_avail_bits( lookup );
+	const uint16_t* offsets    = utf8_lookup_offsets( lookup );
+
+	const __m256i zero    = _mm256_setzero_si256();
+	const __m256i one     = _mm256_set1_epi64x( 1 );
+	const __m256i mask_63 = _mm256_set1_epi64x( 63 );
+	const __m256i mask_16 = _mm256_set1_epi64x( 0xFFFF );
+	const __m256i pack    = _mm256_setr_epi32( 0, 2, 4, 6, 0, 2, 4, 6 );
+
+	size_t i = 0;
+	for( ; i + 4 <= num_codepoints; i += 4 )
+	{
+		__m256i cp = _mm256_cvtepu32_epi64( _mm_loadu_si128( (const __m128i*)( codepoints + i ) ) );
+
+		// ... octet = number of trailing bytes, compares give -1 per limit passed ...
+		__m256i octet = _mm256_sub_epi64( zero, _mm256_add_epi64( _mm256_add_epi64( _mm256_cmpgt_epi64( cp, _mm256_set1_epi64x( 0x7F ) ),
+																					 _mm256_cmpgt_epi64( cp, _mm256_set1_epi64x( 0x7FF ) ) ),
+																  _mm256_cmpgt_epi64( cp, _mm256_set1_epi64x( 0xFFFF ) ) ) );
+		__m256i invalid = _mm256_cmpgt_epi64( cp, _mm256_set1_epi64x( 0x10FFFF ) );
+
+		// ... START_OFFSET[octet], + cp >> 6 for the ascii-roots ...
+		__m256i is_ascii = _mm256_cmpeq_epi64( octet, zero );
+		__m256i curr = _mm256_blendv_epi8( _mm256_add_epi64( octet, _mm256_set1_epi64x( 2 ) ),
+										   _mm256_add_epi64( _mm256_srli_epi64( cp, 6 ), one ),
+										   is_ascii );
+		curr = _mm256_andnot_si256( invalid, curr );
+
+		__m256i gid_mask = _mm256_srlv_epi64( mask_63, octet );
+		__m256i shift    = _mm256_mul_epu32( octet, _mm256_set1_epi64x( 6 ) );
+
+		// ... only walk as many levels as the longest char needs ...
+		int levels = 1 + ( _mm256_movemask_pd( _mm256_castsi256_pd( _mm256_cmpgt_epi64( octet, zero ) ) ) != 0 )
+					   + ( _mm256_movemask_pd( _mm256_castsi256_pd( _mm256_cmpgt_epi64( octet, one ) ) ) != 0 )
+					   + ( _mm256_movemask_pd( _mm256_castsi256_pd( _mm256_cmpgt_epi64( octet, _mm256_set1_epi64x( 2 ) ) ) ) != 0 );
+
+		for( int level = 0; level < levels; ++level )
+		{
+			// ... active while level <= octet ...
+			__m256i active = _mm256_cmpgt_epi64( octet, _mm256_set1_epi64x( level - 1 ) );
+			__m256i index  = _mm256_and_si256( active, curr );
+
+			__m256i gid       = _mm256_and_si256( _mm256_srlv_epi64( cp, shift ), gid_mask );
+			__m256i check_bit = _mm256_sllv_epi64( one, gid );
+			__m256i bits      = _mm256_i64gather_epi64( (const long long*)avail_bits, index, 8 );
+
+			// ... 32 bit gather of the uint16 offset, the element after the last used one always exist in a
+			// table so reading the 2 extra bytes is safe ...
+			__m256i offset = _mm256_and_si256( _mm256_cvtepu32_epi64( _mm256_i64gather_epi32( (const int*)offsets, index, 2 ) ), mask_16 );
+			__m256i before = utf8_lookup_popcnt_epi64( _mm256_and_si256( bits, _mm256_sub_epi64( check_bit, one ) ) );
+			__m256i found  = _mm256_cmpeq_epi64( _mm256_and_si256( bits, check_bit ), check_bit );
+			__m256i next   = _mm256_and_si256( found, _mm256_add_epi64( offset, before ) );
+
+			curr     = _mm256_blendv_epi8( curr, next, active );
+			gid_mask = mask_63;
+			shift    = _mm256_sub_epi64( shift, _mm256_and_si256( active, _mm256_set1_epi64x( 6 ) ) );
+		}
+
+		curr = _mm256_andnot_si256( invalid, curr );
+		_mm_storeu_si128( (__m128i*)( offsets_out + i ), _mm256_castsi256_si128( _mm256_permutevar8x32_epi32( curr, pack ) ) );
+	}
+
+	for( ; i < num_codepoints; ++i )
+		offsets_out[i] = (unsigned int)utf8_lookup_find_codepoint( avail_bits, offsets, codepoints[i], 1 );
+}
+#endif
+
+void utf8_lookup_perform_utf32( const void*         lookup,
+                                const unsigned int* codepoints,
+                                size_t              num_codepoints,
+                                unsigned int*       offsets )
+{
+	static void (* volatile _func)( const void*, const unsigned int*, size_t, unsigned int* ) = 0;
+	if( UTF8_LOOKUP_DISPATCH_LOAD( _func ) == 0 )
+	{
+#if defined(UTF8_LOOKUP_X64)
+		if(utf8_lookup_has_popcnt() && utf8_lookup_has_avx2())
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_perform_utf32_avx2 );
+		else
+#endif
+		if(utf8_lookup_has_popcnt())
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_perform_utf32_popcnt );
+		else
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_perform_utf32_scalar );
+	}
+
+	UTF8_LOOKUP_DISPATCH_LOAD( _func )( lookup, codepoints, num_codepoints, offsets );
+}
+
+void utf8_lookup_stream_init( utf8_lookup_stream* stream,
+                              const void*         table )
+{
+	memset( stream, 0x0, sizeof( utf8_lookup_stream ) );
+	stream->table = table;
+}
+
+UTF8_LOOKUP_ALWAYSINLINE const uint8_t* utf8_lookup_stream_feed_impl( utf8_lookup_stream* stream,
+																	  const uint8_t*      chunk,
+																	  const uint8_t*      chunk_end,
+																	  utf8_lookup_result* res,
+																	  size_t*             res_size,
+																	  int                 has_popcnt )
+{
+	utf8_lookup_result* res_out = res;
+	utf8_lookup_result* res_end = res + *res_size;
+
+	const uint8_t* pos = chunk;
+
+	const uint64_t* avail_bits = utf8_lookup_avail_bits( stream->table );
+	const uint16_t* offsets    = utf8_lookup_offsets( stream->table );
+
+	// ... complete the char left from the last chunk ...
+	if( stream->num_pending > 0 && res_out != res_end )
+	{
+		while( stream->num_pending < stream->char_length && pos != chunk_end )
+			stream->pending[ stream->num_pending++ ] = *pos++;
+
+		if( stream->num_pending == stream->char_length )
+		{
+			// ... moved out of pending since the end of this chunk might need to be stored there ...
+			memcpy( stream->completed, stream->pending, sizeof( stream->pending ) );
+			res_out->pos    = stream->completed;
+			res_out->offset = (unsigned int)utf8_lookup_find( avail_bits, offsets, stream->completed, (int)stream->char_length - 1, has_popcnt );
+			++res_out;
+			stream->num_pending = 0;
+		}
+	}
+
+	if( stream->num_pending == 0 )
+	{
+		while( pos != chunk_end && res_out != res_end )
+		{
+			int octet = UTF8_TRAILING_BYTES_TABLE[ *pos ];
+			if( chunk_end - pos <= octet )
+			{
+				// ... the char continues in the next chunk, save what we have ...
+				stream->char_length = (unsigned int)octet + 1;
+				while( pos != chunk_end )
+					stream->pending[ stream->num_pending++ ] = *pos++;
+				break;
+			}
+
+			res_out->pos    = pos;
+			res_out->offset = (unsigned int)utf8_lookup_find( avail_bits, offsets, pos, octet, has_popcnt );
+			++res_out;
+
+			pos += octet + 1;
+		}
+	}
+
+	*res_size = (size_t)(res_out - res);
+	return pos;
+}
+
+const uint8_t* utf8_lookup_stream_feed_scalar( utf8_lookup_stream* stream,
+                                               const uint8_t*      chunk,
+                                               const uint8_t*      chunk_end,
+                                               utf8_lookup_result* res,
+                                               size_t*             res_size )
+{
+	return utf8_lookup_stream_feed_impl( stream, chunk, chunk_end, res, res_size, 0 );
+}
+
+#if defined(UTF8_LOOKUP_HAS_ATTRIBUTE_TARGET)
+const uint8_t* utf8_lookup_stream_feed_popcnt( utf8_lookup_stream* stream,
+                                               const uint8_t*      chunk,
+                                               const uint8_t*      chunk_end,
+                                               utf8_lookup_result* res,
+                                               size_t*             res_size ) __attribute__((target("popcnt")));
+#endif
+
+const uint8_t* utf8_lookup_stream_feed_popcnt( utf8_lookup_stream* stream,
+                                               const uint8_t*      chunk,
+                                               const uint8_t*      chunk_end,
+                                               utf8_lookup_result* res,
+                                               size_t*             res_size )
+{
+	return utf8_lookup_stream_feed_impl( stream, chunk, chunk_end, res, res_size, 1 );
+}
+
+const uint8_t* utf8_lookup_stream_feed( utf8_lookup_stream* stream,
+                                        const uint8_t*      chunk,
+                                        const uint8_t*      chunk_end,
+                                        utf8_lookup_result* res,
+                                        size_t*             res_size )
+{
+	static const uint8_t* (* volatile _func)( utf8_lookup_stream*, const uint8_t*, const uint8_t*, utf8_lookup_result*, size_t* ) = 0;
+	if( UTF8_LOOKUP_DISPATCH_LOAD( _func ) == 0 )
+	{
+		if(utf8_lookup_has_popcnt())
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_stream_feed_popcnt );
+		else
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_stream_feed_scalar );
+	}
+
+	return UTF8_LOOKUP_DISPATCH_LOAD( _func )( stream, chunk, chunk_end, res, res_size );
+}
+
+void utf8_lookup_stream_finish( utf8_lookup_stream* stream,
+                                utf8_lookup_result* res,
+                                size_t*             res_size )
+{
+	if( stream->num_pending > 0 && *res_size > 0 )
+	{
+		memcpy( stream->completed, stream->pending, sizeof( stream->pending ) );
+		res->pos    = stream->completed;
+		res->offset = 0;
+		*res_size   = 1;
+	}
+	else
+		*res_size = 0;
+
+	stream->num_pending = 0;
+	stream->char_length = 0;
+}
+
+UTF8_LOOKUP_ALWAYSINLINE const uint8_t* utf8_lookup_perform_fallback_impl( const void* const*           tables,
+																		   unsigned int                 num_tables,
+																		   const uint8_t*               str,
+																		   utf8_lookup_fallback_result* res,
+																		   size_t*                      res_size,
+																		   int                          has_popcnt )
+{
+	utf8_lookup_fallback_result* res_out = res;
+	utf8_lookup_fallback_result* res_end = res + *res_size;
+
+	const uint8_t* pos = str;
+
+	while( *pos && res_out != res_end )
+	{
+		int octet = UTF8_TRAILING_BYTES_TABLE[ *pos ];
+
+		res_out->pos    = pos;
+		res_out->table  = 0;
+		res_out->offset = 0;
+
+		for( unsigned int t = 0; t < num_tables; ++t )
+		{
+			uint64_t offset = utf8_lookup_find( utf8_lookup_avail_bits( tables[t] ), utf8_lookup_offsets( tables[t] ), pos, octet, has_popcnt );
+			if( offset != 0 )
+			{
+				res_out->table  = t;
+				res_out->offset = (unsigned int)offset;
+				break;
+			}
+		}
+
+		++res_out;
+		pos += octet + 1;
+	}
+
+	*res_size = (size_t)(res_out - res);
+	return pos;
+}
+
+const uint8_t* utf8_lookup_perform_fallback_scalar( const void* const*           tables,
+                                                    unsigned int                 num_tables,
+                                                    const uint8_t*               str,
+                                                    utf8_lookup_fallback_result* res,
+                                                    size_t*                      res_size )
+{
+	return utf8_lookup_perform_fallback_impl( tables, num_tables, str, res, res_size, 0 );
+}
+
+#if defined(UTF8_LOOKUP_HAS_ATTRIBUTE_TARGET)
+const uint8_t* utf8_lookup_perform_fallback_popcnt( const void* const*           tables,
+                                                    unsigned int                 num_tables,
+                                                    const uint8_t*               str,
+                                                    utf8_lookup_fallback_result* res,
+                                                    size_t*                      res_size ) __attribute__((target("popcnt")));
+#endif
+
+const uint8_t* utf8_lookup_perform_fallback_popcnt( const void* const*           tables,
+                                                    unsigned int                 num_tables,
+                                                    const uint8_t*               str,
+                                                    utf8_lookup_fallback_result* res,
+                                                    size_t*                      res_size )
+{
+	return utf8_lookup_perform_fallback_impl( tables, num_tables, str, res, res_size, 1 );
+}
+
+const uint8_t* utf8_lookup_perform_fallback( const void* const*           tables,
+                                             unsigned int                 num_tables,
+                                             const uint8_t*               str,
+                                             utf8_lookup_fallback_result* res,
+                                             size_t*                      res_size )
+{
+	static const uint8_t* (* volatile _func)( const void* const*, unsigned int, const uint8_t*, utf8_lookup_fallback_result*, size_t* ) = 0;
+	if( UTF8_LOOKUP_DISPATCH_LOAD( _func ) == 0 )
+	{
+		if(utf8_lookup_has_popcnt())
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_perform_fallback_popcnt );
+		else
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_perform_fallback_scalar );
+	}
+
+	return UTF8_LOOKUP_DISPATCH_LOAD( _func )( tables, num_tables, str, res, res_size );
+}
+
+/**
+ * Check if one utf8-char starting at pos with octet trailing bytes exist in the lookup-table. Same walk as
+ * utf8_lookup_find but the last level only need to test the bit, not calculate the offset.
+ */
+static UTF8_LOOKUP_ALWAYSINLINE uint64_t utf8_lookup_contains( const uint64_t* avail_bits,
+															   const uint16_t* offsets,
+															   const uint8_t*  pos,
+															   int             octet,
+															   int             has_popcnt )
+{
+	uint64_t curr_offset = START_OFFSET[octet];
+	uint64_t group_mask  = GROUP_MASK[octet];
+	uint64_t gid_mask    = GID_MASK[octet];
+
+	for( int i = 0; i < octet; ++i )
+	{
+		uint64_t group     = (uint64_t)(*pos & group_mask) >> (uint64_t)6;
+		uint64_t check_bit = (uint64_t)1 << (uint64_t)(*pos & gid_mask);
+		uint64_t index     = group + curr_offset;
+		gid_mask = 63;
+		++pos;
+
+		uint64_t items_before = utf8_popcnt_impl( avail_bits[index] & ( check_bit - (uint64_t)1 ), has_popcnt );
+		curr_offset = ( avail_bits[index] & check_bit ) > (uint64_t)0 ? offsets[index] + items_before : 0x0;
+	}
+
+	uint64_t index = ( (uint64_t)(*pos & group_mask) >> (uint64_t)6 ) + curr_offset;
+	return ( avail_bits[index] >> (uint64_t)(*pos & gid_mask) ) & (uint64_t)1;
+}
+
+#if defined(UTF8_LOOKUP_X64)
+/**
+ * Build a 16 byte table where bit n in byte m is set if ascii-char n * 16 + m is available in table, used
+ * to test 16 ascii-chars at a time with pshufb. The ascii-chars is always stored in avail_bits[1] and [2].
+ */
+static __m128i utf8_lookup_ascii_nibble_table( const uint64_t* avail_bits ) UTF8_LOOKUP_TARGET("ssse3");
+static __m128i utf8_lookup_ascii_nibble_table( const uint64_t* avail_bits )
+{
+	const __m128i spread   = _mm_setr_epi8( 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1 );
+	const __m128i bit_mask = _mm_setr_epi8( 1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128 );
+
+	__m128i table = _mm_setzero_si128();
+	for( int hi = 0; hi < 8; ++hi )
+	{
+		// 16 bits for the chars hi * 16 - hi * 16 + 15, spread to one bit per byte.
+		uint64_t chars = ( avail_bits[ 1 + ( hi >> 2 ) ] >> ( ( hi & 3 ) * 16 ) ) & 0xFFFF;
+		__m128i bits   = _mm_shuffle_epi8( _mm_set1_epi16( (short)chars ), spread );
+		__m128i is_set = _mm_cmpeq_epi8( _mm_and_si128( bits, bit_mask ), bit_mask );
+		table = _mm_or_si128( table, _mm_and_si128( is_set, _mm_set1_epi8( (char)( 1 << hi ) ) ) );
+	}
+	return table;
+}
+
+/**
+ * Return a 16-bit mask with a bit set for each char in block, known to be only ascii, that is missing in
+ * the table described by nibble_table.
+ */
+static UTF8_LOOKUP_ALWAYSINLINE int utf8_lookup_ascii_missing_mask( __m128i block, __m128i nibble_table ) UTF8_LOOKUP_TARGET("ssse3");
+static UTF8_LOOKUP_ALWAYSINLINE int utf8_lookup_ascii_missing_mask( __m128i block, __m128i nibble_table )
+{
+	const __m128i hi_bits = _mm_setr_epi8( 1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0 );
+	__m128i lo    = _mm_and_si128( block, _mm_set1_epi8( 0x0F ) );
+	__m128i hi    = _mm_and_si128( _mm_srli_epi16( block, 4 ), _mm_set1_epi8( 0x07 ) );
+	__m128i found = _mm_and_si128( _mm_shuffle_epi8( nibble_table, lo ), _mm_shuffle_epi8( hi_bits, hi ) );
+	return _mm_movemask_epi8( _mm_cmpeq_epi8( found, _mm_setzero_si128() ) );
+}
+
+/**
+ * Count missing chars in 16 byte aligned blocks of only ascii from *pos, stops at first block that contains
+ * non-ascii or the string terminator. Aligned loads never cross a page so reading past the terminator is safe.
+ */
+static size_t utf8_lookup_count_missing_ascii_blocks( const uint64_t*  avail_bits,
+													  const uint8_t**  pos,
+													  int              stop_at_first ) UTF8_LOOKUP_TARGET("popcnt,ssse3");
+static size_t utf8_lookup_count_missing_ascii_blocks( const uint64_t*  avail_bits,
+													  const uint8_t**  pos,
+													  int              stop_at_first )
+{
+	const uint8_t* p = *pos;
+	size_t missing = 0;
+
+	__m128i block = _mm_load_si128( (const __m128i*)p );
+	if( ( _mm_movemask_epi8( block ) | _mm_movemask_epi8( _mm_cmpeq_epi8( block, _mm_setzero_si128() ) ) ) != 0 )
+		return 0;
+
+	__m128i nibble_table = utf8_lookup_ascii_nibble_table( avail_bits );
+	do
+	{
+		int missing_mask = utf8_lookup_ascii_missing_mask( block, nibble_table );
+		if( missing_mask != 0 && stop_at_first )
+		{
+			// ... leave pos at the missing char ...
+			p += utf8_popcnt_impl( (uint64_t)( missing_mask & -missing_mask ) - 1, 1 );
+			missing = 1;
+			break;
+		}
+		missing += utf8_popcnt_impl( (uint64_t)missing_mask, 1 );
+		p += 16;
+
+		block = _mm_load_si128( (const __m128i*)p );
+	}
+	while( ( _mm_movemask_epi8( block ) | _mm_movemask_epi8( _mm_cmpeq_epi8( block, _mm_setzero_si128() ) ) ) == 0 );
+
+	*pos = p;
+	return missing;
+}
+#endif
+
+UTF8_LOOKUP_ALWAYSINLINE size_t utf8_lookup_count_missing_impl( const uint64_t* avail_bits,
+																const uint16_t* offsets,
+																const uint8_t*  str,
+																int             stop_at_first,
+																int             has_popcnt,
+																int             has_ssse3 )
+{
+	const uint8_t* pos = str;
+	size_t missing = 0;
+
+	while( true )
+	{
+#if defined(UTF8_LOOKUP_X64)
+		if( has_ssse3 && ( (uintptr_t)pos & 15 ) == 0 )
+		{
+			missing += utf8_lookup_count_missing_ascii_blocks( avail_bits, &pos, stop_at_first );
+			if( missing && stop_at_first )
+				break;
+		}
+#else
+		(void)has_ssse3;
+#endif
+		if( *pos == 0 )
+			break;
+
+		int octet = UTF8_TRAILING_BYTES_TABLE[ *pos ];
+		if( !utf8_lookup_contains( avail_bits, offsets, pos, octet, has_popcnt ) )
+		{
+			++missing;
+			if( stop_at_first )
+				break;
+		}
+		pos += octet + 1;
+	}
+
+	return missing;
+}
+
+// the count-kernels take the arrays directly so that they can be shared between full and membership tables.
+size_t utf8_lookup_count_missing_scalar( const uint64_t* avail_bits, const uint16_t* offsets, const uint8_t* str, int stop_at_first )
+{
+	return utf8_lookup_count_missing_impl( avail_bits, offsets, str, stop_at_first, 0, 0 );
+}
+
+#if defined(UTF8_LOOKUP_HAS_ATTRIBUTE_TARGET)
+size_t utf8_lookup_count_missing_popcnt( const uint64_t* avail_bits, const uint16_t* offsets, const uint8_t* str, int stop_at_first ) __attribute__((target("popcnt")));
+size_t utf8_lookup_count_missing_ssse3( const uint64_t* avail_bits, const uint16_t* offsets, const uint8_t* str, int stop_at_first ) __attribute__((target("popcnt,ssse3")));
+#endif
+
+size_t utf8_lookup_count_missing_popcnt( const uint64_t* avail_bits, const uint16_t* offsets, const uint8_t* str, int stop_at_first )
+{
+	return utf8_lookup_count_missing_impl( avail_bits, offsets, str, stop_at_first, 1, 0 );
+}
+
+size_t utf8_lookup_count_missing_ssse3( const uint64_t* avail_bits, const uint16_t* offsets, const uint8_t* str, int stop_at_first )
+{
+	return utf8_lookup_count_missing_impl( avail_bits, offsets, str, stop_at_first, 1, 1 );
+}
+
+static size_t utf8_lookup_count_missing_dispatch( const uint64_t* avail_bits, const uint16_t* offsets, const uint8_t* str, int stop_at_first )
+{
+	static size_t (* volatile _func)( const uint64_t*, const uint16_t*, const uint8_t*, int ) = 0;
+	if( UTF8_LOOKUP_DISPATCH_LOAD( _func ) == 0 )
+	{
+		if(utf8_lookup_has_popcnt() && utf8_lookup_has_ssse3())
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_count_missing_ssse3 );
+		else if(utf8_lookup_has_popcnt())
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_count_missing_popcnt );
+		else
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_count_missing_scalar );
+	}
+
+	return UTF8_LOOKUP_DISPATCH_LOAD( _func )( avail_bits, offsets, str, stop_at_first );
+}
+
+size_t utf8_lookup_count_missing( const void*    table,
+                                  const uint8_t* str )
+{
+	return utf8_lookup_count_missing_dispatch( utf8_lookup_avail_bits( table ), utf8_lookup_offsets( table ), str, 0 );
+}
+
+int utf8_lookup_all_present( const void*    table,
+                             const uint8_t* str )
+{
+	return utf8_lookup_count_missing_dispatch( utf8_lookup_avail_bits( table ), utf8_lookup_offsets( table ), str, 1 ) == 0;
+}
+
+#if defined(UTF8_LOOKUP_X64)
+/**
+ * Extend the runs over 16 byte aligned blocks of only ascii from pos, runs[*num_runs - 1] is the currently
+ * open run. Boundaries within a block is found from the missing-mask without any per-char lookup. Stops at
+ * first block that contains non-ascii or the string terminator or when a new run do not fit in runs.
+ */
+static const uint8_t* utf8_lookup_runs_ascii_blocks( const uint64_t*  avail_bits,
+													 const uint8_t*   pos,
+													 utf8_lookup_run* runs,
+													 size_t*          num_runs,
+													 size_t           max_runs ) UTF8_LOOKUP_TARGET("popcnt,ssse3");
+static const uint8_t* utf8_lookup_runs_ascii_blocks( const uint64_t*  avail_bits,
+													 const uint8_t*   pos,
+													 utf8_lookup_run* runs,
+													 size_t*          num_runs,
+													 size_t           max_runs )
+{
+	__m128i block = _mm_load_si128( (const __m128i*)pos );
+	if( ( _mm_movemask_epi8( block ) | _mm_movemask_epi8( _mm_cmpeq_epi8( block, _mm_setzero_si128() ) ) ) != 0 )
+		return pos;
+
+	__m128i nibble_table = utf8_lookup_ascii_nibble_table( avail_bits );
+	utf8_lookup_run* run = &runs[ *num_runs - 1 ];
+	do
+	{
+		int missing_mask = utf8_lookup_ascii_missing_mask( block, nibble_table );
+		int left = 16;
+		while( true )
+		{
+			// ... chars in what is left of the block that do not belong in the current run ...
+			int differs = ( run->found ? missing_mask : ~missing_mask ) & ( ( 1 << left ) - 1 );
+			if( differs == 0 )
+			{
+				run->byte_length += (size_t)left;
+				run->char_count  += (size_t)left;
+				pos += left;
+				break;
+			}
+
+			int same = (int)utf8_popcnt_impl( (uint64_t)( differs & -differs ) - 1, 1 );
+			run->byte_length += (size_t)same;
+			run->char_count  += (size_t)same;
+			pos  += same;
+			left -= same;
+			missing_mask >>= same;
+
+			if( *num_runs == max_runs )
+				return pos;
+
+			int found = !run->found;
+			run = &runs[ (*num_runs)++ ];
+			run->pos         = pos;
+			run->byte_length = 0;
+			run->char_count  = 0;
+			run->found       = found;
+		}
+
+		block = _mm_load_si128( (const __m128i*)pos );
+	}
+	while( ( _mm_movemask_epi8( block ) | _mm_movemask_epi8( _mm_cmpeq_epi8( block, _mm_setzero_si128() ) ) ) == 0 );
+
+	return pos;
+}
+#endif
+
+UTF8_LOOKUP_ALWAYSINLINE const uint8_t* utf8_lookup_perform_runs_impl( const void*      table,
+																	   const uint8_t*   str,
+																	   utf8_lookup_run* runs,
+																	   size_t*          num_runs,
+																	   int              has_popcnt,
+																	   int              has_ssse3 )
+{
+	const uint64_t* avail_bits = utf8_lookup_avail_bits( table );
+	const uint16_t* offsets    = utf8_lookup_offsets( table );
+
+	const uint8_t* pos = str;
+	size_t max_runs = *num_runs;
+	size_t num_out  = 0;
+
+	while( true )
+	{
+#if defined(UTF8_LOOKUP_X64)
+		if( has_ssse3 && num_out > 0 && ( (uintptr_t)pos & 15 ) == 0 )
+			pos = utf8_lookup_runs_ascii_blocks( avail_bits, pos, runs, &num_out, max_runs );
+#else
+		(void)has_ssse3;
+#endif
+		if( *pos == 0 )
+			break;
+
+		int octet = UTF8_TRAILING_BYTES_TABLE[ *pos ];
+		int found = utf8_lookup_contains( avail_bits, offsets, pos, octet, has_popcnt ) ? 1 : 0;
+		if( num_out == 0 || runs[ num_out - 1 ].found != found )
+		{
+			if( num_out == max_runs )
+				break;
+
+			utf8_lookup_run* run = &runs[ num_out++ ];
+			run->pos         = pos;
+			run->byte_length = 0;
+			run->char_count  = 0;
+			run->found       = found;
+		}
+
+		utf8_lookup_run* run = &runs[ num_out - 1 ];
+		run->byte_length += (size_t)octet + 1;
+		run->char_count  += 1;
+		pos += octet + 1;
+	}
+
+	*num_runs = num_out;
+	return pos;
+}
+
+const uint8_t* utf8_lookup_perform_runs_scalar( const void* table, const uint8_t* str, utf8_lookup_run* runs, size_t* num_runs )
+{
+	return utf8_lookup_perform_runs_impl( table, str, runs, num_runs, 0, 0 );
+}
+
+#if defined(UTF8_LOOKUP_HAS_ATTRIBUTE_TARGET)
+const uint8_t* utf8_lookup_perform_runs_popcnt( const void* table, const uint8_t* str, utf8_lookup_run* runs, size_t* num_runs ) __attribute__((target("popcnt")));
+const uint8_t* utf8_lookup_perform_runs_ssse3( const void* table, const uint8_t* str, utf8_lookup_run* runs, size_t* num_runs ) __attribute__((target("popcnt,ssse3")));
+#endif
+
+const uint8_t* utf8_lookup_perform_runs_popcnt( const void* table, const uint8_t* str, utf8_lookup_run* runs, size_t* num_runs )
+{
+	return utf8_lookup_perform_runs_impl( table, str, runs, num_runs, 1, 0 );
+}
+
+const uint8_t* utf8_lookup_perform_runs_ssse3( const void* table, const uint8_t* str, utf8_lookup_run* runs, size_t* num_runs )
+{
+	return utf8_lookup_perform_runs_impl( table, str, runs, num_runs, 1, 1 );
+}
+
+const uint8_t* utf8_lookup_perform_runs( const void*      table,
+                                         const uint8_t*   str,
+                                         utf8_lookup_run* runs,
+                                         size_t*          num_runs )
+{
+	static const uint8_t* (* volatile _func)( const void*, const uint8_t*, utf8_lookup_run*, size_t* ) = 0;
+	if( UTF8_LOOKUP_DISPATCH_LOAD( _func ) == 0 )
+	{
+		if(utf8_lookup_has_popcnt() && utf8_lookup_has_ssse3())
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_perform_runs_ssse3 );
+		else if(utf8_lookup_has_popcnt())
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_perform_runs_popcnt );
+		else
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_perform_runs_scalar );
+	}
+
+	return UTF8_LOOKUP_DISPATCH_LOAD( _func )( table, str, runs, num_runs );
+}
+
+/**
+ * A class-table is a lookup-table followed, 16 byte aligned, by a class for each ascii-char and then the
+ * class for each offset with the default class for offset 0.
+ */
+static size_t utf8_lookup_class_ascii_offset( size_t table_size )
+{
+	return ( table_size + 15 ) & ~(size_t)15;
+}
+
+static const uint8_t* utf8_lookup_class_ascii( const void* table )
+{
+	size_t items = (size_t)*(const uint64_t*)table;
+	size_t table_size = sizeof( uint64_t ) + items * ( sizeof( uint64_t ) + sizeof( uint16_t ) );
+	return (const uint8_t*)table + utf8_lookup_class_ascii_offset( table_size );
+}
+
+utf8_lookup_error utf8_lookup_calc_class_table_size( size_t*             table_size,
+                                                     const unsigned int* codepoints,
+                                                     unsigned int        num_codepoints )
+{
+	size_t lookup_size;
+	utf8_lookup_error err = utf8_lookup_calc_table_size( &lookup_size, codepoints, num_codepoints );
+	if( err != UTF8_LOOKUP_ERROR_OK )
+		return err;
+	*table_size = utf8_lookup_class_ascii_offset( lookup_size ) + 128 + num_codepoints + 1;
+	return UTF8_LOOKUP_ERROR_OK;
+}
+
+utf8_lookup_error utf8_lookup_gen_class_table( void*               table,
+                                               size_t              table_size,
+                                               const unsigned int* codepoints,
+                                               const uint8_t*      classes,
+                                               unsigned int        num_codepoints,
+                                               uint8_t             default_class )
+{
+	size_t calc_size;
+	utf8_lookup_error err = utf8_lookup_calc_class_table_size( &calc_size, codepoints, num_codepoints );
+	if( err != UTF8_LOOKUP_ERROR_OK )
+		return err;
+	if( calc_size > table_size )
+		return UTF8_LOOKUP_ERROR_BUFFER_TO_SMALL;
+
+	size_t lookup_size;
+	utf8_lookup_calc_table_size( &lookup_size, codepoints, num_codepoints );
+	err = utf8_lookup_gen_table( table, lookup_size, codepoints, num_codepoints );
+	if( err != UTF8_LOOKUP_ERROR_OK )
+		return err;
+
+	uint8_t* ascii   = (uint8_t*)table + utf8_lookup_class_ascii_offset( lookup_size );
+	uint8_t* offsets = ascii + 128;
+	memset( (uint8_t*)table + lookup_size, 0x0, (size_t)( ascii - (uint8_t*)table ) - lookup_size );
+	memset( ascii, default_class, 128 );
+
+	offsets[0] = default_class;
+	memcpy( offsets + 1, classes, num_codepoints );
+	for( unsigned int i = 0; i < num_codepoints && codepoints[i] < 128; ++i )
+		ascii[ codepoints[i] ] = classes[i];
+
+	return UTF8_LOOKUP_ERROR_OK;
+}
+
+#if defined(UTF8_LOOKUP_X64)
+/**
+ * Extend the class-runs over 16 byte aligned blocks of only ascii from pos, runs[*num_runs - 1] is the
+ * currently open run. The class of all 16 chars is looked up at once by splitting the 128 ascii-classes
+ * in 8 16-byte tables selected by the high nibble of each char. Stops at first block that contains non-ascii
+ * or the string terminator or when a new run do not fit in runs.
+ */
+static const uint8_t* utf8_lookup_class_runs_ascii_blocks( const uint8_t*         ascii_classes,
+														   const uint8_t*         pos,
+														   utf8_lookup_class_run* runs,
+														   size_t*                num_runs,
+														   size_t                 max_runs ) UTF8_LOOKUP_TARGET("popcnt,ssse3");
+static const uint8_t* utf8_lookup_class_runs_ascii_blocks( const uint8_t*         ascii_classes,
+														   const uint8_t*         pos,
+														   utf8_lookup_class_run* runs,
+														   size_t*                num_runs,
+														   size_t                 max_runs )
+{
+	__m128i block = _mm_load_si128( (const __m128i*)pos );
+	if( ( _mm_movemask_epi8( block ) | _mm_movemask_epi8( _mm_cmpeq_epi8( block, _mm_setzero_si128() ) ) ) != 0 )
+		return pos;
+
+	__m128i tables[8];
+	for( int hi = 0; hi < 8; ++hi )
+		tables[hi] = _mm_loadu_si128( (const __m128i*)( ascii_classes + hi * 16 ) );
+
+	utf8_lookup_class_run* run = &runs[ *num_runs - 1 ];
+	do
+	{
+		__m128i lo = _mm_and_si128( block, _mm_set1_epi8( 0x0F ) );
+		__m128i hi = _mm_and_si128( _mm_srli_epi16( block, 4 ), _mm_set1_epi8( 0x0F ) );
+		__m128i classes = _mm_setzero_si128();
+		for( int h = 0; h < 8; ++h )
+			classes = _mm_or_si128( classes, _mm_and_si128( _mm_shuffle_epi8( tables[h], lo ), _mm_cmpeq_epi8( hi, _mm_set1_epi8( (char)h ) ) ) );
+
+		// ... a run starts at each char with a different class than the char before it ...
+		__m128i prev = _mm_alignr_epi8( classes, _mm_set1_epi8( (char)run->class_id ), 15 );
+		int starts = ~_mm_movemask_epi8( _mm_cmpeq_epi8( classes, prev ) ) & 0xFFFF;
+
+		int done = 0;
+		if( starts != 0 )
+		{
+			uint8_t block_classes[16];
+			_mm_storeu_si128( (__m128i*)block_classes, classes );
+			do
+			{
+				int start = (int)utf8_popcnt_impl( (uint64_t)( starts & -starts ) - 1, 1 );
+				run->byte_length += (size_t)( start - done );
+				run->char_count  += (size_t)( start - done );
+				pos += start - done;
+				done = start;
+
+				if( *num_runs == max_runs )
+					return pos;
+
+				run = &runs[ (*num_runs)++ ];
+				run->pos         = pos;
+				run->byte_length = 0;
+				run->char_count  = 0;
+				run->class_id    = block_classes[start];
+
+				starts &= starts - 1;
+			}
+			while( starts != 0 );
+		}
+
+		run->byte_length += (size_t)( 16 - done );
+		run->char_count  += (size_t)( 16 - done );
+		pos += 16 - done;
+
+		block = _mm_load_si128( (const __m128i*)pos );
+	}
+	while( ( _mm_movemask_epi8( block ) | _mm_movemask_epi8( _mm_cmpeq_epi8( block, _mm_setzero_si128() ) ) ) == 0 );
+
+	return pos;
+}
+#endif
+
+UTF8_LOOKUP_ALWAYSINLINE const uint8_t* utf8_lookup_perform_class_runs_impl( const void*            table,
+																			 const uint8_t*         str,
+																			 utf8_lookup_class_run* runs,
+																			 size_t*                num_runs,
+																			 int                    has_popcnt,
+																			 int                    has_ssse3 )
+{
+	const uint64_t* avail_bits    = utf8_lookup_avail_bits( table );
+	const uint16_t* offsets       = utf8_lookup_offsets( table );
+	const uint8_t*  ascii_classes = utf8_lookup_class_ascii( table );
+	const uint8_t*  classes       = ascii_classes + 128;
+
+	const uint8_t* pos = str;
+	size_t max_runs = *num_runs;
+	size_t num_out  = 0;
+
+	while( true )
+	{
+#if defined(UTF8_LOOKUP_X64)
+		if( has_ssse3 && num_out > 0 && ( (uintptr_t)pos & 15 ) == 0 )
+			pos = utf8_lookup_class_runs_ascii_blocks( ascii_classes, pos, runs, &num_out, max_runs );
+#else
+		(void)has_ssse3;
+#endif
+		if( *pos == 0 )
+			break;
+
+		int octet = UTF8_TRAILING_BYTES_TABLE[ *pos ];
+		uint8_t class_id = octet == 0 ? ascii_classes[ *pos ]
+									  : classes[ utf8_lookup_find( avail_bits, offsets, pos, octet, has_popcnt ) ];
+		if( num_out == 0 || runs[ num_out - 1 ].class_id != class_id )
+		{
+			if( num_out == max_runs )
+				break;
+
+			utf8_lookup_class_run* run = &runs[ num_out++ ];
+			run->pos         = pos;
+			run->byte_length = 0;
+			run->char_count  = 0;
+			run->class_id    = class_id;
+		}
+
+		utf8_lookup_class_run* run = &runs[ num_out - 1 ];
+		run->byte_length += (size_t)octet + 1;
+		run->char_count  += 1;
+		pos += octet + 1;
+	}
+
+	*num_runs = num_out;
+	return pos;
+}
+
+const uint8_t* utf8_lookup_perform_class_runs_scalar( const void* table, const uint8_t* str, utf8_lookup_class_run* runs, size_t* num_runs )
+{
+	return utf8_lookup_perform_class_runs_impl( table, str, runs, num_runs, 0, 0 );
+}
+
+#if defined(UTF8_LOOKUP_HAS_ATTRIBUTE_TARGET)
+const uint8_t* utf8_lookup_perform_class_runs_popcnt( const void* table, const uint8_t* str, utf8_lookup_class_run* runs, size_t* num_runs ) __attribute__((target("popcnt")));
+const uint8_t* utf8_lookup_perform_class_runs_ssse3( const void* table, const uint8_t* str, utf8_lookup_class_run* runs, size_t* num_runs ) __attribute__((target("popcnt,ssse3")));
+#endif
+
+const uint8_t* utf8_lookup_perform_class_runs_popcnt( const void* table, const uint8_t* str, utf8_lookup_class_run* runs, size_t* num_runs )
+{
+	return utf8_lookup_perform_class_runs_impl( table, str, runs, num_runs, 1, 0 );
+}
+
+const uint8_t* utf8_lookup_perform_class_runs_ssse3( const void* table, const uint8_t* str, utf8_lookup_class_run* runs, size_t* num_runs )
+{
+	return utf8_lookup_perform_class_runs_impl( table, str, runs, num_runs, 1, 1 );
+}
+
+const uint8_t* utf8_lookup_perform_class_runs( const void*            table,
+                                               const uint8_t*         str,
+                                               utf8_lookup_class_run* runs,
+                                               size_t*                num_runs )
+{
+	static const uint8_t* (* volatile _func)( const void*, const uint8_t*, utf8_lookup_class_run*, size_t* ) = 0;
+	if( UTF8_LOOKUP_DISPATCH_LOAD( _func ) == 0 )
+	{
+		if(utf8_lookup_has_popcnt() && utf8_lookup_has_ssse3())
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_perform_class_runs_ssse3 );
+		else if(utf8_lookup_has_popcnt())
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_perform_class_runs_popcnt );
+		else
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_perform_class_runs_scalar );
+	}
+
+	return UTF8_LOOKUP_DISPATCH_LOAD( _func )( table, str, runs, num_runs );
+}
+
+/**
+ * A kerning-table is:
+ *   uint64_t header[4]                    num_words, num_firsts, num_chunks, num_values.
+ *   uint64_t first_bits[num_words]        bit set for each offset that is first in a pair.
+ *   uint64_t chunk_bits[num_chunks]       bit set for each second offset in a chunk of 64 offsets.
+ *   uint32_t first_rank[num_words]        number of bits set in first_bits before each word.
+ *   uint32_t first_chunks[num_firsts + 1] first chunk for each first, chunks for a first is sorted by chunk_hi.
+ *   uint32_t chunk_values[num_chunks]     index of the value for the first bit in each chunk.
+ *   uint16_t chunk_hi[num_chunks]         second offset / 64 for each chunk.
+ *   int16_t  values[num_values]
+ */
+struct utf8_lookup_kerning_layout
+{
+	size_t num_words;
+	size_t num_firsts;
+	size_t num_chunks;
+	size_t num_values;
+};
+
+struct utf8_lookup_kerning_data
+{
+	const uint64_t* first_bits;
+	const uint64_t* chunk_bits;
+	const uint32_t* first_rank;
+	const uint32_t* first_chunks;
+	const uint32_t* chunk_values;
+	const uint16_t* chunk_hi;
+	const int16_t*  values;
+	size_t          num_words;
+};
+
+static size_t utf8_lookup_kerning_size( const utf8_lookup_kerning_layout* layout )
+{
+	return sizeof( uint64_t ) * ( 4 + layout->num_words + layout->num_chunks ) +
+		   sizeof( uint32_t ) * ( layout->num_words + layout->num_firsts + 1 + layout->num_chunks ) +
+		   sizeof( uint16_t ) * ( layout->num_chunks + layout->num_values );
+}
+
+static void utf8_lookup_kerning_unpack( const void* kerning, utf8_lookup_kerning_data* data )
+{
+	const uint64_t* header = (const uint64_t*)kerning;
+	size_t num_words  = (size_t)header[0];
+	size_t num_firsts = (size_t)header[1];
+	size_t num_chunks = (size_t)header[2];
+
+	data->first_bits   = header + 4;
+	data->chunk_bits   = data->first_bits + num_words;
+	data->first_rank   = (const uint32_t*)( data->chunk_bits + num_chunks );
+	data->first_chunks = data->first_rank + num_words;
+	data->chunk_values = data->first_chunks + num_firsts + 1;
+	data->chunk_hi     = (const uint16_t*)( data->chunk_values + num_chunks );
+	data->values       = (const int16_t*)( data->chunk_hi + num_chunks );
+	data->num_words    = num_words;
+}
+
+/**
+ * Walk all pairs with both chars in table in order, count the size of each array in layout if kerning is 0x0
+ * otherwise fill the arrays of kerning, with header already written, from the pairs.
+ */
+static void utf8_lookup_kerning_build( const void*                     table,
+									   const utf8_lookup_kerning_pair* pairs,
+									   size_t                          num_pairs,
+									   utf8_lookup_kerning_layout*     layout,
+									   void*                           kerning )
+{
+	const uint64_t* avail_bits = utf8_lookup_avail_bits( table );
+	const uint16_t* offsets    = utf8_lookup_offsets( table );
+
+	utf8_lookup_kerning_data data;
+	if( kerning != 0x0 )
+		utf8_lookup_kerning_unpack( kerning, &data );
+
+	size_t num_words  = 0;
+	size_t num_firsts = 0;
+	size_t num_chunks = 0;
+	size_t num_values = 0;
+
+	unsigned int first_cp      = 0xFFFFFFFF;
+	unsigned int first_offset  = 0;
+	unsigned int last_first    = 0;
+	unsigned int last_second   = 0;
+	unsigned int last_hi       = 0xFFFFFFFF;
+	for( size_t i = 0; i < num_pairs; ++i )
+	{
+		if( pairs[i].first != first_cp )
+		{
+			first_cp     = pairs[i].first;
+			first_offset = (unsigned int)utf8_lookup_find_codepoint( avail_bits, offsets, first_cp, 0 );
+		}
+		unsigned int second_offset = (unsigned int)utf8_lookup_find_codepoint( avail_bits, offsets, pairs[i].second, 0 );
+		if( first_offset == 0 || second_offset == 0 )
+			continue;
+
+		// ... pairs are sorted so a duplicate always follow the pair it duplicates, keep the first ...
+		if( first_offset == last_first && second_offset == last_second )
+			continue;
+		last_second = second_offset;
+
+		if( first_offset != last_first )
+		{
+			if( kerning != 0x0 )
+			{
+				( (uint64_t*)data.first_bits )[ first_offset / 64 ] |= (uint64_t)1 << ( first_offset % 64 );
+				( (uint32_t*)data.first_chunks )[ num_firsts ] = (uint32_t)num_chunks;
+			}
+			++num_firsts;
+			num_words  = first_offset / 64 + 1;
+			last_first = first_offset;
+			last_hi    = 0xFFFFFFFF;
+		}
+		if( second_offset / 64 != last_hi )
+		{
+			last_hi = second_offset / 64;
+			if( kerning != 0x0 )
+			{
+				( (uint16_t*)data.chunk_hi )[ num_chunks ]     = (uint16_t)last_hi;
+				( (uint32_t*)data.chunk_values )[ num_chunks ] = (uint32_t)num_values;
+			}
+			++num_chunks;
+		}
+		if( kerning != 0x0 )
+		{
+			( (uint64_t*)data.chunk_bits )[ num_chunks - 1 ] |= (uint64_t)1 << ( second_offset % 64 );
+			( (int16_t*)data.values )[ num_values ] = pairs[i].value;
+		}
+		++num_values;
+	}
+
+	if( kerning == 0x0 )
+	{
+		layout->num_words  = num_words;
+		layout->num_firsts = num_firsts;
+		layout->num_chunks = num_chunks;
+		layout->num_values = num_values;
+		return;
+	}
+
+	( (uint32_t*)data.first_chunks )[ num_firsts ] = (uint32_t)num_chunks;
+
+	uint32_t rank = 0;
+	for( size_t i = 0; i < num_words; ++i )
+	{
+		( (uint32_t*)data.first_rank )[i] = rank;
+		rank += (uint32_t)utf8_popcnt_impl( data.first_bits[i], 0 );
+	}
+}
+
+utf8_lookup_error utf8_lookup_calc_kerning_table_size( size_t*                         kerning_size,
+                                                       const void*                     table,
+                                                       const utf8_lookup_kerning_pair* pairs,
+                                                       size_t                          num_pairs )
+{
+	utf8_lookup_kerning_layout layout;
+	utf8_lookup_kerning_build( table, pairs, num_pairs, &layout, 0x0 );
+	*kerning_size = utf8_lookup_kerning_size( &layout );
+	return UTF8_LOOKUP_ERROR_OK;
+}
+
+utf8_lookup_error utf8_lookup_gen_kerning_table( void*                           kerning,
+                                                 size_t                          kerning_size,
+                                                 const void*                     table,
+                                                 const utf8_lookup_kerning_pair* pairs,
+                                                 size_t                          num_pairs )
+{
+	utf8_lookup_kerning_layout layout;
+	utf8_lookup_kerning_build( table, pairs, num_pairs, &layout, 0x0 );
+	size_t size = utf8_lookup_kerning_size( &layout );
+	if( size > kerning_size )
+		return UTF8_LOOKUP_ERROR_BUFFER_TO_SMALL;
+
+	memset( kerning, 0x0, size );
+	uint64_t* header = (uint64_t*)kerning;
+	header[0] = layout.num_words;
+	header[1] = layout.num_firsts;
+	header[2] = layout.num_chunks;
+	header[3] = layout.num_values;
+
+	utf8_lookup_kerning_build( table, pairs, num_pairs, &layout, kerning );
+	return UTF8_LOOKUP_ERROR_OK;
+}
+
+static UTF8_LOOKUP_ALWAYSINLINE int utf8_lookup_kerning_impl( const utf8_lookup_kerning_data* data,
+															  unsigned int                    first_offset,
+															  unsigned int                    second_offset,
+															  int                             has_popcnt )
+{
+	size_t word = first_offset / 64;
+	if( word >= data->num_words )
+		return 0;
+
+	uint64_t first_bit = (uint64_t)1 << ( first_offset % 64 );
+	uint64_t bits      = data->first_bits[word];
+	if( ( bits & first_bit ) == 0 )
+		return 0;
+
+	size_t first = data->first_rank[word] + (size_t)utf8_popcnt_impl( bits & ( first_bit - 1 ), has_popcnt );
+	uint32_t chunk_end = data->first_chunks[ first + 1 ];
+	uint16_t second_hi = (uint16_t)( second_offset / 64 );
+	for( uint32_t chunk = data->first_chunks[ first ]; chunk < chunk_end; ++chunk )
+	{
+		if( data->chunk_hi[chunk] < second_hi )
+			continue;
+		if( data->chunk_hi[chunk] > second_hi )
+			break;
+
+		uint64_t second_bit  = (uint64_t)1 << ( second_offset % 64 );
+		uint64_t second_bits = data->chunk_bits[chunk];
+		if( ( second_bits & second_bit ) == 0 )
+			break;
+		return data->values[ data->chunk_values[chunk] + utf8_popcnt_impl( second_bits & ( second_bit - 1 ), has_popcnt ) ];
+	}
+	return 0;
+}
+
+int utf8_lookup_kerning( const void*  kerning,
+                         unsigned int first_offset,
+                         unsigned int second_offset )
+{
+	utf8_lookup_kerning_data data;
+	utf8_lookup_kerning_unpack( kerning, &data );
+	return utf8_lookup_kerning_impl( &data, first_offset, second_offset, 0 );
+}
+
+UTF8_LOOKUP_ALWAYSINLINE const uint8_t* utf8_lookup_perform_kerning_impl( const void*                 lookup,
+																		  const void*                 kerning,
+																		  const uint8_t*              str,
+																		  unsigned int*               prev_offset,
+																		  utf8_lookup_kerning_result* res,
+																		  size_t*                     res_size,
+																		  int                         has_popcnt )
+{
+	const uint64_t* avail_bits = utf8_lookup_avail_bits( lookup );
+	const uint16_t* offsets    = utf8_lookup_offsets( lookup );
+
+	utf8_lookup_kerning_data data;
+	utf8_lookup_kerning_unpack( kerning, &data );
+
+	utf8_lookup_kerning_result* res_out = res;
+	utf8_lookup_kerning_result* res_end = res + *res_size;
+
+	unsigned int prev = *prev_offset;
+	const uint8_t* pos = str;
+	while( *pos && res_out != res_end )
+	{
+		int octet = UTF8_TRAILING_BYTES_TABLE[ *pos ];
+		unsigned int offset = (unsigned int)utf8_lookup_find( avail_bits, offsets, pos, octet, has_popcnt );
+
+		res_out->pos     = pos;
+		res_out->offset  = offset;
+		res_out->kerning = utf8_lookup_kerning_impl( &data, prev, offset, has_popcnt );
+		++res_out;
+
+		prev = offset;
+		pos += octet + 1;
+	}
+
+	*prev_offset = prev;
+	*res_size = (size_t)( res_out - res );
+	return pos;
+}
+
+const uint8_t* utf8_lookup_perform_kerning_scalar( const void*                 lookup,
+                                                   const void*                 kerning,
+                                                   const uint8_t*              str,
+                                                   unsigned int*               prev_offset,
+                                                   utf8_lookup_kerning_result* res,
+                                                   size_t*                     res_size )
+{
+	return utf8_lookup_perform_kerning_impl( lookup, kerning, str, prev_offset, res, res_size, 0 );
+}
+
+#if defined(UTF8_LOOKUP_HAS_ATTRIBUTE_TARGET)
+const uint8_t* utf8_lookup_perform_kerning_popcnt( const void*                 lookup,
+                                                   const void*                 kerning,
+                                                   const uint8_t*              str,
+                                                   unsigned int*               prev_offset,
+                                                   utf8_lookup_kerning_result* res,
+                                                   size_t*                     res_size ) __attribute__((target("popcnt")));
+#endif
+
+const uint8_t* utf8_lookup_perform_kerning_popcnt( const void*                 lookup,
+                                                   const void*                 kerning,
+                                                   const uint8_t*              str,
+                                                   unsigned int*               prev_offset,
+                                                   utf8_lookup_kerning_result* res,
+                                                   size_t*                     res_size )
+{
+	return utf8_lookup_perform_kerning_impl( lookup, kerning, str, prev_offset, res, res_size, 1 );
+}
+
+const uint8_t* utf8_lookup_perform_kerning( const void*                 lookup,
+                                            const void*                 kerning,
+                                            const uint8_t*              str,
+                                            unsigned int*               prev_offset,
+                                            utf8_lookup_kerning_result* res,
+                                            size_t*                     res_size )
+{
+	static const uint8_t* (* volatile _func)( const void*, const void*, const uint8_t*, unsigned int*, utf8_lookup_kerning_result*, size_t* ) = 0;
+	if( UTF8_LOOKUP_DISPATCH_LOAD( _func ) == 0 )
+	{
+		if(utf8_lookup_has_popcnt())
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_perform_kerning_popcnt );
+		else
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_perform_kerning_scalar );
+	}
+
+	return UTF8_LOOKUP_DISPATCH_LOAD( _func )( lookup, kerning, str, prev_offset, res, res_size );
+}
+
+static unsigned int utf8_lookup_num_codepoints( const uint64_t* avail_bits, const uint16_t* offsets );
+
+/**
+ * A sequence-table is:
+ *   uint64_t header[4]                  num_words, num_roots, num_nodes, num_edges.
+ *   uint64_t first_bits[num_words]      bit set for each offset that is the first char of a sequence.
+ *   uint32_t first_rank[num_words]      number of bits set in first_bits before each word.
+ *   uint32_t node_edges[num_nodes + 1]  first edge of each node, the first num_roots nodes is the first chars
+ *                                       of the sequences in offset-order.
+ *   uint32_t node_match[num_nodes]      offset of the sequence ending at each node, 0 if none.
+ *   uint32_t edge_child[num_edges]      node to continue at for each edge.
+ *   uint16_t edge_key[num_edges]        offset of the next char for each edge, sorted for each node.
+ */
+struct utf8_lookup_sequence_key
+{
+	const uint16_t* keys;    // offsets of the chars in the sequence.
+	unsigned int    length;  // number of chars in the sequence.
+	unsigned int    offset;  // offset returned for the sequence.
+};
+
+struct utf8_lookup_sequence_range
+{
+	unsigned int lo;
+	unsigned int hi;
+	unsigned int depth;
+};
+
+static int utf8_lookup_cmp_sequence_key( const void* a, const void* b )
+{
+	const utf8_lookup_sequence_key* key_a = (const utf8_lookup_sequence_key*)a;
+	const utf8_lookup_sequence_key* key_b = (const utf8_lookup_sequence_key*)b;
+	unsigned int length = key_a->length < key_b->length ? key_a->length : key_b->length;
+	for( unsigned int i = 0; i < length; ++i )
+		if( key_a->keys[i] != key_b->keys[i] )
+			return key_a->keys[i] < key_b->keys[i] ? -1 : 1;
+	if( key_a->length != key_b->length )
+		return key_a->length < key_b->length ? -1 : 1;
+	return key_a->offset < key_b->offset ? -1 : ( key_a->offset > key_b->offset ? 1 : 0 );
+}
+
+/**
+ * Build the continuation-nodes for sequences, the size is always returned in sequences_size and the table is
+ * only written if it fits in out_size.
+ */
+static utf8_lookup_error utf8_lookup_sequence_build( void*                       out,
+													 size_t                      out_size,
+													 size_t*                     sequences_size,
+													 const void*                 table,
+													 const utf8_lookup_sequence* sequences,
+													 unsigned int                num_sequences )
+{
+	const uint64_t* avail_bits = utf8_lookup_avail_bits( table );
+	const uint16_t* offsets    = utf8_lookup_offsets( table );
+	unsigned int    num_table_codepoints = utf8_lookup_num_codepoints( avail_bits, offsets );
+
+	size_t total_codepoints = 0;
+	for( unsigned int i = 0; i < num_sequences; ++i )
+		total_codepoints += sequences[i].num_codepoints;
+
+	// ... one allocation for the keys and the nodes, nodes and edges are never more than the chars ...
+	size_t keys_size   = sizeof( utf8_lookup_sequence_key ) * num_sequences;
+	size_t ranges_size = sizeof( utf8_lookup_sequence_range ) * ( total_codepoints + 1 );
+	size_t nodes_size  = sizeof( uint32_t ) * ( total_codepoints + 1 ) * 2;
+	size_t edges_size  = ( sizeof( uint32_t ) + sizeof( uint16_t ) ) * total_codepoints;
+	size_t chars_size  = sizeof( uint16_t ) * total_codepoints;
+	uint8_t* scratch = (uint8_t*)UTF8_LOOKUP_MALLOC( keys_size + ranges_size + nodes_size + edges_size + chars_size + 1 );
+	if( scratch == 0x0 )
+		return UTF8_LOOKUP_ERROR_OUT_OF_MEMORY;
+
+	utf8_lookup_sequence_key*   keys       = (utf8_lookup_sequence_key*)scratch;
+	utf8_lookup_sequence_range* ranges     = (utf8_lookup_sequence_range*)( scratch + keys_size );
+	uint32_t*                   node_edges = (uint32_t*)( scratch + keys_size + ranges_size );
+	uint32_t*                   node_match = node_edges + total_codepoints + 1;
+	uint32_t*                   edge_child = node_match + total_codepoints + 1;
+	uint16_t*                   edge_key   = (uint16_t*)( edge_child + total_codepoints );
+	uint16_t*                   chars      = edge_key + total_codepoints;
+
+	unsigned int num_keys = 0;
+	uint16_t* chars_out = chars;
+	for( unsigned int i = 0; i < num_sequences; ++i )
+	{
+		const utf8_lookup_sequence& seq = sequences[i];
+		if( seq.num_codepoints < 2 )
+			continue;
+
+		unsigned int c = 0;
+		for( ; c < seq.num_codepoints; ++c )
+		{
+			chars_out[c] = (uint16_t)utf8_lookup_find_codepoint( avail_bits, offsets, seq.codepoints[c], 0 );
+			if( chars_out[c] == 0 )
+				break;
+		}
+		if( c != seq.num_codepoints )
+			continue;
+
+		keys[num_keys].keys   = chars_out;
+		keys[num_keys].length = seq.num_codepoints;
+		keys[num_keys].offset = num_table_codepoints + 1 + i;
+		++num_keys;
+		chars_out += seq.num_codepoints;
+	}
+
+	qsort( keys, num_keys, sizeof( utf8_lookup_sequence_key ), utf8_lookup_cmp_sequence_key );
+
+	// ... one root-node for each distinct first char ...
+	unsigned int num_nodes = 0;
+	for( unsigned int i = 0; i < num_keys; )
+	{
+		unsigned int j = i;
+		while( j < num_keys && keys[j].keys[0] == keys[i].keys[0] )
+			++j;
+		ranges[num_nodes].lo    = i;
+		ranges[num_nodes].hi    = j;
+		ranges[num_nodes].depth = 0;
+		++num_nodes;
+		i = j;
+	}
+	unsigned int num_roots = num_nodes;
+
+	// ... nodes is built breadth-first so that the edges of each node is stored after each other ...
+	unsigned int num_edges = 0;
+	for( unsigned int n = 0; n < num_nodes; ++n )
+	{
+		utf8_lookup_sequence_range range = ranges[n];
+		node_edges[n] = num_edges;
+		node_match[n] = 0;
+
+		// ... a sequence ending at this node is a prefix of the others in the range and is sorted first ...
+		unsigned int i = range.lo;
+		if( keys[i].length == range.depth + 1 )
+		{
+			node_match[n] = keys[i].offset;
+			while( i < range.hi && keys[i].length == range.depth + 1 )
+				++i;
+		}
+
+		while( i < range.hi )
+		{
+			unsigned int j = i;
+			while( j < range.hi && keys[j].keys[range.depth + 1] == keys[i].keys[range.depth + 1] )
+				++j;
+			edge_key[num_edges]   = keys[i].keys[range.depth + 1];
+			edge_child[num_edges] = num_nodes;
+			++num_edges;
+			ranges[num_nodes].lo    = i;
+			ranges[num_nodes].hi    = j;
+			ranges[num_nodes].depth = range.depth + 1;
+			++num_nodes;
+			i = j;
+		}
+	}
+	node_edges[num_nodes] = num_edges;
+
+	size_t num_words = num_roots == 0 ? 0 : (size_t)keys[ ranges[num_roots - 1].lo ].keys[0] / 64 + 1;
+	*sequences_size = sizeof( uint64_t ) * ( 4 + num_words ) +
+					  sizeof( uint32_t ) * ( num_words + num_nodes * 2 + 1 + num_edges ) +
+					  sizeof( uint16_t ) * num_edges;
+
+	if( out != 0x0 && *sequences_size <= out_size )
+	{
+		memset( out, 0x0, *sequences_size );
+		uint64_t* header = (uint64_t*)out;
+		header[0] = num_words;
+		header[1] = num_roots;
+		header[2] = num_nodes;
+		header[3] = num_edges;
+
+		uint64_t* first_bits = header + 4;
+		uint32_t* first_rank = (uint32_t*)( first_bits + num_words );
+		for( unsigned int r = 0; r < num_roots; ++r )
+		{
+			uint16_t first = keys[ ranges[r].lo ].keys[0];
+			first_bits[ first / 64 ] |= (uint64_t)1 << ( first % 64 );
+		}
+
+		uint32_t rank = 0;
+		for( size_t w = 0; w < num_words; ++w )
+		{
+			first_rank[w] = rank;
+			rank += (uint32_t)utf8_popcnt_impl( first_bits[w], 0 );
+		}
+
+		uint32_t* out_edges = first_rank + num_words;
+		memcpy( out_edges, node_edges, sizeof( uint32_t ) * ( num_nodes + 1 ) );
+		memcpy( out_edges + num_nodes + 1, node_match, sizeof( uint32_t ) * num_nodes );
+		memcpy( out_edges + num_nodes * 2 + 1, edge_child, sizeof( uint32_t ) * num_edges );
+		memcpy( out_edges + num_nodes * 2 + 1 + num_edges, edge_key, sizeof( uint16_t ) * num_edges );
+	}
+
+	UTF8_LOOKUP_FREE( scratch );
+	return UTF8_LOOKUP_ERROR_OK;
+}
+
+utf8_lookup_error utf8_lookup_calc_sequence_table_size( size_t*                     sequences_size,
+                                                        const void*                 table,
+                                                        const utf8_lookup_sequence* sequences,
+                                                        unsigned int                num_sequences )
+{
+	return utf8_lookup_sequence_build( 0x0, 0, sequences_size, table, sequences, num_sequences );
+}
+
+utf8_lookup_error utf8_lookup_gen_sequence_table( void*                       sequences_table,
+                                                  size_t                      sequences_size,
+                                                  const void*                 table,
+                                                  const utf8_lookup_sequence* sequences,
+                                                  unsigned int                num_sequences )
+{
+	size_t size;
+	utf8_lookup_error err = utf8_lookup_sequence_build( sequences_table, sequences_size, &size, table, sequences, num_sequences );
+	if( err != UTF8_LOOKUP_ERROR_OK )
+		return err;
+	return size > sequences_size ? UTF8_LOOKUP_ERROR_BUFFER_TO_SMALL : UTF8_LOOKUP_ERROR_OK;
+}
+
+UTF8_LOOKUP_ALWAYSINLINE const uint8_t* utf8_lookup_perform_sequences_impl( const void*                  lookup,
+																			const void*                  sequences_table,
+																			const uint8_t*               str,
+																			utf8_lookup_sequence_result* res,
+																			size_t*                      res_size,
+																			int                          has_popcnt )
+{
+	const uint64_t* avail_bits = utf8_lookup_avail_bits( lookup );
+	const uint16_t* offsets    = utf8_lookup_offsets( lookup );
+
+	const uint64_t* header     = (const uint64_t*)sequences_table;
+	size_t          num_words  = (size_t)header[0];
+	size_t          num_nodes  = (size_t)header[2];
+	size_t          num_edges  = (size_t)header[3];
+	const uint64_t* first_bits = header + 4;
+	const uint32_t* first_rank = (const uint32_t*)( first_bits + num_words );
+	const uint32_t* node_edges = first_rank + num_words;
+	const uint32_t* node_match = node_edges + num_nodes + 1;
+	const uint32_t* edge_child = node_match + num_nodes;
+	const uint16_t* edge_key   = (const uint16_t*)( edge_child + num_edges );
+
+	utf8_lookup_sequence_result* res_out = res;
+	utf8_lookup_sequence_result* res_end = res + *res_size;
+
+	const uint8_t* pos = str;
+	while( *pos && res_out != res_end )
+	{
+		int octet = UTF8_TRAILING_BYTES_TABLE[ *pos ];
+		uint64_t offset = utf8_lookup_find( avail_bits, offsets, pos, octet, has_popcnt );
+		const uint8_t* end = pos + octet + 1;
+
+		uint64_t first_bit = (uint64_t)1 << ( offset % 64 );
+		if( offset / 64 < num_words && ( first_bits[ offset / 64 ] & first_bit ) != 0 )
+		{
+			// ... follow the continuation-nodes as long as possible, remember the longest match ...
+			uint32_t node = first_rank[ offset / 64 ] + (uint32_t)utf8_popcnt_impl( first_bits[ offset / 64 ] & ( first_bit - 1 ), has_popcnt );
+			const uint8_t* next = end;
+			while( *next )
+			{
+				int next_octet = UTF8_TRAILING_BYTES_TABLE[ *next ];
+				uint64_t key = utf8_lookup_find( avail_bits, offsets, next, next_octet, has_popcnt );
+
+				uint32_t edge     = node_edges[node];
+				uint32_t edge_end = node_edges[node + 1];
+				while( edge < edge_end && edge_key[edge] < key )
+					++edge;
+				if( edge == edge_end || edge_key[edge] != key )
+					break;
+
+				node  = edge_child[edge];
+				next += next_octet + 1;
+				if( node_match[node] != 0 )
+				{
+					offset = node_match[node];
+					end    = next;
+				}
+			}
+		}
+
+		res_out->pos    = pos;
+		res_out->offset = (unsigned int)offset;
+		res_out->length = (unsigned int)( end - pos );
+		++res_out;
+		pos = end;
+	}
+
+	*res_size = (size_t)( res_out - res );
+	return pos;
+}
+
+const uint8_t* utf8_lookup_perform_sequences_scalar( const void*                  lookup,
+                                                     const void*                  sequences_table,
+                                                     const uint8_t*               str,
+                                                     utf8_lookup_sequence_result* res,
+                                                     size_t*                      res_size )
+{
+	return utf8_lookup_perform_sequences_impl( lookup, sequences_table, str, res, res_size, 0 );
+}
+
+#if defined(UTF8_LOOKUP_HAS_ATTRIBUTE_TARGET)
+const uint8_t* utf8_lookup_perform_sequences_popcnt( const void*                  lookup,
+                                                     const void*                  sequences_table,
+                                                     const uint8_t*               str,
+                                                     utf8_lookup_sequence_result* res,
+                                                     size_t*                      res_size ) __attribute__((target("popcnt")));
+#endif
+
+const uint8_t* utf8_lookup_perform_sequences_popcnt( const void*                  lookup,
+                                                     const void*                  sequences_table,
+                                                     const uint8_t*               str,
+                                                     utf8_lookup_sequence_result* res,
+                                                     size_t*                      res_size )
+{
+	return utf8_lookup_perform_sequences_impl( lookup, sequences_table, str, res, res_size, 1 );
+}
+
+const uint8_t* utf8_lookup_perform_sequences( const void*                  lookup,
+                                              const void*                  sequences_table,
+                                              const uint8_t*               str,
+                                              utf8_lookup_sequence_result* res,
+                                              size_t*                      res_size )
+{
+	static const uint8_t* (* volatile _func)( const void*, const void*, const uint8_t*, utf8_lookup_sequence_result*, size_t* ) = 0;
+	if( UTF8_LOOKUP_DISPATCH_LOAD( _func ) == 0 )
+	{
+		if(utf8_lookup_has_popcnt())
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_perform_sequences_popcnt );
+		else
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_perform_sequences_scalar );
+	}
+
+	return UTF8_LOOKUP_DISPATCH_LOAD( _func )( lookup, sequences_table, str, res, res_size );
+}
+
+/**
+ * An advance-table is a lookup-table followed, 16 byte aligned, by an int32_t advance for each ascii-char and
+ * then the advance for each offset with the missing advance for offset 0.
+ */
+static size_t utf8_lookup_advance_ascii_offset( size_t table_size )
+{
+	return ( table_size + 15 ) & ~(size_t)15;
+}
+
+static const int32_t* utf8_lookup_advance_ascii( const void* table )
+{
+	size_t items = (size_t)*(const uint64_t*)table;
+	size_t table_size = sizeof( uint64_t ) + items * ( sizeof( uint64_t ) + sizeof( uint16_t ) );
+	return (const int32_t*)( (const uint8_t*)table + utf8_lookup_advance_ascii_offset( table_size ) );
+}
+
+utf8_lookup_error utf8_lookup_calc_advance_table_size( size_t*             table_size,
+                                                       const unsigned int* codepoints,
+                                                       unsigned int        num_codepoints )
+{
+	size_t lookup_size;
+	utf8_lookup_error err = utf8_lookup_calc_table_size( &lookup_size, codepoints, num_codepoints );
+	if( err != UTF8_LOOKUP_ERROR_OK )
+		return err;
+	*table_size = utf8_lookup_advance_ascii_offset( lookup_size ) + sizeof( int32_t ) * ( 128 + num_codepoints + 1 );
+	return UTF8_LOOKUP_ERROR_OK;
+}
+
+utf8_lookup_error utf8_lookup_gen_advance_table( void*               table,
+                                                 size_t              table_size,
+                                                 const unsigned int* codepoints,
+                                                 const int32_t*      advances,
+                                                 unsigned int        num_codepoints,
+                                                 int32_t             missing_advance )
+{
+	size_t calc_size;
+	utf8_lookup_error err = utf8_lookup_calc_advance_table_size( &calc_size, codepoints, num_codepoints );
+	if( err != UTF8_LOOKUP_ERROR_OK )
+		return err;
+	if( calc_size > table_size )
+		return UTF8_LOOKUP_ERROR_BUFFER_TO_SMALL;
+
+	size_t lookup_size;
+	utf8_lookup_calc_table_size( &lookup_size, codepoints, num_codepoints );
+	err = utf8_lookup_gen_table( table, lookup_size, codepoints, num_codepoints );
+	if( err != UTF8_LOOKUP_ERROR_OK )
+		return err;
+
+	size_t ascii_offset = utf8_lookup_advance_ascii_offset( lookup_size );
+	memset( (uint8_t*)table + lookup_size, 0x0, ascii_offset - lookup_size );
+
+	int32_t* ascii   = (int32_t*)( (uint8_t*)table + ascii_offset );
+	int32_t* offsets = ascii + 128;
+	for( int c = 0; c < 128; ++c )
+		ascii[c] = missing_advance;
+
+	offsets[0] = missing_advance;
+	memcpy( offsets + 1, advances, sizeof( int32_t ) * num_codepoints );
+	for( unsigned int i = 0; i < num_codepoints && codepoints[i] < 128; ++i )
+		ascii[ codepoints[i] ] = advances[i];
+
+	return UTF8_LOOKUP_ERROR_OK;
+}
+
+#if defined(UTF8_LOOKUP_X64)
+/**
+ * Sum advances over 16 byte aligned blocks of only ascii from pos with 2 8-wide gathers from the ascii-advances
+ * per block, stops at first block that contains non-ascii or the string terminator.
+ */
+static const uint8_t* utf8_lookup_measure_ascii_blocks( const int32_t* ascii_advances,
+														const uint8_t* pos,
+														int64_t*       width,
+														int64_t**      prefix_widths ) UTF8_LOOKUP_TARGET("avx2");
+static const uint8_t* utf8_lookup_measure_ascii_blocks( const int32_t* ascii_advances,
+														const uint8_t* pos,
+														int64_t*       width,
+														int64_t**      prefix_widths )
+{
+	__m128i block = _mm_load_si128( (const __m128i*)pos );
+	if( ( _mm_movemask_epi8( block ) | _mm_movemask_epi8( _mm_cmpeq_epi8( block, _mm_setzero_si128() ) ) ) != 0 )
+		return pos;
+
+	__m256i sum = _mm256_setzero_si256();
+	int64_t* prefix = *prefix_widths;
+	int64_t  curr   = *width;
+	do
+	{
+		__m256i adv_lo = _mm256_i32gather_epi32( (const int*)ascii_advances, _mm256_cvtepu8_epi32( block ), 4 );
+		__m256i adv_hi = _mm256_i32gather_epi32( (const int*)ascii_advances, _mm256_cvtepu8_epi32( _mm_srli_si128( block, 8 ) ), 4 );
+
+		if( prefix != 0x0 )
+		{
+			int32_t advances[16];
+			_mm256_storeu_si256( (__m256i*)advances, adv_lo );
+			_mm256_storeu_si256( (__m256i*)( advances + 8 ), adv_hi );
+			for( int i = 0; i < 16; ++i )
+			{
+				curr += advances[i];
+				*prefix++ = curr;
+			}
+		}
+		else
+		{
+			// ... each gather widened to 64 bit before adding so that no two advances can overflow ...
+			sum = _mm256_add_epi64( sum, _mm256_cvtepi32_epi64( _mm256_castsi256_si128( adv_lo ) ) );
+			sum = _mm256_add_epi64( sum, _mm256_cvtepi32_epi64( _mm256_extracti128_si256( adv_lo, 1 ) ) );
+			sum = _mm256_add_epi64( sum, _mm256_cvtepi32_epi64( _mm256_castsi256_si128( adv_hi ) ) );
+			sum = _mm256_add_epi64( sum, _mm256_cvtepi32_epi64( _mm256_extracti128_si256( adv_hi, 1 ) ) );
+		}
+
+		pos += 16;
+		block = _mm_load_si128( (const __m128i*)pos );
+	}
+	while( ( _mm_movemask_epi8( block ) | _mm_movemask_epi8( _mm_cmpeq_epi8( block, _mm_setzero_si128() ) ) ) == 0 );
+
+	int64_t lanes[4];
+	_mm256_storeu_si256( (__m256i*)lanes, sum );
+	*width = curr + lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	*prefix_widths = prefix;
+	return pos;
+}
+#endif
+
+UTF8_LOOKUP_ALWAYSINLINE int64_t utf8_lookup_measure_impl( const void*    table,
+														   const uint8_t* str,
+														   int64_t*       prefix_widths,
+														   int            has_popcnt,
+														   int            has_avx2 )
+{
+	const uint64_t* avail_bits     = utf8_lookup_avail_bits( table );
+	const uint16_t* offsets        = utf8_lookup_offsets( table );
+	const int32_t*  ascii_advances = utf8_lookup_advance_ascii( table );
+	const int32_t*  advances       = ascii_advances + 128;
+
+	int64_t width = 0;
+	const uint8_t* pos = str;
+	while( true )
+	{
+#if defined(UTF8_LOOKUP_X64)
+		if( has_avx2 && ( (uintptr_t)pos & 15 ) == 0 )
+			pos = utf8_lookup_measure_ascii_blocks( ascii_advances, pos, &width, &prefix_widths );
+#else
+		(void)has_avx2;
+#endif
+		if( *pos == 0 )
+			break;
+
+		// ... ascii is read directly from the ascii-advances without a walk ...
+		int octet = UTF8_TRAILING_BYTES_TABLE[ *pos ];
+		width += octet == 0 ? ascii_advances[ *pos ]
+							: advances[ utf8_lookup_find( avail_bits, offsets, pos, octet, has_popcnt ) ];
+		if( prefix_widths != 0x0 )
+			*prefix_widths++ = width;
+		pos += octet + 1;
+	}
+
+	return width;
+}
+
+int64_t utf8_lookup_measure_scalar( const void* table, const uint8_t* str, int64_t* prefix_widths )
+{
+	return utf8_lookup_measure_impl( table, str, prefix_widths, 0, 0 );
+}
+
+#if defined(UTF8_LOOKUP_HAS_ATTRIBUTE_TARGET)
+int64_t utf8_lookup_measure_popcnt( const void* table, const uint8_t* str, int64_t* prefix_widths ) __attribute__((target("popcnt")));
+int64_t utf8_lookup_measure_avx2( const void* table, const uint8_t* str, int64_t* prefix_widths ) __attribute__((target("popcnt,avx2")));
+#endif
+
+int64_t utf8_lookup_measure_popcnt( const void* table, const uint8_t* str, int64_t* prefix_widths )
+{
+	return utf8_lookup_measure_impl( table, str, prefix_widths, 1, 0 );
+}
+
+int64_t utf8_lookup_measure_avx2( const void* table, const uint8_t* str, int64_t* prefix_widths )
+{
+	return utf8_lookup_measure_impl( table, str, prefix_widths, 1, 1 );
+}
+
+int64_t utf8_lookup_measure( const void*    table,
+                             const uint8_t* str,
+                             int64_t*       prefix_widths )
+{
+	static int64_t (* volatile _func)( const void*, const uint8_t*, int64_t* ) = 0;
+	if( UTF8_LOOKUP_DISPATCH_LOAD( _func ) == 0 )
+	{
+		if(utf8_lookup_has_popcnt() && utf8_lookup_has_avx2())
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_measure_avx2 );
+		else if(utf8_lookup_has_popcnt())
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_measure_popcnt );
+		else
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_measure_scalar );
+	}
+
+	return UTF8_LOOKUP_DISPATCH_LOAD( _func )( table, str, prefix_widths );
+}
+
+UTF8_LOOKUP_ALWAYSINLINE const uint8_t* utf8_lookup_break_lines_impl( const void*       advance_table,
+																	  const void*       class_table,
+																	  const uint8_t*    str,
+																	  int64_t           max_width,
+																	  utf8_lookup_line* lines,
+																	  size_t*           num_lines,
+																	  int               has_popcnt )
+{
+	const uint64_t* avail_bits     = utf8_lookup_avail_bits( advance_table );
+	const uint16_t* offsets        = utf8_lookup_offsets( advance_table );
+	const int32_t*  ascii_advances = utf8_lookup_advance_ascii( advance_table );
+	const int32_t*  advances       = ascii_advances + 128;
+	const uint8_t*  ascii_classes  = utf8_lookup_class_ascii( class_table );
+	const uint8_t*  classes        = ascii_classes + 128;
+
+	utf8_lookup_line* lines_out = lines;
+	utf8_lookup_line* lines_end = lines + *num_lines;
+
+	// ... width is the width from line_start to pos, content is up to the last char that is not a space ...
+	const uint8_t* line_start    = str;
+	const uint8_t* content_end   = str;
+	int64_t        width         = 0;
+	int64_t        content_width = 0;
+
+	// ... last break-opportunity on the line, 0x0 if none ...
+	const uint8_t* break_pos           = 0x0;
+	const uint8_t* break_content_end   = 0x0;
+	int64_t        break_content_width = 0;
+	int64_t        break_width         = 0;
+
+	const uint8_t* pos = str;
+	while( *pos && lines_out != lines_end )
+	{
+		int octet = UTF8_TRAILING_BYTES_TABLE[ *pos ];
+		int32_t advance;
+		int     break_class;
+		if( octet == 0 )
+		{
+			advance     = ascii_advances[ *pos ];
+			break_class = ascii_classes[ *pos ];
+		}
+		else
+		{
+			uint64_t offset = utf8_lookup_find( avail_bits, offsets, pos, octet, has_popcnt );
+			advance     = advances[ offset ];
+			break_class = classes[ offset ];
+		}
+		const uint8_t* next = pos + octet + 1;
+
+		if( break_class == UTF8_LOOKUP_BREAK_MANDATORY )
+		{
+			lines_out->pos         = line_start;
+			lines_out->byte_length = (size_t)( content_end - line_start );
+			lines_out->width       = content_width;
+			++lines_out;
+
+			line_start  = next;
+			content_end = next;
+			width = content_width = 0;
+			break_pos = 0x0;
+			pos = next;
+			continue;
+		}
+
+		if( break_class == UTF8_LOOKUP_BREAK_SPACE )
+		{
+			// ... spaces never break a line, they hang at the end of it ...
+			width += advance;
+			break_pos           = next;
+			break_content_end   = content_end;
+			break_content_width = content_width;
+			break_width         = width;
+			pos = next;
+			continue;
+		}
+
+		if( width + advance > max_width && content_end != line_start && break_pos != 0x0 )
+		{
+			lines_out->pos         = line_start;
+			lines_out->byte_length = (size_t)( break_content_end - line_start );
+			lines_out->width       = break_content_width;
+			++lines_out;
+
+			// ... the chars after the break-opportunity moves to the next line ...
+			if( content_end <= break_pos )
+			{
+				content_end   = break_pos;
+				content_width = 0;
+			}
+			else
+				content_width -= break_width;
+			width     -= break_width;
+			line_start = break_pos;
+			break_pos  = 0x0;
+
+			if( lines_out == lines_end )
+				break;
+		}
+
+		if( width + advance > max_width && content_end != line_start )
+		{
+			// ... no break-opportunity, break the word ...
+			lines_out->pos         = line_start;
+			lines_out->byte_length = (size_t)( pos - line_start );
+			lines_out->width       = width;
+			++lines_out;
+
+			line_start  = pos;
+			content_end = pos;
+			width = content_width = 0;
+
+			if( lines_out == lines_end )
+				break;
+		}
+
+		width        += advance;
+		content_end   = next;
+		content_width = width;
+		if( break_class == UTF8_LOOKUP_BREAK_AFTER )
+		{
+			break_pos           = next;
+			break_content_end   = next;
+			break_content_width = width;
+			break_width         = width;
+		}
+		pos = next;
+	}
+
+	if( *pos == 0 && line_start != pos && lines_out != lines_end )
+	{
+		lines_out->pos         = line_start;
+		lines_out->byte_length = (size_t)( content_end - line_start );
+		lines_out->width       = content_width;
+		++lines_out;
+		line_start = pos;
+	}
+
+	*num_lines = (size_t)( lines_out - lines );
+	return line_start;
+}
+
+const uint8_t* utf8_lookup_break_lines_scalar( const void*       advance_table,
+                                               const void*       class_table,
+                                               const uint8_t*    str,
+                                               int64_t           max_width,
+                                               utf8_lookup_line* lines,
+                                               size_t*           num_lines )
+{
+	return utf8_lookup_break_lines_impl( advance_table, class_table, str, max_width, lines, num_lines, 0 );
+}
+
+#if defined(UTF8_LOOKUP_HAS_ATTRIBUTE_TARGET)
+const uint8_t* utf8_lookup_break_lines_popcnt( const void*       advance_table,
+                                               const void*       class_table,
+                                               const uint8_t*    str,
+                                               int64_t           max_width,
+                                               utf8_lookup_line* lines,
+                                               size_t*           num_lines ) __attribute__((target("popcnt")));
+#endif
+
+const uint8_t* utf8_lookup_break_lines_popcnt( const void*       advance_table,
+                                               const void*       class_table,
+                                               const uint8_t*    str,
+                                               int64_t           max_width,
+                                               utf8_lookup_line* lines,
+                                               size_t*           num_lines )
+{
+	return utf8_lookup_break_lines_impl( advance_table, class_table, str, max_width, lines, num_lines, 1 );
+}
+
+const uint8_t* utf8_lookup_break_lines( const void*       advance_table,
+                                        const void*       class_table,
+                                        const uint8_t*    str,
+                                        int64_t           max_width,
+                                        utf8_lookup_line* lines,
+                                        size_t*           num_lines )
+{
+	static const uint8_t* (* volatile _func)( const void*, const void*, const uint8_t*, int64_t, utf8_lookup_line*, size_t* ) = 0;
+	if( UTF8_LOOKUP_DISPATCH_LOAD( _func ) == 0 )
+	{
+		if(utf8_lookup_has_popcnt())
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_break_lines_popcnt );
+		else
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_break_lines_scalar );
+	}
+
+	return UTF8_LOOKUP_DISPATCH_LOAD( _func )( advance_table, class_table, str, max_width, lines, num_lines );
+}
+
+/**
+ * Decode the codepoint for one utf8-char starting at pos with octet trailing bytes.
+ */
+static UTF8_LOOKUP_ALWAYSINLINE unsigned int utf8_lookup_decode( const uint8_t* pos, int octet )
+{
+	static const unsigned int FIRST_BYTE_MASK[4] = { 0x7F, 0x1F, 0x0F, 0x07 };
+	unsigned int cp = pos[0] & FIRST_BYTE_MASK[octet];
+	for( int i = 1; i <= octet; ++i )
+		cp = ( cp << 6 ) | ( pos[i] & 63u );
+	return cp;
+}
+
+/**
+ * Return index of the lowest set bit in val, val must not be 0.
+ */
+static UTF8_LOOKUP_ALWAYSINLINE uint64_t utf8_lookup_ctz( uint64_t val )
+{
+	return utf8_popcnt_impl( ( val & ( ~val + 1 ) ) - 1, 0 );
+}
+
+UTF8_LOOKUP_ALWAYSINLINE utf8_lookup_error utf8_lookup_collect_missing_impl( const void*    table,
+																			 const uint8_t* str,
+																			 uint64_t*      missing_bits,
+																			 unsigned int*  codepoints,
+																			 unsigned int*  counts,
+																			 size_t*        num_codepoints,
+																			 size_t*        num_missing,
+																			 int            has_popcnt )
+{
+	const uint64_t* avail_bits = utf8_lookup_avail_bits( table );
+	const uint16_t* offsets    = utf8_lookup_offsets( table );
+
+	size_t   missing   = 0;
+	uint64_t min_word  = UTF8_LOOKUP_MISSING_BITS_WORDS;
+	uint64_t max_word  = 0;
+
+	for( const uint8_t* pos = str; *pos; )
+	{
+		int octet = UTF8_TRAILING_BYTES_TABLE[ *pos ];
+		if( !utf8_lookup_contains( avail_bits, offsets, pos, octet, has_popcnt ) )
+		{
+			++missing;
+
+			unsigned int cp = utf8_lookup_decode( pos, octet );
+			missing_bits[ cp >> 6 ] |= (uint64_t)1 << ( cp & 63 );
+			min_word = ( cp >> 6 ) < min_word ? ( cp >> 6 ) : min_word;
+			max_word = ( cp >> 6 ) > max_word ? ( cp >> 6 ) : max_word;
+		}
+		pos += octet + 1;
+	}
+
+	// ... missing_bits is the set of unique missing codepoints, scan it to get them sorted and leave it zeroed
+	// for the next call ...
+	size_t num_found = 0;
+	size_t max_found = *num_codepoints;
+	int    truncated = 0;
+	for( uint64_t word = min_word; word <= max_word; ++word )
+	{
+		uint64_t bits = missing_bits[word];
+		missing_bits[word] = 0;
+		for( ; bits != 0 && num_found < max_found; bits &= bits - 1 )
+			codepoints[ num_found++ ] = (unsigned int)( word * 64 + utf8_lookup_ctz( bits ) );
+		truncated |= bits != 0;
+	}
+
+	utf8_lookup_error err = UTF8_LOOKUP_ERROR_OK;
+	if( counts != 0x0 && num_found > 0 )
+	{
+		// counts are collected in a second pass when the unique codepoints are known. A lookup-table is built
+		// over the missing codepoints so that a walk in that gives the index of the codepoint directly.
+		memset( counts, 0x0, num_found * sizeof( unsigned int ) );
+
+		// ... offsets in a table is 16 bit so the index of more codepoints than that can not be found ...
+		size_t missing_table_size = 0;
+		void*  missing_table      = 0x0;
+		if( num_found > 0xFFFF )
+			err = UTF8_LOOKUP_ERROR_TOO_MANY_CODEPOINTS;
+		else
+			err = utf8_lookup_calc_table_size( &missing_table_size, codepoints, (unsigned int)num_found );
+
+		if( err == UTF8_LOOKUP_ERROR_OK )
+		{
+			missing_table = UTF8_LOOKUP_MALLOC( missing_table_size );
+			if( missing_table == 0x0 )
+				err = UTF8_LOOKUP_ERROR_OUT_OF_MEMORY;
+			else
+				err = utf8_lookup_gen_table( missing_table, missing_table_size, codepoints, (unsigned int)num_found );
+		}
+
+		if( err == UTF8_LOOKUP_ERROR_OK )
+		{
+			const uint64_t* missing_avail_bits = utf8_lookup_avail_bits( missing_table );
+			const uint16_t* missing_offsets    = utf8_lookup_offsets( missing_table );
+
+			for( const uint8_t* pos = str; *pos; )
+			{
+				int octet = UTF8_TRAILING_BYTES_TABLE[ *pos ];
+				uint64_t index = utf8_lookup_find( missing_avail_bits, missing_offsets, pos, octet, has_popcnt );
+				if( index > 0 )
+					++counts[ index - 1 ];
+				pos += octet + 1;
+			}
+		}
+
+		if( missing_table != 0x0 )
+			UTF8_LOOKUP_FREE( missing_table );
+	}
+
+	if( err == UTF8_LOOKUP_ERROR_OK && truncated )
+		err = UTF8_LOOKUP_ERROR_BUFFER_TO_SMALL;
+
+	*num_codepoints = num_found;
+	if( num_missing != 0x0 )
+		*num_missing = missing;
+	return err;
+}
+
+utf8_lookup_error utf8_lookup_collect_missing_scalar( const void*    table,
+                                                      const uint8_t* str,
+                                                      uint64_t*      missing_bits,
+                                                      unsigned int*  codepoints,
+                                                      unsigned int*  counts,
+                                                      size_t*        num_codepoints,
+                                                      size_t*        num_missing )
+{
+	return utf8_lookup_collect_missing_impl( table, str, missing_bits, codepoints, counts, num_codepoints, num_missing, 0 );
+}
+
+#if defined(UTF8_LOOKUP_HAS_ATTRIBUTE_TARGET)
+utf8_lookup_error utf8_lookup_collect_missing_popcnt( const void*    table,
+                                                      const uint8_t* str,
+                                                      uint64_t*      missing_bits,
+                                                      unsigned int*  codepoints,
+                                                      unsigned int*  counts,
+                                                      size_t*        num_codepoints,
+                                                      size_t*        num_missing ) __attribute__((target("popcnt")));
+#endif
+
+utf8_lookup_error utf8_lookup_collect_missing_popcnt( const void*    table,
+                                                      const uint8_t* str,
+                                                      uint64_t*      missing_bits,
+                                                      unsigned int*  codepoints,
+                                                      unsigned int*  counts,
+                                                      size_t*        num_codepoints,
+                                                      size_t*        num_missing )
+{
+	return utf8_lookup_collect_missing_impl( table, str, missing_bits, codepoints, counts, num_codepoints, num_missing, 1 );
+}
+
+utf8_lookup_error utf8_lookup_collect_missing( const void*    table,
+                                               const uint8_t* str,
+                                               uint64_t*      missing_bits,
+                                               unsigned int*  codepoints,
+                                               unsigned int*  counts,
+                                               size_t*        num_codepoints,
+                                               size_t*        num_missing )
+{
+	static utf8_lookup_error (* volatile _func)( const void*, const uint8_t*, uint64_t*, unsigned int*, unsigned int*, size_t*, size_t* ) = 0;
+	if( UTF8_LOOKUP_DISPATCH_LOAD( _func ) == 0 )
+	{
+		if(utf8_lookup_has_popcnt())
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_collect_missing_popcnt );
+		else
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_collect_missing_scalar );
+	}
+
+	return UTF8_LOOKUP_DISPATCH_LOAD( _func )( table, str, missing_bits, codepoints, counts, num_codepoints, num_missing );
+}
+
+/**
+ * Return index of the bit with rank r in val, i.e. the r:th set bit counting from 0.
+ */
+static uint64_t utf8_lookup_select( uint64_t val, uint64_t r )
+{
+	uint64_t pos = 0;
+
+	// ... narrow down to the byte containing the bit via popcount of the lower half ...
+	for( uint64_t width = 32; width >= 8; width /= 2 )
+	{
+		uint64_t low = utf8_popcnt_impl( val & ( ( (uint64_t)1 << width ) - 1 ), 0 );
+		if( r >= low )
+		{
+			r   -= low;
+			val >>= width;
+			pos += width;
+		}
+	}
+
+	for( ; r > 0; --r )
+		val &= val - 1;
+	return pos + utf8_lookup_ctz( val );
+}
+
+// number of levels below each root-element, root 1 and 2 is the ascii-chars.
+static const int UTF8_LOOKUP_ROOT_LEVELS[6] = { 0, 1, 1, 2, 3, 4 };
+
+/**
+ * Offset of the first codepoint in the sub-tree starting at element with levels levels.
+ */
+static uint64_t utf8_lookup_first_offset( const uint16_t* offsets, uint64_t element, int levels )
+{
+	for( int i = 1; i < levels; ++i )
+		element = offsets[element];
+	return offsets[element];
+}
+
+int utf8_lookup_codepoint_from_offset( const void*   table,
+                                       unsigned int  offset,
+                                       unsigned int* codepoint )
+{
+	const uint64_t* avail_bits = utf8_lookup_avail_bits( table );
+	const uint16_t* offsets    = utf8_lookup_offsets( table );
+
+	if( offset == 0 )
+		return 0;
+
+	// ... find the last root where the first codepoint is before offset, roots are ordered by codepoint ...
+	uint64_t element = 0;
+	for( uint64_t root = 1; root <= 5; ++root )
+		if( avail_bits[root] != 0 && utf8_lookup_first_offset( offsets, root, UTF8_LOOKUP_ROOT_LEVELS[root] ) <= offset )
+			element = root;
+
+	if( element == 0 )
+		return 0;
+
+	int levels = UTF8_LOOKUP_ROOT_LEVELS[element];
+	unsigned int cp = element <= 2 ? (unsigned int)element - 1 : 0;
+
+	for( int level = 1; level < levels; ++level )
+	{
+		// ... binary search for the last child where the first codepoint is before offset ...
+		uint64_t first = 0;
+		uint64_t count = utf8_popcnt_impl( avail_bits[element], 0 );
+		while( count > 1 )
+		{
+			uint64_t half = count / 2;
+			if( utf8_lookup_first_offset( offsets, offsets[element] + first + half, levels - level ) <= offset )
+				first += half;
+			count -= half;
+		}
+
+		cp      = ( cp << 6 ) | (unsigned int)utf8_lookup_select( avail_bits[element], first );
+		element = offsets[element] + first;
+	}
+
+	uint64_t rank = offset - offsets[element];
+	if( rank >= utf8_popcnt_impl( avail_bits[element], 0 ) )
+		return 0;
+
+	*codepoint = ( cp << 6 ) | (unsigned int)utf8_lookup_select( avail_bits[element], rank );
+	return 1;
+}
+
+void utf8_lookup_iterator_init( utf8_lookup_iterator* it,
+                                const void*           table )
+{
+	memset( it, 0x0, sizeof( utf8_lookup_iterator ) );
+	it->table = table;
+	it->root  = 1;
+}
+
+int utf8_lookup_iterator_next( utf8_lookup_iterator* it,
+                               unsigned int*         codepoint,
+                               unsigned int*         offset )
+{
+	const uint64_t* avail_bits = utf8_lookup_avail_bits( it->table );
+	const uint16_t* offsets    = utf8_lookup_offsets( it->table );
+
+	while( true )
+	{
+		if( it->levels == 0 )
+		{
+			if( it->root > 5 )
+				return 0;
+
+			it->levels    = UTF8_LOOKUP_ROOT_LEVELS[ it->root ];
+			it->depth     = 0;
+			it->node[0]   = (uint64_t)it->root;
+			it->bits[0]   = avail_bits[ it->root ];
+			it->prefix[0] = it->root <= 2 ? (unsigned int)it->root - 1 : 0;
+			++it->root;
+		}
+
+		int depth = it->depth;
+		if( it->bits[depth] == 0 )
+		{
+			// ... all visited at this level, go up or select next root ...
+			if( depth == 0 )
+				it->levels = 0;
+			else
+				--it->depth;
+			continue;
+		}
+
+		uint64_t element = it->node[depth];
+		uint64_t bit     = utf8_lookup_ctz( it->bits[depth] );
+		uint64_t rank    = utf8_popcnt_impl( avail_bits[element] & ( ( (uint64_t)1 << bit ) - 1 ), 0 );
+		unsigned int cp  = ( it->prefix[depth] << 6 ) | (unsigned int)bit;
+		it->bits[depth] &= it->bits[depth] - 1;
+
+		if( depth == it->levels - 1 )
+		{
+			*codepoint = cp;
+			*offset    = (unsigned int)( offsets[element] + rank );
+			return 1;
+		}
+
+		uint64_t child = offsets[element] + rank;
+		it->depth = depth + 1;
+		it->node[depth + 1]   = child;
+		it->bits[depth + 1]   = avail_bits[child];
+		it->prefix[depth + 1] = cp;
+	}
+}
+
+/**
+ * Walk to the first codepoint in the sub-tree at element by always taking the lowest set bit, element need
+ * to be non-empty. All elements except the roots is non-empty.
+ */
+static UTF8_LOOKUP_ALWAYSINLINE void utf8_lookup_leftmost( const uint64_t* avail_bits,
+														   const uint16_t* offsets,
+														   uint64_t        element,
+														   int             levels,
+														   unsigned int    prefix,
+														   unsigned int*   codepoint,
+														   unsigned int*   offset,
+														   int             has_popcnt )
+{
+	for( int level = 1; level < levels; ++level )
+	{
+		uint64_t bits = avail_bits[element];
+		prefix  = ( prefix << 6 ) | (unsigned int)utf8_popcnt_impl( ( bits & ( ~bits + 1 ) ) - 1, has_popcnt );
+		element = offsets[element];
+	}
+	uint64_t bits = avail_bits[element];
+	*codepoint = ( prefix << 6 ) | (unsigned int)utf8_popcnt_impl( ( bits & ( ~bits + 1 ) ) - 1, has_popcnt );
+	*offset    = offsets[element];
+}
+
+UTF8_LOOKUP_ALWAYSINLINE int utf8_lookup_successor_impl( const void*   table,
+														 unsigned int  codepoint,
+														 unsigned int* next_codepoint,
+														 unsigned int* offset,
+														 int           has_popcnt )
+{
+	const uint64_t* avail_bits = utf8_lookup_avail_bits( table );
+	const uint16_t* offsets    = utf8_lookup_offsets( table );
+
+	unsigned int digits[4];
+	int octet = utf8_split_to_bytes( codepoint, digits );
+	if( octet < 0 )
+		return 0;
+
+	uint64_t root = START_OFFSET[octet];
+	unsigned int prefix[4] = { 0, 0, 0, 0 };
+	if( octet == 0 )
+	{
+		root     += codepoint >> 6;
+		prefix[0] = codepoint >> 6;
+		digits[0] = codepoint & 63;
+	}
+
+	int levels = UTF8_LOOKUP_ROOT_LEVELS[root];
+	uint64_t element[4] = { root, 0, 0, 0 };
+
+	// ... follow codepoint as far as it exist in the table ...
+	int depth = 0;
+	while( depth < levels - 1 && ( avail_bits[ element[depth] ] >> digits[depth] ) & 1 )
+	{
+		uint64_t rank = utf8_popcnt_impl( avail_bits[ element[depth] ] & ( ( (uint64_t)1 << digits[depth] ) - 1 ), has_popcnt );
+		element[depth + 1] = offsets[ element[depth] ] + rank;
+		prefix[depth + 1]  = ( prefix[depth] << 6 ) | digits[depth];
+		++depth;
+	}
+
+	// ... then look for the next set bit at that level, if there is none go up one level and look for a bit
+	// after the one we went down into. At most levels steps up and levels steps down ...
+	uint64_t min_bit = digits[depth];
+	while( true )
+	{
+		uint64_t bits = min_bit < 64 ? avail_bits[ element[depth] ] & ~( ( (uint64_t)1 << min_bit ) - 1 ) : 0;
+		if( bits != 0 )
+		{
+			uint64_t bit  = utf8_popcnt_impl( ( bits & ( ~bits + 1 ) ) - 1, has_popcnt );
+			uint64_t rank = utf8_popcnt_impl( avail_bits[ element[depth] ] & ( ( (uint64_t)1 << bit ) - 1 ), has_popcnt );
+			unsigned int cp = ( prefix[depth] << 6 ) | (unsigned int)bit;
+			unsigned int found_offset;
+			if( depth == levels - 1 )
+			{
+				found_offset = (unsigned int)( offsets[ element[depth] ] + rank );
+			}
+			else
+			{
+				utf8_lookup_leftmost( avail_bits, offsets, offsets[ element[depth] ] + rank, levels - depth - 1, cp, &cp, &found_offset, has_popcnt );
+			}
+
+			*next_codepoint = cp;
+			if( offset )
+				*offset = found_offset;
+			return 1;
+		}
+
+		if( depth == 0 )
+			break;
+		--depth;
+		min_bit = digits[depth] + 1;
+	}
+
+	// ... nothing more under this root, take the first codepoint in the next non-empty one ...
+	for( ++root; root <= 5; ++root )
+	{
+		if( avail_bits[root] == 0 )
+			continue;
+
+		unsigned int found_offset;
+		utf8_lookup_leftmost( avail_bits, offsets, root, UTF8_LOOKUP_ROOT_LEVELS[root], root <= 2 ? (unsigned int)root - 1 : 0, next_codepoint, &found_offset, has_popcnt );
+		if( offset )
+			*offset = found_offset;
+		return 1;
+	}
+	return 0;
+}
+
+int utf8_lookup_successor_scalar( const void* table, unsigned int codepoint, unsigned int* next_codepoint, unsigned int* offset )
+{
+	return utf8_lookup_successor_impl( table, codepoint, next_codepoint, offset, 0 );
+}
+
+#if defined(UTF8_LOOKUP_HAS_ATTRIBUTE_TARGET)
+int utf8_lookup_successor_popcnt( const void* table, unsigned int codepoint, unsigned int* next_codepoint, unsigned int* offset ) __attribute__((target("popcnt")));
+#endif
+
+int utf8_lookup_successor_popcnt( const void* table, unsigned int codepoint, unsigned int* next_codepoint, unsigned int* offset )
+{
+	return utf8_lookup_successor_impl( table, codepoint, next_codepoint, offset, 1 );
+}
+
+int utf8_lookup_successor( const void*   table,
+                           unsigned int  codepoint,
+                           unsigned int* next_codepoint,
+                           unsigned int* offset )
+{
+	static int (* volatile _func)( const void*, unsigned int, unsigned int*, unsigned int* ) = 0;
+	if( UTF8_LOOKUP_DISPATCH_LOAD( _func ) == 0 )
+	{
+		if(utf8_lookup_has_popcnt())
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_successor_popcnt );
+		else
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_successor_scalar );
+	}
+
+	return UTF8_LOOKUP_DISPATCH_LOAD( _func )( table, codepoint, next_codepoint, offset );
+}
+
+/**
+ * Return number of codepoints in table, i.e. the offset of the last codepoint.
+ */
+static unsigned int utf8_lookup_num_codepoints( const uint64_t* avail_bits, const uint16_t* offsets )
+{
+	for( uint64_t root = 5; root >= 1; --root )
+	{
+		if( avail_bits[root] == 0 )
+			continue;
+
+		// ... walk down the highest set bit ...
+		uint64_t element = root;
+		for( int level = 1; level < UTF8_LOOKUP_ROOT_LEVELS[root]; ++level )
+			element = offsets[element] + utf8_popcnt_impl( avail_bits[element], 0 ) - 1;
+		return (unsigned int)( offsets[element] + utf8_popcnt_impl( avail_bits[element], 0 ) - 1 );
+	}
+	return 0;
+}
+
+unsigned int utf8_lookup_rank( const void*  table,
+                               unsigned int codepoint )
+{
+	// offsets are given in codepoint-order starting at 1 so the offset of the successor is the rank + 1.
+	unsigned int next_codepoint, offset;
+	if( utf8_lookup_successor( table, codepoint, &next_codepoint, &offset ) )
+		return offset - 1;
+	return utf8_lookup_num_codepoints( utf8_lookup_avail_bits( table ), utf8_lookup_offsets( table ) );
+}
+
+unsigned int utf8_lookup_count_range( const void*  table,
+                                      unsigned int first,
+                                      unsigned int last )
+{
+	if( last < first )
+		return 0;
+	unsigned int end_rank = last >= 0x10FFFF ? utf8_lookup_num_codepoints( utf8_lookup_avail_bits( table ), utf8_lookup_offsets( table ) )
+	                                         : utf8_lookup_rank( table, last + 1 );
+	return end_rank - utf8_lookup_rank( table, first );
+}
+
+static void utf8_lookup_stats_element( const uint64_t*    avail_bits,
+									   const uint16_t*    offsets,
+									   uint64_t           element,
+									   int                level,
+									   int                levels,
+									   utf8_lookup_stats* stats )
+{
+	uint64_t count = utf8_popcnt_impl( avail_bits[element], 0 );
+	if( count == 0 )
+		return;
+
+	stats->nodes_per_level[level] += 1;
+	stats->bits_per_level[level]  += count;
+
+	uint64_t last = offsets[element] + count - 1;
+	if( level == levels - 1 )
+		stats->num_codepoints += count;
+	else
+		last = offsets[element]; // the group-offset is what is stored.
+	if( last > stats->max_offset )
+		stats->max_offset = (unsigned int)last;
+
+	if( level == levels - 1 )
+		return;
+
+	for( uint64_t child = 0; child < count; ++child )
+		utf8_lookup_stats_element( avail_bits, offsets, offsets[element] + child, level + 1, levels, stats );
+}
+
+void utf8_lookup_table_stats( const void*        table,
+                              utf8_lookup_stats* stats )
+{
+	const uint64_t* avail_bits = utf8_lookup_avail_bits( table );
+	const uint16_t* offsets    = utf8_lookup_offsets( table );
+
+	memset( stats, 0x0, sizeof( utf8_lookup_stats ) );
+	stats->items            = (size_t)*((const uint64_t*)table);
+	stats->avail_bits_bytes = stats->items * sizeof( uint64_t );
+	stats->offsets_bytes    = stats->items * sizeof( uint16_t );
+	stats->table_size       = sizeof( uint64_t ) + stats->avail_bits_bytes + stats->offsets_bytes;
+
+	for( uint64_t root = 1; root <= 5; ++root )
+		utf8_lookup_stats_element( avail_bits, offsets, root, 0, UTF8_LOOKUP_ROOT_LEVELS[root], stats );
+
+	size_t nodes = 0;
+	size_t bits  = 0;
+	for( int level = 0; level < 4; ++level )
+	{
+		nodes += stats->nodes_per_level[level];
+		bits  += stats->bits_per_level[level];
+	}
+	stats->unused_items = stats->items - nodes;
+	stats->avg_fill     = nodes == 0 ? 0.0f : (float)bits / (float)( nodes * 64 );
+}
+
+struct utf8_lookup_set_op_ctx
+{
+	const uint64_t*    a_avail_bits;
+	const uint16_t*    a_offsets;
+	const uint64_t*    b_avail_bits;
+	const uint16_t*    b_offsets;
+	utf8_lookup_set_op op;
+
+	uint64_t*          avail_bits; // 0x0 when only calculating size.
+	uint16_t*          offsets;
+	uint64_t           next_element;
+	uint64_t           next_offset;
+};
+
+static UTF8_LOOKUP_ALWAYSINLINE uint64_t utf8_lookup_set_op_bits( utf8_lookup_set_op op, uint64_t a, uint64_t b )
+{
+	switch( op )
+	{
+		case UTF8_LOOKUP_SET_UNION:        return a | b;
+		case UTF8_LOOKUP_SET_INTERSECTION: return a & b;
+		default:                           return a & ~b;
+	}
+}
+
+/**
+ * Return child-element for bit in element, 0 (the always empty element) if the bit is not set.
+ */
+static UTF8_LOOKUP_ALWAYSINLINE uint64_t utf8_lookup_child( const uint64_t* avail_bits, const uint16_t* offsets, uint64_t element, uint64_t bit )
+{
+	uint64_t check_bit = (uint64_t)1 << bit;
+	if( ( avail_bits[element] & check_bit ) == 0 )
+		return 0;
+	return offsets[element] + utf8_popcnt_impl( avail_bits[element] & ( check_bit - 1 ), 0 );
+}
+
+/**
+ * Return the bits that will be set for element a op element b, groups where the op gives an empty
+ * sub-tree are removed.
+ */
+static uint64_t utf8_lookup_set_op_element_bits( const utf8_lookup_set_op_ctx* ctx, uint64_t a, uint64_t b, int levels )
+{
+	if( levels == 1 || ctx->op == UTF8_LOOKUP_SET_UNION )
+		return utf8_lookup_set_op_bits( ctx->op, ctx->a_avail_bits[a], ctx->b_avail_bits[b] );
+
+	// ... for intersection and difference a group-bit can be set in the result only if there is something
+	// left below it, children of a is candidates in both cases ...
+	uint64_t candidates = ctx->a_avail_bits[a];
+	if( ctx->op == UTF8_LOOKUP_SET_INTERSECTION )
+		candidates &= ctx->b_avail_bits[b];
+
+	uint64_t result = 0;
+	for( uint64_t left = candidates; left != 0; left &= left - 1 )
+	{
+		uint64_t bit = utf8_lookup_ctz( left );
+		uint64_t child_a = utf8_lookup_child( ctx->a_avail_bits, ctx->a_offsets, a, bit );
+		uint64_t child_b = utf8_lookup_child( ctx->b_avail_bits, ctx->b_offsets, b, bit );
+		if( utf8_lookup_set_op_element_bits( ctx, child_a, child_b, levels - 1 ) != 0 )
+			result |= (uint64_t)1 << bit;
+	}
+	return result;
+}
+
+static void utf8_lookup_set_op_element( utf8_lookup_set_op_ctx* ctx, uint64_t out, uint64_t a, uint64_t b, int levels )
+{
+	uint64_t bits = utf8_lookup_set_op_element_bits( ctx, a, b, levels );
+	uint64_t count = utf8_popcnt_impl( bits, 0 );
+
+	// children of a group is allocated after each other in the order they are visited, chars are given
+	// offsets in the same order. Visiting in bit-order makes that codepoint-order.
+	uint64_t offset = 0;
+	if( bits != 0 )
+	{
+		uint64_t* next = levels == 1 ? &ctx->next_offset : &ctx->next_element;
+		offset = *next;
+		*next += count;
+	}
+
+	if( ctx->avail_bits )
+	{
+		ctx->avail_bits[out] = bits;
+		ctx->offsets[out]    = (uint16_t)offset;
+	}
+
+	if( levels == 1 )
+		return;
+
+	uint64_t rank = 0;
+	for( uint64_t left = bits; left != 0; left &= left - 1, ++rank )
+	{
+		uint64_t bit = utf8_lookup_ctz( left );
+		utf8_lookup_set_op_element( ctx,
+									offset + rank,
+									utf8_lookup_child( ctx->a_avail_bits, ctx->a_offsets, a, bit ),
+									utf8_lookup_child( ctx->b_avail_bits, ctx->b_offsets, b, bit ),
+									levels - 1 );
 	}
-	return false;
 }
 
-static UTF8_LOOKUP_ALWAYSINLINE uint64_t utf8_popcnt_impl( uint64_t val, const int has_popcnt )
+static uint64_t utf8_lookup_set_op_run( utf8_lookup_set_op_ctx* ctx )
 {
-#if defined( __GNUC__ )
-	if( has_popcnt )
-		return (uint64_t)__builtin_popcountll( (unsigned long long)val ); // the gcc implementation of popcountll is only faster when the actual instruction exists
-#endif
+	ctx->next_element = 6;
+	ctx->next_offset  = 1;
+	for( uint64_t root = 1; root <= 5; ++root )
+		utf8_lookup_set_op_element( ctx, root, root, root, UTF8_LOOKUP_ROOT_LEVELS[root] );
 
-#if defined(_MSC_VER)
-#if defined(_WIN64)
-	if( has_popcnt )
-		return (uint64_t)__popcnt64((uint64_t)val);
-#else
-	uint32_t* ptr = (uint32_t*)&val;
-	if( has_popcnt )
-		return (uint64_t)__popcnt(ptr[0]) + __popcnt(ptr[1]);
-#endif
+	// same as utf8_lookup_calc_table_size, index of last element + 2
+	return ctx->next_element + 1;
+}
+
+static void utf8_lookup_set_op_init( utf8_lookup_set_op_ctx* ctx, const void* table_a, const void* table_b, utf8_lookup_set_op op )
+{
+	memset( ctx, 0x0, sizeof( utf8_lookup_set_op_ctx ) );
+	ctx->a_avail_bits = utf8_lookup_avail_bits( table_a );
+	ctx->a_offsets    = utf8_lookup_offsets( table_a );
+	ctx->b_avail_bits = utf8_lookup_avail_bits( table_b );
+	ctx->b_offsets    = utf8_lookup_offsets( table_b );
+	ctx->op           = op;
+}
+
+utf8_lookup_error utf8_lookup_calc_set_op_table_size( size_t*            table_size,
+                                                      const void*        table_a,
+                                                      const void*        table_b,
+                                                      utf8_lookup_set_op op )
+{
+	utf8_lookup_set_op_ctx ctx;
+	utf8_lookup_set_op_init( &ctx, table_a, table_b, op );
+	uint64_t items = utf8_lookup_set_op_run( &ctx );
+
+	*table_size = sizeof(uint64_t) + (size_t)items * ( sizeof(uint64_t) + sizeof(uint16_t) );
+	return UTF8_LOOKUP_ERROR_OK;
+}
+
+utf8_lookup_error utf8_lookup_gen_set_op_table( void*              table,
+                                                size_t             table_size,
+                                                const void*        table_a,
+                                                const void*        table_b,
+                                                utf8_lookup_set_op op )
+{
+	size_t calc_table_size;
+	utf8_lookup_calc_set_op_table_size( &calc_table_size, table_a, table_b, op );
+	if( calc_table_size > table_size )
+		return UTF8_LOOKUP_ERROR_BUFFER_TO_SMALL;
+
+	memset( table, 0x0, table_size );
+
+	uint64_t items = ( calc_table_size - sizeof(uint64_t) ) / ( sizeof( uint64_t ) + sizeof(uint16_t) );
+	*((uint64_t*)table) = items;
+
+	utf8_lookup_set_op_ctx ctx;
+	utf8_lookup_set_op_init( &ctx, table_a, table_b, op );
+	ctx.avail_bits = (uint64_t*)((uint8_t*)table + sizeof(uint64_t));
+	ctx.offsets    = (uint16_t*)((uint8_t*)ctx.avail_bits + sizeof(uint64_t) * items);
+	utf8_lookup_set_op_run( &ctx );
+
+	return UTF8_LOOKUP_ERROR_OK;
+}
+
+// membership table layout:
+// uint64_t                - item_count
+// uint64_t                - group_count, elements 0 - group_count-1 is roots and groups, the rest is chars.
+// uint64_t[item_count]    - availabillity bits.
+// uint16_t[group_count]   - group-offsets, the chars do not need an offset.
+// elements 0-5 is the same roots as in a table from utf8_lookup_gen_table, so utf8_lookup_contains works on
+// a membership-table as is.
+static UTF8_LOOKUP_ALWAYSINLINE const uint64_t* utf8_lookup_membership_avail_bits( const void* table )
+{
+	return (const uint64_t*)((const uint8_t*)table + sizeof(uint64_t) * 2);
+}
+
+static UTF8_LOOKUP_ALWAYSINLINE const uint16_t* utf8_lookup_membership_offsets( const void* table )
+{
+	uint64_t items = *((const uint64_t*)table);
+	return (const uint16_t*)((const uint8_t*)utf8_lookup_membership_avail_bits( table ) + sizeof(uint64_t) * items);
+}
+
+struct utf8_lookup_membership_ctx
+{
+	const uint64_t* src_avail_bits;
+	const uint16_t* src_offsets;
+
+	uint64_t*       avail_bits; // 0x0 when only counting elements.
+	uint16_t*       offsets;
+	uint64_t        next_group;
+	uint64_t        next_char;
+};
+
+/**
+ * Copy element src from a full table to out, groups are allocated from next_group and elements with chars
+ * from next_char. Children of a group are still allocated after each other.
+ */
+static void utf8_lookup_membership_element( utf8_lookup_membership_ctx* ctx, uint64_t out, uint64_t src, int levels )
+{
+	uint64_t bits = ctx->src_avail_bits[src];
+	if( ctx->avail_bits )
+		ctx->avail_bits[out] = bits;
+
+	if( levels == 1 )
+		return;
+
+	uint64_t  count = utf8_popcnt_impl( bits, 0 );
+	uint64_t* next  = levels == 2 ? &ctx->next_char : &ctx->next_group;
+	uint64_t  first = *next;
+	*next += count;
+
+	if( ctx->avail_bits && count > 0 )
+		ctx->offsets[out] = (uint16_t)first;
+
+	for( uint64_t child = 0; child < count; ++child )
+		utf8_lookup_membership_element( ctx, first + child, ctx->src_offsets[src] + child, levels - 1 );
+}
+
+static void utf8_lookup_membership_run( utf8_lookup_membership_ctx* ctx, uint64_t first_char )
+{
+	ctx->next_group = 6;
+	ctx->next_char  = first_char;
+	for( uint64_t root = 1; root <= 5; ++root )
+		utf8_lookup_membership_element( ctx, root, root, UTF8_LOOKUP_ROOT_LEVELS[root] );
+}
+
+/**
+ * Build a full table over codepoints in temporary memory and count groups and chars in it, returned table
+ * need to be freed by the caller.
+ */
+static void* utf8_lookup_membership_source( utf8_lookup_membership_ctx* ctx,
+                                            const unsigned int*         codepoints,
+                                            unsigned int                num_codepoints )
+{
+	size_t src_size;
+	utf8_lookup_calc_table_size( &src_size, codepoints, num_codepoints );
+	void* src = UTF8_LOOKUP_MALLOC( src_size );
+	if( src == 0x0 )
+		return 0x0;
+	utf8_lookup_gen_table( src, src_size, codepoints, num_codepoints );
+
+	memset( ctx, 0x0, sizeof( utf8_lookup_membership_ctx ) );
+	ctx->src_avail_bits = utf8_lookup_avail_bits( src );
+	ctx->src_offsets    = utf8_lookup_offsets( src );
+	utf8_lookup_membership_run( ctx, 0 );
+	return src;
+}
+
+static size_t utf8_lookup_membership_table_size( uint64_t groups, uint64_t chars )
+{
+	return sizeof(uint64_t) * 2 + (size_t)( groups + chars ) * sizeof(uint64_t) + (size_t)groups * sizeof(uint16_t);
+}
+
+utf8_lookup_error utf8_lookup_calc_membership_table_size( size_t*             table_size,
+                                                          const unsigned int* codepoints,
+                                                          unsigned int        num_codepoints )
+{
+	utf8_lookup_membership_ctx ctx;
+	void* src = utf8_lookup_membership_source( &ctx, codepoints, num_codepoints );
+	if( src == 0x0 )
+		return UTF8_LOOKUP_ERROR_OUT_OF_MEMORY;
+	UTF8_LOOKUP_FREE( src );
+
+	*table_size = utf8_lookup_membership_table_size( ctx.next_group, ctx.next_char );
+	return UTF8_LOOKUP_ERROR_OK;
+}
+
+utf8_lookup_error utf8_lookup_gen_membership_table( void*               table,
+                                                    size_t              table_size,
+                                                    const unsigned int* codepoints,
+                                                    unsigned int        num_codepoints )
+{
+	utf8_lookup_membership_ctx ctx;
+	void* src = utf8_lookup_membership_source( &ctx, codepoints, num_codepoints );
+	if( src == 0x0 )
+		return UTF8_LOOKUP_ERROR_OUT_OF_MEMORY;
+
+	uint64_t groups = ctx.next_group;
+	uint64_t items  = groups + ctx.next_char;
+	if( utf8_lookup_membership_table_size( groups, ctx.next_char ) > table_size )
+	{
+		UTF8_LOOKUP_FREE( src );
+		return UTF8_LOOKUP_ERROR_BUFFER_TO_SMALL;
+	}
+
+	memset( table, 0x0, table_size );
+	((uint64_t*)table)[0] = items;
+	((uint64_t*)table)[1] = groups;
+
+	ctx.avail_bits = (uint64_t*)utf8_lookup_membership_avail_bits( table );
+	ctx.offsets    = (uint16_t*)utf8_lookup_membership_offsets( table );
+	utf8_lookup_membership_run( &ctx, groups );
+
+	UTF8_LOOKUP_FREE( src );
+	return UTF8_LOOKUP_ERROR_OK;
+}
+
+UTF8_LOOKUP_ALWAYSINLINE const uint8_t* utf8_lookup_perform_membership_impl( const void*    table,
+																			 const uint8_t* str,
+																			 uint64_t*      found_bits,
+																			 size_t*        res_size,
+																			 int            has_popcnt )
+{
+	const uint64_t* avail_bits = utf8_lookup_membership_avail_bits( table );
+	const uint16_t* offsets    = utf8_lookup_membership_offsets( table );
+
+	const uint8_t* pos = str;
+	size_t max_chars = *res_size;
+	size_t num_chars = 0;
+
+	while( *pos && num_chars != max_chars )
+	{
+		// ... collect bits in a register and only write full words ...
+		uint64_t found = 0;
+		uint64_t bit   = 0;
+		for( ; bit < 64 && *pos && num_chars != max_chars; ++bit, ++num_chars )
+		{
+			int octet = UTF8_TRAILING_BYTES_TABLE[ *pos ];
+			found |= utf8_lookup_contains( avail_bits, offsets, pos, octet, has_popcnt ) << bit;
+			pos += octet + 1;
+		}
+		found_bits[ ( num_chars - 1 ) / 64 ] = found;
+	}
+
+	*res_size = num_chars;
+	return pos;
+}
+
+const uint8_t* utf8_lookup_perform_membership_scalar( const void*    table,
+                                                      const uint8_t* str,
+                                                      uint64_t*      found_bits,
+                                                      size_t*        res_size )
+{
+	return utf8_lookup_perform_membership_impl( table, str, found_bits, res_size, 0 );
+}
+
+#if defined(UTF8_LOOKUP_HAS_ATTRIBUTE_TARGET)
+const uint8_t* utf8_lookup_perform_membership_popcnt( const void*    table,
+                                                      const uint8_t* str,
+                                                      uint64_t*      found_bits,
+                                                      size_t*        res_size ) __attribute__((target("popcnt")));
 #endif
 
-	val = (val & 0x5555555555555555ULL) + ((val >> 1) & 0x5555555555555555ULL);
-	val = (val & 0x3333333333333333ULL) + ((val >> 2) & 0x3333333333333333ULL);
-	val = (val & 0x0F0F0F0F0F0F0F0FULL) + ((val >> 4) & 0x0F0F0F0F0F0F0F0FULL);
-	return (val * 0x0101010101010101ULL) >> 56;
+const uint8_t* utf8_lookup_perform_membership_popcnt( const void*    table,
+                                                      const uint8_t* str,
+                                                      uint64_t*      found_bits,
+                                                      size_t*        res_size )
+{
+	return utf8_lookup_perform_membership_impl( table, str, found_bits, res_size, 1 );
 }
 
-static int utf8_split_to_bytes( unsigned int cp, unsigned int* bytes )
+const uint8_t* utf8_lookup_perform_membership( const void*    table,
+                                               const uint8_t* str,
+                                               uint64_t*      found_bits,
+                                               size_t*        res_size )
 {
-	if ( cp <= 127 )
+	static const uint8_t* (* volatile _func)( const void*, const uint8_t*, uint64_t*, size_t* ) = 0;
+	if( UTF8_LOOKUP_DISPATCH_LOAD( _func ) == 0 )
 	{
-		bytes[0] = cp;
-		bytes[1] = 0;
-		bytes[2] = 0;
-		bytes[3] = 0;
-		return 0;
+		if(utf8_lookup_has_popcnt())
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_perform_membership_popcnt );
+		else
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_perform_membership_scalar );
 	}
-	if( cp <= 0x7FF )
+
+	return UTF8_LOOKUP_DISPATCH_LOAD( _func )( table, str, found_bits, res_size );
+}
+
+size_t utf8_lookup_membership_count_missing( const void*    table,
+                                             const uint8_t* str )
+{
+	return utf8_lookup_count_missing_dispatch( utf8_lookup_membership_avail_bits( table ), utf8_lookup_membership_offsets( table ), str, 0 );
+}
+
+int utf8_lookup_membership_all_present( const void*    table,
+                                        const uint8_t* str )
+{
+	return utf8_lookup_count_missing_dispatch( utf8_lookup_membership_avail_bits( table ), utf8_lookup_membership_offsets( table ), str, 1 ) == 0;
+}
+
+// merged table layout:
+// uint8_t[trie_size]          - table as built by utf8_lookup_gen_table over the union of all sets.
+// uint32_t[union_count + 1]   - payload per offset in trie, ( set << 16 ) | offset in set. Starts at
+//                               the first 4 byte aligned address after the trie.
+static UTF8_LOOKUP_ALWAYSINLINE size_t utf8_lookup_merged_payload_start( const void* table )
+{
+	uint64_t items = *((const uint64_t*)table);
+	size_t trie_size = sizeof(uint64_t) + (size_t)items * ( sizeof(uint64_t) + sizeof(uint16_t) );
+	return ( trie_size + 3 ) & ~(size_t)3;
+}
+
+/**
+ * Merge sorted codepoint-sets into merged, writing payload for each codepoint if payload != 0x0.
+ * Returns number of unique codepoints or -1 if out of memory.
+ */
+static int utf8_lookup_merge_sets( const unsigned int* const* codepoints,
+								   const unsigned int*        num_codepoints,
+								   unsigned int               num_sets,
+								   unsigned int*              merged,
+								   uint32_t*                  payload )
+{
+	unsigned int* cursors = (unsigned int*)UTF8_LOOKUP_MALLOC( num_sets * sizeof( unsigned int ) );
+	if( cursors == 0x0 && num_sets > 0 )
+		return -1;
+	memset( cursors, 0x0, num_sets * sizeof( unsigned int ) );
+
+	int count = 0;
+	while( true )
 	{
-		bytes[0] = cp >> 6;
-		bytes[1] = cp & 63;
-		bytes[2] = 0;
-		bytes[3] = 0;
-		return 1;
+		// find smallest codepoint left in any set, the first set with it has priority.
+		unsigned int min_cp  = 0xFFFFFFFF;
+		unsigned int min_set = num_sets;
+		for( unsigned int set = 0; set < num_sets; ++set )
+		{
+			if( cursors[set] < num_codepoints[set] && codepoints[set][cursors[set]] < min_cp )
+			{
+				min_cp  = codepoints[set][cursors[set]];
+				min_set = set;
+			}
+		}
+
+		if( min_set == num_sets )
+			break;
+
+		merged[count++] = min_cp;
+		if( payload )
+			payload[count] = ( (uint32_t)min_set << 16 ) | ( cursors[min_set] + 1 );
+
+		for( unsigned int set = min_set; set < num_sets; ++set )
+			if( cursors[set] < num_codepoints[set] && codepoints[set][cursors[set]] == min_cp )
+				++cursors[set];
 	}
 
-	if( cp <= 0xFFFF )
+	UTF8_LOOKUP_FREE( cursors );
+	return count;
+}
+
+static size_t utf8_lookup_merged_max_count( const unsigned int* num_codepoints, unsigned int num_sets )
+{
+	size_t total = 0;
+	for( unsigned int set = 0; set < num_sets; ++set )
+		total += num_codepoints[set];
+	return total;
+}
+
+/**
+ * Size of a merged table over the num_merged codepoints in merged. Both the offsets in the trie and the
+ * set-index in the payload is 16 bit so more codepoints or sets than that can not be merged.
+ */
+static utf8_lookup_error utf8_lookup_merged_table_size( size_t* table_size, const unsigned int* merged, int num_merged, unsigned int num_sets )
+{
+	if( num_merged > 0xFFFF || num_sets > 0xFFFF )
+		return UTF8_LOOKUP_ERROR_TOO_MANY_CODEPOINTS;
+
+	size_t trie_size;
+	utf8_lookup_error err = utf8_lookup_calc_table_size( &trie_size, merged, (unsigned int)num_merged );
+	if( err != UTF8_LOOKUP_ERROR_OK )
+		return err;
+	*table_size = ( ( trie_size + 3 ) & ~(size_t)3 ) + ( (size_t)num_merged + 1 ) * sizeof( uint32_t );
+	return UTF8_LOOKUP_ERROR_OK;
+}
+
+utf8_lookup_error utf8_lookup_calc_merged_table_size( size_t*                   table_size,
+                                                      const unsigned int* const* codepoints,
+                                                      const unsigned int*        num_codepoints,
+                                                      unsigned int               num_sets )
+{
+	size_t max_count = utf8_lookup_merged_max_count( num_codepoints, num_sets );
+	unsigned int* merged = (unsigned int*)UTF8_LOOKUP_MALLOC( max_count * sizeof( unsigned int ) );
+	if( merged == 0x0 && max_count > 0 )
+		return UTF8_LOOKUP_ERROR_OUT_OF_MEMORY;
+
+	int num_merged = utf8_lookup_merge_sets( codepoints, num_codepoints, num_sets, merged, 0x0 );
+	utf8_lookup_error err = UTF8_LOOKUP_ERROR_OUT_OF_MEMORY;
+	if( num_merged >= 0 )
+		err = utf8_lookup_merged_table_size( table_size, merged, num_merged, num_sets );
+
+	UTF8_LOOKUP_FREE( merged );
+	return err;
+}
+
+utf8_lookup_error utf8_lookup_gen_merged_table( void*                      table,
+                                                size_t                     table_size,
+                                                const unsigned int* const* codepoints,
+                                                const unsigned int*        num_codepoints,
+                                                unsigned int               num_sets )
+{
+	// scratch-layout: unsigned int[max_count] merged codepoints followed by uint32_t[max_count + 1] payload.
+	size_t max_count = utf8_lookup_merged_max_count( num_codepoints, num_sets );
+	unsigned int* merged = (unsigned int*)UTF8_LOOKUP_MALLOC( ( max_count * 2 + 1 ) * sizeof( unsigned int ) );
+	if( merged == 0x0 )
+		return UTF8_LOOKUP_ERROR_OUT_OF_MEMORY;
+	uint32_t* payload = (uint32_t*)( merged + max_count );
+
+	int num_merged = utf8_lookup_merge_sets( codepoints, num_codepoints, num_sets, merged, payload );
+	if( num_merged < 0 )
 	{
-		bytes[0] = ( cp >> 12 ) & 15;
-		bytes[1] = ( cp >> 6  ) & 63;
-		bytes[2] = cp & 63;
-		bytes[3] = 0;
-		return 2;
+		UTF8_LOOKUP_FREE( merged );
+		return UTF8_LOOKUP_ERROR_OUT_OF_MEMORY;
 	}
 
-	if( cp <= 0x10FFFF )
+	size_t merged_size = 0;
+	utf8_lookup_error err = utf8_lookup_merged_table_size( &merged_size, merged, num_merged, num_sets );
+	if( err == UTF8_LOOKUP_ERROR_OK && merged_size > table_size )
+		err = UTF8_LOOKUP_ERROR_BUFFER_TO_SMALL;
+
+	size_t trie_size = 0;
+	if( err == UTF8_LOOKUP_ERROR_OK )
+		err = utf8_lookup_calc_table_size( &trie_size, merged, (unsigned int)num_merged );
+	if( err == UTF8_LOOKUP_ERROR_OK )
 	{
-		bytes[0] = ( cp >> 18 ) & 7;
-		bytes[1] = ( cp >> 12 ) & 63;
-		bytes[2] = ( cp >> 6  ) & 63;
-		bytes[3] = cp & 63;
-		return 3;
+		memset( table, 0x0, table_size );
+		err = utf8_lookup_gen_table( table, trie_size, merged, (unsigned int)num_merged );
+	}
+	if( err != UTF8_LOOKUP_ERROR_OK )
+	{
+		UTF8_LOOKUP_FREE( merged );
+		return err;
 	}
 
-	return -1;
+	// payload[0] is the "not found"-result, set 0 offset 0.
+	payload[0] = 0;
+	memcpy( (uint8_t*)table + utf8_lookup_merged_payload_start( table ), payload, ( (size_t)num_merged + 1 ) * sizeof( uint32_t ) );
+
+	UTF8_LOOKUP_FREE( merged );
+	return UTF8_LOOKUP_ERROR_OK;
 }
 
-// table telling where to start a lookup-traversal depending on how many bytes the current utf8-char is.
-// first item in the avail_bits is always 0, this is used as "not found". If sometime in the lookup-loop
-// a char is determined that it do not exist, i.e. a bit in the avail_bits-array is not set, the current
-// lookup index will be set to 0 and reference this empty bitset for the rest of the lookup.
-//
-// This was done under the asumption that you mostly do lookups that "hit" the table, i.e. you will need
-// to do all loop-iterations so instead of branching, just make the code always loop all iterations.
-//
-// if this is a gain is something to actually be tested.
-static const uint64_t START_OFFSET[4] = { 1, 3, 4, 5 };
+UTF8_LOOKUP_ALWAYSINLINE const uint8_t* utf8_lookup_perform_merged_impl( const void*                  table,
+																		 const uint8_t*               str,
+																		 utf8_lookup_fallback_result* res,
+																		 size_t*                      res_size,
+																		 int                          has_popcnt )
+{
+	utf8_lookup_fallback_result* res_out = res;
+	utf8_lookup_fallback_result* res_end = res + *res_size;
+
+	const uint8_t* pos = str;
+
+	const uint64_t* avail_bits = utf8_lookup_avail_bits( table );
+	const uint16_t* offsets    = utf8_lookup_offsets( table );
+	const uint32_t* payload    = (const uint32_t*)( (const uint8_t*)table + utf8_lookup_merged_payload_start( table ) );
+
+	while( *pos && res_out != res_end )
+	{
+		int octet = UTF8_TRAILING_BYTES_TABLE[ *pos ];
+
+		uint32_t value = payload[ utf8_lookup_find( avail_bits, offsets, pos, octet, has_popcnt ) ];
+
+		res_out->pos    = pos;
+		res_out->table  = value >> 16;
+		res_out->offset = value & 0xFFFF;
+		++res_out;
+
+		pos += octet + 1;
+	}
+
+	*res_size = (size_t)(res_out - res);
+	return pos;
+}
+
+const uint8_t* utf8_lookup_perform_merged_scalar( const void*                  table,
+                                                  const uint8_t*               str,
+                                                  utf8_lookup_fallback_result* res,
+                                                  size_t*                      res_size )
+{
+	return utf8_lookup_perform_merged_impl( table, str, res, res_size, 0 );
+}
+
+#if defined(UTF8_LOOKUP_HAS_ATTRIBUTE_TARGET)
+const uint8_t* utf8_lookup_perform_merged_popcnt( const void*                  table,
+                                                  const uint8_t*               str,
+                                                  utf8_lookup_fallback_result* res,
+                                                  size_t*                      res_size ) __attribute__((target("popcnt")));
+#endif
+
+const uint8_t* utf8_lookup_perform_merged_popcnt( const void*                  table,
+                                                  const uint8_t*               str,
+                                                  utf8_lookup_fallback_result* res,
+                                                  size_t*                      res_size )
+{
+	return utf8_lookup_perform_merged_impl( table, str, res, res_size, 1 );
+}
+
+const uint8_t* utf8_lookup_perform_merged( const void*                  table,
+                                           const uint8_t*               str,
+                                           utf8_lookup_fallback_result* res,
+                                           size_t*                      res_size )
+{
+	static const uint8_t* (* volatile _func)( const void*, const uint8_t*, utf8_lookup_fallback_result*, size_t* ) = 0;
+	if( UTF8_LOOKUP_DISPATCH_LOAD( _func ) == 0 )
+	{
+		if(utf8_lookup_has_popcnt())
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_perform_merged_popcnt );
+		else
+			UTF8_LOOKUP_DISPATCH_STORE( _func, utf8_lookup_perform_merged_scalar );
+	}
+
+	return UTF8_LOOKUP_DISPATCH_LOAD( _func )( table, str, res, res_size );
+}
+
+#if defined(UTF8_LOOKUP_ENABLE_THREADS)
+
+#include <thread>
+
+#if !defined(UTF8_LOOKUP_MAX_THREADS)
+#  define UTF8_LOOKUP_MAX_THREADS 64
+#endif
+
+#if !defined(UTF8_LOOKUP_PARALLEL_MIN_SLICE)
+#  define UTF8_LOOKUP_PARALLEL_MIN_SLICE (64 * 1024)
+#endif
+
+UTF8_LOOKUP_ALWAYSINLINE size_t utf8_lookup_perform_range_impl( const void*         lookup,
+																const uint8_t*      str,
+																const uint8_t*      end,
+																utf8_lookup_result* res,
+																int                 has_popcnt )
+{
+	const uint64_t* avail_bits = utf8_lookup_avail_bits( lookup );
+	const uint16_t* offsets    = utf8_lookup_offsets( lookup );
+
+	utf8_lookup_result* res_out = res;
+	const uint8_t* pos = str;
+	while( pos < end )
+	{
+		int octet = UTF8_TRAILING_BYTES_TABLE[ *pos ];
+		res_out->pos    = pos;
+		res_out->offset = (unsigned int)utf8_lookup_find( avail_bits, offsets, pos, octet, has_popcnt );
+		++res_out;
+		pos += octet + 1;
+	}
+	return (size_t)( res_out - res );
+}
+
+size_t utf8_lookup_perform_range_scalar( const void* lookup, const uint8_t* str, const uint8_t* end, utf8_lookup_result* res )
+{
+	return utf8_lookup_perform_range_impl( lookup, str, end, res, 0 );
+}
+
+#if defined(UTF8_LOOKUP_HAS_ATTRIBUTE_TARGET)
+size_t utf8_lookup_perform_range_popcnt( const void* lookup, const uint8_t* str, const uint8_t* end, utf8_lookup_result* res ) __attribute__((target("popcnt")));
+#endif
+
+size_t utf8_lookup_perform_range_popcnt( const void* lookup, const uint8_t* str, const uint8_t* end, utf8_lookup_result* res )
+{
+	return utf8_lookup_perform_range_impl( lookup, str, end, res, 1 );
+}
+
+struct utf8_lookup_parallel_slice
+{
+	const void*         table;
+	const uint8_t*      begin;
+	const uint8_t*      end;
+	utf8_lookup_result* res;
+	size_t              num_chars;
+	size_t (*perform)( const void*, const uint8_t*, const uint8_t*, utf8_lookup_result* );
+};
+
+static void utf8_lookup_parallel_count( utf8_lookup_parallel_slice* slice )
+{
+	// ... every byte that is not a continuation-byte starts a char ...
+	size_t num_chars = 0;
+	for( const uint8_t* pos = slice->begin; pos != slice->end; ++pos )
+		num_chars += ( *pos & 0xC0 ) != 0x80;
+	slice->num_chars = num_chars;
+}
+
+static void utf8_lookup_parallel_perform( utf8_lookup_parallel_slice* slice )
+{
+	slice->perform( slice->table, slice->begin, slice->end, slice->res );
+}
 
-utf8_lookup_error utf8_lookup_gen_table( void*         table,
-					 	 	 	 	 	 size_t        table_size,
-					 	 	 	 	 	 unsigned int* codepoints,
-					 	 	 	 	 	 unsigned int  num_codepoints )
+/**
+ * Run func on all slices, slice 0 on the calling thread and the rest on their own threads.
+ */
+static void utf8_lookup_parallel_run( void (*func)( utf8_lookup_parallel_slice* ), utf8_lookup_parallel_slice* slices, unsigned int num_slices )
 {
-    memset( table, 0x0, table_size );
-
-    size_t calc_table_size;
-    utf8_lookup_calc_table_size( &calc_table_size, codepoints, num_codepoints );
+	std::thread threads[UTF8_LOOKUP_MAX_THREADS];
+	for( unsigned int i = 1; i < num_slices; ++i )
+		threads[i] = std::thread( func, &slices[i] );
+	func( &slices[0] );
+	for( unsigned int i = 1; i < num_slices; ++i )
+		threads[i].join();
+}
 
-    if( calc_table_size > table_size )
-        return UTF8_LOOKUP_ERROR_BUFFER_TO_SMALL;
+size_t utf8_lookup_perform_parallel( const void*         table,
+                                     const uint8_t*      str,
+                                     size_t              str_len,
+                                     utf8_lookup_result* res,
+                                     unsigned int        num_threads )
+{
+	unsigned int num_slices = num_threads;
+	if( (size_t)num_slices > str_len / UTF8_LOOKUP_PARALLEL_MIN_SLICE )
+		num_slices = (unsigned int)( str_len / UTF8_LOOKUP_PARALLEL_MIN_SLICE );
+	if( num_slices > UTF8_LOOKUP_MAX_THREADS )
+		num_slices = UTF8_LOOKUP_MAX_THREADS;
+	if( num_slices < 1 )
+		num_slices = 1;
 
-    size_t items = ( table_size - sizeof(uint64_t) ) / ( sizeof( uint64_t ) + sizeof(uint16_t) );
+	// ... resolve dispatch here instead of racing on it from all threads ...
+	size_t (*perform)( const void*, const uint8_t*, const uint8_t*, utf8_lookup_result* ) =
+		utf8_lookup_has_popcnt() ? utf8_lookup_perform_range_popcnt : utf8_lookup_perform_range_scalar;
 
-    uint64_t* avail_bits = (uint64_t*)((uint8_t*)table + sizeof(uint64_t));
-    uint16_t* offsets    = (uint16_t*)((uint8_t*)avail_bits + sizeof(uint64_t) * items);
+	if( num_slices == 1 )
+		return perform( table, str, str + str_len, res );
 
-    // loop all codepoints
+	// ... split evenly and move each split backward to the closest lead-byte ...
+	utf8_lookup_parallel_slice slices[UTF8_LOOKUP_MAX_THREADS];
+	const uint8_t* end = str + str_len;
+	const uint8_t* begin = str;
+	for( unsigned int i = 0; i < num_slices; ++i )
+	{
+		const uint8_t* split = i == num_slices - 1 ? end : str + str_len / num_slices * ( i + 1 );
+		while( split > begin && split < end && ( *split & 0xC0 ) == 0x80 )
+			--split;
 
-    unsigned int* start = codepoints;
-    unsigned int* end   = codepoints + num_codepoints;
+		slices[i].table   = table;
+		slices[i].begin   = begin;
+		slices[i].end     = split;
+		slices[i].perform = perform;
+		begin = split;
+	}
 
-    int curr_elem = 0;
+	utf8_lookup_parallel_run( utf8_lookup_parallel_count, slices, num_slices );
 
-    int octet_start[5] = { -1, -1, -1, -1, -1 };
-    int last_octet = -1;
+	size_t num_chars = 0;
+	for( unsigned int i = 0; i < num_slices; ++i )
+	{
+		slices[i].res = res + num_chars;
+		num_chars += slices[i].num_chars;
+	}
 
-    for( int octet = 0; octet < 5; ++octet )
-    {
-        unsigned int last_prev_gids[4] = { (unsigned int)-1, (unsigned int)-1, (unsigned int)-1, (unsigned int)-1 };
-        unsigned int* curr = start;
-        while( curr != end )
-        {
-			unsigned int gids[4];
-            int curr_octet = utf8_split_to_bytes( *curr++, gids );
+	utf8_lookup_parallel_run( utf8_lookup_parallel_perform, slices, num_slices );
+	return num_chars;
+}
 
-            if( octet == 0 )
-            {
-                // we are in the static section of the table.
-                curr_elem = (int)(START_OFFSET[ curr_octet ] + ( gids[ octet ] >> 6  ) );
-            }
-            else
-            {
-                // we are in the dynamic section of the table.
-                curr_elem = curr_elem < 6 ? 5 : curr_elem;
+#include <atomic>
+#include <mutex>
+#include <new>
 
-                if( ( memcmp( last_prev_gids, gids, (size_t)( octet ) * sizeof( unsigned int ) ) != 0 ) || last_octet != curr_octet )
-                {
-                    ++curr_elem;
-                    memcpy( last_prev_gids, gids, sizeof( gids ) );
-                }
-            }
+/**
+ * Hazard-pointer of one reader, padded to its own cache-line so that readers do not invalidate each other.
+ */
+struct utf8_lookup_hot_table_hazard
+{
+	std::atomic<const void*> table;
+	uint8_t                  pad[64 - sizeof( std::atomic<const void*> )];
+};
 
-            last_octet = curr_octet;
+struct utf8_lookup_hot_table
+{
+	std::atomic<void*>            current;
+	utf8_lookup_hot_table_hazard* hazards;
+	unsigned int                  max_readers;
 
-            if( octet_start[ octet ] == -1 )
-                octet_start[ octet ] = curr_elem;
+	std::mutex publish_lock;
+	void**     retired;
+	size_t     num_retired;
+	size_t     retired_capacity;
+};
 
-            if( octet == curr_octet )
-            {
-                // advance start, we will not do anything with this char again.
-                ++start;
+utf8_lookup_error utf8_lookup_hot_table_create( utf8_lookup_hot_table** hot,
+                                                void*                   table,
+                                                unsigned int            max_readers )
+{
+	size_t hazards_offset = ( sizeof( utf8_lookup_hot_table ) + 63 ) & ~(size_t)63;
+	uint8_t* mem = (uint8_t*)UTF8_LOOKUP_MALLOC( hazards_offset + max_readers * sizeof( utf8_lookup_hot_table_hazard ) );
+	if( mem == 0x0 )
+		return UTF8_LOOKUP_ERROR_OUT_OF_MEMORY;
 
-                // mark element as chars
-                offsets[ curr_elem ] = 1;
-            }
-            else
-            {
-                // mark element as group
-                offsets[ curr_elem ] = 2;
-            }
+	utf8_lookup_hot_table* h = new ( mem ) utf8_lookup_hot_table;
+	h->hazards = (utf8_lookup_hot_table_hazard*)( mem + hazards_offset );
+	for( unsigned int i = 0; i < max_readers; ++i )
+		new ( &h->hazards[i] ) utf8_lookup_hot_table_hazard;
+	for( unsigned int i = 0; i < max_readers; ++i )
+		h->hazards[i].table.store( 0x0, std::memory_order_relaxed );
+	h->max_readers      = max_readers;
+	h->retired          = 0x0;
+	h->num_retired      = 0;
+	h->retired_capacity = 0;
+	h->current.store( table, std::memory_order_release );
 
-			// set the avail bit
-			avail_bits[ curr_elem ] |= (uint64_t)1 << ( gids[ octet ] & 63 );
-        }
-    }
+	*hot = h;
+	return UTF8_LOOKUP_ERROR_OK;
+}
 
-    // write offsets!
+void utf8_lookup_hot_table_destroy( utf8_lookup_hot_table* hot )
+{
+	for( size_t i = 0; i < hot->num_retired; ++i )
+		UTF8_LOOKUP_FREE( hot->retired[i] );
+	UTF8_LOOKUP_FREE( hot->retired );
+	UTF8_LOOKUP_FREE( hot->current.load( std::memory_order_acquire ) );
 
-    octet_start[4] = curr_elem + 1;
-    int last_start = curr_elem + 1;
-    for( int i = 3; i >= 0; --i )
-    {
-        if( octet_start[i] == -1 )
-            octet_start[i] = last_start;
-        else
-            last_start = octet_start[i];
-    }
+	for( unsigned int i = 0; i < hot->max_readers; ++i )
+		hot->hazards[i].~utf8_lookup_hot_table_hazard();
+	hot->~utf8_lookup_hot_table();
+	UTF8_LOOKUP_FREE( hot );
+}
 
-    uint32_t char_offset = 1;
-    uint32_t group_offset = 6;
+utf8_lookup_error utf8_lookup_hot_table_publish( utf8_lookup_hot_table* hot,
+                                                 void*                  table )
+{
+	std::lock_guard<std::mutex> lock( hot->publish_lock );
 
-    for( unsigned int octet = 0; octet < 4; ++octet )
-    {
-		group_offset = (uint32_t)octet_start[ octet + 1 ];
+	// ... make room for the replaced table before it is swapped out so that failing leaves hot as is ...
+	if( hot->num_retired == hot->retired_capacity )
+	{
+		size_t capacity = hot->retired_capacity == 0 ? 8 : hot->retired_capacity * 2;
+		void** retired = (void**)UTF8_LOOKUP_MALLOC( capacity * sizeof( void* ) );
+		if( retired == 0x0 )
+			return UTF8_LOOKUP_ERROR_OUT_OF_MEMORY;
+		if( hot->num_retired > 0 )
+			memcpy( retired, hot->retired, hot->num_retired * sizeof( void* ) );
+		UTF8_LOOKUP_FREE( hot->retired );
+		hot->retired          = retired;
+		hot->retired_capacity = capacity;
+	}
 
-        for( int j = octet_start[ octet ]; j < octet_start[ octet + 1 ]; ++j )
-        {
-            if( offsets[ j ] == 1 )
-            {
-                // writing a char
-                offsets[ j ] = (uint16_t)char_offset;
-                char_offset += (uint32_t)utf8_popcnt_impl( avail_bits[ j ], 0 );
-            }
-            else if( offsets[ j ] == 2 )
-            {
-                // writing a group
-                offsets[ j ] = (uint16_t)group_offset;
-                group_offset += (uint32_t)utf8_popcnt_impl( avail_bits[ j ], 0 );
-            }
-        }
-    }
+	hot->retired[hot->num_retired++] = hot->current.exchange( table, std::memory_order_seq_cst );
 
-    *((uint64_t*)table) = (uint64_t)(curr_elem + 2);
+	// ... a reader that has not set its hazard to a retired table before the exchange will see the new table
+	// when it validates its hazard, so anything not in a hazard now is safe to free ...
+	size_t keep = 0;
+	for( size_t i = 0; i < hot->num_retired; ++i )
+	{
+		void* retired = hot->retired[i];
+		bool in_use = false;
+		for( unsigned int r = 0; r < hot->max_readers && !in_use; ++r )
+			in_use = hot->hazards[r].table.load( std::memory_order_seq_cst ) == retired;
 
+		if( in_use )
+			hot->retired[keep++] = retired;
+		else
+			UTF8_LOOKUP_FREE( retired );
+	}
+	hot->num_retired = keep;
 	return UTF8_LOOKUP_ERROR_OK;
 }
 
-utf8_lookup_error utf8_lookup_calc_table_size( size_t*       table_size,
-                                               unsigned int* codepoints,
-                                               unsigned int  num_codepoints )
+const void* utf8_lookup_hot_table_acquire( utf8_lookup_hot_table* hot,
+                                           unsigned int           reader )
 {
-    // loop all codepoints
+	std::atomic<const void*>& hazard = hot->hazards[reader].table;
+	const void* table = hot->current.load( std::memory_order_acquire );
+	while( true )
+	{
+		// ... the table is protected if it is still current after the hazard is visible to publishers ...
+		hazard.store( table, std::memory_order_seq_cst );
+		const void* current = hot->current.load( std::memory_order_seq_cst );
+		if( current == table )
+			return table;
+		table = current;
+	}
+}
 
-    unsigned int* start = codepoints;
-    unsigned int* end   = codepoints + num_codepoints;
+void utf8_lookup_hot_table_release( utf8_lookup_hot_table* hot,
+                                    unsigned int           reader )
+{
+	hot->hazards[reader].table.store( 0x0, std::memory_order_release );
+}
 
-    unsigned int curr_elem = 0;
-    int last_octet = -1;
+size_t utf8_lookup_hot_table_pending( utf8_lookup_hot_table* hot )
+{
+	std::lock_guard<std::mutex> lock( hot->publish_lock );
+	return hot->num_retired;
+}
 
-    for( int octet = 0; octet < 5; ++octet )
-    {
-        unsigned int last_prev_gids[4] = { (unsigned int)-1, (unsigned int)-1, (unsigned int)-1, (unsigned int)-1 };
-        unsigned int* curr = start;
-        while( curr != end )
-        {
-			unsigned int gids[4];
-            int curr_octet = utf8_split_to_bytes( *curr++, gids );
+#endif // defined(UTF8_LOOKUP_ENABLE_THREADS)
 
-            if( octet == 0 )
-            {
-                // we are in the static section of the table.
-                curr_elem = (unsigned int)(START_OFFSET[ curr_octet ] + ( gids[ octet ] >> 6 ) );
-            }
-            else
-            {
-                // we are in the dynamic section of the table.
-                curr_elem = curr_elem < 6 ? 5 : curr_elem;
+#if defined(UTF8_LOOKUP_ENABLE_SHARED_TABLES)
 
-                if( ( memcmp( last_prev_gids, gids, (size_t)( octet ) * sizeof( unsigned int ) ) != 0 ) || last_octet != curr_octet )
-                {
-                    ++curr_elem;
-                    memcpy( last_prev_gids, gids, sizeof( gids ) );
-                }
-            }
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-            last_octet = curr_octet;
+#if !defined(UTF8_LOOKUP_SHARED_TABLE_TIMEOUT_MS)
+#  define UTF8_LOOKUP_SHARED_TABLE_TIMEOUT_MS 2000 // time to wait for another process to publish a table.
+#endif
 
-            if( octet == curr_octet )
-                // advance start, we will not do anything with this char again.
-                ++start;
-        }
-    }
+// shared segment layout:
+// utf8_lookup_shared_header              - padded to 64 bytes to keep the table aligned.
+// uint8_t[table_size]                    - table as built by utf8_lookup_gen_table.
+// unsigned int[num_codepoints]           - the codepoints the table was built from, to verify that the
+//                                          segment really is for the same set and not a hash-collision.
+struct utf8_lookup_shared_header
+{
+	uint64_t magic;
+	uint64_t hash;
+	uint64_t num_codepoints;
+	uint64_t table_size;
+	uint64_t ready;   // written last by the creating process, table is not valid before it is set.
+	uint64_t creator; // pid of the creating process, written before the table is built.
+	uint64_t pad[2];
+};
 
-    // table layout:
-    // uint64_t              - item_count, kept as uint64_t to get valid alignment for the following arrays.
-    // uint64_t[item_count]  - availabillity bits.
-    // uint16_t[item_count]  - group-offsets.
-    unsigned int item_count = curr_elem + 2; // TODO: remember why I need the +2 here and document. ( unittests fail without it )
-    *table_size = sizeof(uint64_t) +
-                  ( item_count * sizeof(uint64_t) ) +
-                  ( item_count * sizeof(uint16_t) );
-	return UTF8_LOOKUP_ERROR_OK;
-}
+static const uint64_t UTF8_LOOKUP_SHARED_MAGIC = 0x3370756b6f6f6c38ULL; // "8lookup3", bump if the table or segment format changes.
 
-UTF8_LOOKUP_ALWAYSINLINE const uint8_t* utf8_lookup_perform_impl( void*               lookup,
-													  const uint8_t*      str,
-													  utf8_lookup_result* res,
-													  size_t*             res_size,
-													  int                 has_popcnt )
+static uint64_t utf8_lookup_hash_codepoints( const unsigned int* codepoints, unsigned int num_codepoints )
 {
-	utf8_lookup_result* res_out = res;
-	utf8_lookup_result* res_end = res + *res_size;
+	// fnv1a over the codepoints.
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for( unsigned int i = 0; i < num_codepoints; ++i )
+	{
+		unsigned int cp = codepoints[i];
+		for( int b = 0; b < 4; ++b )
+		{
+			hash ^= (uint64_t)( ( cp >> ( b * 8 ) ) & 0xFF );
+			hash *= 0x100000001b3ULL;
+		}
+	}
+	return hash;
+}
 
-	const uint8_t* pos = str;
+static utf8_lookup_error utf8_lookup_shared_table_create( utf8_lookup_shared_table* shared,
+                                                          int                       fd,
+                                                          uint64_t                  hash,
+                                                          const unsigned int*       codepoints,
+                                                          unsigned int              num_codepoints )
+{
+	if( ftruncate( fd, (off_t)shared->mapping_size ) != 0 )
+		return UTF8_LOOKUP_ERROR_SHARED_MEMORY_FAILED;
 
-    uint64_t  items      = *((uint64_t*)lookup);
-    uint64_t* avail_bits = (uint64_t*)((uint8_t*)lookup + sizeof(uint64_t));
-    uint16_t* offsets    = (uint16_t*)((uint8_t*)avail_bits + sizeof(uint64_t) * items);
+	void* mem = mmap( 0x0, shared->mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	if( mem == MAP_FAILED )
+		return UTF8_LOOKUP_ERROR_SHARED_MEMORY_FAILED;
 
-	static const int UTF8_TRAILING_BYTES_TABLE[256] = {
-		0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
-		0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
-		0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
-		0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
-		0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
-		0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
-		1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
-		2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2, 3,3,3,3,3,3,3,3,4,4,4,4,5,5,5,5
-	};
+	utf8_lookup_shared_header* header = (utf8_lookup_shared_header*)mem;
+	__atomic_store_n( &header->creator, (uint64_t)getpid(), __ATOMIC_RELAXED );
 
-	while( *pos && res_out != res_end )
+	utf8_lookup_error err = utf8_lookup_gen_table( header + 1, shared->table_size, codepoints, num_codepoints );
+	if( err != UTF8_LOOKUP_ERROR_OK )
 	{
-		uint8_t first_byte = *pos;
-		res_out->pos = pos;
+		munmap( mem, shared->mapping_size );
+		return err;
+	}
+	memcpy( (uint8_t*)( header + 1 ) + shared->table_size, codepoints, num_codepoints * sizeof( unsigned int ) );
+	header->magic          = UTF8_LOOKUP_SHARED_MAGIC;
+	header->hash           = hash;
+	header->num_codepoints = num_codepoints;
+	header->table_size     = shared->table_size;
+	__atomic_store_n( &header->ready, (uint64_t)1, __ATOMIC_RELEASE );
+
+	// ... the creator do not get to write to the table either ...
+	mprotect( mem, shared->mapping_size, PROT_READ );
+
+	shared->mapping = mem;
+	shared->created = 1;
+	return UTF8_LOOKUP_ERROR_OK;
+}
+
+/**
+ * Check that all offsets in a table mapped from another process are in range, i.e. that every walk
+ * in it stays within the table and ends up in 0 - num_codepoints. Items need to be reachable from the
+ * roots at exactly one depth, as in a table built by utf8_lookup_gen_table, or be empty.
+ */
+static utf8_lookup_error utf8_lookup_shared_table_validate( const void* table, size_t table_size, unsigned int num_codepoints )
+{
+	uint64_t items = *(const uint64_t*)table;
+	if( items < 6 || items > 0x10000 || sizeof( uint64_t ) + items * ( sizeof( uint64_t ) + sizeof( uint16_t ) ) != table_size )
+		return UTF8_LOOKUP_ERROR_SHARED_MEMORY_FAILED;
+
+	const uint64_t* avail_bits = utf8_lookup_avail_bits( table );
+	const uint16_t* offsets    = utf8_lookup_offsets( table );
+	if( avail_bits[0] != 0 )
+		return UTF8_LOOKUP_ERROR_SHARED_MEMORY_FAILED;
 
-		int octet = UTF8_TRAILING_BYTES_TABLE[ first_byte ];
+	// ... levels left to walk below each item, 0xFF for not reached yet, and a queue of items to visit ...
+	uint8_t*  levels = (uint8_t*)UTF8_LOOKUP_MALLOC( (size_t)items * ( sizeof( uint8_t ) + sizeof( uint16_t ) ) );
+	if( levels == 0x0 )
+		return UTF8_LOOKUP_ERROR_OUT_OF_MEMORY;
+	uint16_t* queue = (uint16_t*)( levels + items );
+	memset( levels, 0xFF, (size_t)items );
+
+	// ... roots as in START_OFFSET, ascii is split over 2 roots that are leafs ...
+	static const uint8_t ROOT_LEVELS[6] = { 0xFF, 0, 0, 1, 2, 3 };
+	size_t queue_end = 0;
+	for( uint16_t i = 1; i < 6; ++i )
+	{
+		levels[i] = ROOT_LEVELS[i];
+		queue[queue_end++] = i;
+	}
 
-		static const uint64_t GROUP_MASK[4]   = { 127, 63, 63, 63 };
-		static const uint64_t GID_MASK[4]     = {  63, 31, 15,  7 };
+	int valid = 1;
+	for( size_t q = 0; valid && q < queue_end; ++q )
+	{
+		uint16_t item  = queue[q];
+		uint64_t count = utf8_popcnt_impl( avail_bits[item], 0 );
+		if( count == 0 )
+			continue;
 
-		uint64_t curr_offset = START_OFFSET[octet];
-		uint64_t group_mask  = GROUP_MASK[octet];
-		uint64_t gid_mask    = GID_MASK[octet];
+		uint64_t first = offsets[item];
+		uint64_t last  = first + count - 1;
+		if( levels[item] == 0 )
+		{
+			valid = first >= 1 && last <= num_codepoints;
+			continue;
+		}
 
-		for( int i = 0; i <= octet; ++i )
+		valid = first >= 1 && last < items;
+		for( uint64_t child = first; valid && child <= last; ++child )
 		{
-			// make sure that we get a value between 0-63 to decide what bit the current byte.
-			// it is only octet 1 that will have more than 6 significant bits.
-			uint64_t group     = (uint64_t)(*pos & group_mask) >> (uint64_t)6;
+			if( levels[child] == 0xFF )
+			{
+				levels[child] = (uint8_t)( levels[item] - 1 );
+				queue[queue_end++] = (uint16_t)child;
+			}
+			else
+				valid = 0; // reached twice, a table with a loop or shared nodes.
+		}
+	}
+	// ... items not reached, i.e. padding at the end, must be empty ...
+	for( uint64_t i = 1; valid && i < items; ++i )
+		valid = levels[i] != 0xFF || avail_bits[i] == 0;
 
-			// mask of the bits that is valid in this mask, only the first byte will have a
-			// different amount of set bits. Thereof the table above.
-			uint64_t gid       = (uint64_t)(*pos & gid_mask);
+	UTF8_LOOKUP_FREE( levels );
+	return valid ? UTF8_LOOKUP_ERROR_OK : UTF8_LOOKUP_ERROR_SHARED_MEMORY_FAILED;
+}
 
-			uint64_t check_bit = (uint64_t)1 << gid;
+/**
+ * Map a segment published by another process. stale is set to 1 if the segment will never become a valid
+ * table and can be replaced, i.e. the creator died before marking it ready.
+ */
+static utf8_lookup_error utf8_lookup_shared_table_map( utf8_lookup_shared_table* shared,
+                                                       int                       fd,
+                                                       uint64_t                  hash,
+                                                       const unsigned int*       codepoints,
+                                                       unsigned int              num_codepoints,
+                                                       int*                      stale )
+{
+	*stale = 0;
 
-			// gid mask will always be 0b111111 i.e. the lowest 6 bit set on all loops except
-			// the first one. This is due to how utf8 is structured, see table at the top of
-			// the file.
-			gid_mask = 63;
+	// ... only trust segments created by this user, that no one else could have written to ...
+	struct stat st;
+	if( fstat( fd, &st ) != 0 || st.st_uid != geteuid() || ( st.st_mode & ( S_IWGRP | S_IWOTH ) ) != 0 )
+		return UTF8_LOOKUP_ERROR_SHARED_MEMORY_FAILED;
 
-			++pos;
+	// the creating process might not have gotten to ftruncate yet, wait for the segment to get its size
+	// and the table to be marked as ready.
+	for( int attempt = 0; attempt < UTF8_LOOKUP_SHARED_TABLE_TIMEOUT_MS; ++attempt )
+	{
+		if( fstat( fd, &st ) != 0 )
+			return UTF8_LOOKUP_ERROR_SHARED_MEMORY_FAILED;
 
-			// index in avail_bits and corresponding offsets that we are currently working in.
-			uint64_t index = group + curr_offset;
+		if( (size_t)st.st_size == shared->mapping_size )
+		{
+			if( shared->mapping == 0x0 )
+			{
+				void* mem = mmap( 0x0, shared->mapping_size, PROT_READ, MAP_SHARED, fd, 0 );
+				if( mem == MAP_FAILED )
+					return UTF8_LOOKUP_ERROR_SHARED_MEMORY_FAILED;
+				shared->mapping = mem;
+			}
 
-			// how many bits are set "before" the current element in this group? this is used
-			// to calculate the next item in the lookup.
-			uint64_t items_before = utf8_popcnt_impl( avail_bits[index] & ( check_bit - (uint64_t)1 ), has_popcnt );
+			const utf8_lookup_shared_header* header = (const utf8_lookup_shared_header*)shared->mapping;
+			if( __atomic_load_n( &header->ready, __ATOMIC_ACQUIRE ) != 0 )
+			{
+				utf8_lookup_error err = UTF8_LOOKUP_ERROR_OK;
+				const uint8_t* stored_codepoints = (const uint8_t*)( header + 1 ) + shared->table_size;
+				if( header->magic          != UTF8_LOOKUP_SHARED_MAGIC ||
+					header->hash           != hash ||
+					header->num_codepoints != num_codepoints ||
+					header->table_size     != shared->table_size ||
+					memcmp( stored_codepoints, codepoints, num_codepoints * sizeof( unsigned int ) ) != 0 )
+					err = UTF8_LOOKUP_ERROR_SHARED_MEMORY_COLLISION;
+				else
+					err = utf8_lookup_shared_table_validate( header + 1, shared->table_size, num_codepoints );
 
-			// select the next offset in the avail_bits-array to check or if this is the last iteration this
-			// will be the actual result.
-			// note: if the lookup is a miss, i.e. bit is not set, point curr_offset to 0 that is a bitfield
-			//       that is always 0 and offsets[0] == 0 to just keep on "missing"
-			curr_offset = ( avail_bits[index] & check_bit ) > (uint64_t)0 ? offsets[index] + items_before : 0x0;
+				if( err != UTF8_LOOKUP_ERROR_OK )
+				{
+					munmap( shared->mapping, shared->mapping_size );
+					shared->mapping = 0x0;
+					return err;
+				}
+				shared->created = 0;
+				return UTF8_LOOKUP_ERROR_OK;
+			}
 		}
+		else if( st.st_size != 0 )
+			return UTF8_LOOKUP_ERROR_SHARED_MEMORY_COLLISION; // size mismatch, a segment for another set.
 
-		// curr_offset is now either 0 for not found or offset in glyphs-table
-
-		res_out->offset = (unsigned int)curr_offset;
-		++res_out;
+		usleep( 1000 );
 	}
 
-	*res_size = (size_t)(res_out - res);
-	return pos;
+	// ... not ready in time, only replace it if the creator is gone. creator is 0 if it died before writing
+	// it, or if the segment never got its size ...
+	uint64_t creator = 0;
+	if( shared->mapping != 0x0 )
+	{
+		creator = __atomic_load_n( &( (const utf8_lookup_shared_header*)shared->mapping )->creator, __ATOMIC_RELAXED );
+		munmap( shared->mapping, shared->mapping_size );
+		shared->mapping = 0x0;
+	}
+	*stale = creator == 0 || ( kill( (pid_t)creator, 0 ) != 0 && errno == ESRCH );
+	return UTF8_LOOKUP_ERROR_SHARED_MEMORY_FAILED;
 }
 
-const uint8_t* utf8_lookup_perform_scalar( void*               lookup,
-                                           const uint8_t*      str,
-                                           utf8_lookup_result* res,
-                                           size_t*             res_size )
+/**
+ * Create the segment if it does not exist, otherwise map it. stale is set as by utf8_lookup_shared_table_map.
+ */
+static utf8_lookup_error utf8_lookup_shared_table_open( utf8_lookup_shared_table* shared,
+                                                        uint64_t                  hash,
+                                                        const unsigned int*       codepoints,
+                                                        unsigned int              num_codepoints,
+                                                        int*                      stale )
 {
-	return utf8_lookup_perform_impl( lookup, str, res, res_size, 0 );
-}
-
-#if defined(__GNUC__)
-#  if defined(__clang__)
-#    if defined(__has_attribute)
-#      if __has_attribute(target)
-#        define UTF8_LOOKUP_HAS_ATTRIBUTE_TARGET
-#      endif
-#    endif
-#  else
-#      define UTF8_LOOKUP_HAS_ATTRIBUTE_TARGET
-#  endif
-#endif
+	utf8_lookup_error err = UTF8_LOOKUP_ERROR_SHARED_MEMORY_FAILED;
+	*stale = 0;
 
-#if defined(UTF8_LOOKUP_HAS_ATTRIBUTE_TARGET)
-// ... tell gcc to optimize this as if a popcnt instruction exists ...
-const uint8_t* utf8_lookup_perform_popcnt( void*               lookup,
-                                           const uint8_t*      str,
-                                           utf8_lookup_result* res,
-                                           size_t*             res_size ) __attribute__((target("popcnt")));
-#endif
+	int fd = shm_open( shared->name, O_RDWR | O_CREAT | O_EXCL, 0600 );
+	if( fd >= 0 )
+	{
+		err = utf8_lookup_shared_table_create( shared, fd, hash, codepoints, num_codepoints );
+		if( err != UTF8_LOOKUP_ERROR_OK )
+			shm_unlink( shared->name );
+	}
+	else if( errno == EEXIST )
+	{
+		fd = shm_open( shared->name, O_RDONLY, 0 );
+		if( fd >= 0 )
+			err = utf8_lookup_shared_table_map( shared, fd, hash, codepoints, num_codepoints, stale );
+	}
 
-const uint8_t* utf8_lookup_perform_popcnt( void*               lookup,
-                                           const uint8_t*      str,
-                                           utf8_lookup_result* res,
-                                           size_t*             res_size )
-{
-	return utf8_lookup_perform_impl( lookup, str, res, res_size, 1 );
+	if( fd >= 0 )
+		close( fd ); // the mapping keeps the segment alive.
+	return err;
 }
 
-const uint8_t* utf8_lookup_perform( void*               lookup,
-                                    const uint8_t*      str,
-                                    utf8_lookup_result* res,
-                                    size_t*             res_size )
+utf8_lookup_error utf8_lookup_shared_table_acquire( utf8_lookup_shared_table* shared,
+                                                    const unsigned int*       codepoints,
+                                                    unsigned int              num_codepoints )
 {
-	static const uint8_t* (*_func)( void*, const uint8_t*, utf8_lookup_result*, size_t* ) = 0;
-	if( _func == 0 )
+	memset( shared, 0x0, sizeof( utf8_lookup_shared_table ) );
+
+	uint64_t hash = utf8_lookup_hash_codepoints( codepoints, num_codepoints );
+	snprintf( shared->name, sizeof( shared->name ), "/utf8_lookup_%016llx", (unsigned long long)hash );
+
+	utf8_lookup_error err = utf8_lookup_calc_table_size( &shared->table_size, codepoints, num_codepoints );
+	if( err != UTF8_LOOKUP_ERROR_OK )
+		return err;
+	shared->mapping_size = sizeof( utf8_lookup_shared_header ) + shared->table_size + num_codepoints * sizeof( unsigned int );
+
+	int stale;
+	err = utf8_lookup_shared_table_open( shared, hash, codepoints, num_codepoints, &stale );
+	if( err != UTF8_LOOKUP_ERROR_OK && stale )
 	{
-		if(utf8_lookup_has_popcnt())
-			_func = utf8_lookup_perform_popcnt;
-		else
-			_func = utf8_lookup_perform_scalar;
+		// ... the creator of the segment, run by this user, died before publishing it. replace it once ...
+		shm_unlink( shared->name );
+		err = utf8_lookup_shared_table_open( shared, hash, codepoints, num_codepoints, &stale );
 	}
 
-	return _func( lookup, str, res, res_size );
+	if( err != UTF8_LOOKUP_ERROR_OK )
+		return err;
+
+	shared->table = (const utf8_lookup_shared_header*)shared->mapping + 1;
+	return UTF8_LOOKUP_ERROR_OK;
+}
+
+void utf8_lookup_shared_table_release( utf8_lookup_shared_table* shared )
+{
+	if( shared->mapping != 0x0 )
+		munmap( shared->mapping, shared->mapping_size );
+	shared->mapping = 0x0;
+	shared->table   = 0x0;
 }
 
+void utf8_lookup_shared_table_unlink( utf8_lookup_shared_table* shared )
+{
+	shm_unlink( shared->name );
+}
+
+#endif // defined(UTF8_LOOKUP_ENABLE_SHARED_TABLES)
+
 #endif // defined(UTF8_LOOKUP_IMPLEMENTATION)
 
 #endif // UTF8_LOOKUP_H_INCLUDED